@@ -0,0 +1,80 @@
+#ifndef DD_OPENTRACING_BENCHMARK_BENCHMARK_H
+#define DD_OPENTRACING_BENCHMARK_BENCHMARK_H
+
+// This component is a minimal harness for microbenchmarks, so that building
+// the benchmarks doesn't require a benchmarking library.
+//
+// A benchmark program creates a `Runner` from its command line arguments and
+// then calls the `Runner` once per benchmark.  Each benchmark is run
+// repeatedly for a fixed time, and its average time per iteration is printed
+// to standard output:
+//
+//     extract/Datadog/text_map                    1048576 iterations        212.3 ns/op
+//
+// If the program is given an argument, then only the benchmarks whose names
+// contain the argument are run.
+
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <string>
+
+namespace datadog {
+namespace opentracing {
+namespace benchmark {
+
+// Prevent the compiler from optimizing away the computation of the specified
+// `value`.
+template <typename Value>
+void doNotOptimize(const Value& value) {
+#if defined(__GNUC__) || defined(__clang__)
+  asm volatile("" : : "r"(&value) : "memory");
+#else
+  static const void* volatile sink;
+  sink = &value;
+#endif
+}
+
+class Runner {
+ public:
+  Runner(int argc, char** argv) : filter_(argc > 1 ? argv[1] : "") {}
+
+  // Run the specified `function` repeatedly, and print its average time per
+  // call, labeled with the specified `name`.  Do nothing if `name` does not
+  // match the filter.
+  template <typename Function>
+  void operator()(const std::string& name, Function&& function) {
+    if (name.find(filter_) == std::string::npos) {
+      return;
+    }
+    using Clock = std::chrono::steady_clock;
+    const auto min_duration = std::chrono::milliseconds(200);
+    // Double the number of iterations until they take long enough to time.
+    uint64_t iterations = 1;
+    for (;;) {
+      const auto start = Clock::now();
+      for (uint64_t i = 0; i < iterations; ++i) {
+        function();
+      }
+      const auto elapsed = Clock::now() - start;
+      if (elapsed >= min_duration) {
+        const double nanoseconds =
+            double(std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count());
+        std::printf("%-60s %12llu iterations %12.1f ns/op\n", name.c_str(),
+                    static_cast<unsigned long long>(iterations), nanoseconds / double(iterations));
+        std::fflush(stdout);
+        return;
+      }
+      iterations *= 2;
+    }
+  }
+
+ private:
+  std::string filter_;
+};
+
+}  // namespace benchmark
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif
@@ -0,0 +1,86 @@
+// These benchmarks measure the CPU time spent compressing payloads of encoded
+// traces at each compression level, and print the bytes saved, so that the
+// cost of `agent_compression_level` can be weighed against the bandwidth it
+// saves.  The payloads are encoded by the tracer from traces that resemble
+// those of a web service: a request span with a database query and a cache
+// lookup beneath it.
+
+#include <datadog/opentracing.h>
+#include <opentracing/tracer.h>
+
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <tuple>
+
+#include "../src/compression.h"
+#include "benchmark.h"
+
+using namespace datadog::opentracing;
+namespace bench = datadog::opentracing::benchmark;
+namespace ot = opentracing;
+
+namespace {
+
+// Return a payload of the specified `num_traces` encoded traces.
+std::string makePayload(int num_traces) {
+  TracerOptions options;
+  options.service = "storefront";
+  options.environment = "prod";
+  options.version = "1.4.2";
+  options.log_func = [](LogLevel, ot::string_view) {};
+  std::shared_ptr<ot::Tracer> tracer;
+  std::shared_ptr<TraceEncoder> encoder;
+  std::tie(tracer, encoder) = makeTracerAndEncoder(options);
+
+  for (int i = 0; i < num_traces; ++i) {
+    const std::string item = std::to_string(1000 + (i * 7919) % 5000);
+    auto request = tracer->StartSpan("http.request");
+    request->SetTag("resource.name", "GET /api/items/:id");
+    request->SetTag("span.kind", "server");
+    request->SetTag("http.method", "GET");
+    request->SetTag("http.url", "https://shop.example.com/api/items/" + item + "?ref=home");
+    request->SetTag("http.status_code", i % 20 == 0 ? 404 : 200);
+    request->SetTag("http.useragent",
+                    "Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko)");
+    {
+      auto query = tracer->StartSpan("postgres.query", {ot::ChildOf(&request->context())});
+      query->SetTag("resource.name", "SELECT * FROM items WHERE id = ?");
+      query->SetTag("span.type", "sql");
+      query->SetTag("db.instance", "inventory");
+      query->SetTag("db.row_count", i % 3);
+      query->SetTag("out.host", "db-replica-2.internal");
+      query->SetTag("out.port", 5432);
+    }
+    {
+      auto lookup = tracer->StartSpan("redis.command", {ot::ChildOf(&request->context())});
+      lookup->SetTag("resource.name", "GET");
+      lookup->SetTag("span.type", "redis");
+      lookup->SetTag("redis.raw_command", "GET item:" + item);
+      lookup->SetTag("out.host", "cache-1.internal");
+    }
+    request->Finish();
+  }
+  return encoder->payload();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Runner run{argc, argv};
+
+  for (const int num_traces : {10, 100, 1000}) {
+    const std::string payload = makePayload(num_traces);
+    const std::string name = "gzip/" + std::to_string(num_traces) + "_traces";
+    for (const int level : {1, 3, 6, 9}) {
+      std::string compressed;
+      gzipCompress(payload, level, compressed);
+      std::printf("%-60s %12zu bytes  -> %9zu bytes (%4.1f%%)\n",
+                  (name + "/level_" + std::to_string(level) + "/size").c_str(), payload.size(),
+                  compressed.size(), 100.0 * double(compressed.size()) / double(payload.size()));
+      run(name + "/level_" + std::to_string(level), [&]() {
+        bench::doNotOptimize(gzipCompress(payload, level, compressed));
+      });
+    }
+  }
+}
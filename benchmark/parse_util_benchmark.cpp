@@ -0,0 +1,36 @@
+// These benchmarks compare the integer codecs in `parse_util.h` with the
+// standard library facilities that they replaced.
+
+#include "../src/parse_util.h"
+
+#include <ios>
+#include <sstream>
+#include <string>
+
+#include "benchmark.h"
+
+using namespace datadog::opentracing;
+namespace bench = datadog::opentracing::benchmark;
+
+int main(int argc, char** argv) {
+  bench::Runner run{argc, argv};
+  const uint64_t value = 0xdeadbeefcafebabeULL;
+  const std::string hex = "deadbeefcafebabe";
+  const std::string decimal = "16045690984503098046";
+  IntegerText buffer;
+
+  run("format/hex/format_hex", [&]() { bench::doNotOptimize(format_hex(value, buffer)); });
+  run("format/hex/ostringstream", [&]() {
+    std::ostringstream stream;
+    stream << std::hex << value;
+    bench::doNotOptimize(stream.str());
+  });
+  run("format/decimal/format_decimal",
+      [&]() { bench::doNotOptimize(format_decimal(value, buffer)); });
+  run("format/decimal/to_string", [&]() { bench::doNotOptimize(std::to_string(value)); });
+
+  run("parse/hex/parse_uint64", [&]() { bench::doNotOptimize(parse_uint64(hex, 16)); });
+  run("parse/hex/stoull", [&]() { bench::doNotOptimize(std::stoull(hex, nullptr, 16)); });
+  run("parse/decimal/parse_uint64", [&]() { bench::doNotOptimize(parse_uint64(decimal, 10)); });
+  run("parse/decimal/stoull", [&]() { bench::doNotOptimize(std::stoull(decimal, nullptr, 10)); });
+}
@@ -0,0 +1,192 @@
+// These benchmarks measure the cost of injecting and extracting span context
+// in each propagation style and with each kind of carrier, the cost of
+// extracting adversarial headers, and the cost of the "x-datadog-tags" codec.
+
+#include <datadog/opentracing.h>
+#include <opentracing/tracer.h>
+
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "../src/tag_propagation.h"
+#include "benchmark.h"
+
+using namespace datadog::opentracing;
+namespace bench = datadog::opentracing::benchmark;
+namespace ot = opentracing;
+
+namespace {
+
+// `Carrier` is a text map or HTTP headers carrier that stores its headers in
+// a `vector`.  `Set` appends without looking for duplicates.
+template <typename Reader, typename Writer>
+class Carrier : public Reader, public Writer {
+ public:
+  using ReaderType = Reader;
+  using WriterType = Writer;
+
+  ot::expected<void> Set(ot::string_view key, ot::string_view value) const override {
+    headers.emplace_back(key, value);
+    return {};
+  }
+
+  ot::expected<void> ForeachKey(
+      std::function<ot::expected<void>(ot::string_view key, ot::string_view value)> f)
+      const override {
+    for (const auto& header : headers) {
+      auto result = f(header.first, header.second);
+      if (!result) {
+        return result;
+      }
+    }
+    return {};
+  }
+
+  mutable std::vector<std::pair<std::string, std::string>> headers;
+};
+
+using TextMapCarrier = Carrier<ot::TextMapReader, ot::TextMapWriter>;
+using HTTPHeadersCarrier = Carrier<ot::HTTPHeadersReader, ot::HTTPHeadersWriter>;
+
+std::shared_ptr<ot::Tracer> makeTracer(PropagationStyle style, bool binary = false) {
+  TracerOptions options;
+  options.service = "benchmark";
+  options.inject = {style};
+  options.extract = {style};
+  options.binary_stream_propagation = binary;
+  // Extraction of adversarial headers logs errors, which are not of interest.
+  options.log_func = [](LogLevel, ot::string_view) {};
+  return std::get<0>(makeTracerAndEncoder(options));
+}
+
+const char* styleName(PropagationStyle style) {
+  switch (style) {
+    case PropagationStyle::Datadog:
+      return "Datadog";
+    case PropagationStyle::B3:
+      return "B3";
+    case PropagationStyle::B3Single:
+      return "B3Single";
+    case PropagationStyle::W3C:
+      return "W3C";
+  }
+  return "unknown";
+}
+
+// Benchmark injecting and then extracting a context using the specified
+// `tracer` and a carrier of the specified type.
+template <typename CarrierType>
+void runCarrier(bench::Runner& run, const std::string& name, const ot::Tracer& tracer,
+                const ot::SpanContext& context) {
+  CarrierType carrier;
+  run("inject/" + name, [&]() {
+    carrier.headers.clear();
+    bench::doNotOptimize(
+        tracer.Inject(context, static_cast<const typename CarrierType::WriterType&>(carrier)));
+  });
+  run("extract/" + name, [&]() {
+    bench::doNotOptimize(
+        tracer.Extract(static_cast<const typename CarrierType::ReaderType&>(carrier)));
+  });
+}
+
+// Benchmark extracting the specified `headers` using the specified `tracer`.
+void runExtract(bench::Runner& run, const std::string& name, const ot::Tracer& tracer,
+                std::vector<std::pair<std::string, std::string>> headers) {
+  HTTPHeadersCarrier carrier;
+  carrier.headers = std::move(headers);
+  run("extract/hostile/" + name, [&]() {
+    bench::doNotOptimize(tracer.Extract(static_cast<const ot::HTTPHeadersReader&>(carrier)));
+  });
+}
+
+// Return an "x-datadog-tags" header value of at least the specified `size`.
+std::string manyTags(std::size_t size) {
+  std::string tags;
+  for (int i = 0; tags.size() < size; ++i) {
+    appendTag(tags, "_dd.p.tag" + std::to_string(i), "value");
+  }
+  return tags;
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+  bench::Runner run{argc, argv};
+
+  for (const PropagationStyle style : {PropagationStyle::Datadog, PropagationStyle::B3,
+                                       PropagationStyle::B3Single, PropagationStyle::W3C}) {
+    const auto tracer = makeTracer(style);
+    auto span = tracer->StartSpan("benchmark");
+    span->SetBaggageItem("user", "alice");
+    const std::string name = styleName(style);
+    runCarrier<TextMapCarrier>(run, name + "/text_map", *tracer, span->context());
+    runCarrier<HTTPHeadersCarrier>(run, name + "/http_headers", *tracer, span->context());
+  }
+
+  for (const bool binary : {false, true}) {
+    const auto tracer = makeTracer(PropagationStyle::Datadog, binary);
+    auto span = tracer->StartSpan("benchmark");
+    span->SetBaggageItem("user", "alice");
+    const std::string name = binary ? "istream/binary" : "istream/json";
+    run("inject/" + name, [&]() {
+      std::ostringstream stream;
+      bench::doNotOptimize(tracer->Inject(span->context(), stream));
+    });
+    std::ostringstream injected;
+    tracer->Inject(span->context(), injected);
+    const std::string encoded = injected.str();
+    run("extract/" + name, [&]() {
+      std::istringstream stream{encoded};
+      bench::doNotOptimize(tracer->Extract(stream));
+    });
+  }
+
+  {
+    const auto tracer = makeTracer(PropagationStyle::Datadog);
+    runExtract(run, "huge_tags", *tracer,
+               {{"x-datadog-trace-id", "123"},
+                {"x-datadog-parent-id", "456"},
+                {"x-datadog-tags", manyTags(1 << 16)}});
+
+    std::vector<std::pair<std::string, std::string>> headers{{"x-datadog-trace-id", "123"},
+                                                             {"x-datadog-parent-id", "456"}};
+    for (int i = 0; i < 10000; ++i) {
+      headers.emplace_back("ot-baggage-item" + std::to_string(i), "value");
+    }
+    runExtract(run, "many_baggage_items", *tracer, std::move(headers));
+
+    runExtract(run, "malformed_id", *tracer,
+               {{"x-datadog-trace-id", std::string(4096, '9') + "z"},
+                {"x-datadog-parent-id", "456"}});
+  }
+
+  {
+    const auto tracer = makeTracer(PropagationStyle::W3C);
+    std::string tracestate = "dd=s:1;o:rum;t.dm:-4";
+    for (int i = 0; i < 10000; ++i) {
+      tracestate += ",vendor" + std::to_string(i) + "=value";
+    }
+    runExtract(run, "long_tracestate", *tracer,
+               {{"traceparent", "00-0000000000000000000000000000007b-00000000000001c8-01"},
+                {"tracestate", tracestate}});
+    runExtract(run, "malformed_traceparent", *tracer,
+               {{"traceparent", "00-0000000000000000000000000000007B-00000000000001c8-01"}});
+  }
+
+  const std::string tags = "_dd.p.dm=-4,_dd.p.usr.id=12345";
+  const std::string huge_tags = manyTags(1 << 16);
+  run("tags/deserialize", [&]() { bench::doNotOptimize(deserializeTags(tags)); });
+  run("tags/deserialize/huge", [&]() { bench::doNotOptimize(deserializeTags(huge_tags)); });
+  run("tags/append", [&]() {
+    std::string serialized;
+    appendTag(serialized, "_dd.p.dm", "-4");
+    appendTag(serialized, "_dd.p.usr.id", "12345");
+    bench::doNotOptimize(serialized);
+  });
+}
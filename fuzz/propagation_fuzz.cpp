@@ -0,0 +1,110 @@
+// This is a libFuzzer target for span context extraction and injection.
+//
+// The input is a sequence of headers, each a name line followed by a value
+// line.  The headers are extracted in every propagation style, once from a
+// text map and once from HTTP headers, and the input as a whole is extracted
+// as JSON from an `istream`.  Each context that is extracted is then injected
+// in every propagation style.
+
+#include <datadog/opentracing.h>
+#include <opentracing/tracer.h>
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+namespace dd = datadog::opentracing;
+namespace ot = opentracing;
+
+namespace {
+
+using Headers = std::vector<std::pair<ot::string_view, ot::string_view>>;
+
+template <typename Reader, typename Writer>
+class Carrier : public Reader, public Writer {
+ public:
+  explicit Carrier(const Headers& headers) : headers_(headers) {}
+
+  ot::expected<void> Set(ot::string_view, ot::string_view) const override { return {}; }
+
+  ot::expected<void> ForeachKey(
+      std::function<ot::expected<void>(ot::string_view key, ot::string_view value)> f)
+      const override {
+    for (const auto& header : headers_) {
+      auto result = f(header.first, header.second);
+      if (!result) {
+        return result;
+      }
+    }
+    return {};
+  }
+
+ private:
+  const Headers& headers_;
+};
+
+using TextMapCarrier = Carrier<ot::TextMapReader, ot::TextMapWriter>;
+using HTTPHeadersCarrier = Carrier<ot::HTTPHeadersReader, ot::HTTPHeadersWriter>;
+
+const ot::Tracer& tracer() {
+  static const std::shared_ptr<ot::Tracer> instance = []() {
+    dd::TracerOptions options;
+    options.service = "fuzz";
+    options.inject = options.extract = {dd::PropagationStyle::Datadog, dd::PropagationStyle::B3,
+                                        dd::PropagationStyle::B3Single,
+                                        dd::PropagationStyle::W3C};
+    options.log_func = [](dd::LogLevel, ot::string_view) {};
+    return std::get<0>(dd::makeTracerAndEncoder(options));
+  }();
+  return *instance;
+}
+
+// Return the headers encoded in the specified `input`.
+Headers parseHeaders(ot::string_view input) {
+  Headers headers;
+  const char* iter = input.begin();
+  const char* const end = input.end();
+  while (iter < end) {
+    const char* const name_end = std::find(iter, end, '\n');
+    if (name_end == end) {
+      break;
+    }
+    const char* const value_begin = name_end + 1;
+    const char* const value_end = std::find(value_begin, end, '\n');
+    headers.emplace_back(ot::string_view{iter, std::size_t(name_end - iter)},
+                         ot::string_view{value_begin, std::size_t(value_end - value_begin)});
+    iter = value_end == end ? end : value_end + 1;
+  }
+  return headers;
+}
+
+// Inject the specified extracted `context`, if any.
+void inject(const ot::expected<std::unique_ptr<ot::SpanContext>>& context) {
+  if (!context || *context == nullptr) {
+    return;
+  }
+  const Headers no_headers;
+  tracer().Inject(**context, TextMapCarrier{no_headers});
+  tracer().Inject(**context, HTTPHeadersCarrier{no_headers});
+  std::ostringstream json;
+  tracer().Inject(**context, json);
+}
+
+}  // namespace
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size) {
+  const ot::string_view input{reinterpret_cast<const char*>(data), size};
+  const Headers headers = parseHeaders(input);
+  inject(tracer().Extract(TextMapCarrier{headers}));
+  inject(tracer().Extract(HTTPHeadersCarrier{headers}));
+  std::istringstream json{std::string(input)};
+  inject(tracer().Extract(json));
+  return 0;
+}
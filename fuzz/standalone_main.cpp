@@ -0,0 +1,27 @@
+// This driver runs a fuzz target on the contents of the files named on the
+// command line.  It is linked into the fuzz targets when the compiler does
+// not support libFuzzer, so that a corpus or a crashing input can still be
+// replayed.
+
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <iostream>
+#include <iterator>
+#include <string>
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size);
+
+int main(int argc, char** argv) {
+  for (int i = 1; i < argc; ++i) {
+    std::ifstream file{argv[i], std::ios::binary};
+    if (!file) {
+      std::cerr << "Unable to open " << argv[i] << '\n';
+      return 1;
+    }
+    const std::string input{std::istreambuf_iterator<char>(file),
+                            std::istreambuf_iterator<char>()};
+    LLVMFuzzerTestOneInput(reinterpret_cast<const uint8_t*>(input.data()), input.size());
+  }
+  return 0;
+}
@@ -0,0 +1,35 @@
+// This is a libFuzzer target for the "x-datadog-tags" codec.
+//
+// The input is decoded as an "x-datadog-tags" header value.  If decoding
+// succeeds, then the tags are encoded again using `appendTag`, and decoding
+// the result must yield the same tags.
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdlib>
+#include <stdexcept>
+#include <string>
+
+#include "../src/tag_propagation.h"
+
+namespace dd = datadog::opentracing;
+namespace ot = opentracing;
+
+extern "C" int LLVMFuzzerTestOneInput(const uint8_t* data, std::size_t size) {
+  const ot::string_view input{reinterpret_cast<const char*>(data), size};
+  std::unordered_map<std::string, std::string> tags;
+  try {
+    tags = dd::deserializeTags(input);
+  } catch (const std::invalid_argument&) {
+    return 0;
+  }
+
+  std::string serialized;
+  for (const auto& tag : tags) {
+    dd::appendTag(serialized, tag.first, tag.second);
+  }
+  if (dd::deserializeTags(serialized) != tags) {
+    std::abort();
+  }
+  return 0;
+}
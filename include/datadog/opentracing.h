@@ -18,7 +18,9 @@
 
 #include <opentracing/tracer.h>
 
+#include <chrono>
 #include <cmath>
+#include <future>
 #include <iostream>
 #include <map>
 #include <set>
@@ -40,13 +42,20 @@ enum class LogLevel {
 using LogFunc = std::function<void(LogLevel, ot::string_view)>;
 
 // The type of headers that are used for propagating distributed traces.
-// B3 headers only support 64 bit trace IDs.
+// B3 headers only support 64 bit trace IDs.  W3C headers carry 128 bit trace
+// IDs, of which this tracer uses the low 64 bits.
 enum class PropagationStyle {
   // Using Datadog headers.
   Datadog,
   // Use B3 headers.
   // https://github.com/openzipkin/b3-propagation
   B3,
+  // Use the single "b3" header form of B3.
+  // https://github.com/openzipkin/b3-propagation#single-header
+  B3Single,
+  // Use W3C trace context headers, "traceparent" and "tracestate".
+  // https://www.w3.org/TR/trace-context/
+  W3C,
 };
 
 struct TracerOptions {
@@ -91,7 +100,8 @@ struct TracerOptions {
   // environment variable DD_TRACE_SAMPLING_RULES.
   std::string sampling_rules = "[]";
   // Max amount of time to wait between sending traces to agent, in ms. Agent discards traces older
-  // than 10s, so that is the upper bound.
+  // than 10s, so that is the upper bound. While there are no traces to send, the tracer wakes up
+  // less often, but a trace still waits no longer than this.
   int64_t write_period_ms = 1000;
   // If not empty, the given string overrides the operation name (and the overridden operation name
   // is recorded in the tag "operation").
@@ -207,6 +217,141 @@ struct TracerOptions {
   // - The glob pattern "a?b*e*" is matched by "amble" and "albedo", but not by
   //   "albino".
   std::string span_sampling_rules = "[]";
+  // `adaptive_sampling_spans_per_second` is the total number of spans per
+  // second that the tracer aims to keep among traces that do not match any
+  // sampling rule.  If it is not NaN, then such traces are sampled at rates
+  // that the tracer computes locally from the observed volume of traces for
+  // each service and operation name, instead of at rates determined by the
+  // Datadog trace agent ("priority sampling").  This option is also
+  // configurable as the environment variable
+  // DD_TRACE_ADAPTIVE_SAMPLING_SPANS_PER_SECOND.
+  double adaptive_sampling_spans_per_second = std::nan("");
+  // If `early_trace_drop` is true, then the sampling decision for a trace is
+  // made when its local root span starts, rather than when the trace
+  // finishes.  Spans of a trace that is dropped this way record no tags, are
+  // not timed, and are never sent to the agent, but their contexts still
+  // propagate the trace (including its sampling priority) downstream.  The
+  // decision is made from the service, environment, and operation name that
+  // the root span has when it starts, so changes made to a dropped trace's
+  // spans afterwards (e.g. setting the "sampling.priority" tag) have no
+  // effect.  Traces are never dropped early when span sampling rules are
+  // configured, or when the root span is started with tags that affect
+  // sampling.  This option is also configurable as the environment variable
+  // DD_TRACE_EARLY_DROP.
+  bool early_trace_drop = false;
+  // If `stats_computation_enabled` is true, then the tracer computes
+  // aggregate statistics ("trace metrics") from every finished span, before
+  // any sampling decision is applied, and periodically sends them to the
+  // Datadog Agent.  The Agent then does not need to receive every trace in
+  // order to compute accurate trace metrics, and so traces that are not
+  // sampled are not sent (except for spans kept by span sampling rules).
+  // Statistics are sent only by tracers created by `makeTracer` (not by
+  // `makeTracerAndEncoder`).  When this option is enabled, traces are never
+  // dropped early (see `early_trace_drop`), since every span must be
+  // measured.  This option is also configurable as the environment variable
+  // DD_TRACE_STATS_COMPUTATION_ENABLED.
+  bool stats_computation_enabled = false;
+  // If `binary_stream_propagation` is true, then span contexts injected into
+  // a `std::ostream` are encoded in a compact binary format instead of JSON.
+  // Extraction from a `std::istream` accepts either encoding regardless of
+  // this option, so it can be enabled once every consumer of the injected
+  // contexts is able to decode the binary format.  This option is also
+  // configurable as the environment variable
+  // DD_TRACE_BINARY_STREAM_PROPAGATION.
+  bool binary_stream_propagation = false;
+  // If `agent_tcp_nodelay` is true, then Nagle's algorithm is disabled on the
+  // TCP connection to the Datadog Agent, so that a request is not delayed
+  // while an earlier segment is unacknowledged.  The connection is kept open
+  // and reused between requests.  This option has no effect when the agent is
+  // reached over a unix domain socket.  This option is also configurable as
+  // the environment variable DD_TRACE_AGENT_TCP_NODELAY.
+  bool agent_tcp_nodelay = true;
+  // If `agent_tcp_keepalive_seconds` is positive, then TCP keep-alive probes
+  // are sent on the connection to the Datadog Agent after it has been idle
+  // for that many seconds, and then at that interval, so that an idle
+  // connection is not silently dropped by the network (e.g. by a NAT or a
+  // firewall) between flushes.  Zero disables keep-alive probes.  This option
+  // has no effect when the agent is reached over a unix domain socket.  This
+  // option is also configurable as the environment variable
+  // DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS.
+  int agent_tcp_keepalive_seconds = 0;
+  // The most requests that are sent to the Datadog Agent at the same time,
+  // each on its own connection.  While a request is in flight, the next batch
+  // of traces is encoded, and a request waiting to be retried does not hold up
+  // the requests behind it.  Must be at least 1.  This option is also
+  // configurable as the environment variable
+  // DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS.
+  int agent_max_concurrent_requests = 1;
+  // If `agent_compression_level` is positive, then payloads of traces sent
+  // to the Datadog Agent are compressed in the gzip format at that level,
+  // from 1 (fastest) to 9 (smallest).  Compression takes place on the
+  // tracer's own threads, not on the threads that finish spans.  Zero
+  // disables compression.  Payloads are compressed only by tracers created
+  // by `makeTracer` (not by `makeTracerAndEncoder`).  This option is also
+  // configurable as the environment variable DD_TRACE_AGENT_COMPRESSION_LEVEL.
+  int agent_compression_level = 0;
+  // Payloads of traces smaller than `agent_compression_min_bytes` are not
+  // compressed, since compressing them saves little.  This option is also
+  // configurable as the environment variable
+  // DD_TRACE_AGENT_COMPRESSION_MIN_BYTES.
+  int agent_compression_min_bytes = 1024;
+  // If `agent_spool_directory` is not empty, then payloads of traces that
+  // could not be sent to the Datadog Agent, even after retrying, are kept in
+  // files in that directory and sent once the Agent is available again,
+  // oldest first.  Each process uses its own subdirectory.  Spooling is
+  // supported only by tracers created by `makeTracer` (not by
+  // `makeTracerAndEncoder`), and not on Windows.  This option is also
+  // configurable as the environment variable DD_TRACE_AGENT_SPOOL_DIRECTORY.
+  std::string agent_spool_directory = "";
+  // The spool in `agent_spool_directory` uses at most
+  // `agent_spool_max_megabytes` of disk space.  When it is full, the oldest
+  // payloads are dropped.  This option is also configurable as the
+  // environment variable DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES.
+  int agent_spool_max_megabytes = 100;
+  // After `agent_circuit_breaker_failures` consecutive requests to the
+  // Datadog Agent get no response, requests fail without being sent until a
+  // small probe request gets a response.  Probes are sent after a backoff
+  // period that grows while the Agent remains unavailable.  Zero disables
+  // the circuit breaker.  This option is also configurable as the
+  // environment variable DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES.
+  int agent_circuit_breaker_failures = 5;
+  // The longest time, in milliseconds, to wait for a response from the
+  // Datadog Agent.  This option is also configurable as the environment
+  // variable DD_TRACE_AGENT_TIMEOUT_MS.
+  int agent_timeout_ms = 2000;
+  // If positive and less than `agent_timeout_ms`, then once the Datadog
+  // Agent has responded, requests use shorter timeouts that adapt to its
+  // latency, but are no shorter than `agent_min_timeout_ms` milliseconds.
+  // Zero means that every request waits for `agent_timeout_ms`.  This option
+  // is also configurable as the environment variable
+  // DD_TRACE_AGENT_MIN_TIMEOUT_MS.
+  int agent_min_timeout_ms = 0;
+  // `ot::Tracer::Close` sends the finished traces, and blocks for at most
+  // `close_timeout_ms` milliseconds while doing so.  Requests to the Datadog
+  // Agent are cut short at that deadline.  Zero means that `Close` does not
+  // wait.  See also `flushAsync`.  This option is also configurable as the
+  // environment variable DD_TRACE_CLOSE_TIMEOUT_MS.
+  int close_timeout_ms = 5000;
+  // Finished traces are sent to the Datadog Agent as soon as they contain at
+  // least `agent_flush_threshold_spans` spans, or are estimated to take up at
+  // least `agent_flush_threshold_bytes` once encoded, instead of waiting for
+  // the write period.  Zero disables either threshold.  These options are also
+  // configurable as the environment variables
+  // DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS and DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES.
+  int agent_flush_threshold_spans = 0;
+  int agent_flush_threshold_bytes = 1048576;
+  // The number of threads that encode traces before they are sent to the
+  // Datadog Agent.  Large batches of traces are split between the threads.
+  // This option is also configurable as the environment variable
+  // DD_TRACE_AGENT_ENCODER_THREADS.
+  int agent_encoder_threads = 1;
+  // Each thread collects the traces that it finishes, and hands them to the
+  // writer together once it has collected `agent_write_batch_size` of them
+  // (or at the next write, flush, or thread exit), so that finishing a trace
+  // rarely contends with other threads.  `1` hands over each trace as it
+  // finishes.  This option is also configurable as the environment variable
+  // DD_TRACE_AGENT_WRITE_BATCH_SIZE.
+  int agent_write_batch_size = 64;
 };
 
 // TraceEncoder exposes the data required to encode and submit traces to the
@@ -249,6 +394,16 @@ std::string toJSON(const TracerOptions& options, bool with_timestamp);
 // This function is defined in `tracer.cpp`.
 const TracerOptions& getOptions(const ot::Tracer& tracer);
 
+// Start sending the traces that the specified `tracer` has finished, without
+// blocking, and return a future that becomes `true` once they have been sent,
+// or `false` once the specified `deadline` passes first.  Requests to the
+// Datadog Agent are not given longer than the time remaining until
+// `deadline`.  Unlike `Close`, this can be used to shut down within a budget
+// (e.g. during a graceful reload) without blocking the calling thread.  The
+// behavior is undefined unless `tracer` is a Datadog tracer.
+// This function is defined in `tracer.cpp`.
+std::future<bool> flushAsync(ot::Tracer& tracer, std::chrono::steady_clock::time_point deadline);
+
 }  // namespace opentracing
 }  // namespace datadog
 
@@ -1,11 +1,17 @@
 #include "agent_writer.h"
 
+#include <algorithm>
 #include <sstream>
+#include <unordered_map>
 
+#include "compression.h"
 #include "encoder.h"
 #include "sample.h"
 #include "span.h"
+#include "spool.h"
+#include "stats_concentrator.h"
 #include "transport.h"
+#include "unix_socket_handle.h"
 
 namespace datadog {
 namespace opentracing {
@@ -17,35 +23,133 @@ const std::string agent_protocol = "http://";
 // write_period 1s + timeout 2s + (retry & timeout) 2.5s + (retry and timeout) 4.5s = 10s.
 const std::vector<std::chrono::milliseconds> default_retry_periods{
     std::chrono::milliseconds(500), std::chrono::milliseconds(2500)};
-// Agent communication timeout.
-const long default_timeout_ms = 2000L;
+const std::string header_content_encoding = "Content-Encoding";
+
+// Return whether the specified agent `url` refers to a unix domain socket, either as
+// "unix:///path/to/trace-agent.socket" or as "/path/to/trace-agent.socket".
+bool isUnixSocketURL(const std::string &url) {
+  return url.substr(0, 7) == "unix://" || url.substr(0, 1) == "/";
+}
+
+// Return a handle for sending requests to the agent at the specified `url`. An agent listening on
+// a unix domain socket is sent requests directly rather than via curl.
+std::unique_ptr<Handle> makeHandle(const std::string &url, std::shared_ptr<const Logger> logger) {
+#ifndef _MSC_VER
+  if (isUnixSocketURL(url)) {
+    return std::unique_ptr<Handle>{new UnixSocketHandle{logger}};
+  }
+#endif
+  // `CurlHandle` is defined in `transport.h`.
+  return std::unique_ptr<Handle>{new CurlHandle{logger}};
+}
+
+// Return the specified `count` (at least one) of handles made by `makeHandle`.
+std::vector<std::unique_ptr<Handle>> makeHandles(const std::string &url,
+                                                 std::shared_ptr<const Logger> logger,
+                                                 std::size_t count) {
+  std::vector<std::unique_ptr<Handle>> handles;
+  do {
+    handles.push_back(makeHandle(url, logger));
+  } while (handles.size() < count);
+  return handles;
+}
+
+// The id of the next AgentWriter.
+std::atomic<uint64_t> next_writer_id{1};
+
+// Batches of traces are not split between encoder threads into ranges smaller than this many
+// spans, since handing a range to another thread costs about as much as encoding a few spans.
+const std::size_t min_spans_per_encode_job = 1000;
+
+// Return roughly how many bytes the specified `span` takes up once encoded, without encoding it.
+std::size_t estimateEncodedSize(const SpanData &span) {
+  // The field names and the integer fields take up about 150 bytes.
+  std::size_t size = 150 + span.type.size() + span.service.size() + span.resource.size() +
+                     span.name.size();
+  for (const auto &tag : span.meta) {
+    size += tag.first.size() + tag.second.size() + 4;
+  }
+  for (const auto &metric : span.metrics) {
+    size += metric.first.size() + 12;
+  }
+  return size;
+}
+
+std::vector<std::unique_ptr<Handle>> singleHandle(std::unique_ptr<Handle> handle) {
+  std::vector<std::unique_ptr<Handle>> handles;
+  handles.push_back(std::move(handle));
+  return handles;
+}
 }  // namespace
 
 AgentWriter::AgentWriter(std::string host, uint32_t port, std::string url,
                          std::chrono::milliseconds write_period,
                          std::shared_ptr<RulesSampler> sampler,
-                         std::shared_ptr<const Logger> logger)
-    // `CurlHandle` is defined in `transport.h`.
-    : AgentWriter(std::unique_ptr<Handle>{new CurlHandle{logger}}, write_period,
-                  default_max_queued_traces, default_retry_periods, host, port, url, sampler,
-                  logger) {}
+                         std::shared_ptr<const Logger> logger,
+                         std::shared_ptr<StatsConcentrator> stats,
+                         AgentConnectionOptions connection_options)
+    : AgentWriter(makeHandles(url, logger, connection_options.max_concurrent_requests),
+                  write_period, default_max_queued_traces, default_retry_periods, host, port, url,
+                  sampler, logger, stats, connection_options) {}
 
 AgentWriter::AgentWriter(std::unique_ptr<Handle> handle, std::chrono::milliseconds write_period,
                          size_t max_queued_traces,
                          std::vector<std::chrono::milliseconds> retry_periods, std::string host,
                          uint32_t port, std::string url, std::shared_ptr<RulesSampler> sampler,
-                         std::shared_ptr<const Logger> logger)
+                         std::shared_ptr<const Logger> logger,
+                         std::shared_ptr<StatsConcentrator> stats,
+                         AgentConnectionOptions connection_options)
+    : AgentWriter(singleHandle(std::move(handle)), write_period, max_queued_traces,
+                  retry_periods, host, port, url, sampler, logger, stats, connection_options) {}
+
+AgentWriter::AgentWriter(std::vector<std::unique_ptr<Handle>> handles,
+                         std::chrono::milliseconds write_period, size_t max_queued_traces,
+                         std::vector<std::chrono::milliseconds> retry_periods, std::string host,
+                         uint32_t port, std::string url, std::shared_ptr<RulesSampler> sampler,
+                         std::shared_ptr<const Logger> logger,
+                         std::shared_ptr<StatsConcentrator> stats,
+                         AgentConnectionOptions connection_options)
     : Writer(sampler, logger),
       write_period_(write_period),
       max_queued_traces_(max_queued_traces),
       retry_periods_(retry_periods),
-      logger_(logger) {
-  setUpHandle(handle, host, port, url);
-  startWriting(std::move(handle));
+      // Enough for each sender to have a request waiting behind the one it is sending.
+      max_queued_requests_(2 * handles.size()),
+      compression_level_(std::min(connection_options.compression_level, max_compression_level)),
+      compression_min_bytes_(connection_options.compression_min_bytes),
+      spool_replay_period_(connection_options.spool_replay_period),
+      spool_retry_period_(connection_options.spool_retry_period),
+      flush_threshold_spans_(connection_options.flush_threshold_spans),
+      flush_threshold_bytes_(connection_options.flush_threshold_bytes),
+      max_idle_write_period_(std::max(connection_options.max_idle_write_period, write_period)),
+      encoder_threads_(std::max(connection_options.encoder_threads, std::size_t(1))),
+      write_batch_size_(connection_options.write_batch_size),
+      id_(next_writer_id++),
+      breaker_(getRealTime, connection_options.circuit_breaker),
+      logger_(logger),
+      stats_(stats) {
+  if (stats_ != nullptr) {
+    trace_encoder_->setClientComputedStats();
+  }
+  if (!connection_options.spool_directory.empty()) {
+    try {
+      spool_ = std::make_unique<Spool>(connection_options.spool_directory,
+                                       connection_options.spool_max_bytes, logger_);
+      // A previous process might have left payloads in the spool.
+      spool_pending_ = true;
+    } catch (const std::runtime_error &error) {
+      logger_->Log(LogLevel::error, std::string("Unable to spool traces: ") + error.what());
+    }
+  }
+  for (auto &handle : handles) {
+    setUpHandle(handle, host, port, url, connection_options);
+  }
+  startWriting(std::move(handles));
 }
 
 void AgentWriter::setUpHandle(std::unique_ptr<Handle> &handle, std::string host, uint32_t port,
-                              std::string url) {
+                              std::string url,
+                              const AgentConnectionOptions &connection_options) {
   // Some options are the same for all actions, set them here.
   // Set the agent URL.
   // The URL can be either
@@ -62,9 +166,10 @@ void AgentWriter::setUpHandle(std::unique_ptr<Handle> &handle, std::string host,
     const std::string unix_scheme = "unix://";
     if (url.substr(0, http_scheme.size()) == http_scheme ||
         url.substr(0, https_scheme.size()) == https_scheme) {
-      std::string agent_uri = url + trace_encoder_->path();
+      traces_url_ = url + trace_encoder_->path();
+      stats_url_ = url + trace_encoder_->statsPath();
       // http:// or https://
-      auto rcode = handle->setopt(CURLOPT_URL, agent_uri.c_str());
+      auto rcode = handle->setopt(CURLOPT_URL, traces_url_.c_str());
       if (rcode != CURLE_OK) {
         throw std::runtime_error(std::string("Unable to set agent URL: ") +
                                  curl_easy_strerror(rcode));
@@ -90,19 +195,40 @@ void AgentWriter::setUpHandle(std::unique_ptr<Handle> &handle, std::string host,
     }
   }
   if (!urlopt_set) {
-    std::string agent_uri =
-        agent_protocol + host + ":" + std::to_string(port) + trace_encoder_->path();
-    auto rcode = handle->setopt(CURLOPT_URL, agent_uri.c_str());
+    const std::string agent_uri = agent_protocol + host + ":" + std::to_string(port);
+    traces_url_ = agent_uri + trace_encoder_->path();
+    stats_url_ = agent_uri + trace_encoder_->statsPath();
+    auto rcode = handle->setopt(CURLOPT_URL, traces_url_.c_str());
     if (rcode != CURLE_OK) {
       throw std::runtime_error(std::string("Unable to set agent URL: ") +
                                curl_easy_strerror(rcode));
     }
   }
-  auto rcode = handle->setopt(CURLOPT_TIMEOUT_MS, default_timeout_ms);
+  // The timeout is lowered once the agent's latency is known. See `CircuitBreaker`.
+  auto rcode = handle->setopt(CURLOPT_TIMEOUT_MS,
+                              long(connection_options.circuit_breaker.max_timeout.count()));
   if (rcode != CURLE_OK) {
     throw std::runtime_error(std::string("Unable to set agent timeout: ") +
                              curl_easy_strerror(rcode));
   }
+  // The handle keeps its connection to the agent open between requests, so these options apply
+  // for the life of the connection rather than to each request.
+  auto setConnectionOption = [&handle](CURLoption key, long value, const char *name) {
+    auto rcode = handle->setopt(key, value);
+    if (rcode != CURLE_OK) {
+      throw std::runtime_error(std::string("Unable to set agent connection option ") + name +
+                               ": " + curl_easy_strerror(rcode));
+    }
+  };
+  setConnectionOption(CURLOPT_TCP_NODELAY, connection_options.tcp_nodelay ? 1L : 0L,
+                      "TCP_NODELAY");
+  if (connection_options.tcp_keepalive_seconds > 0) {
+    setConnectionOption(CURLOPT_TCP_KEEPALIVE, 1L, "TCP_KEEPALIVE");
+    setConnectionOption(CURLOPT_TCP_KEEPIDLE, connection_options.tcp_keepalive_seconds,
+                        "TCP_KEEPIDLE");
+    setConnectionOption(CURLOPT_TCP_KEEPINTVL, connection_options.tcp_keepalive_seconds,
+                        "TCP_KEEPINTVL");
+  }
 }
 
 AgentWriter::~AgentWriter() { stop(); }
@@ -115,119 +241,682 @@ void AgentWriter::stop() {
     }
     stop_writing_ = true;
   }
+  // Threads that write traces from now on drop them, as do threads that exit.
+  {
+    std::lock_guard<std::mutex> lock(staging_mutex_);
+    staging_stopped_ = true;
+    for (auto &weak_buffer : staging_buffers_) {
+      auto buffer = weak_buffer.lock();
+      if (buffer != nullptr) {
+        std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+        buffer->writer = nullptr;
+        buffer->batch = Batch{};
+      }
+    }
+    staging_buffers_.clear();
+  }
   condition_.notify_all();
   worker_->join();
+  for (auto &sender : senders_) {
+    sender.join();
+  }
+  // The worker might have been waiting for the encoder threads, so they stop last.
+  {
+    std::unique_lock<std::mutex> lock(encode_mutex_);
+    stop_encoding_ = true;
+  }
+  encode_condition_.notify_all();
+  for (auto &encoder : encoders_) {
+    encoder.join();
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  for (auto &flush : flushes_) {
+    flush.flushed.set_value(false);
+  }
+  flushes_.clear();
 }
 
 void AgentWriter::write(TraceData trace) {
+  // Measure the trace before taking a lock.
+  const std::size_t spans = trace->size();
+  std::size_t bytes = 0;
+  if (flush_threshold_bytes_ != 0) {
+    for (const auto &span : *trace) {
+      bytes += estimateEncodedSize(*span);
+    }
+  }
+  // Count the trace as queued, unless too many are queued already. The counts are approximate,
+  // since other threads update them at the same time.
+  if (queued_traces_.load(std::memory_order_relaxed) >= max_queued_traces_) {
+    return;
+  }
+  queued_traces_.fetch_add(1, std::memory_order_relaxed);
+  const std::size_t queued_spans = queued_spans_.fetch_add(spans, std::memory_order_relaxed);
+  const std::size_t queued_bytes = queued_bytes_.fetch_add(bytes, std::memory_order_relaxed);
+  // Whether this trace brings the traces that every thread has written to a flush threshold.
+  const bool reached_flush_threshold =
+      !reachesFlushThreshold(queued_spans, queued_bytes) &&
+      reachesFlushThreshold(queued_spans + spans, queued_bytes + bytes);
+
+  Batch batch;
+  bool first_staged = false;
+  if (write_batch_size_ <= 1) {
+    batch.traces.push_back(std::move(trace));
+    batch.spans = spans;
+    batch.bytes = bytes;
+  } else {
+    // Collect the trace in this thread's staging buffer, whose lock other threads rarely take.
+    StagingBuffer *buffer = stagingBuffer();
+    if (buffer == nullptr) {
+      return;
+    }
+    std::lock_guard<std::mutex> lock(buffer->mutex);
+    if (buffer->writer == nullptr) {
+      return;
+    }
+    Batch &staged = buffer->batch;
+    first_staged = staged.traces.empty();
+    staged.traces.push_back(std::move(trace));
+    staged.spans += spans;
+    staged.bytes += bytes;
+    if (staged.traces.size() >= write_batch_size_) {
+      std::swap(batch, staged);
+    }
+  }
+  writeBatch(std::move(batch));
+  if (reached_flush_threshold || (first_staged && idle_)) {
+    // The worker collects the staged traces when it wakes up. Wake it now if the traces should be
+    // sent now, and don't let it sleep for longer than the write period if it has backed off while
+    // there were no traces.
+    std::lock_guard<std::mutex> lock(mutex_);
+    if (shortenIdleWait() || reached_flush_threshold) {
+      condition_.notify_all();
+    }
+  }
+}
+
+void AgentWriter::writeBatch(Batch batch) {
+  if (batch.traces.empty() && batch.dropped_traces == 0 && batch.dropped_spans == 0) {
+    return;
+  }
   std::unique_lock<std::mutex> lock(mutex_);
   if (stop_writing_) {
     return;
   }
-  if (trace_encoder_->pendingTraces() >= max_queued_traces_) {
+  trace_encoder_->addDropped(batch.dropped_traces, batch.dropped_spans);
+  if (batch.traces.empty()) {
     return;
   }
-  trace_encoder_->addTrace(std::move(trace));
+  const bool was_empty = trace_encoder_->pendingTraces() == 0;
+  for (auto &trace : batch.traces) {
+    trace_encoder_->addTrace(std::move(trace));
+  }
+  pending_spans_ += batch.spans;
+  pending_bytes_ += batch.bytes;
+  // The worker might have backed off while there were no traces, but these should not wait longer
+  // than the write period.
+  if (was_empty && shortenIdleWait()) {
+    condition_.notify_all();
+  }
 }
 
-void AgentWriter::startWriting(std::unique_ptr<Handle> handle) {
-  // Start worker that sends Traces to agent.
-  // We can capture 'this' because destruction of this stops the thread and the lambda.
-  worker_ = std::make_unique<std::thread>(
-      [this](std::unique_ptr<Handle> handle) {
-        size_t num_traces = 0;
-        std::map<std::string, std::string> headers;
-        std::string payload;
-        while (true) {
-          // Encode traces when there are new ones.
-          {
-            // Wait to be told about new traces (or to stop).
-            std::unique_lock<std::mutex> lock(mutex_);
-            condition_.wait_for(lock, write_period_,
-                                [&]() -> bool { return flush_worker_ || stop_writing_; });
-            if (stop_writing_) {
-              return;  // Stop the thread.
-            }
-            num_traces = trace_encoder_->pendingTraces();
-            if (num_traces == 0) {
-              continue;
-            }
-            headers = trace_encoder_->headers();
-            payload = trace_encoder_->payload();
-            trace_encoder_->clearTraces();
-          }  // lock on mutex_ ends.
-          // Send the spans. Note that this is not in the critical section above.
-          bool success = retryFiniteOnFail(
-              [&]() { return AgentWriter::postTraces(handle, headers, payload, logger_); });
-          // Sending could fail. If it succeeds, then the HTTP response status
-          // could indicate an error or success. Also, an empty response body
-          // indicates an error even when the status is 200.
-          if (success) {
-            const int response_status = handle->getResponseStatus();
-            const std::string body = handle->getResponse();
-            if (response_status == 0) {
-              std::ostringstream diagnostic;
-              diagnostic << "Datadog Agent returned response without an HTTP status and with the "
-                            "following body of length "
-                         << body.size() << ": " << body;
-              logger_->Log(LogLevel::error, diagnostic.str());
-            } else if (response_status != 200) {
-              std::ostringstream diagnostic;
-              diagnostic << "Datadog Agent returned response with unexpected HTTP status "
-                         << response_status << " and the following body of length " << body.size()
-                         << ": " << body;
-              logger_->Log(LogLevel::error, diagnostic.str());
-            } else if (body.empty()) {
-              logger_->Log(LogLevel::error,
-                           "Datadog Agent returned response without a body. This tracer might be "
-                           "sending batches of traces too frequently.");
-            } else {
-              // success
-              trace_encoder_->handleResponse(handle->getResponse());
-            }
-          }
-          // If `success == false`, then `postTraces` will have already logged
-          // an error.
-
-          // Let thread calling 'flush' know that we're done flushing.
-          {
-            std::unique_lock<std::mutex> lock(mutex_);
-            flush_worker_ = false;
-          }
-          condition_.notify_all();
+AgentWriter::StagingBuffer *AgentWriter::stagingBuffer() {
+  // The staging buffers of a thread, by the id of their writer. When the thread exits, the
+  // contents of them are handed to their writers.
+  struct ThreadStaging {
+    std::unordered_map<uint64_t, std::shared_ptr<StagingBuffer>> buffers;
+
+    ~ThreadStaging() {
+      for (auto &entry : buffers) {
+        StagingBuffer &buffer = *entry.second;
+        // The writer does not stop while the buffer is locked.
+        std::lock_guard<std::mutex> lock(buffer.mutex);
+        if (buffer.writer != nullptr) {
+          buffer.writer->writeBatch(std::move(buffer.batch));
         }
-      },
-      std::move(handle));
+      }
+    }
+  };
+  static thread_local ThreadStaging staging;
+
+  auto found = staging.buffers.find(id_);
+  if (found != staging.buffers.end()) {
+    return found->second.get();
+  }
+  // Forget the buffers of writers that have stopped.
+  auto entry = staging.buffers.begin();
+  while (entry != staging.buffers.end()) {
+    std::unique_lock<std::mutex> lock(entry->second->mutex);
+    if (entry->second->writer == nullptr) {
+      lock.unlock();
+      entry = staging.buffers.erase(entry);
+    } else {
+      ++entry;
+    }
+  }
+  auto buffer = std::make_shared<StagingBuffer>();
+  buffer->writer = this;
+  {
+    std::lock_guard<std::mutex> lock(staging_mutex_);
+    if (staging_stopped_) {
+      return nullptr;
+    }
+    staging_buffers_.push_back(buffer);
+  }
+  staging.buffers.emplace(id_, buffer);
+  return buffer.get();
 }
 
-void AgentWriter::flush(std::chrono::milliseconds timeout) try {
-  std::unique_lock<std::mutex> lock(mutex_);
-  flush_worker_ = true;
-  condition_.notify_all();
-  // Wait until flush is complete.
-  condition_.wait_for(lock, timeout, [&]() -> bool { return !flush_worker_ || stop_writing_; });
-} catch (const std::bad_alloc &) {
+AgentWriter::Batch AgentWriter::collectStaged() {
+  Batch batch;
+  std::lock_guard<std::mutex> lock(staging_mutex_);
+  auto weak_buffer = staging_buffers_.begin();
+  while (weak_buffer != staging_buffers_.end()) {
+    auto buffer = weak_buffer->lock();
+    if (buffer == nullptr) {
+      // The thread has exited.
+      weak_buffer = staging_buffers_.erase(weak_buffer);
+      continue;
+    }
+    std::lock_guard<std::mutex> buffer_lock(buffer->mutex);
+    Batch &staged = buffer->batch;
+    for (auto &trace : staged.traces) {
+      batch.traces.push_back(std::move(trace));
+    }
+    batch.spans += staged.spans;
+    batch.bytes += staged.bytes;
+    batch.dropped_traces += staged.dropped_traces;
+    batch.dropped_spans += staged.dropped_spans;
+    staged = Batch{};
+    ++weak_buffer;
+  }
+  return batch;
+}
+
+void AgentWriter::writeDropped(uint64_t traces, uint64_t spans) {
+  Batch batch;
+  batch.dropped_traces = traces;
+  batch.dropped_spans = spans;
+  if (write_batch_size_ <= 1) {
+    writeBatch(std::move(batch));
+    return;
+  }
+  // Count them in this thread's staging buffer, as for traces that are kept.
+  StagingBuffer *buffer = stagingBuffer();
+  if (buffer == nullptr) {
+    return;
+  }
+  std::lock_guard<std::mutex> lock(buffer->mutex);
+  if (buffer->writer != nullptr) {
+    buffer->batch.dropped_traces += traces;
+    buffer->batch.dropped_spans += spans;
+  }
+}
+
+void AgentWriter::startWriting(std::vector<std::unique_ptr<Handle>> handles) {
+  // We can capture 'this' because destruction of this stops the threads and the lambdas.
+  for (auto &handle : handles) {
+    senders_.emplace_back(
+        [this](std::unique_ptr<Handle> handle) { sendRequests(std::move(handle)); },
+        std::move(handle));
+  }
+  // The worker encodes traces too, so it is one of the `encoder_threads_`.
+  for (std::size_t i = 1; i < encoder_threads_; i++) {
+    encoders_.emplace_back([this]() { encodeJobs(); });
+  }
+  // Start worker that encodes Traces into requests.
+  worker_ = std::make_unique<std::thread>([this]() {
+    std::unique_lock<std::mutex> lock(mutex_);
+    auto write_period = write_period_;
+    next_write_ = std::chrono::steady_clock::now() + write_period;
+    while (true) {
+      // Wait to be told about new traces (or to stop), until the write period or the deadline of
+      // a flush passes. Requests that finish wake the worker too, in case there was no room to
+      // queue traces that reached the high-water mark.
+      const auto deadline = finishFlushes(std::chrono::steady_clock::now());
+      if (!flush_worker_ && !stop_writing_ && !aboveHighWaterMark()) {
+        condition_.wait_until(lock, std::min(next_write_, deadline));
+      }
+      if (stop_writing_) {
+        return;  // Stop the thread.
+      }
+      const auto now = std::chrono::steady_clock::now();
+      if (!flush_worker_ && !aboveHighWaterMark() && now < next_write_) {
+        continue;
+      }
+      if (write_batch_size_ > 1) {
+        // Collect what threads have staged, without holding up writes.
+        lock.unlock();
+        writeBatch(collectStaged());
+        lock.lock();
+      }
+      // While there is nothing to send, wake up less and less often.
+      if (trace_encoder_->pendingTraces() == 0 && !trace_encoder_->hasDropped()) {
+        write_period = std::min(2 * write_period, max_idle_write_period_);
+      } else {
+        write_period = write_period_;
+      }
+      idle_ = write_period > write_period_;
+      // Flushes wait for the traces that are pending now to be encoded, and for the requests to be
+      // sent. Flushes that are requested while they are encoded wait for the next traces, too.
+      const bool flushing = flush_worker_;
+      flush_worker_ = false;
+      enqueueRequests(lock, flushing);
+      next_write_ = now + write_period;
+      condition_.notify_all();
+    }
+  });
+}
+
+bool AgentWriter::reachesFlushThreshold(std::size_t spans, std::size_t bytes) const {
+  return (flush_threshold_spans_ != 0 && spans >= flush_threshold_spans_) ||
+         (flush_threshold_bytes_ != 0 && bytes >= flush_threshold_bytes_);
+}
+
+bool AgentWriter::aboveHighWaterMark() const {
+  return requests_.size() < max_queued_requests_ &&
+         reachesFlushThreshold(queued_spans_.load(std::memory_order_relaxed),
+                               queued_bytes_.load(std::memory_order_relaxed));
+}
+
+bool AgentWriter::shortenIdleWait() {
+  const auto latest = std::chrono::steady_clock::now() + write_period_;
+  if (next_write_ <= latest) {
+    return false;
+  }
+  next_write_ = latest;
+  return true;
+}
+
+void AgentWriter::enqueueRequests(std::unique_lock<std::mutex> &lock, bool flushing) {
+  if (!flushing && requests_.size() >= max_queued_requests_) {
+    // The agent is not keeping up. Leave the traces in the encoder, which limits how many there
+    // can be.
+    return;
+  }
+  const auto now = std::chrono::steady_clock::now();
+  // Trace metrics are sent even when there are no traces, since they cover traces that might not
+  // be sent at all. They are sent before the traces.
+  if (stats_ != nullptr) {
+    std::string payload = stats_->flush(flushing);
+    if (!payload.empty()) {
+      requests_.push_back(
+          Request{&stats_url_, trace_encoder_->statsHeaders(), std::move(payload), 0, now});
+    }
+  }
+  if (trace_encoder_->pendingTraces() != 0) {
+    auto headers = trace_encoder_->headers();
+    auto traces = trace_encoder_->takeTraces();
+    const std::size_t spans = pending_spans_;
+    queued_traces_.fetch_sub(traces.size(), std::memory_order_relaxed);
+    queued_spans_.fetch_sub(spans, std::memory_order_relaxed);
+    queued_bytes_.fetch_sub(pending_bytes_, std::memory_order_relaxed);
+    pending_spans_ = 0;
+    pending_bytes_ = 0;
+    // Encode (and free) the traces without holding up the threads that write more.
+    encoding_ = true;
+    lock.unlock();
+    std::string payload = encode(traces, spans);
+    traces.clear();
+    lock.lock();
+    encoding_ = false;
+    requests_.push_back(Request{&traces_url_, std::move(headers), std::move(payload), 0, now});
+  } else if (trace_encoder_->hasDropped()) {
+    // Every trace was dropped. The agent still needs their counts, so send it a request that
+    // contains no traces.
+    auto headers = trace_encoder_->headers();
+    trace_encoder_->clearTraces();
+    requests_.push_back(
+        Request{&traces_url_, std::move(headers), trace_encoder_->probePayload(), 0, now});
+  }
 }
 
-bool AgentWriter::retryFiniteOnFail(std::function<bool()> f) const {
-  for (std::chrono::milliseconds backoff : retry_periods_) {
-    if (f()) {
-      return true;
+std::string AgentWriter::encode(const std::deque<TraceData> &traces, std::size_t spans) {
+  // Split the traces into ranges with about the same number of spans.
+  const std::size_t num_jobs =
+      std::max(std::size_t(1), std::min(encoder_threads_, spans / min_spans_per_encode_job));
+  std::vector<EncodeJob> jobs(num_jobs);
+  auto trace = traces.begin();
+  std::size_t counted_spans = 0;
+  for (std::size_t i = 0; i < num_jobs; i++) {
+    jobs[i].first = trace;
+    const std::size_t target = spans * (i + 1) / num_jobs;
+    while (trace != traces.end() && (counted_spans < target || i + 1 == num_jobs)) {
+      counted_spans += (*trace)->size();
+      ++trace;
     }
+    jobs[i].last = trace;
+  }
+  if (num_jobs > 1) {
     {
-      std::unique_lock<std::mutex> lock(mutex_);
-      condition_.wait_for(lock, backoff, [&]() -> bool { return stop_writing_; });
-      if (stop_writing_) {
-        return false;
+      std::unique_lock<std::mutex> lock(encode_mutex_);
+      for (std::size_t i = 1; i < num_jobs; i++) {
+        encode_queue_.push_back(&jobs[i]);
       }
+      encode_jobs_remaining_ = num_jobs - 1;
+    }
+    encode_condition_.notify_all();
+  }
+  jobs[0].payload = AgentHttpEncoder::encodeTraces(jobs[0].first, jobs[0].last);
+  if (num_jobs > 1) {
+    std::unique_lock<std::mutex> lock(encode_mutex_);
+    encode_condition_.wait(lock, [this]() { return encode_jobs_remaining_ == 0; });
+  }
+
+  std::string payload = AgentHttpEncoder::encodeArrayHeader(traces.size());
+  std::size_t size = payload.size();
+  for (const auto &job : jobs) {
+    size += job.payload.size();
+  }
+  payload.reserve(size);
+  for (const auto &job : jobs) {
+    payload += job.payload;
+  }
+  return payload;
+}
+
+void AgentWriter::encodeJobs() {
+  std::unique_lock<std::mutex> lock(encode_mutex_);
+  while (true) {
+    encode_condition_.wait(lock, [this]() { return stop_encoding_ || !encode_queue_.empty(); });
+    if (encode_queue_.empty()) {
+      return;  // Stop the thread.
+    }
+    EncodeJob *job = encode_queue_.back();
+    encode_queue_.pop_back();
+    lock.unlock();
+    job->payload = AgentHttpEncoder::encodeTraces(job->first, job->last);
+    lock.lock();
+    if (--encode_jobs_remaining_ == 0) {
+      encode_condition_.notify_all();
+    }
+  }
+}
+
+std::chrono::steady_clock::time_point AgentWriter::finishFlushes(
+    std::chrono::steady_clock::time_point now) {
+  const bool flushed =
+      !flush_worker_ && !encoding_ && requests_.empty() && requests_in_flight_ == 0;
+  auto earliest = std::chrono::steady_clock::time_point::max();
+  auto flush = flushes_.begin();
+  while (flush != flushes_.end()) {
+    if (flushed || flush->deadline <= now) {
+      flush->flushed.set_value(flushed);
+      flush = flushes_.erase(flush);
+    } else {
+      earliest = std::min(earliest, flush->deadline);
+      ++flush;
     }
   }
-  return f();  // Final try after final sleep.
+  return earliest;
+}
+
+void AgentWriter::sendRequests(std::unique_ptr<Handle> handle) {
+  // `setUpHandle` pointed the handle at the traces URL, with the longest timeout.
+  Connection connection{std::move(handle), &traces_url_, breaker_.timeout()};
+  std::unique_lock<std::mutex> lock(mutex_);
+  while (!stop_writing_) {
+    const auto now = std::chrono::steady_clock::now();
+    // Take the request that can be sent soonest. Spooled payloads are sent only when there is no
+    // such request.
+    auto next = std::min_element(requests_.begin(), requests_.end(),
+                                 [](const Request &left, const Request &right) {
+                                   return left.not_before < right.not_before;
+                                 });
+    const bool request_due = next != requests_.end() && next->not_before <= now;
+    const bool replay_pending = spool_pending_ && !replaying_;
+    const bool replay_due = replay_pending && next_replay_ <= now;
+    auto decision = CircuitBreaker::Decision::send;
+    if (request_due || replay_due) {
+      decision = breaker_.allow();
+    }
+
+    if (decision == CircuitBreaker::Decision::probe) {
+      // Check whether the agent is available again with a request that contains no traces. The
+      // request that is due stays queued.
+      Request probe{&traces_url_, trace_encoder_->probeHeaders(), trace_encoder_->probePayload(),
+                    0, now};
+      lock.unlock();
+      if (compression_level_ > 0 || spool_ != nullptr) {
+        compress(probe);
+      }
+      sendRequest(connection, probe, decision);
+      lock.lock();
+      condition_.notify_all();
+      continue;
+    }
+
+    if (request_due) {
+      Request request = std::move(*next);
+      requests_.erase(next);
+      ++requests_in_flight_;
+      lock.unlock();
+      // Compress and send the request, unless the agent is unavailable. Note that this is not in
+      // the critical section. The handle keeps the headers of previous requests, any of which
+      // might have been compressed.
+      bool sent = false;
+      if (decision == CircuitBreaker::Decision::send) {
+        if (compression_level_ > 0 || spool_ != nullptr) {
+          compress(request);
+        }
+        sent = sendRequest(connection, request, decision);
+      }
+      // Trace metrics are neither retried nor spooled.
+      const bool retry =
+          !sent && request.url == &traces_url_ && request.failures < retry_periods_.size();
+      const bool spooled = !sent && !retry && request.url == &traces_url_ &&
+                           spool_ != nullptr && spool_->push(request.headers, request.payload);
+      if (decision == CircuitBreaker::Decision::reject && !retry && !spooled) {
+        logger_->Log(LogLevel::error,
+                     "Datadog Agent has not responded to recent requests; dropped a request to " +
+                         *request.url);
+      }
+      lock.lock();
+      --requests_in_flight_;
+      if (retry) {
+        request.not_before = std::chrono::steady_clock::now() +
+                             breaker_.jitter(retry_periods_[request.failures]);
+        ++request.failures;
+        requests_.push_back(std::move(request));
+      }
+      if (spooled) {
+        // The agent is unavailable, so don't try to send spooled payloads for a while.
+        spool_pending_ = true;
+        ++spool_pushes_;
+        next_replay_ = std::max(next_replay_, now + spool_retry_period_);
+      }
+      // Complete any flushes that were waiting for the request, and let other senders know that
+      // it is finished.
+      finishFlushes(std::chrono::steady_clock::now());
+      condition_.notify_all();
+      continue;
+    }
+
+    if (replay_due && decision == CircuitBreaker::Decision::reject) {
+      // Wait for the breaker to allow a probe, or for another sender's probe to finish.
+      next_replay_ = std::max(breaker_.probeTime(), now + spool_replay_period_);
+      continue;
+    }
+    if (replay_due) {
+      replaying_ = true;
+      const uint64_t spool_pushes = spool_pushes_;
+      lock.unlock();
+      bool exhausted = false;
+      const bool sent = replaySpooled(connection, exhausted);
+      lock.lock();
+      replaying_ = false;
+      if (exhausted && spool_pushes == spool_pushes_) {
+        spool_pending_ = false;
+      }
+      next_replay_ = std::chrono::steady_clock::now() +
+                     (sent || exhausted ? spool_replay_period_ : spool_retry_period_);
+      condition_.notify_all();
+      continue;
+    }
+
+    // Wait until a request or a spooled payload can be sent.
+    if (next != requests_.end() && (!replay_pending || next->not_before < next_replay_)) {
+      condition_.wait_until(lock, next->not_before);
+    } else if (replay_pending) {
+      condition_.wait_until(lock, next_replay_);
+    } else {
+      condition_.wait(lock);
+    }
+  }
+}
+
+bool AgentWriter::replaySpooled(Connection &connection, bool &exhausted) {
+  Request request{&traces_url_, {}, {}, 0, {}};
+  Spool::Position position;
+  if (!spool_->front(request.headers, request.payload, position)) {
+    exhausted = true;
+    return false;
+  }
+  compress(request);
+  if (!sendRequest(connection, request, CircuitBreaker::Decision::send)) {
+    return false;
+  }
+  spool_->pop(position);
+  return true;
+}
+
+void AgentWriter::compress(Request &request) const {
+  // The handle keeps the headers of the previous request, so the header is always set. It is not
+  // sent if it is empty.
+  std::string &encoding = request.headers[header_content_encoding];
+  if (!encoding.empty() || compression_level_ <= 0 || request.url != &traces_url_ ||
+      request.payload.size() < compression_min_bytes_) {
+    return;
+  }
+  std::string compressed;
+  if (!gzipCompress(request.payload, compression_level_, compressed)) {
+    logger_->Log(LogLevel::error, "Unable to compress traces; sending them uncompressed.");
+    return;
+  }
+  if (compressed.size() < request.payload.size()) {
+    request.payload = std::move(compressed);
+    encoding = "gzip";
+  }
+}
+
+bool AgentWriter::sendRequest(Connection &connection, const Request &request,
+                              CircuitBreaker::Decision decision) {
+  auto &handle = connection.handle;
+  if (request.url != connection.url) {
+    auto rcode = handle->setopt(CURLOPT_URL, request.url->c_str());
+    if (rcode != CURLE_OK) {
+      std::ostringstream error;
+      error << "Error setting agent URL: " << curl_easy_strerror(rcode);
+      logger_->Log(LogLevel::error, error.str());
+      return false;
+    }
+    connection.url = request.url;
+  }
+  auto timeout = breaker_.timeout();
+  // Don't wait for a response past the deadline of a flush, such as the one made when the tracer
+  // is closed, so that whatever fits before the deadline is sent.
+  bool capped = false;
+  {
+    std::unique_lock<std::mutex> lock(mutex_);
+    if (!flushes_.empty()) {
+      auto deadline = flushes_.front().deadline;
+      for (const auto &flush : flushes_) {
+        deadline = std::max(deadline, flush.deadline);
+      }
+      const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining < timeout) {
+        timeout = std::max(remaining, std::chrono::milliseconds(1));
+        capped = true;
+      }
+    }
+  }
+  if (timeout != connection.timeout) {
+    auto rcode = handle->setopt(CURLOPT_TIMEOUT_MS, long(timeout.count()));
+    if (rcode != CURLE_OK) {
+      std::ostringstream error;
+      error << "Error setting agent timeout: " << curl_easy_strerror(rcode);
+      logger_->Log(LogLevel::error, error.str());
+      return false;
+    }
+    connection.timeout = timeout;
+  }
+  const auto start = std::chrono::steady_clock::now();
+  if (!AgentWriter::postTraces(handle, request.headers, request.payload, logger_)) {
+    // `postTraces` will have already logged an error. A request cut short by the deadline of a
+    // flush says nothing about the agent, but a probe has to be resolved.
+    const bool timed_out = std::chrono::steady_clock::now() - start >= timeout;
+    if (!capped || !timed_out) {
+      breaker_.recordFailure(decision, timed_out);
+    } else if (decision == CircuitBreaker::Decision::probe) {
+      breaker_.recordFailure(decision, false);
+    }
+    return false;
+  }
+  breaker_.recordResponse(decision, std::chrono::steady_clock::now() - start);
+  // The HTTP response status could indicate an error or success. Also, an empty response body
+  // indicates an error even when the status is 200.
+  const int response_status = handle->getResponseStatus();
+  const std::string body = handle->getResponse();
+  if (request.url == &stats_url_) {
+    if (response_status != 200) {
+      std::ostringstream diagnostic;
+      diagnostic << "Datadog Agent returned response with unexpected HTTP status "
+                 << response_status << " for trace metrics: " << body;
+      logger_->Log(LogLevel::error, diagnostic.str());
+    }
+  } else if (response_status == 0) {
+    std::ostringstream diagnostic;
+    diagnostic << "Datadog Agent returned response without an HTTP status and with the "
+                  "following body of length "
+               << body.size() << ": " << body;
+    logger_->Log(LogLevel::error, diagnostic.str());
+  } else if (response_status != 200) {
+    std::ostringstream diagnostic;
+    diagnostic << "Datadog Agent returned response with unexpected HTTP status "
+               << response_status << " and the following body of length " << body.size()
+               << ": " << body;
+    logger_->Log(LogLevel::error, diagnostic.str());
+  } else if (body.empty()) {
+    logger_->Log(LogLevel::error,
+                 "Datadog Agent returned response without a body. This tracer might be "
+                 "sending batches of traces too frequently.");
+  } else {
+    // success
+    trace_encoder_->handleResponse(body);
+  }
+  return true;
+}
+
+void AgentWriter::flush(std::chrono::milliseconds timeout) try {
+  // Wait until the traces are encoded and every request has been sent or given up on.
+  flushAsync(std::chrono::steady_clock::now() + timeout).wait();
+} catch (const std::bad_alloc &) {
+}
+
+std::future<bool> AgentWriter::flushAsync(std::chrono::steady_clock::time_point deadline) {
+  std::promise<bool> flushed;
+  auto result = flushed.get_future();
+  if (write_batch_size_ > 1) {
+    // Flush what threads have staged, too.
+    writeBatch(collectStaged());
+  }
+  std::unique_lock<std::mutex> lock(mutex_);
+  if (stop_writing_) {
+    flushed.set_value(false);
+    return result;
+  }
+  flushes_.push_back(Flush{deadline, std::move(flushed)});
+  // The worker completes the flush, or fails it once its deadline passes.
+  flush_worker_ = true;
+  condition_.notify_all();
+  return result;
 }
 
 bool AgentWriter::postTraces(std::unique_ptr<Handle> &handle,
-                             std::map<std::string, std::string> headers, std::string payload,
-                             std::shared_ptr<const Logger> logger) try {
+                             const std::map<std::string, std::string> &headers,
+                             const std::string &payload,
+                             const std::shared_ptr<const Logger> &logger) try {
   handle->setHeaders(headers);
 
   // We have to set the size manually, because msgpack uses null characters.
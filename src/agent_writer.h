@@ -3,15 +3,19 @@
 
 #include <curl/curl.h>
 
+#include <atomic>
+#include <chrono>
 #include <condition_variable>
 #include <deque>
-#include <functional>
+#include <future>
 #include <map>
 #include <mutex>
 #include <sstream>
+#include <string>
 #include <thread>
 #include <vector>
 
+#include "circuit_breaker.h"
 #include "sample.h"
 #include "writer.h"
 
@@ -19,32 +23,114 @@ namespace datadog {
 namespace opentracing {
 
 class Handle;
+class Spool;
+class StatsConcentrator;
 
-// A Writer that manages a thread that sends Traces (collections of Spans) to a
-// Datadog agent.
+// Options for the connections to the agent, and for the requests sent on them. See the
+// corresponding `agent_*` fields of `TracerOptions`. The TCP options have no effect when the agent
+// is reached over a unix domain socket.
+struct AgentConnectionOptions {
+  // How many requests can be sent to the agent at the same time, each on its own connection.
+  std::size_t max_concurrent_requests = 1;
+  // Whether to disable Nagle's algorithm, so that requests are not delayed waiting for the
+  // acknowledgement of a previous segment.
+  bool tcp_nodelay = true;
+  // If positive, how long the connection is idle before keep-alive probes are sent, and the
+  // interval between probes. Zero disables keep-alive probes.
+  long tcp_keepalive_seconds = 0;
+  // If positive, the gzip compression level of trace payloads, where levels above 9 mean 9. Zero
+  // disables compression.
+  int compression_level = 0;
+  // Trace payloads smaller than this many bytes are not compressed.
+  std::size_t compression_min_bytes = 1024;
+  // If not empty, the directory in which to spool trace payloads that could not be sent, so that
+  // they are sent once the agent is available again.
+  std::string spool_directory;
+  // The most disk space that spooled payloads use.
+  std::size_t spool_max_bytes = 100 * 1024 * 1024;
+  // How long to wait between sending spooled payloads, and between attempts to send them while
+  // the agent is unavailable.
+  std::chrono::milliseconds spool_replay_period{100};
+  std::chrono::milliseconds spool_retry_period{5000};
+  // When to stop sending requests to an agent that does not respond, and how long to wait for a
+  // response.
+  CircuitBreakerOptions circuit_breaker;
+  // Pending traces are sent as soon as they contain at least `flush_threshold_spans` spans, or
+  // are estimated to encode to at least `flush_threshold_bytes`, rather than when the write period
+  // passes. Zero disables either threshold.
+  std::size_t flush_threshold_spans = 0;
+  std::size_t flush_threshold_bytes = 1024 * 1024;
+  // While there are no traces to send, the write period doubles each time it passes, up to this
+  // long. A trace that is written restores it.
+  std::chrono::milliseconds max_idle_write_period{8000};
+  // How many threads encode traces. Large batches of traces are split into ranges that are encoded
+  // at the same time, and then joined into one payload.
+  std::size_t encoder_threads = 1;
+  // Each thread that writes traces collects them, and hands them to the writer together once it
+  // has collected this many. Collected traces are also handed over at each write period, by
+  // flushes, and when the thread exits. They count toward the flush thresholds and the maximum
+  // number of queued traces while they are collected, so traces that reach a flush threshold
+  // across all threads are sent early. One means that each trace is handed over when it is
+  // written.
+  std::size_t write_batch_size = 64;
+};
+
+// A Writer that manages threads that send Traces (collections of Spans) to a
+// Datadog agent. One thread encodes the Traces into requests, with the help of a pool of encoder
+// threads for large batches, and each of the other threads sends those requests on its own
+// connection to the agent, so that encoding continues while requests are in flight. Traces are
+// encoded without holding the lock that write() takes. A request that fails is retried once its
+// (jittered) retry period has passed, without holding up the requests queued behind it. While the
+// agent does not respond, a circuit breaker fails requests without sending them.
 class AgentWriter : public Writer {
  public:
   // Creates an AgentWriter that uses curl to send Traces to a Datadog agent. May throw a
-  // runtime_exception.
+  // runtime_exception. If `stats` is not nullptr, then the trace metrics that it computes are
+  // also sent to the agent. Each connection is reused for every request, unless the agent closes
+  // it.
   AgentWriter(std::string host, uint32_t port, std::string unix_socket,
               std::chrono::milliseconds write_period, std::shared_ptr<RulesSampler> sampler,
-              std::shared_ptr<const Logger> logger);
+              std::shared_ptr<const Logger> logger,
+              std::shared_ptr<StatsConcentrator> stats = nullptr,
+              AgentConnectionOptions connection_options = AgentConnectionOptions());
 
+  // Creates an AgentWriter that sends requests using the specified `handle`, so at most one at a
+  // time. The `max_concurrent_requests` of `connection_options` is ignored.
   AgentWriter(std::unique_ptr<Handle> handle, std::chrono::milliseconds write_period,
               size_t max_queued_traces, std::vector<std::chrono::milliseconds> retry_periods,
               std::string host, uint32_t port, std::string unix_socket,
-              std::shared_ptr<RulesSampler> sampler, std::shared_ptr<const Logger> logger);
+              std::shared_ptr<RulesSampler> sampler, std::shared_ptr<const Logger> logger,
+              std::shared_ptr<StatsConcentrator> stats = nullptr,
+              AgentConnectionOptions connection_options = AgentConnectionOptions());
+
+  // Creates an AgentWriter that sends as many requests at the same time as there are `handles`.
+  // The `max_concurrent_requests` of `connection_options` is ignored.
+  AgentWriter(std::vector<std::unique_ptr<Handle>> handles,
+              std::chrono::milliseconds write_period, size_t max_queued_traces,
+              std::vector<std::chrono::milliseconds> retry_periods, std::string host,
+              uint32_t port, std::string unix_socket, std::shared_ptr<RulesSampler> sampler,
+              std::shared_ptr<const Logger> logger,
+              std::shared_ptr<StatsConcentrator> stats = nullptr,
+              AgentConnectionOptions connection_options = AgentConnectionOptions());
 
   // Does not flush on destruction, buffered traces may be lost. Stops all threads.
   ~AgentWriter() override;
 
   void write(TraceData trace) override;
 
+  void writeDropped(uint64_t traces, uint64_t spans) override;
+
   // Send all buffered Traces to the destination now. Will block until sending is complete, or
   // timeout passes.
   void flush(std::chrono::milliseconds timeout) override;
 
-  // Permanently stops writing Traces. Calls to write() and flush() will do nothing.
+  // Send all buffered Traces to the destination now, without blocking. The returned future
+  // becomes true once sending is complete, or false once `deadline` passes or the writer stops.
+  // Until then, requests are not given longer than what remains until `deadline` to complete.
+  std::future<bool> flushAsync(std::chrono::steady_clock::time_point deadline) override;
+
+  // Permanently stops writing Traces. Calls to write() and flush() will do nothing, and pending
+  // flushes become false.
   void stop();
 
   // Default value of `max_queued_traces` in the constructor overload without
@@ -53,44 +139,214 @@ class AgentWriter : public Writer {
   static const size_t default_max_queued_traces = 7000;
 
  private:
+  // A request waiting to be sent to the agent.
+  struct Request {
+    // Either `traces_url_` or `stats_url_`.
+    const std::string *url;
+    std::map<std::string, std::string> headers;
+    std::string payload;
+    // How many times sending this request has failed.
+    std::size_t failures;
+    // The request is not sent before this time.
+    std::chrono::steady_clock::time_point not_before;
+  };
+
+  // Traces, their number of spans and an estimate of their encoded size, and counts of the
+  // traces and spans that the tracer dropped, which are handed to the writer together.
+  struct Batch {
+    std::vector<TraceData> traces;
+    std::size_t spans = 0;
+    std::size_t bytes = 0;
+    uint64_t dropped_traces = 0;
+    uint64_t dropped_spans = 0;
+  };
+
+  // What one thread has written, but not handed to the writer yet.
+  struct StagingBuffer {
+    std::mutex mutex;
+    // nullptr once the writer has stopped. Locked by mutex.
+    AgentWriter *writer;
+    // Locked by mutex.
+    Batch batch;
+  };
+
+  // A range of traces to encode, and their encoding.
+  struct EncodeJob {
+    std::deque<TraceData>::const_iterator first;
+    std::deque<TraceData>::const_iterator last;
+    std::string payload;
+  };
+
+  // A call to flushAsync that has not completed yet.
+  struct Flush {
+    std::chrono::steady_clock::time_point deadline;
+    std::promise<bool> flushed;
+  };
+
+  // A handle used by one sender, and the options that were last set on it and that vary between
+  // requests.
+  struct Connection {
+    std::unique_ptr<Handle> handle;
+    const std::string *url;
+    std::chrono::milliseconds timeout;
+  };
+
   // Initialises the curl handle. May throw a runtime_exception.
   void setUpHandle(std::unique_ptr<Handle> &handle, std::string host, uint32_t port,
-                   std::string unix_socket);
+                   std::string unix_socket, const AgentConnectionOptions &connection_options);
 
-  // Starts asynchronously writing traces. They will be written periodically (set by write_period_)
-  // or when flush() is called manually.
-  void startWriting(std::unique_ptr<Handle> handle);
-  // Posts the given Traces to the Agent. Returns true if it succeeds, otherwise false.
+  // Starts asynchronously writing traces. They will be encoded periodically (set by write_period_)
+  // or when flush() is called manually, and sent using the `handles`.
+  void startWriting(std::vector<std::unique_ptr<Handle>> handles);
+  // Returns the calling thread's staging buffer, or nullptr if the writer has stopped.
+  StagingBuffer *stagingBuffer();
+  // Removes the contents of every staging buffer and returns them. Expects mutex_ not to be
+  // locked.
+  Batch collectStaged();
+  // Adds the traces of the specified `batch` to the pending traces, and its dropped counts to the
+  // encoder. The traces must have been counted in queued_traces_ already. Expects mutex_ not to be
+  // locked.
+  void writeBatch(Batch batch);
+  // Returns whether the specified number of `spans` or `bytes` reach a flush threshold.
+  bool reachesFlushThreshold(std::size_t spans, std::size_t bytes) const;
+  // Returns whether the queued traces have reached a flush threshold, and there is room to queue
+  // them. Expects mutex_ to be locked.
+  bool aboveHighWaterMark() const;
+  // Brings the next write forward to within the write period, if the worker has backed off while
+  // there were no traces. Returns whether it did. Expects mutex_ to be locked.
+  bool shortenIdleWait();
+  // Encodes the pending Traces and trace metrics into requests, and queues them to be sent. The
+  // Traces are left pending if too many requests are queued already, unless `flushing` is true.
+  // Expects `lock` to hold mutex_, and releases it while encoding the Traces.
+  void enqueueRequests(std::unique_lock<std::mutex> &lock, bool flushing);
+  // Returns the payload of a request that contains the specified `traces`, which contain `spans`
+  // spans in total. Splits them between this thread and the encoder threads if there are enough.
+  std::string encode(const std::deque<TraceData> &traces, std::size_t spans);
+  // Encodes jobs from encode_queue_ until the writer is stopped.
+  void encodeJobs();
+  // Completes the flushes that are complete, or whose deadlines have passed, as of `now`. Returns
+  // the earliest deadline of the remaining flushes, or `time_point::max()` if there are none.
+  // Expects mutex_ to be locked.
+  std::chrono::steady_clock::time_point finishFlushes(std::chrono::steady_clock::time_point now);
+  // Sends requests from requests_ using `handle` until the writer is stopped.
+  void sendRequests(std::unique_ptr<Handle> handle);
+  // Compresses the payload of the given request if it is a traces request that is large enough,
+  // and sets its Content-Encoding header accordingly. Does nothing if the request is compressed
+  // already.
+  void compress(Request &request) const;
+  // Sends the oldest payload in spool_ using `connection`. Returns true if the agent responded.
+  // Sets `exhausted` to true if there was no payload to send.
+  bool replaySpooled(Connection &connection, bool &exhausted);
+  // Sends the given request, for which breaker_ returned `decision`, and records the outcome in
+  // breaker_. Returns true if the agent responded, otherwise false.
+  bool sendRequest(Connection &connection, const Request &request,
+                   CircuitBreaker::Decision decision);
+  // Posts the given payload to the Agent. Returns true if it succeeds, otherwise false.
   static bool postTraces(std::unique_ptr<Handle> &handle,
-                         std::map<std::string, std::string> headers, std::string payload,
-                         std::shared_ptr<const Logger> logger);
-  // Retries the given function a finite number of times according to retry_periods_. Retries when
-  // f() returns false.
-  bool retryFiniteOnFail(std::function<bool()> f) const;
+                         const std::map<std::string, std::string> &headers,
+                         const std::string &payload, const std::shared_ptr<const Logger> &logger);
 
   // How often to send Traces.
   const std::chrono::milliseconds write_period_;
   const size_t max_queued_traces_;
   // How long to wait before retrying each time. If empty, only try once.
   const std::vector<std::chrono::milliseconds> retry_periods_;
+  // How many requests can be queued before Traces are left pending in the encoder. Requests
+  // waiting to be retried count towards the limit.
+  const std::size_t max_queued_requests_;
+  // See `AgentConnectionOptions`.
+  const int compression_level_;
+  const std::size_t compression_min_bytes_;
+  const std::chrono::milliseconds spool_replay_period_;
+  const std::chrono::milliseconds spool_retry_period_;
+  const std::size_t flush_threshold_spans_;
+  const std::size_t flush_threshold_bytes_;
+  const std::chrono::milliseconds max_idle_write_period_;
+  const std::size_t encoder_threads_;
+  const std::size_t write_batch_size_;
+  // Identifies this writer in the staging buffers of each thread. Unlike its address, it is not
+  // reused by a later writer.
+  const uint64_t id_;
+  // Decides whether requests are sent, and their timeouts.
+  CircuitBreaker breaker_;
 
-  // The thread on which traces are encoded and send to the agent. Receives traces on the
-  // traces_ queue as notified by condition_. Encodes traces to buffer_ and sends to the
-  // agent.
+  // The thread on which traces are encoded into requests_. Woken by condition_.
   std::unique_ptr<std::thread> worker_ = nullptr;
-  // Locks access to the traces_ queue and the stop_writing_ and flush_worker_ signals.
+  // The threads that send requests_ to the agent, each using its own handle.
+  std::vector<std::thread> senders_;
+  // The threads that help the worker encode large batches of traces. Woken by encode_condition_.
+  std::vector<std::thread> encoders_;
+  // Locks access to encode_queue_, encode_jobs_remaining_ and stop_encoding_.
+  std::mutex encode_mutex_;
+  // Notifies the encoder threads when there are jobs or they should stop, and the worker when the
+  // jobs are done.
+  std::condition_variable encode_condition_;
+  // Jobs for the encoder threads, which belong to the worker. Locked by encode_mutex_.
+  std::vector<EncodeJob *> encode_queue_;
+  // How many of the worker's jobs have not been encoded yet. Locked by encode_mutex_.
+  std::size_t encode_jobs_remaining_ = 0;
+  // If set to true, stops the encoder threads. Locked by encode_mutex_.
+  bool stop_encoding_ = false;
+  // Locks access to the trace encoder, requests_, requests_in_flight_, flushes_ and the
+  // stop_writing_ and flush_worker_ signals.
   mutable std::mutex mutex_;
-  // Notifies worker thread when there are new traces in the queue or it should stop.
+  // Notifies the threads when there are new traces or requests, when a request finishes, or when
+  // they should stop.
   mutable std::condition_variable condition_;
+  // Requests waiting to be sent, including those waiting to be retried. Locked by mutex_.
+  std::deque<Request> requests_;
+  // Whether the worker is encoding traces, which flushes wait for. Locked by mutex_.
+  bool encoding_ = false;
+  // Whether the worker has backed off while there were no traces.
+  std::atomic<bool> idle_{false};
+  // Locks access to staging_buffers_ and staging_stopped_.
+  std::mutex staging_mutex_;
+  // The staging buffers of the threads that have written traces. Each buffer belongs to its
+  // thread, and expires when the thread exits. Locked by staging_mutex_.
+  std::vector<std::weak_ptr<StagingBuffer>> staging_buffers_;
+  // Whether traces written from now on are dropped. Locked by staging_mutex_.
+  bool staging_stopped_ = false;
+  // The number of requests being sent. Locked by mutex_.
+  std::size_t requests_in_flight_ = 0;
+  // Flushes that are waiting for requests_ to be sent. Locked by mutex_.
+  std::vector<Flush> flushes_;
+  // The number of spans in the pending traces, and an estimate of their encoded size. Locked by
+  // mutex_.
+  std::size_t pending_spans_ = 0;
+  std::size_t pending_bytes_ = 0;
+  // The number of traces that have been written but not encoded yet, whether they are pending or
+  // still in a staging buffer, their number of spans, and an estimate of their encoded size. They
+  // are updated with relaxed atomic operations, so that write() can check them against the flush
+  // thresholds and max_queued_traces_ without locking mutex_.
+  std::atomic<std::size_t> queued_traces_{0};
+  std::atomic<std::size_t> queued_spans_{0};
+  std::atomic<std::size_t> queued_bytes_{0};
+  // When the worker next encodes the pending traces, unless it is woken sooner. Locked by mutex_.
+  std::chrono::steady_clock::time_point next_write_;
+  // Trace payloads that were not sent after every retry, or nullptr if spooling is disabled.
+  std::unique_ptr<Spool> spool_;
+  // Whether spool_ might contain payloads, how many payloads have been spooled, whether a spooled
+  // payload is being sent, and when the next one can be sent. Locked by mutex_.
+  bool spool_pending_ = false;
+  uint64_t spool_pushes_ = 0;
+  bool replaying_ = false;
+  std::chrono::steady_clock::time_point next_replay_;
   // These two bools, stop_writing_ and flush_worker_, act as signals. They are the predicates on
   // which the condition_ variable acts.
   // If set to true, stops worker. Locked by mutex_;
   bool stop_writing_ = false;
-  // If set to true, flushes worker (which sets it false again). Locked by mutex_;
+  // If set to true, the worker encodes the pending traces now (and then sets it false again).
+  // Locked by mutex_;
   bool flush_worker_ = false;
   // The logger is used to print diagnostic messages.  The actual mechanism is
   // determined by the `log_func` field of `TracerOptions`.
   std::shared_ptr<const Logger> logger_;
+  // Computes the trace metrics sent to the agent. May be nullptr if the tracer does not compute
+  // trace metrics.
+  std::shared_ptr<StatsConcentrator> stats_;
+  // The agent URLs to which traces and trace metrics are sent.
+  std::string traces_url_;
+  std::string stats_url_;
 };
 
 }  // namespace opentracing
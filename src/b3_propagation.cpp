@@ -0,0 +1,107 @@
+#include "b3_propagation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+#include "parse_util.h"
+
+namespace datadog {
+namespace opentracing {
+namespace {
+
+// Return the specified `id` field, having one of the specified sizes
+// `size_a` or `size_b`.  Throw a `std::invalid_argument` if the field has a
+// different size or is not hexadecimal.
+ot::string_view id_field(ot::string_view id, std::size_t size_a, std::size_t size_b) {
+  if (id.size() != size_a && id.size() != size_b) {
+    throw std::invalid_argument("b3 ID has an unexpected length");
+  }
+  const bool is_hex = std::all_of(id.begin(), id.end(), [](char c) {
+    return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f') || (c >= 'A' && c <= 'F');
+  });
+  if (!is_hex) {
+    throw std::invalid_argument("b3 ID is not hexadecimal");
+  }
+  return id;
+}
+
+// Return the sampling priority of the specified `sampling_state`.  Throw a
+// `std::invalid_argument` if the state is invalid.
+OptionalSamplingPriority parse_sampling_state(ot::string_view sampling_state) {
+  if (sampling_state == "0") {
+    return std::make_unique<SamplingPriority>(SamplingPriority::SamplerDrop);
+  }
+  if (sampling_state == "1") {
+    return std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep);
+  }
+  if (sampling_state == "d") {
+    return std::make_unique<SamplingPriority>(SamplingPriority::UserKeep);
+  }
+  throw std::invalid_argument("b3 sampling state is not \"0\", \"1\", or \"d\"");
+}
+
+}  // namespace
+
+B3Context parseB3(ot::string_view header_value) {
+  const ot::string_view value = trim_ows(header_value);
+  B3Context result;
+  if (value.size() == 1) {
+    result.sampling_priority = parse_sampling_state(value);
+    return result;
+  }
+
+  // Split `value` on "-" into at most four fields.
+  ot::string_view fields[4];
+  std::size_t num_fields = 0;
+  const char* iter = value.begin();
+  const char* const end = value.end();
+  for (;;) {
+    const char* const next = std::find(iter, end, '-');
+    if (num_fields == 4) {
+      throw std::invalid_argument("b3 has too many fields");
+    }
+    fields[num_fields++] = range(iter, next);
+    if (next == end) {
+      break;
+    }
+    iter = next + 1;
+  }
+  if (num_fields < 2) {
+    throw std::invalid_argument("b3 is missing the span ID");
+  }
+
+  uint64_t trace_id_high;
+  parse_hex128(id_field(fields[0], 16, 32), trace_id_high, result.trace_id);
+  result.span_id = parse_uint64(id_field(fields[1], 16, 16), 16);
+  result.ids_set = true;
+  if (num_fields > 2) {
+    result.sampling_priority = parse_sampling_state(fields[2]);
+  }
+  if (num_fields > 3) {
+    // The parent span ID is validated, but otherwise unused.
+    id_field(fields[3], 16, 16);
+  }
+  return result;
+}
+
+ot::string_view formatB3(uint64_t trace_id, uint64_t span_id,
+                         const SamplingPriority* sampling_priority, B3Text& buffer) {
+  IntegerText digits;
+  // Each ID is the low 16 of 32 digits.
+  ot::string_view id = format_hex128(0, trace_id, digits);
+  char* out = std::copy(id.begin() + 16, id.end(), buffer.data());
+  *out++ = '-';
+  id = format_hex128(0, span_id, digits);
+  out = std::copy(id.begin() + 16, id.end(), out);
+  if (sampling_priority != nullptr) {
+    *out++ = '-';
+    *out++ = static_cast<int>(*sampling_priority) > 0 ? '1' : '0';
+  }
+  assert(out <= buffer.data() + buffer.size());
+  return range(buffer.data(), out);
+}
+
+}  // namespace opentracing
+}  // namespace datadog
@@ -0,0 +1,59 @@
+#ifndef DD_OPENTRACING_B3_PROPAGATION_H
+#define DD_OPENTRACING_B3_PROPAGATION_H
+
+// This component provides serialization and deserialization routines for the
+// [single header form][1] of B3 propagation, the "b3" header:
+//
+//     b3: {trace-id}-{span-id}[-{sampling-state}[-{parent-span-id}]]
+//
+// or, for a sampling decision without any IDs:
+//
+//     b3: {sampling-state}
+//
+// The routines operate on `string_view` and do not copy the header's text.
+//
+// [1]: https://github.com/openzipkin/b3-propagation#single-header
+
+#include <opentracing/string_view.h>
+
+#include <array>
+#include <cstdint>
+
+#include "sampling_priority.h"
+
+namespace ot = opentracing;
+
+namespace datadog {
+namespace opentracing {
+
+// `B3Context` is the trace context encoded in a "b3" header.
+struct B3Context {
+  // Whether the header has a trace ID and a span ID.  If not, then it
+  // carries only a sampling decision.
+  bool ids_set = false;
+  // A 128-bit trace ID is truncated to its low 64 bits.
+  uint64_t trace_id = 0;
+  uint64_t span_id = 0;
+  // "0" is `SamplerDrop`, "1" is `SamplerKeep`, and "d" (debug) is
+  // `UserKeep`.  Null if the sampling state is absent.
+  OptionalSamplingPriority sampling_priority;
+};
+
+// Return the trace context parsed from the specified "b3" `header_value`.
+// Throw a `std::invalid_argument` if an error occurs.
+B3Context parseB3(ot::string_view header_value);
+
+// `B3Text` is storage for the text produced by `formatB3`.
+using B3Text = std::array<char, 35>;
+
+// Return the "b3" header value that encodes the specified `trace_id`,
+// `span_id`, and optionally specified `sampling_priority`.  As in the
+// multiple header form, the sampling state is either "0" or "1".  The text is
+// stored in the specified `buffer`.
+ot::string_view formatB3(uint64_t trace_id, uint64_t span_id,
+                         const SamplingPriority *sampling_priority, B3Text &buffer);
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif
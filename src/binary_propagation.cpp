@@ -0,0 +1,193 @@
+#include "binary_propagation.h"
+
+#include <cstddef>
+#include <stdexcept>
+#include <utility>
+
+namespace datadog {
+namespace opentracing {
+
+// A binary encoded span context has the following layout:
+//
+//     marker  version  body size  body
+//     0xdd    0x01     varint     <body size> bytes
+//
+// where the body is:
+//
+//     trace ID           8 bytes, little-endian
+//     parent ID          8 bytes, little-endian
+//     flags              1 byte; bit 0 is set if a sampling priority follows
+//     sampling priority  1 byte, two's complement (if present)
+//     origin             varint size, then bytes
+//     tags               varint size, then bytes ("x-datadog-tags" format)
+//     baggage            varint count, then for each item: varint key size,
+//                        key bytes, varint value size, value bytes
+//
+// A varint is an unsigned integer encoded in little-endian groups of seven
+// bits, where the high bit of each byte is set if another byte follows
+// (i.e. LEB128).
+//
+// Decoders ignore any bytes that follow the baggage within the body, so that
+// fields can be appended to the body without changing the version.
+
+namespace {
+
+const unsigned char version = 1;
+const unsigned char has_sampling_priority_flag = 1;
+// The largest body that a decoder accepts, to bound the memory allocated for
+// hostile input.
+const uint64_t max_body_size = 1 << 20;
+
+void appendFixed64(std::string& destination, uint64_t value) {
+  for (int i = 0; i < 8; ++i) {
+    destination += static_cast<char>(value & 0xff);
+    value >>= 8;
+  }
+}
+
+void appendVarint(std::string& destination, uint64_t value) {
+  while (value >= 0x80) {
+    destination += static_cast<char>((value & 0x7f) | 0x80);
+    value >>= 7;
+  }
+  destination += static_cast<char>(value);
+}
+
+void appendSized(std::string& destination, ot::string_view text) {
+  appendVarint(destination, text.size());
+  destination.append(text.data(), text.size());
+}
+
+// Return a varint whose bytes are obtained by calling the specified
+// `next_byte`.  Throw a `std::invalid_argument` if the varint is longer than
+// 64 bits.
+template <typename NextByte>
+uint64_t decodeVarint(NextByte&& next_byte) {
+  uint64_t value = 0;
+  for (int shift = 0; shift < 64; shift += 7) {
+    const unsigned char next = next_byte();
+    value |= uint64_t(next & 0x7f) << shift;
+    if ((next & 0x80) == 0) {
+      return value;
+    }
+  }
+  throw std::invalid_argument("binary context has a varint that is too long");
+}
+
+// `Decoder` consumes bytes from the front of a body.  Its member functions
+// throw a `std::invalid_argument` if the body ends prematurely.
+class Decoder {
+ public:
+  explicit Decoder(ot::string_view body) : iter_(body.begin()), end_(body.end()) {}
+
+  unsigned char byte() {
+    if (iter_ == end_) {
+      throw std::invalid_argument("binary context is truncated");
+    }
+    return static_cast<unsigned char>(*iter_++);
+  }
+
+  uint64_t fixed64() {
+    uint64_t value = 0;
+    for (int i = 0; i < 8; ++i) {
+      value |= uint64_t(byte()) << (8 * i);
+    }
+    return value;
+  }
+
+  uint64_t varint() { return decodeVarint([this]() { return byte(); }); }
+
+  std::string sized() {
+    const uint64_t size = varint();
+    if (size > uint64_t(end_ - iter_)) {
+      throw std::invalid_argument("binary context is truncated");
+    }
+    std::string result(iter_, std::size_t(size));
+    iter_ += size;
+    return result;
+  }
+
+ private:
+  const char* iter_;
+  const char* const end_;
+};
+
+// Return the next byte from the specified `reader`.  Throw a
+// `std::invalid_argument` if there are no more bytes.
+unsigned char readByte(std::istream& reader) {
+  const auto next = reader.get();
+  if (next == std::istream::traits_type::eof()) {
+    throw std::invalid_argument("binary context is truncated");
+  }
+  return static_cast<unsigned char>(next);
+}
+
+}  // namespace
+
+void encodeBinaryContext(std::string& destination, uint64_t trace_id, uint64_t parent_id,
+                         const SamplingPriority* sampling_priority, ot::string_view origin,
+                         ot::string_view serialized_tags,
+                         const std::unordered_map<std::string, std::string>& baggage) {
+  std::string body;
+  appendFixed64(body, trace_id);
+  appendFixed64(body, parent_id);
+  if (sampling_priority != nullptr) {
+    body += static_cast<char>(has_sampling_priority_flag);
+    body += static_cast<char>(static_cast<int>(*sampling_priority));
+  } else {
+    body += '\0';
+  }
+  appendSized(body, origin);
+  appendSized(body, serialized_tags);
+  appendVarint(body, baggage.size());
+  for (const auto& item : baggage) {
+    appendSized(body, item.first);
+    appendSized(body, item.second);
+  }
+
+  destination += static_cast<char>(binary_context_marker);
+  destination += static_cast<char>(version);
+  appendVarint(destination, body.size());
+  destination += body;
+}
+
+BinaryContext readBinaryContext(std::istream& reader) {
+  if (readByte(reader) != binary_context_marker) {
+    throw std::invalid_argument("binary context does not begin with the expected marker");
+  }
+  if (readByte(reader) != version) {
+    throw std::invalid_argument("binary context has an unsupported version");
+  }
+  const uint64_t body_size = decodeVarint([&reader]() { return readByte(reader); });
+  if (body_size > max_body_size) {
+    throw std::invalid_argument("binary context is too large");
+  }
+
+  std::string body(std::size_t(body_size), '\0');
+  reader.read(&body[0], std::streamsize(body_size));
+  if (uint64_t(reader.gcount()) != body_size) {
+    throw std::invalid_argument("binary context is truncated");
+  }
+
+  Decoder decoder{body};
+  BinaryContext result;
+  result.trace_id = decoder.fixed64();
+  result.parent_id = decoder.fixed64();
+  if ((decoder.byte() & has_sampling_priority_flag) != 0) {
+    result.sampling_priority = asSamplingPriority(static_cast<signed char>(decoder.byte()));
+    if (result.sampling_priority == nullptr) {
+      throw std::invalid_argument("binary context has an invalid sampling priority");
+    }
+  }
+  result.origin = decoder.sized();
+  result.serialized_tags = decoder.sized();
+  const uint64_t baggage_size = decoder.varint();
+  for (uint64_t i = 0; i < baggage_size; ++i) {
+    std::string key = decoder.sized();
+    result.baggage[std::move(key)] = decoder.sized();
+  }
+  return result;
+}
+
+}  // namespace opentracing
+}  // namespace datadog
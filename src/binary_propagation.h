@@ -0,0 +1,59 @@
+#ifndef DD_OPENTRACING_BINARY_PROPAGATION_H
+#define DD_OPENTRACING_BINARY_PROPAGATION_H
+
+// This component provides serialization and deserialization routines for a
+// compact binary encoding of span context, which is an alternative to JSON
+// for the `std::ostream`/`std::istream` carriers.  The format is described in
+// the cpp file.
+//
+// The first byte of an encoded context is `binary_context_marker`, which
+// cannot begin a JSON document, so that a reader can tell the two encodings
+// apart.
+
+#include <opentracing/string_view.h>
+
+#include <cstdint>
+#include <istream>
+#include <string>
+#include <unordered_map>
+
+#include "sampling_priority.h"
+
+namespace ot = opentracing;
+
+namespace datadog {
+namespace opentracing {
+
+const unsigned char binary_context_marker = 0xdd;
+
+// `BinaryContext` is the span context encoded in the binary format.
+struct BinaryContext {
+  uint64_t trace_id = 0;
+  uint64_t parent_id = 0;
+  // Null if the encoding has no sampling priority.
+  OptionalSamplingPriority sampling_priority;
+  std::string origin;
+  // The trace tags, in the "x-datadog-tags" format.
+  std::string serialized_tags;
+  std::unordered_map<std::string, std::string> baggage;
+};
+
+// Append to the specified `destination` the binary encoding of a span
+// context having the specified `trace_id`, `parent_id`, optionally specified
+// `sampling_priority`, `origin`, `serialized_tags` (in the "x-datadog-tags"
+// format), and `baggage`.
+void encodeBinaryContext(std::string &destination, uint64_t trace_id, uint64_t parent_id,
+                         const SamplingPriority *sampling_priority, ot::string_view origin,
+                         ot::string_view serialized_tags,
+                         const std::unordered_map<std::string, std::string> &baggage);
+
+// Read from the specified `reader` a binary encoded span context, and return
+// it.  Read no further than the end of the encoding.  Throw a
+// `std::invalid_argument` if the encoding is malformed or truncated, or if
+// its version is not supported.
+BinaryContext readBinaryContext(std::istream &reader);
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif
@@ -0,0 +1,111 @@
+#include "circuit_breaker.h"
+
+#include <algorithm>
+#include <cmath>
+
+namespace datadog {
+namespace opentracing {
+
+namespace {
+// The timeout doubles after each consecutive timeout, up to this multiple.
+const int max_timeout_multiplier = 64;
+}  // namespace
+
+CircuitBreaker::CircuitBreaker(TimeProvider now_func, CircuitBreakerOptions options)
+    : now_func_(now_func),
+      options_(options),
+      random_(std::random_device{}()),
+      open_period_(options.min_open_period) {}
+
+CircuitBreaker::Decision CircuitBreaker::allow() {
+  auto now = now_func_().relative_time;
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (!open_) {
+    return Decision::send;
+  }
+  if (probing_ || now < probe_time_) {
+    return Decision::reject;
+  }
+  probing_ = true;
+  return Decision::probe;
+}
+
+void CircuitBreaker::recordResponse(Decision decision,
+                                    std::chrono::steady_clock::duration latency) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  // Any response shows that the agent is available again, even one to a request that was sent
+  // before the breaker opened.
+  consecutive_failures_ = 0;
+  open_ = false;
+  if (decision == Decision::probe) {
+    probing_ = false;
+  }
+  open_period_ = options_.min_open_period;
+  timeout_multiplier_ = 1;
+
+  const double sample =
+      double(std::chrono::duration_cast<std::chrono::microseconds>(latency).count());
+  if (latency_ < 0) {
+    latency_ = sample;
+    latency_deviation_ = sample / 2;
+  } else {
+    latency_deviation_ = 0.75 * latency_deviation_ + 0.25 * std::abs(latency_ - sample);
+    latency_ = 0.875 * latency_ + 0.125 * sample;
+  }
+}
+
+void CircuitBreaker::recordFailure(Decision decision, bool timed_out) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (timed_out) {
+    timeout_multiplier_ = std::min(2 * timeout_multiplier_, max_timeout_multiplier);
+  }
+  ++consecutive_failures_;
+  if (decision == Decision::probe) {
+    probing_ = false;
+    open_period_ = std::min(2 * open_period_, options_.max_open_period);
+    backOff();
+  } else if (!open_ && options_.failure_threshold != 0 &&
+             consecutive_failures_ >= options_.failure_threshold) {
+    open_ = true;
+    open_period_ = options_.min_open_period;
+    backOff();
+  }
+}
+
+bool CircuitBreaker::open() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return open_;
+}
+
+std::chrono::steady_clock::time_point CircuitBreaker::probeTime() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return probe_time_;
+}
+
+std::chrono::milliseconds CircuitBreaker::timeout() const {
+  std::lock_guard<std::mutex> lock{mutex_};
+  if (latency_ < 0) {
+    return options_.max_timeout;
+  }
+  const double timeout_us = (latency_ + 4 * latency_deviation_) * timeout_multiplier_;
+  const auto timeout = std::chrono::milliseconds(std::llround(timeout_us / 1000));
+  return std::max(options_.min_timeout, std::min(timeout, options_.max_timeout));
+}
+
+std::chrono::milliseconds CircuitBreaker::jitter(std::chrono::milliseconds period) {
+  std::lock_guard<std::mutex> lock{mutex_};
+  return jitterLocked(period);
+}
+
+void CircuitBreaker::backOff() {
+  probe_time_ = now_func_().relative_time + jitterLocked(open_period_);
+}
+
+std::chrono::milliseconds CircuitBreaker::jitterLocked(std::chrono::milliseconds period) {
+  const auto count = period.count();
+  std::uniform_int_distribution<decltype(period.count())> distribution(count - count / 2, count);
+  return std::chrono::milliseconds(distribution(random_));
+}
+
+}  // namespace opentracing
+}  // namespace datadog
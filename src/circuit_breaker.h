@@ -0,0 +1,112 @@
+#ifndef DD_OPENTRACING_CIRCUIT_BREAKER_H
+#define DD_OPENTRACING_CIRCUIT_BREAKER_H
+
+// This component decides when `AgentWriter` sends requests to the agent, and
+// how long it waits for a response, based on how the agent has responded so
+// far.
+//
+// While the agent responds, the breaker is "closed" and every request is
+// sent.  After several consecutive requests get no response, the breaker
+// "opens": requests fail immediately instead of each waiting for a timeout.
+// Once a backoff period has passed, one small "probe" request is sent.  If
+// the agent responds, the breaker closes.  Otherwise it stays open for twice
+// as long (up to a limit).  Backoff periods are jittered, so that tracers
+// that lost the same agent do not all probe it at the same moment.
+//
+// If so configured, the timeout of each request adapts to the latency of the
+// agent's recent responses, the way TCP computes its retransmission timeout:
+// it is the smoothed latency plus four times its smoothed deviation, doubled
+// after each timeout, and kept within configured bounds.  The latency of
+// small requests says little about how long a large trace payload takes, so
+// by default the timeout does not adapt.
+
+#include <chrono>
+#include <cstddef>
+#include <mutex>
+#include <random>
+
+#include "clock.h"
+
+namespace datadog {
+namespace opentracing {
+
+struct CircuitBreakerOptions {
+  // The breaker opens after this many consecutive requests get no response.
+  // Zero means that it never opens.
+  std::size_t failure_threshold = 5;
+  // How long the breaker stays open before the first probe.  The period
+  // doubles after each probe that fails, up to `max_open_period`.
+  std::chrono::milliseconds min_open_period{1000};
+  std::chrono::milliseconds max_open_period{60000};
+  // The bounds of the request timeout.  The timeout is `max_timeout` until
+  // the agent has responded.  If they are equal, the timeout does not adapt.
+  std::chrono::milliseconds min_timeout{2000};
+  std::chrono::milliseconds max_timeout{2000};
+};
+
+// A thread-safe circuit breaker for the requests sent to the agent.
+class CircuitBreaker {
+ public:
+  // What to do with a request.
+  enum class Decision {
+    // Send the request.
+    send,
+    // Don't send the request yet. Send a probe instead.
+    probe,
+    // Don't send the request; the agent is unavailable.
+    reject
+  };
+
+  CircuitBreaker(TimeProvider now_func, CircuitBreakerOptions options);
+
+  // Return what to do with a request now.  While the breaker is open,
+  // `probe` is returned to one caller once the backoff period has passed.
+  // Other callers are rejected until that caller records the probe's
+  // outcome.
+  Decision allow();
+  // Record that the agent responded, after the specified `latency`, to a
+  // request for which `allow` returned the specified `decision`.
+  void recordResponse(Decision decision, std::chrono::steady_clock::duration latency);
+  // Record that the agent did not respond to a request for which `allow`
+  // returned the specified `decision`.  `timed_out` is whether the request
+  // took as long as the timeout.
+  void recordFailure(Decision decision, bool timed_out);
+
+  // Return whether the breaker is open.
+  bool open() const;
+  // Return when the breaker next allows a probe.  Only meaningful while the
+  // breaker is open.
+  std::chrono::steady_clock::time_point probeTime() const;
+  // Return the timeout for the next request.
+  std::chrono::milliseconds timeout() const;
+  // Return the specified `period` shortened by a random amount of up to
+  // half of it.
+  std::chrono::milliseconds jitter(std::chrono::milliseconds period);
+
+ private:
+  // Start a backoff period of `open_period_`. Expects mutex_ to be locked.
+  void backOff();
+  std::chrono::milliseconds jitterLocked(std::chrono::milliseconds period);
+
+  const TimeProvider now_func_;
+  const CircuitBreakerOptions options_;
+
+  mutable std::mutex mutex_;
+  std::mt19937_64 random_;
+  std::size_t consecutive_failures_ = 0;
+  bool open_ = false;
+  bool probing_ = false;
+  std::chrono::milliseconds open_period_;
+  std::chrono::steady_clock::time_point probe_time_;
+  // The smoothed latency and its smoothed deviation, in microseconds, or
+  // negative if the agent has not responded yet.
+  double latency_ = -1;
+  double latency_deviation_ = 0;
+  // Doubles after each timeout, and is reset by a response.
+  int timeout_multiplier_ = 1;
+};
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif  // DD_OPENTRACING_CIRCUIT_BREAKER_H
@@ -0,0 +1,47 @@
+#include "compression.h"
+
+#include <zlib.h>
+
+#include <limits>
+
+namespace datadog {
+namespace opentracing {
+
+namespace {
+
+// Adding 16 to the base two logarithm of the window size selects the gzip
+// format rather than the zlib format.
+const int gzip_window_bits = 15 + 16;
+const int memory_level = 8;
+
+}  // namespace
+
+bool gzipCompress(const std::string& input, int level, std::string& output) {
+  if (level < min_compression_level || level > max_compression_level) {
+    return false;
+  }
+  z_stream stream{};
+  if (deflateInit2(&stream, level, Z_DEFLATED, gzip_window_bits, memory_level,
+                   Z_DEFAULT_STRATEGY) != Z_OK) {
+    return false;
+  }
+  // Size the output for the worst case, so that the whole payload is
+  // compressed by a single call.
+  const uLong bound = deflateBound(&stream, uLong(input.size()));
+  if (bound > std::numeric_limits<uInt>::max()) {
+    deflateEnd(&stream);
+    return false;
+  }
+  output.resize(bound);
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(input.data()));
+  stream.avail_in = uInt(input.size());
+  stream.next_out = reinterpret_cast<Bytef*>(&output[0]);
+  stream.avail_out = uInt(output.size());
+  const int result = deflate(&stream, Z_FINISH);
+  output.resize(stream.total_out);
+  deflateEnd(&stream);
+  return result == Z_STREAM_END;
+}
+
+}  // namespace opentracing
+}  // namespace datadog
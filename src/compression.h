@@ -0,0 +1,29 @@
+#ifndef DD_OPENTRACING_COMPRESSION_H
+#define DD_OPENTRACING_COMPRESSION_H
+
+// This component provides compression of the payloads that `AgentWriter`
+// sends to the agent.  Encoded traces repeat the same service names,
+// resources, tag keys and so on in every span, and so compress well.  The
+// agent accepts a payload compressed in the gzip format when the request has
+// the header "Content-Encoding: gzip".
+
+#include <string>
+
+namespace datadog {
+namespace opentracing {
+
+// The lowest and highest compression levels accepted by `gzipCompress`.
+// Higher levels produce smaller output, but take longer.
+const int min_compression_level = 1;
+const int max_compression_level = 9;
+
+// Compress the specified `input` in the gzip format at the specified
+// `level`, and store the result in the specified `output`.  Return true on
+// success, or return false if `level` is out of range or if compression
+// fails, in which case `output` is unspecified.
+bool gzipCompress(const std::string& input, int level, std::string& output);
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif
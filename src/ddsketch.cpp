@@ -0,0 +1,153 @@
+#include "ddsketch.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+
+namespace datadog {
+namespace opentracing {
+namespace {
+
+// The following functions append protobuf wire format elements to a string.
+// See <https://developers.google.com/protocol-buffers/docs/encoding>.
+
+enum WireType { varint = 0, fixed64 = 1, length_delimited = 2 };
+
+void appendVarint(std::string& destination, uint64_t value) {
+  while (value >= 0x80) {
+    destination.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  destination.push_back(static_cast<char>(value));
+}
+
+void appendKey(std::string& destination, int field, WireType type) {
+  appendVarint(destination, (static_cast<uint64_t>(field) << 3) | type);
+}
+
+void appendDouble(std::string& destination, double value) {
+  uint64_t bits;
+  std::memcpy(&bits, &value, sizeof bits);
+  for (int i = 0; i < 8; ++i) {
+    destination.push_back(static_cast<char>(bits & 0xff));
+    bits >>= 8;
+  }
+}
+
+void appendDoubleField(std::string& destination, int field, double value) {
+  appendKey(destination, field, fixed64);
+  appendDouble(destination, value);
+}
+
+void appendMessageField(std::string& destination, int field, const std::string& message) {
+  appendKey(destination, field, length_delimited);
+  appendVarint(destination, message.size());
+  destination += message;
+}
+
+uint64_t zigzag(int64_t value) {
+  return (static_cast<uint64_t>(value) << 1) ^ static_cast<uint64_t>(value >> 63);
+}
+
+}  // namespace
+
+constexpr double DDSketch::default_relative_accuracy;
+
+DDSketch::DDSketch(double relative_accuracy)
+    : gamma_((1 + relative_accuracy) / (1 - relative_accuracy)),
+      multiplier_(1 / std::log(gamma_)),
+      // Below this, indices would overflow `int`.
+      min_indexable_value_(std::max(std::exp((std::numeric_limits<int>::min() + 1) / multiplier_),
+                                    std::numeric_limits<double>::min() * gamma_)) {}
+
+int DDSketch::index(double value) const {
+  return static_cast<int>(std::ceil(std::log(value) * multiplier_));
+}
+
+double DDSketch::value(int index) const {
+  // The midpoint, in relative terms, of the values mapped to `index`.
+  return std::pow(gamma_, index) * 2 / (1 + gamma_);
+}
+
+void DDSketch::add(double value) {
+  ++count_;
+  if (!(value >= min_indexable_value_)) {
+    ++zero_count_;
+    return;
+  }
+
+  const int i = index(value);
+  if (bins_.empty()) {
+    offset_ = i;
+    bins_.push_back(0);
+  } else if (i < offset_) {
+    bins_.insert(bins_.begin(), offset_ - i, 0);
+    offset_ = i;
+  } else if (i - offset_ >= static_cast<int>(bins_.size())) {
+    bins_.resize(i - offset_ + 1, 0);
+  }
+  ++bins_[i - offset_];
+}
+
+uint64_t DDSketch::count() const { return count_; }
+
+double DDSketch::quantile(double quantile) const {
+  if (count_ == 0) {
+    return 0;
+  }
+
+  const double rank = quantile * (count_ - 1);
+  double seen = zero_count_;
+  if (seen > rank) {
+    return 0;
+  }
+  for (std::size_t i = 0; i < bins_.size(); ++i) {
+    seen += bins_[i];
+    if (seen > rank) {
+      return value(offset_ + static_cast<int>(i));
+    }
+  }
+  return value(offset_ + static_cast<int>(bins_.size()) - 1);
+}
+
+void DDSketch::encode(std::string& destination) const {
+  // message IndexMapping {
+  //   double gamma = 1;
+  //   double indexOffset = 2;
+  //   Interpolation interpolation = 3;  // NONE, i.e. logarithmic
+  // }
+  std::string mapping;
+  appendDoubleField(mapping, 1, gamma_);
+
+  // message Store {
+  //   map<sint32, double> binCounts = 1;
+  //   repeated double contiguousBinCounts = 2 [packed = true];
+  //   sint32 contiguousBinIndexOffset = 3;
+  // }
+  std::string store;
+  if (!bins_.empty()) {
+    std::string counts;
+    for (const uint64_t count : bins_) {
+      appendDouble(counts, static_cast<double>(count));
+    }
+    appendMessageField(store, 2, counts);
+    appendKey(store, 3, varint);
+    appendVarint(store, zigzag(offset_));
+  }
+
+  // message DDSketch {
+  //   IndexMapping mapping = 1;
+  //   Store positiveValues = 2;
+  //   Store negativeValues = 3;
+  //   double zeroCount = 4;
+  // }
+  appendMessageField(destination, 1, mapping);
+  appendMessageField(destination, 2, store);
+  if (zero_count_ != 0) {
+    appendDoubleField(destination, 4, static_cast<double>(zero_count_));
+  }
+}
+
+}  // namespace opentracing
+}  // namespace datadog
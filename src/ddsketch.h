@@ -0,0 +1,61 @@
+#ifndef DD_OPENTRACING_DDSKETCH_H
+#define DD_OPENTRACING_DDSKETCH_H
+
+// This component provides a `DDSketch`, a quantile sketch having relative
+// error guarantees.  Client-side stats (see `stats_concentrator.h`) use
+// sketches to summarize span durations.
+//
+// A sketch maps each positive value `v` to the index `ceil(log(v) /
+// log(gamma))`, where `gamma = (1 + alpha) / (1 - alpha)` for the relative
+// accuracy `alpha`, and counts the values mapped to each index.  Any value
+// inferred from a bin is within `alpha` of the values counted in it.  See
+// <https://arxiv.org/abs/1908.10693>.
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace datadog {
+namespace opentracing {
+
+class DDSketch {
+ public:
+  // The relative accuracy used by the Datadog Agent for span durations.
+  static constexpr double default_relative_accuracy = 0.01;
+
+  explicit DDSketch(double relative_accuracy = default_relative_accuracy);
+
+  // Count the specified `value`.  Values too small to be indexed, including
+  // zero and negative values, are counted as zero.
+  void add(double value);
+
+  // Return the number of values added to this sketch.
+  uint64_t count() const;
+
+  // Return an estimate of the specified `quantile` (between 0 and 1) of the
+  // values added to this sketch, or return zero if the sketch is empty.
+  double quantile(double quantile) const;
+
+  // Append to the specified `destination` the protobuf encoding of this
+  // sketch, as defined by the "DDSketch" message of the sketches-go library.
+  // This is the encoding expected by the Datadog Agent in stats payloads.
+  void encode(std::string& destination) const;
+
+ private:
+  int index(double value) const;
+  double value(int index) const;
+
+  double gamma_;
+  double multiplier_;
+  double min_indexable_value_;
+  // `bins_[i]` is the count of index `offset_ + i`.
+  std::vector<uint64_t> bins_;
+  int offset_ = 0;
+  uint64_t zero_count_ = 0;
+  uint64_t count_ = 0;
+};
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif
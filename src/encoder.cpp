@@ -20,6 +20,9 @@ const std::string header_dd_meta_lang = "Datadog-Meta-Lang";
 const std::string header_dd_meta_lang_version = "Datadog-Meta-Lang-Version";
 const std::string header_dd_meta_tracer_version = "Datadog-Meta-Tracer-Version";
 const std::string header_dd_trace_count = "X-Datadog-Trace-Count";
+const std::string header_dd_client_computed_stats = "Datadog-Client-Computed-Stats";
+const std::string header_dd_client_dropped_p0_traces = "Datadog-Client-Dropped-P0-Traces";
+const std::string header_dd_client_dropped_p0_spans = "Datadog-Client-Dropped-P0-Spans";
 
 const size_t RESPONSE_ERROR_REGION_SIZE = 50;
 }  // namespace
@@ -38,16 +41,81 @@ const std::string agent_api_path = "/v0.4/traces";
 
 const std::string& AgentHttpEncoder::path() { return agent_api_path; }
 
-void AgentHttpEncoder::clearTraces() { traces_.clear(); }
+void AgentHttpEncoder::clearTraces() {
+  traces_.clear();
+  dropped_traces_ = 0;
+  dropped_spans_ = 0;
+}
 
 std::size_t AgentHttpEncoder::pendingTraces() { return traces_.size(); }
 
 const std::map<std::string, std::string> AgentHttpEncoder::headers() {
   std::map<std::string, std::string> headers(common_headers_);
   headers[header_dd_trace_count] = std::to_string(traces_.size());
+  if (client_computed_stats_) {
+    headers[header_dd_client_computed_stats] = "yes";
+    headers[header_dd_client_dropped_p0_traces] = std::to_string(dropped_traces_);
+    headers[header_dd_client_dropped_p0_spans] = std::to_string(dropped_spans_);
+  }
   return headers;
 }
 
+const std::string agent_stats_path = "/v0.6/stats";
+
+void AgentHttpEncoder::setClientComputedStats() { client_computed_stats_ = true; }
+
+void AgentHttpEncoder::addDropped(uint64_t traces, uint64_t spans) {
+  dropped_traces_ += traces;
+  dropped_spans_ += spans;
+}
+
+bool AgentHttpEncoder::hasDropped() const { return dropped_traces_ != 0 || dropped_spans_ != 0; }
+
+const std::string& AgentHttpEncoder::statsPath() { return agent_stats_path; }
+
+const std::map<std::string, std::string> AgentHttpEncoder::statsHeaders() {
+  return common_headers_;
+}
+
+const std::map<std::string, std::string> AgentHttpEncoder::probeHeaders() {
+  std::map<std::string, std::string> headers(common_headers_);
+  headers[header_dd_trace_count] = "0";
+  if (client_computed_stats_) {
+    headers[header_dd_client_computed_stats] = "yes";
+    headers[header_dd_client_dropped_p0_traces] = "0";
+    headers[header_dd_client_dropped_p0_spans] = "0";
+  }
+  return headers;
+}
+
+const std::string AgentHttpEncoder::probePayload() {
+  std::stringstream buffer;
+  msgpack::pack(buffer, std::deque<TraceData>{});
+  return buffer.str();
+}
+
+std::deque<TraceData> AgentHttpEncoder::takeTraces() {
+  std::deque<TraceData> traces;
+  traces.swap(traces_);
+  clearTraces();
+  return traces;
+}
+
+std::string AgentHttpEncoder::encodeArrayHeader(std::size_t size) {
+  msgpack::sbuffer buffer;
+  msgpack::packer<msgpack::sbuffer>(buffer).pack_array(uint32_t(size));
+  return std::string(buffer.data(), buffer.size());
+}
+
+std::string AgentHttpEncoder::encodeTraces(std::deque<TraceData>::const_iterator first,
+                                           std::deque<TraceData>::const_iterator last) {
+  msgpack::sbuffer buffer;
+  for (; first != last; ++first) {
+    msgpack::pack(buffer, *first);
+  }
+  return std::string(buffer.data(), buffer.size());
+}
+
 const std::string AgentHttpEncoder::payload() {
   buffer_.clear();
   buffer_.str(std::string{});
@@ -59,12 +127,17 @@ void AgentHttpEncoder::addTrace(TraceData trace) { traces_.push_back(std::move(t
 
 void AgentHttpEncoder::handleResponse(const std::string& response) {
   if (sampler_ != nullptr) {
+    const std::size_t hash = std::hash<std::string>{}(response);
+    if (hash == last_response_hash_) {
+      return;  // The sampler is already configured with this response.
+    }
     try {
       json config = json::parse(response);
-      if (config.find(priority_sampling_key) == config.end()) {
-        return;  // No priority sampling info.
+      // Responses without priority sampling info leave the sampler as it is.
+      if (config.find(priority_sampling_key) != config.end()) {
+        sampler_->updatePrioritySampler(config[priority_sampling_key]);
       }
-      sampler_->updatePrioritySampler(config[priority_sampling_key]);
+      last_response_hash_ = hash;
     } catch (const json::parse_error& error) {
       size_t start = (error.byte > (RESPONSE_ERROR_REGION_SIZE / 2))
                          ? error.byte - (RESPONSE_ERROR_REGION_SIZE / 2)
@@ -3,6 +3,7 @@
 
 #include <datadog/opentracing.h>
 
+#include <atomic>
 #include <deque>
 #include <memory>
 #include <sstream>
@@ -31,15 +32,49 @@ class AgentHttpEncoder : public TraceEncoder {
   const std::string payload() override;
   void handleResponse(const std::string& response) override;
   void addTrace(TraceData trace);
+  // Removes the pending traces and returns them, so that they can be encoded elsewhere. Also
+  // clears what `clearTraces` clears, so call `headers` first.
+  std::deque<TraceData> takeTraces();
+
+  // A payload is the encoding of the header of an array of its traces, followed by the encoding of
+  // each trace. These encode the parts of a payload separately, so that consecutive ranges of
+  // traces can be encoded at the same time.
+  static std::string encodeArrayHeader(std::size_t size);
+  static std::string encodeTraces(std::deque<TraceData>::const_iterator first,
+                                  std::deque<TraceData>::const_iterator last);
+
+  // Indicate in the headers of trace requests that trace metrics are computed
+  // by the tracer (see `stats_concentrator.h`), so that the agent does not
+  // compute them from the traces.
+  void setClientComputedStats();
+  // Count the specified number of `traces` and `spans` that the tracer
+  // dropped, for the headers of the next request.
+  void addDropped(uint64_t traces, uint64_t spans);
+  // Returns whether there are dropped traces or spans to count in the next request.
+  bool hasDropped() const;
+  // Returns the path that is used to submit trace metrics to the agent.
+  const std::string& statsPath();
+  // Returns the HTTP headers that are required for a trace metrics payload.
+  const std::map<std::string, std::string> statsHeaders();
+  // Returns the HTTP headers and the payload of a request that contains no traces, which is sent
+  // to check that the agent is available. The pending traces are not affected.
+  const std::map<std::string, std::string> probeHeaders();
+  const std::string probePayload();
 
  private:
   // Holds the headers that are used for all HTTP requests.
   std::map<std::string, std::string> common_headers_;
+  bool client_computed_stats_ = false;
+  uint64_t dropped_traces_ = 0;
+  uint64_t dropped_spans_ = 0;
   std::deque<TraceData> traces_;
   std::stringstream buffer_;
   // Responses from the Agent may contain configuration for the sampler. May be nullptr if priority
   // sampling is not enabled.
   std::shared_ptr<RulesSampler> sampler_ = nullptr;
+  // The hash of the last response that was parsed successfully. The agent sends the same response
+  // until its rates change, so a response with the same hash is not parsed again.
+  std::atomic<std::size_t> last_response_hash_{0};
   // The logger is used to print diagnostic messages.  The actual mechanism is
   // determined by the `log_func` field of `TracerOptions`.
   std::shared_ptr<const Logger> logger_;
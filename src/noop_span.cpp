@@ -0,0 +1,42 @@
+#include "noop_span.h"
+
+#include "tracer.h"
+
+namespace datadog {
+namespace opentracing {
+
+NoopSpan::NoopSpan(std::shared_ptr<const Tracer> tracer, SpanContext context)
+    : tracer_(std::move(tracer)), context_(std::move(context)) {}
+
+void NoopSpan::FinishWithOptions(
+    const ot::FinishSpanOptions & /* finish_span_options */) noexcept {}
+
+void NoopSpan::SetOperationName(ot::string_view /* name */) noexcept {}
+
+void NoopSpan::SetTag(ot::string_view /* key */, const ot::Value & /* value */) noexcept {}
+
+void NoopSpan::SetBaggageItem(ot::string_view restricted_key, ot::string_view value) noexcept {
+  context_.setBaggageItem(restricted_key, value);
+}
+
+std::string NoopSpan::BaggageItem(ot::string_view restricted_key) const noexcept {
+  return context_.baggageItem(restricted_key);
+}
+
+void NoopSpan::Log(
+    std::initializer_list<std::pair<ot::string_view, ot::Value>> /* fields */) noexcept {}
+
+void NoopSpan::Log(
+    ot::SystemTime /* timestamp */,
+    std::initializer_list<std::pair<ot::string_view, ot::Value>> /* fields */) noexcept {}
+
+void NoopSpan::Log(
+    ot::SystemTime /* timestamp */,
+    const std::vector<std::pair<ot::string_view, ot::Value>> & /* fields */) noexcept {}
+
+const ot::SpanContext &NoopSpan::context() const noexcept { return context_; }
+
+const ot::Tracer &NoopSpan::tracer() const noexcept { return *tracer_; }
+
+}  // namespace opentracing
+}  // namespace datadog
@@ -0,0 +1,58 @@
+#ifndef DD_OPENTRACING_NOOP_SPAN_H
+#define DD_OPENTRACING_NOOP_SPAN_H
+
+#include <opentracing/span.h>
+
+#include <memory>
+
+#include "span_context.h"
+
+namespace ot = opentracing;
+
+namespace datadog {
+namespace opentracing {
+
+class Tracer;
+
+// A `NoopSpan` is a span belonging to a trace that was dropped when its local
+// root span started (see `TracerOptions::early_trace_drop`).  It records no
+// tags, logs, or timings, and is never sent to the agent.  Its context still
+// carries the trace's sampling decision and baggage, so that injecting it, or
+// starting child spans from it, propagates the dropped trace downstream.
+class NoopSpan : public ot::Span {
+ public:
+  NoopSpan(std::shared_ptr<const Tracer> tracer, SpanContext context);
+
+  NoopSpan() = delete;
+
+  void FinishWithOptions(const ot::FinishSpanOptions &finish_span_options) noexcept override;
+
+  void SetOperationName(ot::string_view name) noexcept override;
+
+  void SetTag(ot::string_view key, const ot::Value &value) noexcept override;
+
+  void SetBaggageItem(ot::string_view restricted_key, ot::string_view value) noexcept override;
+
+  std::string BaggageItem(ot::string_view restricted_key) const noexcept override;
+
+  void Log(std::initializer_list<std::pair<ot::string_view, ot::Value>> fields) noexcept override;
+
+  void Log(ot::SystemTime timestamp,
+           std::initializer_list<std::pair<ot::string_view, ot::Value>> fields) noexcept override;
+
+  void Log(ot::SystemTime timestamp,
+           const std::vector<std::pair<ot::string_view, ot::Value>> &fields) noexcept override;
+
+  const ot::SpanContext &context() const noexcept override;
+
+  const ot::Tracer &tracer() const noexcept override;
+
+ private:
+  std::shared_ptr<const Tracer> tracer_;
+  SpanContext context_;
+};
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif  // DD_OPENTRACING_NOOP_SPAN_H
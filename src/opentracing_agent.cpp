@@ -5,11 +5,13 @@
 
 #include <datadog/opentracing.h>
 
+#include <algorithm>
 #include <sstream>
 
 #include "agent_writer.h"
 #include "logger.h"
 #include "sample.h"
+#include "stats_concentrator.h"
 #include "tracer.h"
 #include "tracer_options.h"
 
@@ -31,10 +33,55 @@ std::shared_ptr<ot::Tracer> makeTracer(const TracerOptions &options) {
 
   auto logger = makeLogger(opts);
   auto sampler = std::make_shared<RulesSampler>(opts.sampling_limit_per_second);
-  auto writer = std::shared_ptr<Writer>{
-      new AgentWriter(opts.agent_host, opts.agent_port, opts.agent_url,
-                      std::chrono::milliseconds(llabs(opts.write_period_ms)), sampler, logger)};
-  return std::shared_ptr<ot::Tracer>{new Tracer{opts, writer, sampler, logger}};
+  std::shared_ptr<StatsConcentrator> stats;
+  if (opts.stats_computation_enabled) {
+    stats = std::make_shared<StatsConcentrator>(
+        getRealTime, reportingHostname(opts), opts.environment, opts.version);
+  }
+  AgentConnectionOptions connection_options;
+  connection_options.tcp_nodelay = opts.agent_tcp_nodelay;
+  connection_options.tcp_keepalive_seconds = opts.agent_tcp_keepalive_seconds;
+  if (opts.agent_max_concurrent_requests > 0) {
+    connection_options.max_concurrent_requests = opts.agent_max_concurrent_requests;
+  }
+  connection_options.compression_level = opts.agent_compression_level;
+  if (opts.agent_compression_min_bytes >= 0) {
+    connection_options.compression_min_bytes = opts.agent_compression_min_bytes;
+  }
+  connection_options.spool_directory = opts.agent_spool_directory;
+  if (opts.agent_spool_max_megabytes > 0) {
+    connection_options.spool_max_bytes = std::size_t(opts.agent_spool_max_megabytes) << 20;
+  }
+  if (opts.agent_flush_threshold_spans >= 0) {
+    connection_options.flush_threshold_spans = opts.agent_flush_threshold_spans;
+  }
+  if (opts.agent_flush_threshold_bytes >= 0) {
+    connection_options.flush_threshold_bytes = opts.agent_flush_threshold_bytes;
+  }
+  if (opts.agent_encoder_threads > 0) {
+    connection_options.encoder_threads = opts.agent_encoder_threads;
+  }
+  if (opts.agent_write_batch_size > 0) {
+    connection_options.write_batch_size = opts.agent_write_batch_size;
+  }
+  auto &circuit_breaker = connection_options.circuit_breaker;
+  if (opts.agent_circuit_breaker_failures >= 0) {
+    circuit_breaker.failure_threshold = opts.agent_circuit_breaker_failures;
+  }
+  if (opts.agent_timeout_ms > 0) {
+    circuit_breaker.max_timeout = std::chrono::milliseconds(opts.agent_timeout_ms);
+  }
+  // Unless a shorter minimum is configured, the timeout does not adapt.
+  circuit_breaker.min_timeout = circuit_breaker.max_timeout;
+  if (opts.agent_min_timeout_ms > 0) {
+    circuit_breaker.min_timeout = std::min(std::chrono::milliseconds(opts.agent_min_timeout_ms),
+                                           circuit_breaker.max_timeout);
+  }
+  auto writer = std::shared_ptr<Writer>{new AgentWriter(
+      opts.agent_host, opts.agent_port, opts.agent_url,
+      std::chrono::milliseconds(llabs(opts.write_period_ms)), sampler, logger, stats,
+      connection_options)};
+  return std::shared_ptr<ot::Tracer>{new Tracer{opts, writer, sampler, logger, stats}};
 }
 
 }  // namespace opentracing
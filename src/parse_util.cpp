@@ -1,24 +1,174 @@
 #include "parse_util.h"
 
-#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <limits>
 #include <stdexcept>
 
 namespace datadog {
 namespace opentracing {
+namespace {
 
-uint64_t parse_uint64(const std::string &text, int base) {
-  std::size_t end_index;
-  const uint64_t result = std::stoull(text, &end_index, base);
+// `DigitTable` maps each character to its value as a hexadecimal (and so
+// also decimal) digit, or to `not_a_digit`.
+struct DigitTable {
+  static constexpr unsigned char not_a_digit = 0xFF;
+  unsigned char values[256];
 
-  // If any of the remaining characters are not whitespace, then `text`
-  // contains something other than a base-`base` integer.
-  if (std::any_of(text.begin() + end_index, text.end(),
-                  [](unsigned char ch) { return !std::isspace(ch); })) {
-    throw std::invalid_argument("integer text field has a trailing non-whitespace character");
+  constexpr DigitTable() : values() {
+    for (int ch = 0; ch < 256; ++ch) {
+      values[ch] = not_a_digit;
+    }
+    for (int digit = 0; digit < 10; ++digit) {
+      values['0' + digit] = static_cast<unsigned char>(digit);
+    }
+    for (int digit = 0; digit < 6; ++digit) {
+      values['a' + digit] = static_cast<unsigned char>(10 + digit);
+      values['A' + digit] = static_cast<unsigned char>(10 + digit);
+    }
   }
+};
 
+constexpr DigitTable digit_table;
+
+const char hex_digits[] = "0123456789abcdef";
+
+bool is_ows(char ch) { return ch == ' ' || ch == '\t'; }
+
+// Return the specified `text` without a "0x" or "0X" prefix, if present.
+ot::string_view remove_hex_prefix(ot::string_view text) {
+  if (text.size() > 2 && text[0] == '0' && (text[1] == 'x' || text[1] == 'X')) {
+    return ot::string_view(text.data() + 2, text.size() - 2);
+  }
+  return text;
+}
+
+// Return the integer whose base-`base` digits are the specified `digits`.
+// Throw an exception if `digits` contains anything else or if the integer
+// does not fit in 64 bits.
+uint64_t parse_digits(ot::string_view digits, unsigned base) {
+  if (digits.empty()) {
+    throw std::invalid_argument("integer text field is empty");
+  }
+  const uint64_t max = std::numeric_limits<uint64_t>::max();
+  uint64_t result = 0;
+  for (const char ch : digits) {
+    const unsigned digit = digit_table.values[static_cast<unsigned char>(ch)];
+    if (digit >= base) {
+      throw std::invalid_argument("integer text field has a non-digit character");
+    }
+    if (result > (max - digit) / base) {
+      throw std::out_of_range("integer text field is out of range");
+    }
+    result = result * base + digit;
+  }
   return result;
 }
 
+// Store the text of the specified `value` in the specified `buffer`, ending
+// at the end of `buffer`, and return the text.
+template <unsigned base>
+ot::string_view format_backward(uint64_t value, IntegerText &buffer) {
+  char *const end = buffer.data() + buffer.size();
+  char *begin = end;
+  do {
+    *--begin = hex_digits[value % base];
+    value /= base;
+  } while (value != 0);
+  return ot::string_view(begin, end - begin);
+}
+
+}  // namespace
+
+constexpr unsigned char DigitTable::not_a_digit;
+
+ot::string_view range(const char *begin, const char *end) {
+  assert(begin <= end);
+  return ot::string_view{begin, std::size_t(end - begin)};
+}
+
+ot::string_view trim_ows(ot::string_view text) {
+  const char *begin = text.begin();
+  const char *end = text.end();
+  while (begin != end && is_ows(*begin)) {
+    ++begin;
+  }
+  while (end != begin && is_ows(end[-1])) {
+    --end;
+  }
+  return range(begin, end);
+}
+
+uint64_t parse_uint64(ot::string_view text, int base) {
+  text = trim_ows(text);
+  if (base == 16) {
+    return parse_digits(remove_hex_prefix(text), 16);
+  }
+  if (base != 10) {
+    throw std::invalid_argument("integer text field has an unsupported base");
+  }
+  return parse_digits(text, 10);
+}
+
+void parse_hex128(ot::string_view text, uint64_t &high, uint64_t &low) {
+  text = remove_hex_prefix(trim_ows(text));
+  const std::size_t low_digits = 16;
+  if (text.size() <= low_digits) {
+    high = 0;
+    low = parse_digits(text, 16);
+    return;
+  }
+  const std::size_t high_digits = text.size() - low_digits;
+  high = parse_digits(ot::string_view(text.data(), high_digits), 16);
+  low = parse_digits(ot::string_view(text.data() + high_digits, low_digits), 16);
+}
+
+int parse_int(ot::string_view text) {
+  text = trim_ows(text);
+  bool negative = false;
+  if (!text.empty() && (text[0] == '-' || text[0] == '+')) {
+    negative = text[0] == '-';
+    text = ot::string_view(text.data() + 1, text.size() - 1);
+  }
+  const uint64_t magnitude = parse_digits(text, 10);
+  const uint64_t limit =
+      negative ? uint64_t(std::numeric_limits<int>::max()) + 1 : std::numeric_limits<int>::max();
+  if (magnitude > limit) {
+    throw std::out_of_range("integer text field is out of range");
+  }
+  return negative ? static_cast<int>(-static_cast<int64_t>(magnitude))
+                  : static_cast<int>(magnitude);
+}
+
+ot::string_view format_hex(uint64_t value, IntegerText &buffer) {
+  return format_backward<16>(value, buffer);
+}
+
+ot::string_view format_hex128(uint64_t high, uint64_t low, IntegerText &buffer) {
+  char *out = buffer.data();
+  for (const uint64_t half : {high, low}) {
+    for (int shift = 60; shift >= 0; shift -= 4) {
+      *out++ = hex_digits[(half >> shift) & 0xF];
+    }
+  }
+  return ot::string_view(buffer.data(), out - buffer.data());
+}
+
+ot::string_view format_decimal(uint64_t value, IntegerText &buffer) {
+  return format_backward<10>(value, buffer);
+}
+
+ot::string_view format_decimal(int value, IntegerText &buffer) {
+  if (value >= 0) {
+    return format_decimal(static_cast<uint64_t>(value), buffer);
+  }
+  // Negate in 64 bits, so that the minimum `int` can be negated.
+  const ot::string_view digits =
+      format_decimal(static_cast<uint64_t>(-static_cast<int64_t>(value)), buffer);
+  char *const begin = buffer.data() + (digits.data() - buffer.data()) - 1;
+  *begin = '-';
+  return ot::string_view(begin, digits.size() + 1);
+}
+
 }  // namespace opentracing
 }  // namespace datadog
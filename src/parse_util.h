@@ -1,19 +1,67 @@
 #ifndef DD_OPENTRACING_PARSE_UTIL_H
 #define DD_OPENTRACING_PARSE_UTIL_H
 
-// This component provides parsing routines used by other components.
+// This component provides parsing routines used by other components, and the
+// corresponding formatting routines for integers.
+//
+// The integer routines operate on `string_view` and do not allocate memory,
+// except for the exceptions that they might throw.  They are used to encode
+// and decode trace context in propagation headers.
 
+#include <opentracing/string_view.h>
+
+#include <array>
 #include <cstdint>
 #include <string>
 
+namespace ot = opentracing;
+
 namespace datadog {
 namespace opentracing {
 
+// Return a `string_view` over the specified range of characters
+// `[begin, end)`.
+ot::string_view range(const char *begin, const char *end);
+
+// Return the specified `text` without leading and trailing optional
+// whitespace, which is spaces and tabs, as in HTTP header values.
+ot::string_view trim_ows(ot::string_view text);
+
 // Interpret the specified `text` as a non-negative integer formatted in the
-// specified `base` (e.g. base 10 for decimal, base 16 for hexadecimal),
-// possibly surrounded by whitespace, and return the integer.  Throw an
+// specified `base` (either 10 for decimal or 16 for hexadecimal), possibly
+// surrounded by optional whitespace, and return the integer.  Hexadecimal text may
+// have a "0x" prefix.  Throw an exception derived from `std::logic_error` if
+// an error occurs.
+uint64_t parse_uint64(ot::string_view text, int base);
+
+// Interpret the specified `text` as a 128-bit integer formatted in
+// hexadecimal, possibly surrounded by optional whitespace, and store its high and low
+// 64 bits into the specified `high` and `low`.  Throw an exception derived
+// from `std::logic_error` if an error occurs.
+void parse_hex128(ot::string_view text, uint64_t &high, uint64_t &low);
+
+// Interpret the specified `text` as a decimal integer, possibly negative and
+// possibly surrounded by optional whitespace, and return the integer.  Throw an
 // exception derived from `std::logic_error` if an error occurs.
-uint64_t parse_uint64(const std::string &text, int base);
+int parse_int(ot::string_view text);
+
+// `IntegerText` is storage for the text produced by the following functions,
+// which is large enough for any of them.
+using IntegerText = std::array<char, 32>;
+
+// Return the lowercase hexadecimal text, without leading zeros, of the
+// specified `value`.  The text is stored in the specified `buffer`.
+ot::string_view format_hex(uint64_t value, IntegerText &buffer);
+
+// Return the 32 lowercase hexadecimal digits, including leading zeros, of
+// the 128-bit integer whose high and low 64 bits are the specified `high`
+// and `low`.  The text is stored in the specified `buffer`.
+ot::string_view format_hex128(uint64_t high, uint64_t low, IntegerText &buffer);
+
+// Return the decimal text of the specified `value`.  The text is stored in
+// the specified `buffer`.
+ot::string_view format_decimal(uint64_t value, IntegerText &buffer);
+ot::string_view format_decimal(int value, IntegerText &buffer);
 
 }  // namespace opentracing
 }  // namespace datadog
@@ -1,5 +1,6 @@
 #include "pending_trace.h"
 
+#include <algorithm>
 #include <cassert>
 
 #include "span.h"
@@ -130,6 +131,22 @@ void PendingTrace::finish(SpanSampler* span_sampler) {
   }
 }
 
+std::size_t PendingTrace::removeSpansNotKeptBySpanSampling() {
+  auto& spans = *finished_spans;
+  const auto kept_end =
+      std::remove_if(spans.begin(), spans.end(), [](const std::unique_ptr<SpanData>& span) {
+        return span->metrics.find(span_sampling_mechanism) == span->metrics.end();
+      });
+  const std::size_t removed = spans.end() - kept_end;
+  spans.erase(kept_end, spans.end());
+  return removed;
+}
+
+void PendingTrace::invalidateSerializedTraceTags() {
+  serialized_trace_tags.reset();
+  serialized_trace_tags_valid = false;
+}
+
 void PendingTrace::applySamplingDecisionToTraceTags() {
   if (sampling_decision_extracted || sampling_priority == nullptr) {
     // We did not make the sampling decision.
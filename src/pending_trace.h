@@ -31,11 +31,20 @@ struct PendingTrace {
   // sampling is performed.
   void finish(SpanSampler *span_sampler = nullptr);
 
+  // Remove from `finished_spans` the spans that were not kept by span
+  // sampling (see `finish`), and return the number of spans removed.
+  std::size_t removeSpansNotKeptBySpanSampling();
+
   // If this tracer did not inherit a sampling decision from an upstream
   // service, but instead made a sampling decision, then record that decision
   // in the "_dd.p.dm" member of `trace_tags`.
   void applySamplingDecisionToTraceTags();
 
+  // Discard the cached result of `SpanBuffer::serializeTraceTags`.  This must
+  // be called whenever `trace_tags`, `service`, or the sampling decision
+  // changes.
+  void invalidateSerializedTraceTags();
+
   std::shared_ptr<const Logger> logger;
   uint64_t trace_id;
   TraceData finished_spans;
@@ -46,6 +55,11 @@ struct PendingTrace {
   std::string hostname;
   double analytics_rate;
   SampleResult sample_result;
+  // The service and operation name of the span for which the trace sampler
+  // made the decision in `sample_result`.  The sampler measures the volume of
+  // the trace by this key when the trace finishes.
+  std::string sampler_service;
+  std::string sampler_name;
   // `trace_tags` are tags that are associated with the entire local trace,
   // rather than with a single span.  Some other tags are added to the local
   // root span when the trace chunk is sent to the agent (see
@@ -69,6 +83,13 @@ struct PendingTrace {
   // upstream service when span context was extracted (`false`), or has not yet
   // been decided (`false`).
   bool sampling_decision_extracted = false;
+  // `serialized_trace_tags` caches the result of
+  // `SpanBuffer::serializeTraceTags`, so that a trace injected into many
+  // downstream requests serializes its tags only once.  The cache is valid
+  // only if `serialized_trace_tags_valid` is `true`, in which case a null
+  // `serialized_trace_tags` means that the tags were too large to propagate.
+  std::unique_ptr<std::string> serialized_trace_tags;
+  bool serialized_trace_tags_valid = false;
 };
 
 }  // namespace opentracing
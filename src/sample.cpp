@@ -32,20 +32,24 @@ uint64_t maxIdFromSampleRate(double rate) {
 }
 }  // namespace
 
+PrioritySampler::PrioritySampler() {
+  auto rates = std::make_shared<AgentRates>();
+  rates->default_rate = {1.0, std::numeric_limits<uint64_t>::max()};
+  rates_ = std::move(rates);
+}
+
 SampleResult PrioritySampler::sample(const std::string& environment, const std::string& service,
                                      uint64_t trace_id) const {
   SampleResult result;
-  SamplingRate applied_rate = default_sample_rate_;
+  const auto rates = std::atomic_load(&rates_);
+  SamplingRate applied_rate = rates->default_rate;
   result.sampling_mechanism = SamplingMechanism::Default;
   std::ostringstream key;
   key << "service:" << service << ",env:" << environment;
-  {
-    std::lock_guard<std::mutex> lock{mutex_};
-    auto const rule = agent_sampling_rates_.find(key.str());
-    if (rule != agent_sampling_rates_.end()) {
-      applied_rate = rule->second;
-      result.sampling_mechanism = SamplingMechanism::AgentRate;
-    }
+  auto const rule = rates->by_service.find(key.str());
+  if (rule != rates->by_service.end()) {
+    applied_rate = rule->second;
+    result.sampling_mechanism = SamplingMechanism::AgentRate;
   }
   // I don't know how voodoo it is to use the trace_id essentially as a source of randomness,
   // rather than generating a new random number here. It's a bit faster, and more importantly it's
@@ -64,17 +68,157 @@ SampleResult PrioritySampler::sample(const std::string& environment, const std::
 }
 
 void PrioritySampler::configure(json config) {
-  std::lock_guard<std::mutex> lock{mutex_};
-  agent_sampling_rates_.clear();
+  // The default rate is kept unless the agent sends a new one.
+  auto rates = std::make_shared<AgentRates>();
+  rates->default_rate = std::atomic_load(&rates_)->default_rate;
   for (json::iterator it = config.begin(); it != config.end(); ++it) {
     auto key = it.key();
     auto rate = it.value();
     auto max_hashed = maxIdFromSampleRate(rate);
     if (key == priority_sampler_default_rate_key) {
-      default_sample_rate_ = {rate, max_hashed};
+      rates->default_rate = {rate, max_hashed};
+    } else {
+      rates->by_service[key] = {rate, max_hashed};
+    }
+  }
+  std::atomic_store(&rates_, std::shared_ptr<const AgentRates>(std::move(rates)));
+}
+
+const std::size_t AdaptiveSampler::num_windows;
+
+AdaptiveSampler::AdaptiveSampler(TimeProvider clock, double target_spans_per_second,
+                                 std::chrono::steady_clock::duration window)
+    : clock_(clock),
+      target_spans_per_second_(target_spans_per_second),
+      window_(window),
+      window_start_(clock_().relative_time) {}
+
+SampleResult AdaptiveSampler::sample(const std::string& service, const std::string& name,
+                                     uint64_t trace_id) {
+  const auto now = clock_().relative_time;
+  SamplingRate applied_rate;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    advance(now);
+    KeyState& state = keyState(service, name);
+    ++state.windows[current_window_].traces;
+    applied_rate = state.rate;
+  }
+
+  // The adaptive rate replaces the agent's rate, so the decision is of
+  // "sampler" type, and the rate is reported where the agent's would be.
+  SampleResult result;
+  result.sampling_mechanism = SamplingMechanism::Adaptive;
+  result.applied_rate = result.priority_rate = applied_rate.rate;
+  uint64_t hashed_id = trace_id * constant_rate_hash_factor;
+  if (hashed_id >= applied_rate.max_hash) {
+    result.sampling_priority = std::make_unique<SamplingPriority>(SamplingPriority::SamplerDrop);
+  } else {
+    result.sampling_priority = std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep);
+  }
+  return result;
+}
+
+void AdaptiveSampler::recordSpans(const std::string& service, const std::string& name,
+                                  std::size_t num_spans) {
+  const auto now = clock_().relative_time;
+  std::lock_guard<std::mutex> lock{mutex_};
+  advance(now);
+  Counts& counts = keyState(service, name).windows[current_window_];
+  ++counts.finished;
+  counts.spans += num_spans;
+}
+
+AdaptiveSampler::KeyState& AdaptiveSampler::keyState(const std::string& service,
+                                                     const std::string& name) {
+  std::string key;
+  key.reserve(service.size() + name.size() + 14);
+  key += "service:";
+  key += service;
+  key += ",name:";
+  key += name;
+  return keys_[key];
+}
+
+void AdaptiveSampler::advance(std::chrono::steady_clock::time_point now) {
+  if (now - window_start_ < window_) {
+    return;
+  }
+
+  const auto elapsed = (now - window_start_) / window_;
+  window_start_ += elapsed * window_;
+  const std::size_t rotations = std::min<std::size_t>(elapsed, num_windows);
+  for (std::size_t i = 0; i < rotations; ++i) {
+    current_window_ = (current_window_ + 1) % num_windows;
+    for (auto& entry : keys_) {
+      entry.second.windows[current_window_] = Counts{};
+    }
+  }
+  complete_windows_ = std::min<std::size_t>(complete_windows_ + elapsed, num_windows - 1);
+
+  // Forget keys that have had no traffic in any window.
+  for (auto iter = keys_.begin(); iter != keys_.end();) {
+    const auto& windows = iter->second.windows;
+    const auto is_empty = [](const Counts& counts) {
+      return counts.traces == 0 && counts.spans == 0;
+    };
+    if (std::all_of(windows.begin(), windows.end(), is_empty)) {
+      iter = keys_.erase(iter);
+    } else {
+      ++iter;
+    }
+  }
+
+  computeRates();
+}
+
+void AdaptiveSampler::computeRates() {
+  const double seconds =
+      std::chrono::duration<double>(window_).count() * double(complete_windows_);
+  if (keys_.empty() || seconds <= 0) {
+    return;
+  }
+
+  // Pair each key's measured volume (spans per second) with its state.
+  std::vector<std::pair<double, KeyState*>> volumes;
+  volumes.reserve(keys_.size());
+  for (auto& entry : keys_) {
+    Counts total;
+    for (const Counts& counts : entry.second.windows) {
+      total.traces += counts.traces;
+      total.finished += counts.finished;
+      total.spans += counts.spans;
+    }
+    // Spans are not recorded for traces dropped before they were collected
+    // (see `TracerOptions::early_trace_drop`), so extrapolate the number of
+    // spans from the traces that were recorded.  If no spans have been
+    // recorded for the key, assume one span per trace.
+    double count = double(total.traces);
+    if (total.finished != 0) {
+      count = double(total.spans) * double(std::max(total.traces, total.finished)) /
+              double(total.finished);
+    }
+    volumes.emplace_back(count / seconds, &entry.second);
+  }
+
+  // Divide the budget in order of increasing volume.  A key whose volume is
+  // within its share of the remaining budget keeps everything, and leaves the
+  // unused portion of its share to the higher-volume keys that follow.
+  std::sort(volumes.begin(), volumes.end(),
+            [](const std::pair<double, KeyState*>& left,
+               const std::pair<double, KeyState*>& right) { return left.first < right.first; });
+  double budget = target_spans_per_second_;
+  std::size_t remaining = volumes.size();
+  for (const auto& entry : volumes) {
+    const double share = budget / double(remaining--);
+    double rate = 1.0;
+    if (entry.first > share) {
+      rate = share / entry.first;
+      budget -= share;
     } else {
-      agent_sampling_rates_[key] = {rate, max_hashed};
+      budget -= entry.first;
     }
+    entry.second->rate = {rate, maxIdFromSampleRate(rate)};
   }
 }
 
@@ -93,6 +237,9 @@ SampleResult RulesSampler::sample(const std::string& environment, const std::str
                                   const std::string& name, uint64_t trace_id) {
   auto rule_result = match(service, name);
   if (!rule_result.matched) {
+    if (adaptive_sampler_) {
+      return adaptive_sampler_->sample(service, name, trace_id);
+    }
     return priority_sampler_.sample(environment, service, trace_id);
   }
 
@@ -143,6 +290,17 @@ RuleResult RulesSampler::match(const std::string& service, const std::string& na
 
 void RulesSampler::updatePrioritySampler(json config) { priority_sampler_.configure(config); }
 
+void RulesSampler::setAdaptiveSampler(std::shared_ptr<AdaptiveSampler> adaptive_sampler) {
+  adaptive_sampler_ = std::move(adaptive_sampler);
+}
+
+void RulesSampler::recordFinishedTrace(const std::string& service, const std::string& name,
+                                       std::size_t num_spans) {
+  if (adaptive_sampler_) {
+    adaptive_sampler_->recordSpans(service, name, num_spans);
+  }
+}
+
 SpanSampler::Rule::Config::Config()
     : service_pattern("*"),
       operation_name_pattern("*"),
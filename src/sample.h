@@ -10,12 +10,14 @@
 #include <datadog/opentracing.h>
 #include <opentracing/tracer.h>
 
+#include <array>
 #include <iostream>
 #include <limits>
 #include <map>
 #include <memory>
 #include <mutex>
 #include <nlohmann/json.hpp>
+#include <unordered_map>
 
 #include "limiter.h"
 #include "sampling_mechanism.h"
@@ -47,7 +49,7 @@ struct SamplingRate {
 
 class PrioritySampler {
  public:
-  PrioritySampler() : default_sample_rate_{1.0, std::numeric_limits<uint64_t>::max()} {}
+  PrioritySampler();
   virtual ~PrioritySampler() {}
 
   virtual SampleResult sample(const std::string& environment, const std::string& service,
@@ -55,9 +57,15 @@ class PrioritySampler {
   virtual void configure(json config);
 
  private:
-  mutable std::mutex mutex_;
-  std::map<std::string, SamplingRate> agent_sampling_rates_;
-  SamplingRate default_sample_rate_;
+  // The sample rates sent by the agent.
+  struct AgentRates {
+    std::map<std::string, SamplingRate> by_service;
+    SamplingRate default_rate;
+  };
+  // The rates are never modified once published. `configure` builds a new table and swaps it in
+  // with `std::atomic_store`, so `sample` reads them (with `std::atomic_load`) without waiting for
+  // a table to be built.
+  std::shared_ptr<const AgentRates> rates_;
 };
 
 struct RuleResult {
@@ -67,6 +75,72 @@ struct RuleResult {
 
 using RuleFunc = std::function<RuleResult(const std::string&, const std::string&)>;
 
+// `AdaptiveSampler` makes sampling decisions for traces at rates that it
+// computes locally, rather than waiting for rates from the Datadog Agent.  It
+// measures the volume of traces and spans per (service, operation name) key
+// over a sliding set of fixed-length windows.  At the end of each window, the
+// configured spans-per-second budget is divided among the keys so that
+// low-volume keys keep all of their traces, and high-volume keys share the
+// remainder equally.
+//
+// Volume is measured in two ways: each call to `sample` counts one trace for
+// its key, and each call to `recordSpans` counts the spans of one finished
+// trace.  Spans are preferred when known, since the budget is in spans.
+class AdaptiveSampler {
+ public:
+  // The number of windows over which volume is measured.  The current
+  // (incomplete) window is one of these.
+  static const std::size_t num_windows = 10;
+
+  // Create a sampler that aims to keep `target_spans_per_second` spans per
+  // second across all keys, using the specified `clock` to delimit windows of
+  // the specified `window` duration.
+  AdaptiveSampler(TimeProvider clock, double target_spans_per_second,
+                  std::chrono::steady_clock::duration window = std::chrono::seconds(1));
+
+  SampleResult sample(const std::string& service, const std::string& name, uint64_t trace_id);
+
+  // Count the specified `num_spans`, which belong to one finished trace,
+  // toward the volume of the key formed by the specified `service` and
+  // `name`.
+  void recordSpans(const std::string& service, const std::string& name, std::size_t num_spans);
+
+ private:
+  struct Counts {
+    uint64_t traces = 0;
+    // The number of traces whose spans were recorded, and their spans.
+    uint64_t finished = 0;
+    uint64_t spans = 0;
+  };
+
+  struct KeyState {
+    std::array<Counts, num_windows> windows;
+    SamplingRate rate{1.0, std::numeric_limits<uint64_t>::max()};
+  };
+
+  // Return the state for the specified key, creating it if necessary.  The
+  // caller must hold `mutex_`.
+  KeyState& keyState(const std::string& service, const std::string& name);
+  // If one or more windows have elapsed as of the specified `now`, rotate the
+  // windows and recompute each key's rate.  The caller must hold `mutex_`.
+  void advance(std::chrono::steady_clock::time_point now);
+  // Divide `target_spans_per_second_` among the keys.  The caller must hold
+  // `mutex_`.
+  void computeRates();
+
+  TimeProvider clock_;
+  const double target_spans_per_second_;
+  const std::chrono::steady_clock::duration window_;
+  std::mutex mutex_;
+  std::unordered_map<std::string, KeyState> keys_;
+  std::chrono::steady_clock::time_point window_start_;
+  // Index into each key's `windows` of the current window.
+  std::size_t current_window_ = 0;
+  // The number of complete windows (at most `num_windows - 1`) that
+  // contribute to volume measurements.
+  std::size_t complete_windows_ = 0;
+};
+
 class RulesSampler {
  public:
   RulesSampler();
@@ -81,10 +155,20 @@ class RulesSampler {
   virtual RuleResult match(const std::string& service, const std::string& name) const;
   virtual void updatePrioritySampler(json config);
 
+  // Use the specified `adaptive_sampler` instead of priority sampling for
+  // traces that do not match any rule.
+  void setAdaptiveSampler(std::shared_ptr<AdaptiveSampler> adaptive_sampler);
+  // Notify this sampler that a trace whose sampling decision was made by the
+  // adaptive sampler, for the specified `service` and `name`, finished with
+  // the specified `num_spans` spans.
+  void recordFinishedTrace(const std::string& service, const std::string& name,
+                           std::size_t num_spans);
+
  private:
   Limiter sampling_limiter_;
   std::vector<RuleFunc> sampling_rules_;
   PrioritySampler priority_sampler_;
+  std::shared_ptr<AdaptiveSampler> adaptive_sampler_;
 };
 
 class Logger;
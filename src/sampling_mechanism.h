@@ -65,6 +65,9 @@ enum class SamplingMechanism {
   // Individual span kept by a matching span sampling rule when the enclosing
   // trace was dropped.
   SpanRule = 8,
+  // The sampling decision was due to a rate computed locally by
+  // `AdaptiveSampler` in order to meet a configured spans-per-second target.
+  Adaptive = 9,
 };
 
 // `OptionalSamplingMechanism` is either a `SamplingMechanism` or "empty,"
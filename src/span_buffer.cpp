@@ -1,7 +1,10 @@
 #include "span_buffer.h"
 
+#include <algorithm>
+
 #include "sample.h"
 #include "span.h"
+#include "stats_concentrator.h"
 #include "tag_propagation.h"
 #include "writer.h"
 
@@ -10,11 +13,13 @@ namespace opentracing {
 
 SpanBuffer::SpanBuffer(std::shared_ptr<const Logger> logger, std::shared_ptr<Writer> writer,
                        std::shared_ptr<RulesSampler> trace_sampler,
-                       std::shared_ptr<SpanSampler> span_sampler, SpanBufferOptions options)
+                       std::shared_ptr<SpanSampler> span_sampler, SpanBufferOptions options,
+                       std::shared_ptr<StatsConcentrator> stats)
     : logger_(logger),
       writer_(writer),
       trace_sampler_(trace_sampler),
       span_sampler_(span_sampler),
+      stats_(stats),
       options_(options) {}
 
 void SpanBuffer::registerSpan(const SpanContext& context) {
@@ -34,9 +39,23 @@ void SpanBuffer::registerSpan(const SpanContext& context) {
       trace.origin = context.origin();
     }
     trace.trace_tags = context.getExtractedTraceTags();
+    trace.invalidateSerializedTraceTags();
     trace.hostname = options_.hostname;
     trace.analytics_rate = options_.analytics_rate;
     trace.service = options_.service;
+    // If the sampler already decided to keep this trace, apply that decision
+    // rather than consulting the sampler again when the trace finishes.
+    auto early_result = early_sample_results_.find(trace_id);
+    if (early_result != early_sample_results_.end()) {
+      const EarlySampleResult& early = early_result->second;
+      setSamplerResult(trace_id, early.result, early.service, early.name);
+      setSamplingPriorityFromSampler(trace_id, early.result);
+      early_sample_results_.erase(early_result);
+    }
+  } else if (!early_sample_results_.empty()) {
+    // Another local root of this trace was registered first, and already
+    // applied (or never needed) the sampler's early decision.
+    early_sample_results_.erase(trace_id);
   }
   trace_iter->second.all_spans.insert(context.id());
 }
@@ -56,8 +75,21 @@ void SpanBuffer::finishSpan(std::unique_ptr<SpanData> span) {
   uint64_t trace_id = span->traceId();
   trace.finished_spans->push_back(std::move(span));
   if (trace.finished_spans->size() == trace.all_spans.size()) {
-    generateSamplingPriorityImpl(trace.finished_spans->back().get());
+    const SpanData& last_span = *trace.finished_spans->back();
+    generateSamplingPriorityImpl(&last_span);
+    // Let the adaptive sampler measure the volume of the traces it decides
+    // upon, by the same key that it decided by.  Traces kept or dropped for
+    // another reason (a rule, or the user) don't count against its budget.
+    const OptionalSamplingMechanism& mechanism = trace.sample_result.sampling_mechanism;
+    if (!trace.sampling_decision_extracted && mechanism.is<SamplingMechanism>() &&
+        mechanism.get<SamplingMechanism>() == SamplingMechanism::Adaptive) {
+      trace_sampler_->recordFinishedTrace(trace.sampler_service, trace.sampler_name,
+                                          trace.finished_spans->size());
+    }
     trace.finish(span_sampler_.get());
+    if (stats_ != nullptr) {
+      stats_->add(*trace.finished_spans);
+    }
     unbufferAndWriteTrace(trace_id);
   }
 }
@@ -69,6 +101,25 @@ void SpanBuffer::unbufferAndWriteTrace(uint64_t trace_id) {
   }
   auto& trace = trace_iter->second;
   if (options_.enabled) {
+    // The agent does not keep traces that are not sampled, so when trace
+    // metrics are computed here (the agent's other use of such traces),
+    // don't send them.  Spans kept by span sampling are still sent.  Traces
+    // containing an error are sent whole, because the agent may still keep
+    // them (see its error sampler).
+    if (stats_ != nullptr && trace.sampling_priority != nullptr &&
+        int(*trace.sampling_priority) <= 0 &&
+        std::none_of(trace.finished_spans->begin(), trace.finished_spans->end(),
+                     [](const std::unique_ptr<SpanData>& span) { return span->error != 0; })) {
+      const std::size_t dropped_spans = trace.removeSpansNotKeptBySpanSampling();
+      const bool dropped_trace = trace.finished_spans->empty();
+      if (dropped_spans != 0) {
+        writer_->writeDropped(dropped_trace ? 1 : 0, dropped_spans);
+      }
+      if (dropped_trace) {
+        traces_.erase(trace_iter);
+        return;
+      }
+    }
     writer_->write(std::move(trace.finished_spans));
   }
   traces_.erase(trace_iter);
@@ -76,6 +127,10 @@ void SpanBuffer::unbufferAndWriteTrace(uint64_t trace_id) {
 
 void SpanBuffer::flush(std::chrono::milliseconds timeout) { writer_->flush(timeout); }
 
+std::future<bool> SpanBuffer::flushAsync(std::chrono::steady_clock::time_point deadline) {
+  return writer_->flushAsync(deadline);
+}
+
 OptionalSamplingPriority SpanBuffer::getSamplingPriority(uint64_t trace_id) const {
   std::lock_guard<std::mutex> lock_guard{mutex_};
   return getSamplingPriorityImpl(trace_id);
@@ -112,6 +167,7 @@ OptionalSamplingPriority SpanBuffer::setSamplingPriorityFromExtractedContext(
   // An upstream service has made a decision -- the user can no longer override it.
   trace.sampling_priority_locked = true;
   trace.sampling_decision_extracted = true;
+  trace.invalidateSerializedTraceTags();
   // We can't infer the sampling mechanism from the priority, so mechanism will
   // be left null.  Setting the mechanism makes sense when we are the one
   // making the sampling decision.
@@ -136,6 +192,7 @@ OptionalSamplingPriority SpanBuffer::setSamplingPriorityFromUserImpl(
   trace.sampling_priority = asSamplingPriority(value);
   trace.sampling_decision_extracted = false;
   trace.sample_result.sampling_mechanism = SamplingMechanism::Manual;
+  trace.invalidateSerializedTraceTags();
   // We do _not_ lock the sampling decision here, because the user could change
   // it again before we need to use it.
 
@@ -160,6 +217,7 @@ OptionalSamplingPriority SpanBuffer::setSamplingPriorityFromSampler(uint64_t tra
   // override it before it's needed, so we don't modify
   // `trace.sampling_priority_locked` here.
   trace.sampling_decision_extracted = false;
+  trace.invalidateSerializedTraceTags();
 
   return getSamplingPriorityImpl(trace_id);
 }
@@ -178,11 +236,61 @@ OptionalSamplingPriority SpanBuffer::generateSamplingPriorityImpl(const SpanData
   // saved decision.
   auto sampler_result =
       trace_sampler_->sample(span->env(), span->service, span->name, span->trace_id);
-  setSamplerResult(span->trace_id, sampler_result);
+  setSamplerResult(span->trace_id, sampler_result, span->service, span->name);
   setSamplingPriorityFromSampler(span->trace_id, sampler_result);
   return getSamplingPriorityImpl(span->trace_id);
 }
 
+std::shared_ptr<const DroppedTrace> SpanBuffer::dropTraceEarly(const std::string& environment,
+                                                               const std::string& service,
+                                                               const std::string& name,
+                                                               uint64_t trace_id,
+                                                               const SpanContext* parent) {
+  if (span_sampler_ != nullptr && !span_sampler_->rules().empty()) {
+    return nullptr;
+  }
+
+  // The trace is not registered, so build a temporary `PendingTrace` in order
+  // to reuse its trace tag logic.
+  PendingTrace trace{logger_, trace_id};
+  trace.service = service;
+  if (parent != nullptr) {
+    trace.trace_tags = parent->getExtractedTraceTags();
+    trace.sampling_priority = parent->getPropagatedSamplingPriority();
+    trace.sampling_decision_extracted = trace.sampling_priority != nullptr;
+  }
+
+  if (trace.sampling_priority == nullptr) {
+    // Consult the sampler at most once per trace.  If the trace is already
+    // tracked (e.g. another local root span has the same extracted trace ID),
+    // or another root span already decided to keep it, then it is kept.  The
+    // decision is stored only if the trace is about to be registered, and
+    // `registerSpan` removes it.
+    std::lock_guard<std::mutex> lock{mutex_};
+    const auto registered = traces_.find(trace_id);
+    if ((registered != traces_.end() && !registered->second.all_spans.empty()) ||
+        early_sample_results_.count(trace_id) != 0) {
+      return nullptr;
+    }
+    auto result = trace_sampler_->sample(environment, service, name, trace_id);
+    if (result.sampling_priority == nullptr) {
+      return nullptr;
+    }
+    if (int(*result.sampling_priority) > 0) {
+      early_sample_results_[trace_id] = EarlySampleResult{std::move(result), service, name};
+      return nullptr;
+    }
+    trace.sampling_priority = clone(result.sampling_priority);
+    trace.sample_result.sampling_mechanism = result.sampling_mechanism;
+  } else if (int(*trace.sampling_priority) > 0) {
+    return nullptr;
+  }
+
+  auto tags = serializeTraceTagsImpl(trace);
+  return std::make_shared<const DroppedTrace>(
+      DroppedTrace{*trace.sampling_priority, tags ? std::move(*tags) : std::string()});
+}
+
 std::unique_ptr<std::string> SpanBuffer::serializeTraceTags(uint64_t trace_id) {
   std::lock_guard<std::mutex> lock{mutex_};
 
@@ -193,7 +301,37 @@ std::unique_ptr<std::string> SpanBuffer::serializeTraceTags(uint64_t trace_id) {
     return nullptr;
   }
 
-  auto& trace = trace_found->second;
+  return serializeTraceTagsImpl(trace_found->second);
+}
+
+InjectedTraceState SpanBuffer::prepareInjection(uint64_t trace_id,
+                                                bool lock_sampling_priority) {
+  std::lock_guard<std::mutex> lock{mutex_};
+
+  InjectedTraceState result;
+  const auto trace_found = traces_.find(trace_id);
+  if (trace_found == traces_.end()) {
+    logger_->Log(LogLevel::error, trace_id,
+                 "Requested trace_id not found in SpanBuffer::prepareInjection");
+    return result;
+  }
+
+  PendingTrace& trace = trace_found->second;
+  result.sampling_priority = clone(trace.sampling_priority);
+  if (lock_sampling_priority && trace.sampling_priority != nullptr) {
+    trace.sampling_priority_locked = true;
+  }
+  result.serialized_tags = serializeTraceTagsImpl(trace);
+  return result;
+}
+
+std::unique_ptr<std::string> SpanBuffer::serializeTraceTagsImpl(PendingTrace& trace) {
+  if (trace.serialized_trace_tags_valid) {
+    if (trace.serialized_trace_tags == nullptr) {
+      return nullptr;
+    }
+    return std::unique_ptr<std::string>(new std::string(*trace.serialized_trace_tags));
+  }
 
   trace.applySamplingDecisionToTraceTags();
   std::string result;
@@ -208,11 +346,14 @@ std::unique_ptr<std::string> SpanBuffer::serializeTraceTags(uint64_t trace_id) {
     message
         << "Serialized trace tags are too large for propagation.  Configured maximum length is "
         << configured_max << ", but the following has length " << result.size() << ": " << result;
-    logger_->Log(LogLevel::error, trace_id, message.str());
+    logger_->Log(LogLevel::error, trace.trace_id, message.str());
+    trace.serialized_trace_tags_valid = true;
     return nullptr;
   }
 
-  return std::unique_ptr<std::string>(new std::string(std::move(result)));
+  trace.serialized_trace_tags.reset(new std::string(std::move(result)));
+  trace.serialized_trace_tags_valid = true;
+  return std::unique_ptr<std::string>(new std::string(*trace.serialized_trace_tags));
 }
 
 void SpanBuffer::setServiceName(uint64_t trace_id, ot::string_view service_name) {
@@ -222,10 +363,15 @@ void SpanBuffer::setServiceName(uint64_t trace_id, ot::string_view service_name)
     return;
   }
 
-  trace_entry->second.service = service_name;
+  PendingTrace& trace = trace_entry->second;
+  if (trace.service != service_name) {
+    trace.service = service_name;
+    trace.invalidateSerializedTraceTags();
+  }
 }
 
-void SpanBuffer::setSamplerResult(uint64_t trace_id, const SampleResult& sample_result) {
+void SpanBuffer::setSamplerResult(uint64_t trace_id, const SampleResult& sample_result,
+                                  const std::string& service, const std::string& name) {
   auto trace_entry = traces_.find(trace_id);
   if (trace_entry == traces_.end()) {
     logger_->Trace(trace_id, "cannot assign rules sampler result, trace not found");
@@ -238,6 +384,9 @@ void SpanBuffer::setSamplerResult(uint64_t trace_id, const SampleResult& sample_
   trace.sample_result.applied_rate = sample_result.applied_rate;
   trace.sample_result.sampling_priority = clone(sample_result.sampling_priority);
   trace.sample_result.sampling_mechanism = sample_result.sampling_mechanism;
+  trace.sampler_service = service;
+  trace.sampler_name = name;
+  trace.invalidateSerializedTraceTags();
 }
 
 void SpanBuffer::lockSamplingPriority(uint64_t trace_id) {
@@ -1,7 +1,9 @@
 #ifndef DD_OPENTRACING_SPAN_BUFFER_H
 #define DD_OPENTRACING_SPAN_BUFFER_H
 
+#include <chrono>
 #include <cmath>
+#include <future>
 #include <memory>
 #include <mutex>
 #include <unordered_map>
@@ -11,6 +13,7 @@
 #include "pending_trace.h"
 #include "sample.h"
 #include "span.h"
+#include "span_context.h"
 #include "trace_data.h"
 
 namespace datadog {
@@ -19,6 +22,7 @@ namespace opentracing {
 class Writer;
 class SpanContext;
 class SpanSampler;
+class StatsConcentrator;
 
 struct SpanBufferOptions {
   bool enabled = true;
@@ -40,13 +44,15 @@ class SpanBuffer {
   // - uses the specified `trace_sampler` to make decisions about whether to keep traces,
   // - uses the specified `span_sampler` to make decisions about whether to keep spans when a trace
   //   is dropped,
-  // - is configured using the specified `options`.
+  // - is configured using the specified `options`,
+  // - adds every completed trace segment to the optionally specified `stats`.
   //
   // If `span_sampler` is `nullptr`, then span sampling is disabled (but
   // `trace_sampler` is still consulted for trace sampling decisions).
   SpanBuffer(std::shared_ptr<const Logger> logger, std::shared_ptr<Writer> writer,
              std::shared_ptr<RulesSampler> trace_sampler,
-             std::shared_ptr<SpanSampler> span_sampler, SpanBufferOptions options);
+             std::shared_ptr<SpanSampler> span_sampler, SpanBufferOptions options,
+             std::shared_ptr<StatsConcentrator> stats = nullptr);
   virtual ~SpanBuffer() = default;
 
   void registerSpan(const SpanContext& context);
@@ -77,12 +83,38 @@ class SpanBuffer {
   // resulting sampling decision.
   OptionalSamplingPriority generateSamplingPriority(const SpanData* span);
 
+  // Decide, before its local root span starts, whether the trace having the
+  // specified `trace_id` can be dropped without tracking any of its spans.
+  // The trace's local root span would have the specified `environment`,
+  // `service`, and `name`, and would be a child of the optionally specified
+  // extracted `parent` context.  If the trace is to be dropped, return the
+  // state that its span contexts need in order to propagate it.  Otherwise,
+  // return `nullptr`; the trace is then tracked as usual, and any decision
+  // made here by the trace sampler is applied to the trace when its root span
+  // is registered.  The trace sampler is not consulted for a trace that is
+  // already tracked or already decided upon here.  A trace is never dropped
+  // here if span sampling rules are configured, because those rules might
+  // keep some of the trace's spans.
+  std::shared_ptr<const DroppedTrace> dropTraceEarly(const std::string& environment,
+                                                     const std::string& service,
+                                                     const std::string& name, uint64_t trace_id,
+                                                     const SpanContext* parent);
+
   // Return the serialization of the trace tags associated with the trace
   // having the specified `trace_id`, or return `nullptr` if an error occurs.
   // If an encoding error occurs, a corresponding `_dd.propagation_error` tag
   // value will be added to the relevant trace's local root span.
   std::unique_ptr<std::string> serializeTraceTags(uint64_t trace_id);
 
+  // Return the sampling priority and the serialized trace tags (see
+  // `serializeTraceTags`) of the trace having the specified `trace_id`, as
+  // needed to inject a span context of that trace.  If
+  // `lock_sampling_priority` is `true` and the trace has a sampling priority,
+  // then also lock it (see `lockSamplingPriority`).  This is done in a single
+  // critical section.  This function is `virtual` so that it can be
+  // overridden in unit tests.
+  virtual InjectedTraceState prepareInjection(uint64_t trace_id, bool lock_sampling_priority);
+
   // Change the name of the service associated with the trace having the
   // specified `trace_id` to the specified `service_name`.
   void setServiceName(uint64_t trace_id, ot::string_view service_name);
@@ -94,6 +126,8 @@ class SpanBuffer {
   // Causes the Writer to flush, but does not send any PendingTraces.
   // This function is `virtual` so that it can be overridden in unit tests.
   virtual void flush(std::chrono::milliseconds timeout);
+  // Causes the Writer to flush without blocking. See `Writer::flushAsync`.
+  virtual std::future<bool> flushAsync(std::chrono::steady_clock::time_point deadline);
 
  private:
   // Each method whose name ends with "Impl" is a non-mutex-locking version of
@@ -113,7 +147,13 @@ class SpanBuffer {
 
   OptionalSamplingPriority generateSamplingPriorityImpl(const SpanData* span);
 
-  void setSamplerResult(uint64_t trace_id, const SampleResult& sample_result);
+  // Record for the trace having the specified `trace_id` the specified
+  // `sample_result`, which the trace sampler decided for a span having the
+  // specified `service` and `name`.
+  void setSamplerResult(uint64_t trace_id, const SampleResult& sample_result,
+                        const std::string& service, const std::string& name);
+
+  std::unique_ptr<std::string> serializeTraceTagsImpl(PendingTrace& trace);
 
   void lockSamplingPriorityImpl(uint64_t trace_id);
 
@@ -122,6 +162,18 @@ class SpanBuffer {
   mutable std::mutex mutex_;
   std::shared_ptr<RulesSampler> trace_sampler_;
   std::shared_ptr<SpanSampler> span_sampler_;
+  // Computes trace metrics from finished traces, if enabled.  May be nullptr.
+  // If not nullptr, then traces that are not sampled are not written.
+  std::shared_ptr<StatsConcentrator> stats_;
+  // A decision made by `dropTraceEarly`, and the key that it was made for.
+  struct EarlySampleResult {
+    SampleResult result;
+    std::string service;
+    std::string name;
+  };
+  // Sampler decisions made by `dropTraceEarly` to keep traces whose root
+  // spans have not yet been registered, keyed by trace ID.
+  std::unordered_map<uint64_t, EarlySampleResult> early_sample_results_;
 
  protected:
   // Exists to make it easy for a subclass (ie, our testing mock) to override on-trace-finish
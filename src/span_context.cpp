@@ -1,15 +1,19 @@
 #include "span_context.h"
 
 #include <algorithm>
+#include <memory>
 #include <nlohmann/json.hpp>
 #include <sstream>
 #include <stdexcept>
 #include <utility>
 
+#include "b3_propagation.h"
+#include "binary_propagation.h"
 #include "parse_util.h"
 #include "sample.h"
 #include "span_buffer.h"
 #include "tag_propagation.h"
+#include "w3c_propagation.h"
 
 namespace ot = opentracing;
 using json = nlohmann::json;
@@ -28,27 +32,28 @@ struct HeadersImpl {
   // See `tag_propagation.h`.
   const char *tags_header;
   const int base;
-  std::string (*encode_id)(uint64_t);
-  std::string (*encode_sampling_priority)(SamplingPriority);
+  // The following functions return text stored in the specified buffer.
+  ot::string_view (*encode_id)(uint64_t, IntegerText &);
+  ot::string_view (*encode_sampling_priority)(SamplingPriority, IntegerText &);
 };
 
 namespace {
-std::string asHex(uint64_t id) {
-  std::stringstream stream;
-  stream << std::hex << id;
-  return stream.str();
-}
+ot::string_view asDecimal(uint64_t id, IntegerText &buffer) { return format_decimal(id, buffer); }
+
+ot::string_view asHex(uint64_t id, IntegerText &buffer) { return format_hex(id, buffer); }
 
 // B3 style header propagation only supports "drop" and "keep", with no distinction between
 // user/sampler as the decision maker. Here we clamp the serialized values.
-std::string clampB3SamplingPriorityValue(SamplingPriority p) {
+ot::string_view clampB3SamplingPriorityValue(SamplingPriority p, IntegerText & /* buffer */) {
   if (static_cast<int>(p) > 0) {
     return "1";  // Keep, as SamplingPriority::SamplerKeep.
   }
   return "0";  // Drop, as SamplingPriority::SamplerDrop.
 }
 
-std::string to_string(SamplingPriority p) { return std::to_string(static_cast<int>(p)); }
+ot::string_view to_string(SamplingPriority p, IntegerText &buffer) {
+  return format_decimal(static_cast<int>(p), buffer);
+}
 
 // Header names for trace data. Hax constexpr map-like object.
 constexpr struct {
@@ -59,7 +64,7 @@ constexpr struct {
                       "x-datadog-origin",
                       "x-datadog-tags",
                       10,
-                      std::to_string,
+                      asDecimal,
                       to_string};
   // https://github.com/openzipkin/b3-propagation
   HeadersImpl b3{"X-B3-TraceId",
@@ -71,6 +76,14 @@ constexpr struct {
                  asHex,
                  clampB3SamplingPriorityValue};
 
+  // The W3C style does not fit in `HeadersImpl`, and instead is handled by
+  // `w3c_propagation.h`.  Its header names are these.
+  const char *w3c_traceparent_header = "traceparent";
+  const char *w3c_tracestate_header = "tracestate";
+  // The same goes for the single header form of B3, handled by
+  // `b3_propagation.h`.  Its origin and tags headers are those of `b3`.
+  const char *b3_single_header = "b3";
+
   const HeadersImpl &operator[](const PropagationStyle style) const {
     if (style == PropagationStyle::B3) {
       return b3;
@@ -80,6 +93,10 @@ constexpr struct {
 
 } propagation_headers;
 
+// The trace tag that holds, as 16 hexadecimal digits, the high 64 bits of a
+// 128-bit trace ID extracted in the W3C style.
+const std::string trace_id_high_tag = "_dd.p.tid";
+
 // Key names for binary serialization in JSON
 const std::string json_trace_id_key = "trace_id";
 const std::string json_parent_id_key = "parent_id";
@@ -88,16 +105,18 @@ const std::string json_origin_key = "origin";
 const std::string json_tags_key = "tags";
 const std::string json_baggage_key = "baggage";
 
+char lower(char c) { return (c >= 'A' && c <= 'Z') ? c - 'A' + 'a' : c; }
+
 // Does what it says on the tin. Just looks at each char, so don't try and use this on
 // unicode strings, only used for comparing HTTP header names.
 // Rolled my own because I don't want to import all of libboost for a couple of functions!
-bool equals_ignore_case(const std::string &a, const std::string &b) {
+bool equals_ignore_case(ot::string_view a, ot::string_view b) {
   return std::equal(a.begin(), a.end(), b.begin(), b.end(),
-                    [](char a, char b) { return tolower(a) == tolower(b); });
+                    [](char a, char b) { return lower(a) == lower(b); });
 }
 
 // Checks to see if the given string has the given prefix.
-bool has_prefix(const std::string &str, const std::string &prefix) {
+bool has_prefix(ot::string_view str, ot::string_view prefix) {
   if (str.size() < prefix.size()) {
     return false;
   }
@@ -105,6 +124,142 @@ bool has_prefix(const std::string &str, const std::string &prefix) {
   return result.first == prefix.end();
 }
 
+// The part of a span context that a header of an extracted context provides.
+enum class HeaderField {
+  trace_id,
+  parent_id,
+  sampling_priority,
+  origin,
+  tags,
+  traceparent,
+  tracestate,
+  b3_single
+};
+
+// A header that is extracted in some propagation style.
+struct ExtractedHeader {
+  ot::string_view name;
+  HeaderField field;
+  PropagationStyle style;
+  // Whether the header is extracted in every style, in which case `style` is
+  // irrelevant.
+  bool all_styles;
+};
+
+// The headers that `SpanContext::deserialize` looks for.  The origin and tags
+// headers are the same in each style, so they appear once.
+const ExtractedHeader extracted_headers[] = {
+    {propagation_headers.datadog.trace_id_header, HeaderField::trace_id,
+     PropagationStyle::Datadog, false},
+    {propagation_headers.datadog.span_id_header, HeaderField::parent_id,
+     PropagationStyle::Datadog, false},
+    {propagation_headers.datadog.sampling_priority_header, HeaderField::sampling_priority,
+     PropagationStyle::Datadog, false},
+    {propagation_headers.b3.trace_id_header, HeaderField::trace_id, PropagationStyle::B3, false},
+    {propagation_headers.b3.span_id_header, HeaderField::parent_id, PropagationStyle::B3, false},
+    {propagation_headers.b3.sampling_priority_header, HeaderField::sampling_priority,
+     PropagationStyle::B3, false},
+    {propagation_headers.w3c_traceparent_header, HeaderField::traceparent, PropagationStyle::W3C,
+     false},
+    {propagation_headers.w3c_tracestate_header, HeaderField::tracestate, PropagationStyle::W3C,
+     false},
+    {propagation_headers.b3_single_header, HeaderField::b3_single, PropagationStyle::B3Single,
+     false},
+    {propagation_headers.datadog.origin_header, HeaderField::origin, PropagationStyle::Datadog,
+     true},
+    {propagation_headers.datadog.tags_header, HeaderField::tags, PropagationStyle::Datadog, true},
+};
+
+// Return the element of `extracted_headers` whose name is equal, ignoring
+// case, to the specified `key`, or return `nullptr` if there is none.  Most
+// keys are rejected by their length or by their first character, without a
+// full comparison.
+const ExtractedHeader *find_extracted_header(ot::string_view key) {
+  for (const ExtractedHeader &header : extracted_headers) {
+    if (header.name.size() == key.size() && lower(header.name[0]) == lower(key[0]) &&
+        equals_ignore_case(header.name, key)) {
+      return &header;
+    }
+  }
+  return nullptr;
+}
+
+// The values extracted from the headers of one propagation style.
+struct ExtractedIds {
+  bool trace_id_set = false;
+  uint64_t trace_id = 0;
+  bool parent_id_set = false;
+  uint64_t parent_id = 0;
+  OptionalSamplingPriority sampling_priority;
+  // Whether `sampling_priority` was inferred from a "sampled" flag, rather
+  // than propagated as a priority.  An inferred priority agrees with any
+  // priority that makes the same keep/drop decision, and with an absent one.
+  bool sampling_priority_inferred = false;
+};
+
+// Return whether the specified `a` and `b` describe the same context.
+bool operator==(const ExtractedIds &a, const ExtractedIds &b) {
+  if (a.trace_id != b.trace_id || a.parent_id != b.parent_id) {
+    return false;
+  }
+  if (a.sampling_priority == nullptr || b.sampling_priority == nullptr) {
+    return (a.sampling_priority == nullptr || a.sampling_priority_inferred) &&
+           (b.sampling_priority == nullptr || b.sampling_priority_inferred);
+  }
+  if (a.sampling_priority_inferred || b.sampling_priority_inferred) {
+    return (static_cast<int>(*a.sampling_priority) > 0) ==
+           (static_cast<int>(*b.sampling_priority) > 0);
+  }
+  return *a.sampling_priority == *b.sampling_priority;
+}
+
+// `HeaderExtraction` collects, in a single pass over a carrier's headers, the
+// values of the headers of each of a set of propagation styles.
+struct HeaderExtraction {
+  HeaderExtraction(const std::set<PropagationStyle> &styles, const Logger &logger)
+      : styles(styles), logger(logger) {}
+
+  // Record the value of the header having the specified `key` and `value`,
+  // if the header is relevant.  Return an error if a relevant header's value
+  // is invalid.  Invalid trace tags are logged and otherwise ignored.  This
+  // function allocates memory only for relevant headers.
+  ot::expected<void> operator()(ot::string_view key, ot::string_view value);
+
+  // Complete the W3C context, if any, after all headers have been recorded.
+  // The sampling priority is taken from "tracestate" if it agrees with the
+  // "traceparent" flags.  The origin and trace tags in "tracestate" are used
+  // only if the corresponding Datadog headers are absent.
+  void finishW3C();
+
+  ExtractedIds &ids(PropagationStyle style) {
+    switch (style) {
+      case PropagationStyle::B3:
+        return b3_ids;
+      case PropagationStyle::W3C:
+        return w3c_ids;
+      case PropagationStyle::B3Single:
+        return b3_single_ids;
+      default:
+        return datadog_ids;
+    }
+  }
+
+  const std::set<PropagationStyle> &styles;
+  const Logger &logger;
+  ExtractedIds datadog_ids;
+  ExtractedIds b3_ids;
+  ExtractedIds b3_single_ids;
+  ExtractedIds w3c_ids;
+  uint64_t w3c_trace_id_high = 0;
+  bool w3c_sampled = false;
+  TraceState w3c_state;
+  std::string origin;
+  bool origin_set = false;
+  std::unordered_map<std::string, std::string> baggage;
+  std::unordered_map<std::string, std::string> trace_tags;
+  bool trace_tags_set = false;
+};
+
 // If the result of `SpanContext::deserialize` can be determined solely from
 // the presence of certain tags, return the appropriate result.  If the result
 // cannot be determined, return `nullptr`.  Each specified boolean indicates
@@ -133,12 +288,166 @@ std::unique_ptr<ot::expected<std::unique_ptr<ot::SpanContext>>> enforce_tag_pres
 // with character escapes.
 std::string json_quote(const std::string &raw) { return json(raw).dump(); }
 
+// Return a `SharedStringMap` holding the specified `map`.  All empty maps
+// share the same instance, so that they need not be allocated.
+SharedStringMap share(std::unordered_map<std::string, std::string> &&map) {
+  static const SharedStringMap empty =
+      std::make_shared<const std::unordered_map<std::string, std::string>>();
+  if (map.empty()) {
+    return empty;
+  }
+  return std::make_shared<const std::unordered_map<std::string, std::string>>(std::move(map));
+}
+
+// Return a shared `ExtractedTraceState` holding the specified `state`.  All
+// empty states share the same instance, so that they need not be allocated.
+std::shared_ptr<const ExtractedTraceState> share(ExtractedTraceState &&state) {
+  static const std::shared_ptr<const ExtractedTraceState> empty =
+      std::make_shared<const ExtractedTraceState>();
+  if (state.origin.empty() && state.trace_tags.empty() && state.w3c_tracestate.empty()) {
+    return empty;
+  }
+  return std::make_shared<const ExtractedTraceState>(std::move(state));
+}
+
+// Return the high 64 bits of the trace ID of a context having the specified
+// extracted `trace_tags`, or return zero if they are unknown.
+uint64_t trace_id_high(const std::unordered_map<std::string, std::string> &trace_tags) {
+  const auto found = trace_tags.find(trace_id_high_tag);
+  if (found == trace_tags.end()) {
+    return 0;
+  }
+  try {
+    return parse_uint64(found->second, 16);
+  } catch (const std::logic_error &) {
+    return 0;
+  }
+}
+
+ot::expected<void> HeaderExtraction::operator()(ot::string_view key, ot::string_view value) {
+  const ExtractedHeader *const header = find_extracted_header(key);
+  if (header == nullptr) {
+    if (has_prefix(key, baggage_prefix)) {
+      baggage.emplace(std::string{std::begin(key) + baggage_prefix.size(), std::end(key)}, value);
+    }
+    return {};
+  }
+  if (!header->all_styles && styles.count(header->style) == 0) {
+    return {};
+  }
+  ExtractedIds &style_ids = ids(header->style);
+  try {
+    switch (header->field) {
+      case HeaderField::trace_id:
+        style_ids.trace_id = parse_uint64(value, propagation_headers[header->style].base);
+        style_ids.trace_id_set = true;
+        break;
+      case HeaderField::parent_id:
+        style_ids.parent_id = parse_uint64(value, propagation_headers[header->style].base);
+        style_ids.parent_id_set = true;
+        break;
+      case HeaderField::sampling_priority:
+        style_ids.sampling_priority = asSamplingPriority(parse_int(value));
+        if (style_ids.sampling_priority == nullptr) {
+          // The sampling_priority key was present, but the value makes no sense.
+          logger.Log(LogLevel::error, "Invalid sampling_priority value in serialized SpanContext");
+          return ot::make_unexpected(ot::span_context_corrupted_error);
+        }
+        break;
+      case HeaderField::origin:
+        origin = value;
+        origin_set = true;
+        break;
+      case HeaderField::tags:
+        trace_tags_set = true;
+        trace_tags = deserializeTags(value);
+        break;
+      case HeaderField::traceparent: {
+        const TraceParent trace_parent = parseTraceParent(value);
+        style_ids.trace_id = trace_parent.trace_id;
+        style_ids.trace_id_set = true;
+        style_ids.parent_id = trace_parent.parent_id;
+        style_ids.parent_id_set = true;
+        w3c_trace_id_high = trace_parent.trace_id_high;
+        w3c_sampled = trace_parent.sampled;
+        break;
+      }
+      case HeaderField::tracestate:
+        w3c_state = parseTraceState(value);
+        break;
+      case HeaderField::b3_single: {
+        B3Context b3 = parseB3(value);
+        if (b3.ids_set) {
+          style_ids.trace_id = b3.trace_id;
+          style_ids.trace_id_set = true;
+          style_ids.parent_id = b3.span_id;
+          style_ids.parent_id_set = true;
+        }
+        style_ids.sampling_priority = std::move(b3.sampling_priority);
+        break;
+      }
+    }
+  } catch (const std::logic_error &error) {
+    std::ostringstream message;
+    message << "Error decoding context key " << json_quote(key) << " with value "
+            << json_quote(value) << ": " << error.what();
+    logger.Log(LogLevel::error, message.str());
+    // Tolerate failure to parse `tags_header`, but not e.g.
+    // `trace_id_header`.
+    if (header->field != HeaderField::tags) {
+      return ot::make_unexpected(ot::span_context_corrupted_error);
+    }
+  }
+  return {};
+}
+
+void HeaderExtraction::finishW3C() {
+  if (!w3c_ids.trace_id_set) {
+    return;
+  }
+
+  const OptionalSamplingPriority &state_priority = w3c_state.sampling_priority;
+  if (state_priority != nullptr && (static_cast<int>(*state_priority) > 0) == w3c_sampled) {
+    w3c_ids.sampling_priority = clone(state_priority);
+  } else {
+    w3c_ids.sampling_priority = std::make_unique<SamplingPriority>(
+        w3c_sampled ? SamplingPriority::SamplerKeep : SamplingPriority::SamplerDrop);
+    w3c_ids.sampling_priority_inferred = true;
+  }
+
+  if (!origin_set && !w3c_state.origin.empty()) {
+    origin = std::move(w3c_state.origin);
+    origin_set = true;
+  }
+  if (!trace_tags_set) {
+    trace_tags = std::move(w3c_state.trace_tags);
+  }
+  if (w3c_trace_id_high != 0) {
+    IntegerText buffer;
+    const ot::string_view digits = format_hex128(0, w3c_trace_id_high, buffer);
+    trace_tags[trace_id_high_tag] = std::string{digits.data() + 16, 16};
+  }
+}
+
 }  // namespace
 
 std::vector<ot::string_view> getPropagationHeaderNames(const std::set<PropagationStyle> &styles,
                                                        bool prioritySamplingEnabled) {
   std::vector<ot::string_view> headers;
   for (auto &style : styles) {
+    if (style == PropagationStyle::W3C) {
+      headers.push_back(propagation_headers.w3c_traceparent_header);
+      headers.push_back(propagation_headers.w3c_tracestate_header);
+      continue;
+    }
+    if (style == PropagationStyle::B3Single) {
+      headers.push_back(propagation_headers.b3_single_header);
+      if (prioritySamplingEnabled) {
+        headers.push_back(propagation_headers.b3.origin_header);
+      }
+      headers.push_back(propagation_headers.b3.tags_header);
+      continue;
+    }
     headers.push_back(propagation_headers[style].trace_id_header);
     headers.push_back(propagation_headers[style].span_id_header);
     if (prioritySamplingEnabled) {  // FIXME[willgittoes-dd], ensure this elsewhere
@@ -150,19 +459,16 @@ std::vector<ot::string_view> getPropagationHeaderNames(const std::set<Propagatio
   return headers;
 }
 
-SpanContext::SpanContext(std::shared_ptr<const Logger> logger, uint64_t id, uint64_t trace_id,
-                         std::string origin,
+SpanContext::SpanContext(uint64_t id, uint64_t trace_id, std::string origin,
                          std::unordered_map<std::string, std::string> &&baggage)
-    : logger_(std::move(logger)),
-      id_(id),
+    : id_(id),
       trace_id_(trace_id),
-      origin_(origin),
-      baggage_(std::move(baggage)) {}
+      baggage_(share(std::move(baggage))),
+      extracted_state_(share(ExtractedTraceState{std::move(origin), {}, {}})) {}
 
 SpanContext SpanContext::NginxOpenTracingCompatibilityHackSpanContext(
-    std::shared_ptr<const Logger> logger, uint64_t id, uint64_t trace_id,
-    std::unordered_map<std::string, std::string> &&baggage) {
-  SpanContext c = SpanContext{logger, id, trace_id, "", std::move(baggage)};
+    uint64_t id, uint64_t trace_id, std::unordered_map<std::string, std::string> &&baggage) {
+  SpanContext c = SpanContext{id, trace_id, "", std::move(baggage)};
   c.nginx_opentracing_compatibility_hack_ = true;
   return c;
 }
@@ -171,73 +477,48 @@ SpanContext::SpanContext(const SpanContext &other)
     : nginx_opentracing_compatibility_hack_(other.nginx_opentracing_compatibility_hack_),
       id_(other.id_),
       trace_id_(other.trace_id_),
-      origin_(other.origin_),
-      baggage_(other.baggage_),
-      extracted_trace_tags_(other.extracted_trace_tags_) {
-  if (other.propagated_sampling_priority_ != nullptr) {
-    propagated_sampling_priority_.reset(
-        new SamplingPriority(*other.propagated_sampling_priority_));
-  }
-}
-
-SpanContext &SpanContext::operator=(const SpanContext &other) {
-  std::lock_guard<std::mutex> lock{mutex_};
-  id_ = other.id_;
-  trace_id_ = other.trace_id_;
-  origin_ = other.origin_;
-  baggage_ = other.baggage_;
-  nginx_opentracing_compatibility_hack_ = other.nginx_opentracing_compatibility_hack_;
-  if (other.propagated_sampling_priority_ != nullptr) {
-    propagated_sampling_priority_.reset(
-        new SamplingPriority(*other.propagated_sampling_priority_));
-  }
-  return *this;
-}
+      has_propagated_sampling_priority_(other.has_propagated_sampling_priority_),
+      propagated_sampling_priority_(other.propagated_sampling_priority_),
+      baggage_(std::atomic_load(&other.baggage_)),
+      extracted_state_(other.extracted_state_),
+      extracted_(other.extracted_),
+      dropped_trace_(other.dropped_trace_) {}
 
 SpanContext::SpanContext(SpanContext &&other)
     : nginx_opentracing_compatibility_hack_(other.nginx_opentracing_compatibility_hack_),
-      logger_(std::move(other.logger_)),
       id_(other.id_),
       trace_id_(other.trace_id_),
-      propagated_sampling_priority_(std::move(other.propagated_sampling_priority_)),
-      origin_(other.origin_),
-      baggage_(std::move(other.baggage_)),
-      extracted_trace_tags_(std::move(other.extracted_trace_tags_)) {}
-
-SpanContext &SpanContext::operator=(SpanContext &&other) {
-  std::lock_guard<std::mutex> lock{mutex_};
-  logger_ = std::move(other.logger_);
-  id_ = other.id_;
-  trace_id_ = other.trace_id_;
-  origin_ = other.origin_;
-  propagated_sampling_priority_ = std::move(other.propagated_sampling_priority_);
-  baggage_ = std::move(other.baggage_);
-  nginx_opentracing_compatibility_hack_ = other.nginx_opentracing_compatibility_hack_;
-  extracted_trace_tags_ = std::move(other.extracted_trace_tags_);
-  return *this;
-}
+      has_propagated_sampling_priority_(other.has_propagated_sampling_priority_),
+      propagated_sampling_priority_(other.propagated_sampling_priority_),
+      // The shared state is copied rather than moved, so that it is never
+      // null, even in a moved-from context.
+      baggage_(std::atomic_load(&other.baggage_)),
+      extracted_state_(other.extracted_state_),
+      extracted_(other.extracted_),
+      dropped_trace_(std::move(other.dropped_trace_)) {}
 
 bool SpanContext::operator==(const SpanContext &other) const {
-  if (logger_ != other.logger_ || id_ != other.id_ || trace_id_ != other.trace_id_ ||
-      baggage_ != other.baggage_ ||
+  if (id_ != other.id_ || trace_id_ != other.trace_id_ ||
+      *std::atomic_load(&baggage_) != *std::atomic_load(&other.baggage_) ||
       nginx_opentracing_compatibility_hack_ != other.nginx_opentracing_compatibility_hack_ ||
-      extracted_trace_tags_ != other.extracted_trace_tags_) {
+      extracted_state_->trace_tags != other.extracted_state_->trace_tags) {
     return false;
   }
-  if (propagated_sampling_priority_ == nullptr) {
-    return other.propagated_sampling_priority_ == nullptr;
+  if (!has_propagated_sampling_priority_) {
+    return !other.has_propagated_sampling_priority_;
   }
-  return other.propagated_sampling_priority_ != nullptr &&
-         *propagated_sampling_priority_ == *other.propagated_sampling_priority_ &&
-         origin_ == other.origin_;
+  return other.has_propagated_sampling_priority_ &&
+         propagated_sampling_priority_ == other.propagated_sampling_priority_ &&
+         extracted_state_->origin == other.extracted_state_->origin;
 }
 
 bool SpanContext::operator!=(const SpanContext &other) const { return !(*this == other); }
 
 void SpanContext::ForeachBaggageItem(
     std::function<bool(const std::string &, const std::string &)> f) const {
-  std::lock_guard<std::mutex> lock{mutex_};
-  for (const auto &baggage_item : baggage_) {
+  // Iterate over a snapshot, which `setBaggageItem` won't modify.
+  const SharedStringMap baggage = std::atomic_load(&baggage_);
+  for (const auto &baggage_item : *baggage) {
     if (!f(baggage_item.first, baggage_item.second)) {
       return;
     }
@@ -245,7 +526,6 @@ void SpanContext::ForeachBaggageItem(
 }
 
 std::unique_ptr<ot::SpanContext> SpanContext::Clone() const noexcept {
-  std::lock_guard<std::mutex> lock{mutex_};
   return std::unique_ptr<opentracing::SpanContext>(new SpanContext(*this));
 }
 
@@ -253,85 +533,126 @@ std::string SpanContext::ToTraceID() const noexcept { return std::to_string(trac
 
 std::string SpanContext::ToSpanID() const noexcept { return std::to_string(id_); }
 
-uint64_t SpanContext::id() const {
-  // Not locked, since id_ never modified.
-  return id_;
-}
+uint64_t SpanContext::id() const { return id_; }
 
-uint64_t SpanContext::traceId() const {
-  // Not locked, since trace_id_ never modified.
-  return trace_id_;
-}
+uint64_t SpanContext::traceId() const { return trace_id_; }
 
 OptionalSamplingPriority SpanContext::getPropagatedSamplingPriority() const {
-  // Not locked. Both these members are only ever written in the constructor/builder.
-  return clone(propagated_sampling_priority_);
+  if (!has_propagated_sampling_priority_) {
+    return nullptr;
+  }
+  return std::make_unique<SamplingPriority>(propagated_sampling_priority_);
 }
 
-const std::string SpanContext::origin() const {
-  // Not locked, since origin_ never modified.
-  return origin_;
+const std::string &SpanContext::origin() const { return extracted_state_->origin; }
+
+const std::unordered_map<std::string, std::string> &SpanContext::getExtractedTraceTags() const {
+  return extracted_state_->trace_tags;
 }
 
-std::unordered_map<std::string, std::string> SpanContext::getExtractedTraceTags() const {
-  // No need to lock `mutex_`, because `extracted_trace_tags_` isn't modified
-  // after being initially set by `deserialize`.
-  return extracted_trace_tags_;
+bool SpanContext::extracted() const { return extracted_; }
+
+const std::shared_ptr<const DroppedTrace> &SpanContext::droppedTrace() const {
+  return dropped_trace_;
 }
 
 void SpanContext::setBaggageItem(ot::string_view key, ot::string_view value) noexcept try {
-  std::lock_guard<std::mutex> lock{mutex_};
-  baggage_.emplace(key, value);
+  SharedStringMap expected = std::atomic_load(&baggage_);
+  SharedStringMap desired;
+  do {
+    if (expected->find(key) != expected->end()) {
+      return;
+    }
+    // Other contexts might share `baggage_`, so modify a copy.  If another
+    // thread replaces `baggage_` in the meantime, then try again with its
+    // replacement.
+    auto baggage = *expected;
+    baggage.emplace(key, value);
+    desired = share(std::move(baggage));
+  } while (!std::atomic_compare_exchange_weak(&baggage_, &expected, desired));
 } catch (const std::bad_alloc &) {
 }
 
 std::string SpanContext::baggageItem(ot::string_view key) const {
-  std::lock_guard<std::mutex> lock{mutex_};
-  auto lookup = baggage_.find(key);
-  if (lookup != baggage_.end()) {
+  const SharedStringMap baggage = std::atomic_load(&baggage_);
+  auto lookup = baggage->find(key);
+  if (lookup != baggage->end()) {
     return lookup->second;
   }
   return {};
 }
 
 SpanContext SpanContext::withId(uint64_t id) const {
-  std::lock_guard<std::mutex> lock{mutex_};
-  SpanContext context{logger_, id, trace_id_, origin_, decltype(baggage_)(baggage_)};
-  context.extracted_trace_tags_ = extracted_trace_tags_;
-  if (propagated_sampling_priority_ != nullptr) {
-    context.propagated_sampling_priority_.reset(
-        new SamplingPriority(*propagated_sampling_priority_));
-  }
+  SpanContext context{id, trace_id_, std::string(), {}};
+  // The child shares this context's baggage and extracted state.
+  context.baggage_ = std::atomic_load(&baggage_);
+  context.extracted_state_ = extracted_state_;
+  context.has_propagated_sampling_priority_ = has_propagated_sampling_priority_;
+  context.propagated_sampling_priority_ = propagated_sampling_priority_;
+  context.dropped_trace_ = dropped_trace_;
   return context;
 }
 
+void SpanContext::setDroppedTrace(std::shared_ptr<const DroppedTrace> dropped_trace) {
+  dropped_trace_ = std::move(dropped_trace);
+}
+
+InjectedTraceState SpanContext::injectedTraceState(SpanBuffer &pending_traces,
+                                                   bool prioritySamplingEnabled) const {
+  if (dropped_trace_) {
+    InjectedTraceState result;
+    result.sampling_priority =
+        std::make_unique<SamplingPriority>(dropped_trace_->sampling_priority);
+    result.serialized_tags = std::make_unique<std::string>(dropped_trace_->serialized_tags);
+    return result;
+  }
+  return pending_traces.prepareInjection(trace_id_, prioritySamplingEnabled);
+}
+
 ot::expected<void> SpanContext::serialize(std::ostream &writer,
                                           const std::shared_ptr<SpanBuffer> pending_traces,
-                                          bool prioritySamplingEnabled) const try {
+                                          bool prioritySamplingEnabled, bool binary) const try {
   // check ostream state
   if (!writer.good()) {
     return ot::make_unexpected(std::make_error_code(std::errc::io_error));
   }
 
+  if (binary) {
+    const InjectedTraceState trace_state =
+        injectedTraceState(*pending_traces, prioritySamplingEnabled);
+    const SamplingPriority *sampling_priority =
+        prioritySamplingEnabled ? trace_state.sampling_priority.get() : nullptr;
+    // As in JSON, the origin is propagated only with a sampling priority.
+    std::string encoded;
+    encodeBinaryContext(encoded, trace_id_, id_, sampling_priority,
+                        sampling_priority != nullptr ? extracted_state_->origin : std::string(),
+                        trace_state.serialized_tags ? *trace_state.serialized_tags : std::string(),
+                        *std::atomic_load(&baggage_));
+    writer.write(encoded.data(), std::streamsize(encoded.size()));
+    if (!writer.good()) {
+      return ot::make_unexpected(std::make_error_code(std::errc::io_error));
+    }
+    return {};
+  }
+
   json j;
   // JSON numbers only support 64bit IEEE 754, so we encode these as strings.
   j[json_trace_id_key] = std::to_string(trace_id_);
   j[json_parent_id_key] = std::to_string(id_);
-  OptionalSamplingPriority sampling_priority = pending_traces->getSamplingPriority(trace_id_);
-  if (sampling_priority != nullptr && prioritySamplingEnabled) {
-    pending_traces->lockSamplingPriority(trace_id_);
-    j[json_sampling_priority_key] = static_cast<int>(*sampling_priority);
-    if (!origin_.empty()) {
-      j[json_origin_key] = origin_;
+  const InjectedTraceState trace_state =
+      injectedTraceState(*pending_traces, prioritySamplingEnabled);
+  if (trace_state.sampling_priority != nullptr && prioritySamplingEnabled) {
+    j[json_sampling_priority_key] = static_cast<int>(*trace_state.sampling_priority);
+    if (!origin().empty()) {
+      j[json_origin_key] = origin();
     }
   }
-  auto tags = pending_traces->serializeTraceTags(trace_id_);
-  if (tags) {
-    j[json_tags_key] = *tags;
+  if (trace_state.serialized_tags) {
+    j[json_tags_key] = *trace_state.serialized_tags;
   } else {
     j[json_tags_key] = "";
   }
-  j[json_baggage_key] = baggage_;
+  j[json_baggage_key] = *std::atomic_load(&baggage_);
 
   writer << j.dump();
   // check ostream state
@@ -348,10 +669,19 @@ ot::expected<void> SpanContext::serialize(const ot::TextMapWriter &writer,
                                           const std::shared_ptr<SpanBuffer> pending_traces,
                                           std::set<PropagationStyle> styles,
                                           bool prioritySamplingEnabled) const try {
+  // The trace-wide state is obtained once and shared by all of the styles.
+  const InjectedTraceState trace_state =
+      injectedTraceState(*pending_traces, prioritySamplingEnabled);
   ot::expected<void> result;
   for (PropagationStyle style : styles) {
-    result =
-        serialize(writer, pending_traces, propagation_headers[style], prioritySamplingEnabled);
+    if (style == PropagationStyle::W3C) {
+      result = serializeW3C(writer, trace_state, prioritySamplingEnabled);
+    } else if (style == PropagationStyle::B3Single) {
+      result = serializeB3Single(writer, trace_state, prioritySamplingEnabled);
+    } else {
+      result =
+          serialize(writer, trace_state, propagation_headers[style], prioritySamplingEnabled);
+    }
     if (!result) {
       return result;
     }
@@ -362,57 +692,128 @@ ot::expected<void> SpanContext::serialize(const ot::TextMapWriter &writer,
 }
 
 ot::expected<void> SpanContext::serialize(const ot::TextMapWriter &writer,
-                                          const std::shared_ptr<SpanBuffer> pending_traces,
+                                          const InjectedTraceState &trace_state,
                                           const HeadersImpl &headers_impl,
                                           bool prioritySamplingEnabled) const {
-  std::lock_guard<std::mutex> lock{mutex_};
-  auto result = writer.Set(headers_impl.trace_id_header, headers_impl.encode_id(trace_id_));
+  IntegerText buffer;
+  auto result =
+      writer.Set(headers_impl.trace_id_header, headers_impl.encode_id(trace_id_, buffer));
   if (!result) {
     return result;
   }
-  result = writer.Set(headers_impl.span_id_header, headers_impl.encode_id(id_));
+  result = writer.Set(headers_impl.span_id_header, headers_impl.encode_id(id_, buffer));
   if (!result) {
     return result;
   }
 
-  if (prioritySamplingEnabled) {
-    OptionalSamplingPriority sampling_priority = pending_traces->getSamplingPriority(trace_id_);
-    if (sampling_priority != nullptr) {
-      pending_traces->lockSamplingPriority(trace_id_);
-      result = writer.Set(headers_impl.sampling_priority_header,
-                          headers_impl.encode_sampling_priority(*sampling_priority));
-      if (!result) {
-        return result;
-      }
-      if (!origin_.empty()) {
-        result = writer.Set(headers_impl.origin_header, origin_);
-        if (!result) {
-          return result;
-        }
-      }
-    } else if (nginx_opentracing_compatibility_hack_) {
-      // See the comment in the header file on nginx_opentracing_compatibility_hack_.
-      result = writer.Set(headers_impl.sampling_priority_header, "1");
-      if (!result) {
-        return result;
-      }
+  const SamplingPriority *sampling_priority =
+      injectedSamplingPriority(trace_state, prioritySamplingEnabled);
+  if (sampling_priority != nullptr) {
+    result = writer.Set(headers_impl.sampling_priority_header,
+                        headers_impl.encode_sampling_priority(*sampling_priority, buffer));
+    if (!result) {
+      return result;
+    }
+  }
+
+  return serializeDatadogContext(writer, trace_state, prioritySamplingEnabled);
+}
+
+ot::expected<void> SpanContext::serializeB3Single(const ot::TextMapWriter &writer,
+                                                  const InjectedTraceState &trace_state,
+                                                  bool prioritySamplingEnabled) const {
+  B3Text buffer;
+  auto result = writer.Set(
+      propagation_headers.b3_single_header,
+      formatB3(trace_id_, id_, injectedSamplingPriority(trace_state, prioritySamplingEnabled),
+               buffer));
+  if (!result) {
+    return result;
+  }
+
+  return serializeDatadogContext(writer, trace_state, prioritySamplingEnabled);
+}
+
+ot::expected<void> SpanContext::serializeDatadogContext(const ot::TextMapWriter &writer,
+                                                        const InjectedTraceState &trace_state,
+                                                        bool prioritySamplingEnabled) const {
+  ot::expected<void> result;
+  if (prioritySamplingEnabled && trace_state.sampling_priority != nullptr && !origin().empty()) {
+    result = writer.Set(propagation_headers.datadog.origin_header, origin());
+    if (!result) {
+      return result;
     }
   }
 
-  const auto tags = pending_traces->serializeTraceTags(trace_id_);
   // Inject the trace tags, even if they're empty of if an error occurred.
   // This is to work around a quirk of nginx-opentracing.
   // See <https://github.com/DataDog/dd-opentracing-cpp/issues/241>.
-  if (tags) {
-    result = writer.Set(headers_impl.tags_header, *tags);
+  if (trace_state.serialized_tags) {
+    result = writer.Set(propagation_headers.datadog.tags_header, *trace_state.serialized_tags);
   } else {
-    result = writer.Set(headers_impl.tags_header, "");
+    result = writer.Set(propagation_headers.datadog.tags_header, "");
   }
   if (!result) {
     return result;
   }
 
-  for (auto baggage_item : baggage_) {
+  return serializeBaggage(writer);
+}
+
+const SamplingPriority *SpanContext::injectedSamplingPriority(
+    const InjectedTraceState &trace_state, bool prioritySamplingEnabled) const {
+  static const SamplingPriority keep = SamplingPriority::SamplerKeep;
+  if (!prioritySamplingEnabled) {
+    return nullptr;
+  }
+  if (trace_state.sampling_priority == nullptr && nginx_opentracing_compatibility_hack_) {
+    // See the comment in the header file on nginx_opentracing_compatibility_hack_.
+    return &keep;
+  }
+  return trace_state.sampling_priority.get();
+}
+
+ot::expected<void> SpanContext::serializeW3C(const ot::TextMapWriter &writer,
+                                             const InjectedTraceState &trace_state,
+                                             bool prioritySamplingEnabled) const {
+  const SamplingPriority *sampling_priority =
+      injectedSamplingPriority(trace_state, prioritySamplingEnabled);
+
+  TraceParent trace_parent;
+  trace_parent.trace_id_high = trace_id_high(extracted_state_->trace_tags);
+  trace_parent.trace_id = trace_id_;
+  trace_parent.parent_id = id_;
+  // Without a sampling decision to propagate, the trace is marked as sampled,
+  // so that W3C tracers downstream don't drop it.
+  trace_parent.sampled =
+      sampling_priority == nullptr || static_cast<int>(*sampling_priority) > 0;
+  TraceParentText buffer;
+  auto result = writer.Set(propagation_headers.w3c_traceparent_header,
+                           formatTraceParent(trace_parent, buffer));
+  if (!result) {
+    return result;
+  }
+
+  // As in the other styles, the origin is propagated only with a sampling
+  // priority.
+  const std::string tracestate = formatTraceState(
+      sampling_priority, sampling_priority != nullptr ? extracted_state_->origin : std::string(),
+      trace_state.serialized_tags ? *trace_state.serialized_tags : std::string(),
+      extracted_state_->w3c_tracestate);
+  if (!tracestate.empty()) {
+    result = writer.Set(propagation_headers.w3c_tracestate_header, tracestate);
+    if (!result) {
+      return result;
+    }
+  }
+
+  return serializeBaggage(writer);
+}
+
+ot::expected<void> SpanContext::serializeBaggage(const ot::TextMapWriter &writer) const {
+  ot::expected<void> result;
+  const SharedStringMap baggage = std::atomic_load(&baggage_);
+  for (const auto &baggage_item : *baggage) {
     std::string key = std::string(baggage_prefix) + baggage_item.first;
     result = writer.Set(key, baggage_item.second);
     if (!result) {
@@ -434,6 +835,10 @@ ot::expected<std::unique_ptr<ot::SpanContext>> SpanContext::deserialize(
     return {};
   }
 
+  if (reader.peek() == binary_context_marker) {
+    return deserializeBinary(logger, reader);
+  }
+
   uint64_t trace_id, parent_id;
   OptionalSamplingPriority sampling_priority = nullptr;
   std::string origin;
@@ -481,9 +886,14 @@ ot::expected<std::unique_ptr<ot::SpanContext>> SpanContext::deserialize(
   }
 
   auto context =
-      std::make_unique<SpanContext>(logger, parent_id, trace_id, origin, std::move(baggage));
-  context->propagated_sampling_priority_ = std::move(sampling_priority);
-  context->extracted_trace_tags_ = std::move(trace_tags);
+      std::make_unique<SpanContext>(parent_id, trace_id, std::string(), std::move(baggage));
+  if (sampling_priority != nullptr) {
+    context->has_propagated_sampling_priority_ = true;
+    context->propagated_sampling_priority_ = *sampling_priority;
+  }
+  context->extracted_state_ =
+      share(ExtractedTraceState{std::move(origin), std::move(trace_tags), {}});
+  context->extracted_ = true;
   return std::unique_ptr<ot::SpanContext>(std::move(context));
 } catch (const json::parse_error &) {
   return ot::make_unexpected(std::make_error_code(std::errc::invalid_argument));
@@ -494,113 +904,112 @@ ot::expected<std::unique_ptr<ot::SpanContext>> SpanContext::deserialize(
   return ot::make_unexpected(std::make_error_code(std::errc::not_enough_memory));
 }
 
+ot::expected<std::unique_ptr<ot::SpanContext>> SpanContext::deserializeBinary(
+    std::shared_ptr<const Logger> logger, std::istream &reader) try {
+  BinaryContext decoded = readBinaryContext(reader);
+  std::unordered_map<std::string, std::string> trace_tags;
+  try {
+    trace_tags = deserializeTags(decoded.serialized_tags);
+  } catch (const std::invalid_argument &error) {
+    std::ostringstream message;
+    message << "Error decoding the trace tags of a binary context with value "
+            << json_quote(decoded.serialized_tags) << ": " << error.what();
+    logger->Log(LogLevel::error, message.str());
+  }
+
+  auto context = std::make_unique<SpanContext>(decoded.parent_id, decoded.trace_id,
+                                               std::string(), std::move(decoded.baggage));
+  if (decoded.sampling_priority != nullptr) {
+    context->has_propagated_sampling_priority_ = true;
+    context->propagated_sampling_priority_ = *decoded.sampling_priority;
+  }
+  context->extracted_state_ =
+      share(ExtractedTraceState{std::move(decoded.origin), std::move(trace_tags), {}});
+  context->extracted_ = true;
+  return std::unique_ptr<ot::SpanContext>(std::move(context));
+} catch (const std::invalid_argument &error) {
+  logger->Log(LogLevel::error,
+              std::string("Unable to decode a binary span context: ") + error.what());
+  return ot::make_unexpected(ot::span_context_corrupted_error);
+}
+
 ot::expected<std::unique_ptr<ot::SpanContext>> SpanContext::deserialize(
     std::shared_ptr<const Logger> logger, const ot::TextMapReader &reader,
     std::set<PropagationStyle> styles) try {
-  // `context` is the value that we are preparing to return.
-  std::unique_ptr<ot::SpanContext> context = nullptr;
+  if (styles.empty()) {
+    return {};
+  }
 
   // `PropagationStyle` determines from which headers context will be
   // extracted.
   //
-  // We try to extract context in each configured `PropagationStyle`.  The call
-  // to `SpanContext::deserialize`, below, will return one of three kinds of
-  // values:
+  // We extract the headers of every configured `PropagationStyle` in a single
+  // pass over the `reader`, and then try to make a context out of each
+  // style's headers:
   //
-  // 1. An error means that an error occurred while attempting to deserialize
-  //    context in that style, and so we fail without trying any further styles.
-  // 2. A `nullptr` means that no context could be extracted in that style.
-  //    It's still possible that one of the other styles (if active) will
-  //    succeed.
-  // 3. A `SpanContext` object means that context was extracted successfully in
-  //    that style.
+  // 1. If a header of any style cannot be decoded, or if a style's headers do
+  //    not make a valid context, then we fail without trying any further
+  //    styles.
+  // 2. If a style's headers are absent, then no context could be extracted in
+  //    that style.  It's still possible that one of the other styles (if
+  //    active) will succeed.
+  // 3. Otherwise, context was extracted successfully in that style.
   //
   // It's also possible that a context is successfully extracted in two or more
-  // different styles.  In that case, the resulting `SpanContext` objects must
-  // all be equivalent (otherwise, which would we return?), where equivalence
-  // is defined by `SpanContext::operator==`.
+  // different styles.  In that case, the resulting contexts must all be
+  // equivalent (otherwise, which would we return?).  The origin, trace tags,
+  // and baggage are shared by all styles, so only the IDs and the sampling
+  // priority need to be compared.
+  HeaderExtraction extraction{styles, *logger};
+  // Capture only a reference, so that `std::function` need not allocate.
+  auto result = reader.ForeachKey([&extraction](ot::string_view key, ot::string_view value) {
+    return extraction(key, value);
+  });
+  if (!result) {  // "if unexpected", hence "return {}" from above is fine.
+    return ot::make_unexpected(result.error());
+  }
+  extraction.finishW3C();
+
+  // `ids` refers to the IDs of the context that we are preparing to return.
+  ExtractedIds *ids = nullptr;
   for (PropagationStyle style : styles) {
-    auto result = SpanContext::deserialize(logger, reader, propagation_headers[style]);
-    if (!result) {
-      return ot::make_unexpected(result.error());
+    ExtractedIds &style_ids = extraction.ids(style);
+    if (!style_ids.trace_id_set && !style_ids.parent_id_set) {
+      // No context in this style.
+      continue;
     }
-    if (result.value() != nullptr) {
-      if (context != nullptr && *dynamic_cast<SpanContext *>(result.value().get()) !=
-                                    *dynamic_cast<SpanContext *>(context.get())) {
-        logger->Log(LogLevel::error,
-                    "Attempt to deserialize SpanContext with conflicting Datadog and B3 headers");
-        return ot::make_unexpected(ot::span_context_corrupted_error);
+    if (const auto result = enforce_tag_presence_policy(
+            style_ids.trace_id_set, style_ids.parent_id_set, extraction.origin_set)) {
+      if (!*result) {
+        return ot::make_unexpected(result->error());
       }
-      context = std::move(result.value());
+      continue;
     }
+    if (ids != nullptr && !(*ids == style_ids)) {
+      logger->Log(LogLevel::error,
+                  "Attempt to deserialize SpanContext with conflicting headers of different "
+                  "propagation styles");
+      return ot::make_unexpected(ot::span_context_corrupted_error);
+    }
+    ids = &style_ids;
   }
-  return context;
-} catch (const std::bad_alloc &) {
-  return ot::make_unexpected(std::make_error_code(std::errc::not_enough_memory));
-}
-
-ot::expected<std::unique_ptr<ot::SpanContext>> SpanContext::deserialize(
-    std::shared_ptr<const Logger> logger, const ot::TextMapReader &reader,
-    const HeadersImpl &headers_impl) {
-  uint64_t trace_id, parent_id;
-  OptionalSamplingPriority sampling_priority = nullptr;
-  std::string origin;
-  bool trace_id_set = false;
-  bool parent_id_set = false;
-  bool origin_set = false;
-  std::unordered_map<std::string, std::string> baggage;
-  std::unordered_map<std::string, std::string> trace_tags;
-  auto result =
-      reader.ForeachKey([&](ot::string_view key, ot::string_view value) -> ot::expected<void> {
-        try {
-          if (equals_ignore_case(key, headers_impl.trace_id_header)) {
-            trace_id = parse_uint64(value, headers_impl.base);
-            trace_id_set = true;
-          } else if (equals_ignore_case(key, headers_impl.span_id_header)) {
-            parent_id = parse_uint64(value, headers_impl.base);
-            parent_id_set = true;
-          } else if (equals_ignore_case(key, headers_impl.sampling_priority_header)) {
-            sampling_priority = asSamplingPriority(std::stoi(value));
-            if (sampling_priority == nullptr) {
-              // The sampling_priority key was present, but the value makes no sense.
-              logger->Log(LogLevel::error,
-                          "Invalid sampling_priority value in serialized SpanContext");
-              return ot::make_unexpected(ot::span_context_corrupted_error);
-            }
-          } else if (headers_impl.origin_header != nullptr &&
-                     equals_ignore_case(key, headers_impl.origin_header)) {
-            origin = value;
-            origin_set = true;
-          } else if (has_prefix(key, baggage_prefix)) {
-            baggage.emplace(std::string{std::begin(key) + baggage_prefix.size(), std::end(key)},
-                            value);
-          } else if (equals_ignore_case(key, headers_impl.tags_header)) {
-            trace_tags = deserializeTags(value);
-          }
-        } catch (const std::logic_error &error) {
-          std::ostringstream message;
-          message << "Error decoding context key " << json_quote(key) << " with value "
-                  << json_quote(value) << ": " << error.what();
-          logger->Log(LogLevel::error, message.str());
-          // Tolerate failure to parse `tags_header`, but not e.g.
-          // `trace_id_header`.
-          if (!equals_ignore_case(key, headers_impl.tags_header)) {
-            return ot::make_unexpected(ot::span_context_corrupted_error);
-          }
-        }
-        return {};
-      });
-  if (!result) {  // "if unexpected", hence "return {}" from above is fine.
-    return ot::make_unexpected(result.error());
+  if (ids == nullptr) {
+    return {};
   }
-  if (const auto result = enforce_tag_presence_policy(trace_id_set, parent_id_set, origin_set)) {
-    return std::move(*result);
+
+  auto context = std::make_unique<SpanContext>(ids->parent_id, ids->trace_id, std::string(),
+                                               std::move(extraction.baggage));
+  if (ids->sampling_priority != nullptr) {
+    context->has_propagated_sampling_priority_ = true;
+    context->propagated_sampling_priority_ = *ids->sampling_priority;
   }
-  auto context =
-      std::make_unique<SpanContext>(logger, parent_id, trace_id, origin, std::move(baggage));
-  context->propagated_sampling_priority_ = std::move(sampling_priority);
-  context->extracted_trace_tags_ = std::move(trace_tags);
+  context->extracted_state_ = share(ExtractedTraceState{
+      std::move(extraction.origin), std::move(extraction.trace_tags),
+      std::move(extraction.w3c_state.other_members)});
+  context->extracted_ = true;
   return std::unique_ptr<ot::SpanContext>(std::move(context));
+} catch (const std::bad_alloc &) {
+  return ot::make_unexpected(std::make_error_code(std::errc::not_enough_memory));
 }
 
 }  // namespace opentracing
@@ -4,7 +4,6 @@
 #include <datadog/opentracing.h>
 #include <opentracing/tracer.h>
 
-#include <mutex>
 #include <set>
 #include <unordered_map>
 
@@ -28,20 +27,66 @@ std::vector<ot::string_view> getPropagationHeaderNames(const std::set<Propagatio
 class SpanBuffer;
 struct HeadersImpl;
 
+// `DroppedTrace` is the state that a `SpanContext` carries for a trace that
+// was dropped when its local root span started (see
+// `TracerOptions::early_trace_drop`).  Such a trace is not tracked by the
+// `SpanBuffer`, so the information needed to propagate it travels with its
+// span contexts instead.
+struct DroppedTrace {
+  SamplingPriority sampling_priority;
+  // The value of the "x-datadog-tags" header, possibly empty.
+  std::string serialized_tags;
+};
+
+// `InjectedTraceState` is the trace-wide information that
+// `SpanContext::serialize` injects along with a span context's IDs.  See
+// `SpanBuffer::prepareInjection`.
+struct InjectedTraceState {
+  OptionalSamplingPriority sampling_priority;
+  // The value of the "x-datadog-tags" header, or `nullptr` if the trace tags
+  // could not be serialized.
+  std::unique_ptr<std::string> serialized_tags;
+};
+
+// `SharedStringMap` is an immutable name->value mapping that is shared among
+// a span context and the contexts derived from it.  A context that modifies
+// its mapping replaces it with a modified copy.
+using SharedStringMap = std::shared_ptr<const std::unordered_map<std::string, std::string>>;
+
+// `ExtractedTraceState` is the trace-wide state that a span context received
+// from another service, other than its sampling priority.  It is immutable,
+// and shared among the extracted context and the contexts derived from it.
+struct ExtractedTraceState {
+  // The propagated "origin", or empty if none was provided.
+  std::string origin;
+  // Trace tags are key/value pairs that are propagated along a trace.  These
+  // are the trace tags parsed from the "x-datadog-tags" header.  If the
+  // context is later injected, these trace tags will be included in the
+  // "x-datadog-tags" header, possibly modified.
+  std::unordered_map<std::string, std::string> trace_tags;
+  // The members of an extracted W3C "tracestate" header other than Datadog's,
+  // which are injected unmodified in the W3C style.
+  std::string w3c_tracestate;
+};
+
+// A `SpanContext` is immutable once it has been shared, except for its
+// baggage.  The baggage is an immutable snapshot that `setBaggageItem`
+// atomically replaces, so a context needs no lock.  Copying a context, or
+// deriving a child context with `withId`, copies a few words and shared
+// pointers, and does not allocate.
 class SpanContext : public ot::SpanContext {
  public:
-  SpanContext(std::shared_ptr<const Logger> logger, uint64_t id, uint64_t trace_id,
-              std::string origin, std::unordered_map<std::string, std::string> &&baggage);
+  SpanContext(uint64_t id, uint64_t trace_id, std::string origin,
+              std::unordered_map<std::string, std::string> &&baggage);
 
   // Enables a hack, see the comment below on nginx_opentracing_compatibility_hack_.
   static SpanContext NginxOpenTracingCompatibilityHackSpanContext(
-      std::shared_ptr<const Logger> logger, uint64_t id, uint64_t trace_id,
-      std::unordered_map<std::string, std::string> &&baggage);
+      uint64_t id, uint64_t trace_id, std::unordered_map<std::string, std::string> &&baggage);
 
   SpanContext(const SpanContext &other);
   SpanContext(SpanContext &&other);
-  SpanContext &operator=(const SpanContext &other);
-  SpanContext &operator=(SpanContext &&other);
+  SpanContext &operator=(const SpanContext &other) = delete;
+  SpanContext &operator=(SpanContext &&other) = delete;
   bool operator==(const SpanContext &other) const;
   bool operator!=(const SpanContext &other) const;
 
@@ -52,14 +97,18 @@ class SpanContext : public ot::SpanContext {
   std::string ToTraceID() const noexcept override;
   std::string ToSpanID() const noexcept override;
 
+  // Add the specified baggage item, unless an item having the specified `key`
+  // already exists.  This is safe to call concurrently with the other member
+  // functions.
   void setBaggageItem(ot::string_view key, ot::string_view value) noexcept;
 
   std::string baggageItem(ot::string_view key) const;
 
-  // Serializes the context into the given writer.
+  // Serializes the context into the given writer, as JSON or, if `binary` is
+  // true, in the format of `binary_propagation.h`.
   ot::expected<void> serialize(std::ostream &writer,
                                const std::shared_ptr<SpanBuffer> pending_traces,
-                               bool prioritySamplingEnabled) const;
+                               bool prioritySamplingEnabled, bool binary = false) const;
   ot::expected<void> serialize(const ot::TextMapWriter &writer,
                                const std::shared_ptr<SpanBuffer> pending_traces,
                                std::set<PropagationStyle> styles,
@@ -67,11 +116,18 @@ class SpanContext : public ot::SpanContext {
 
   SpanContext withId(uint64_t id) const;
 
-  // Returns a new context from the given reader.
+  // Mark this context as belonging to the specified `dropped_trace`.  Contexts
+  // derived from this one using `withId` belong to the same dropped trace.
+  // This must be called before the context is shared with other threads.
+  void setDroppedTrace(std::shared_ptr<const DroppedTrace> dropped_trace);
+
+  // Returns a new context from the given reader.  Errors are logged to the
+  // specified `logger`, which the returned context does not retain.  A
+  // `std::istream` may contain either encoding produced by `serialize`.
   static ot::expected<std::unique_ptr<ot::SpanContext>> deserialize(
-      std::shared_ptr<const Logger> tracer, std::istream &reader);
+      std::shared_ptr<const Logger> logger, std::istream &reader);
   static ot::expected<std::unique_ptr<ot::SpanContext>> deserialize(
-      std::shared_ptr<const Logger> tracer, const ot::TextMapReader &reader,
+      std::shared_ptr<const Logger> logger, const ot::TextMapReader &reader,
       std::set<PropagationStyle> styles);
 
   uint64_t id() const;
@@ -81,17 +137,54 @@ class SpanContext : public ot::SpanContext {
   // set a sampling priority.
   OptionalSamplingPriority getPropagatedSamplingPriority() const;
   // Returns the propagated "origin". It returns an empty string if no origin was provided.
-  const std::string origin() const;
-  std::unordered_map<std::string, std::string> getExtractedTraceTags() const;
+  const std::string &origin() const;
+  const std::unordered_map<std::string, std::string> &getExtractedTraceTags() const;
+  // Returns whether this context was produced by `deserialize`, i.e. whether
+  // it was received from another service rather than created locally.
+  bool extracted() const;
+  // Returns the state of the dropped trace to which this context belongs, or
+  // returns `nullptr` if this context's trace is tracked by the `SpanBuffer`.
+  const std::shared_ptr<const DroppedTrace> &droppedTrace() const;
 
  private:
-  static ot::expected<std::unique_ptr<ot::SpanContext>> deserialize(
-      std::shared_ptr<const Logger> tracer, const ot::TextMapReader &reader,
-      const HeadersImpl &headers_impl);
   ot::expected<void> serialize(const ot::TextMapWriter &writer,
-                               const std::shared_ptr<SpanBuffer> pending_traces,
+                               const InjectedTraceState &trace_state,
                                const HeadersImpl &headers_impl,
                                bool prioritySamplingEnabled) const;
+  // Decode a context in the format of `binary_propagation.h` from the
+  // specified `reader`.
+  static ot::expected<std::unique_ptr<ot::SpanContext>> deserializeBinary(
+      std::shared_ptr<const Logger> logger, std::istream &reader);
+  // Inject this context in the W3C style, which does not fit in
+  // `HeadersImpl`.
+  ot::expected<void> serializeW3C(const ot::TextMapWriter &writer,
+                                  const InjectedTraceState &trace_state,
+                                  bool prioritySamplingEnabled) const;
+  // Inject this context in the single header form of B3, which does not fit
+  // in `HeadersImpl`.
+  ot::expected<void> serializeB3Single(const ot::TextMapWriter &writer,
+                                       const InjectedTraceState &trace_state,
+                                       bool prioritySamplingEnabled) const;
+  // Inject the Datadog-specific context shared by the styles other than W3C:
+  // the origin (if there is a sampling priority), the trace tags, and the
+  // baggage items.
+  ot::expected<void> serializeDatadogContext(const ot::TextMapWriter &writer,
+                                             const InjectedTraceState &trace_state,
+                                             bool prioritySamplingEnabled) const;
+  // Inject the baggage items.
+  ot::expected<void> serializeBaggage(const ot::TextMapWriter &writer) const;
+  // Return the sampling priority to inject, or return `nullptr` if none is
+  // to be injected.
+  const SamplingPriority *injectedSamplingPriority(const InjectedTraceState &trace_state,
+                                                   bool prioritySamplingEnabled) const;
+
+  // Return the sampling priority of this context's trace and the
+  // serialization of its trace tags.  The values are taken from
+  // `dropped_trace_` if this context belongs to a dropped trace, and are
+  // otherwise obtained from the specified `pending_traces`, which also locks
+  // the trace's sampling priority if `prioritySamplingEnabled` is `true`.
+  InjectedTraceState injectedTraceState(SpanBuffer &pending_traces,
+                                        bool prioritySamplingEnabled) const;
 
   // Terrible, terrible hack; to get around:
   // https://github.com/opentracing-contrib/nginx-opentracing/blob/master/opentracing/src/discover_span_context_keys.cpp#L49-L50
@@ -111,20 +204,26 @@ class SpanContext : public ot::SpanContext {
   // make it more of a pain to do and less obvious what's happening.
   bool nginx_opentracing_compatibility_hack_ = false;
 
-  std::shared_ptr<const Logger> logger_;
-  uint64_t id_;
-  uint64_t trace_id_;
-  OptionalSamplingPriority propagated_sampling_priority_ = nullptr;
-  std::string origin_;
-  std::unordered_map<std::string, std::string> baggage_;
-  // Trace tags are key/value pairs that are propagated along a trace.  If this
-  // `SpanContext` was extracted, then `extracted_trace_tags_` contains any
-  // trace tags parsed from the "x-datadog-trace-tags" header.  If this
-  // `SpanContext` is later injected, these trace tags will be included as the
-  // "x-datadog-trace-tags" header, possibly modified.
-  std::unordered_map<std::string, std::string> extracted_trace_tags_;
-
-  mutable std::mutex mutex_;
+  const uint64_t id_;
+  const uint64_t trace_id_;
+  // The propagated sampling priority is stored inline rather than as an
+  // `OptionalSamplingPriority`, so that copying a context doesn't allocate.
+  bool has_propagated_sampling_priority_ = false;
+  SamplingPriority propagated_sampling_priority_ = SamplingPriority::SamplerKeep;
+  // `baggage_` is never null.  It is shared with the contexts derived from
+  // this one until `setBaggageItem` replaces it.  It is accessed only with
+  // `std::atomic_load` and friends, because `setBaggageItem` may replace it
+  // while another thread reads it.
+  SharedStringMap baggage_;
+  // `extracted_state_` is never null.  It is empty unless this context, or
+  // the context from which it was derived, was extracted, and it is shared
+  // with the contexts derived from this one.
+  std::shared_ptr<const ExtractedTraceState> extracted_state_;
+  bool extracted_ = false;
+  // If this context's trace was dropped when its local root span started,
+  // then `dropped_trace_` is what `serialize` propagates in place of the
+  // state kept by the `SpanBuffer`.
+  std::shared_ptr<const DroppedTrace> dropped_trace_;
 };
 
 }  // namespace opentracing
@@ -0,0 +1,436 @@
+#include "spool.h"
+
+#ifndef _MSC_VER
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include <algorithm>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <stdexcept>
+#include <vector>
+
+namespace datadog {
+namespace opentracing {
+
+// A segment is a sequence of records, each of which has the following layout:
+//
+//     body size  checksum   state   body
+//     4 bytes    4 bytes    1 byte  <body size> bytes
+//
+// where the sizes are little-endian, the checksum is the CRC-32 of the body,
+// and the state is `record_sent` once the payload has been sent (and
+// `record_pending` before then).  The body is:
+//
+//     header count                 4 bytes
+//     for each header: name size   4 bytes
+//                      name        <name size> bytes
+//                      value size  4 bytes
+//                      value       <value size> bytes
+//     payload                      the rest of the body
+//
+// A record whose checksum does not match its body (e.g. because the process
+// died while appending it) ends the segment.
+
+namespace {
+
+const std::size_t record_header_size = 9;
+const char record_pending = 0;
+const char record_sent = 1;
+const char segment_suffix[] = ".segment";
+// How many processes can use the same spool directory.
+const int max_subdirectories = 64;
+const std::size_t min_segment_size = 64 * 1024;
+const std::size_t max_segment_size = 8 * 1024 * 1024;
+
+std::string errorText(const std::string &what) { return what + ": " + std::strerror(errno); }
+
+void appendFixed32(std::string &destination, uint32_t value) {
+  for (int i = 0; i < 4; ++i) {
+    destination += static_cast<char>(value & 0xff);
+    value >>= 8;
+  }
+}
+
+uint32_t readFixed32(const char *source) {
+  uint32_t value = 0;
+  for (int i = 0; i < 4; ++i) {
+    value |= uint32_t(static_cast<unsigned char>(source[i])) << (8 * i);
+  }
+  return value;
+}
+
+uint32_t checksum(const char *data, std::size_t size) {
+  return uint32_t(crc32(crc32(0L, Z_NULL, 0), reinterpret_cast<const Bytef *>(data), uInt(size)));
+}
+
+std::string encodeRecord(const std::map<std::string, std::string> &headers,
+                         const std::string &payload) {
+  std::string body;
+  appendFixed32(body, uint32_t(headers.size()));
+  for (const auto &header : headers) {
+    appendFixed32(body, uint32_t(header.first.size()));
+    body += header.first;
+    appendFixed32(body, uint32_t(header.second.size()));
+    body += header.second;
+  }
+  body += payload;
+
+  std::string record;
+  record.reserve(record_header_size + body.size());
+  appendFixed32(record, uint32_t(body.size()));
+  appendFixed32(record, checksum(body.data(), body.size()));
+  record += record_pending;
+  record += body;
+  return record;
+}
+
+// Decode the specified record `body` into `headers` and `payload`. Return false if it is invalid.
+bool decodeBody(const char *body, std::size_t size, std::map<std::string, std::string> &headers,
+                std::string &payload) {
+  const char *const end = body + size;
+  auto readSized = [&](std::string &destination) {
+    if (end - body < 4) {
+      return false;
+    }
+    const uint32_t length = readFixed32(body);
+    body += 4;
+    if (std::size_t(end - body) < length) {
+      return false;
+    }
+    destination.assign(body, length);
+    body += length;
+    return true;
+  };
+  if (end - body < 4) {
+    return false;
+  }
+  uint32_t count = readFixed32(body);
+  body += 4;
+  headers.clear();
+  while (count-- != 0) {
+    std::string name;
+    std::string value;
+    if (!readSized(name) || !readSized(value)) {
+      return false;
+    }
+    headers[std::move(name)] = std::move(value);
+  }
+  payload.assign(body, end);
+  return true;
+}
+
+bool writeAll(int file, const std::string &data) {
+  const char *next = data.data();
+  std::size_t remaining = data.size();
+  while (remaining != 0) {
+    const ssize_t written = ::write(file, next, remaining);
+    if (written == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      return false;
+    }
+    next += written;
+    remaining -= std::size_t(written);
+  }
+  return true;
+}
+
+}  // namespace
+
+Spool::Spool(const std::string &directory, std::size_t max_bytes,
+             std::shared_ptr<const Logger> logger)
+    : max_bytes_(max_bytes),
+      segment_size_(std::min(std::max(max_bytes / 8, min_segment_size), max_segment_size)),
+      logger_(logger) {
+  if (mkdir(directory.c_str(), 0700) != 0 && errno != EEXIST) {
+    throw std::runtime_error(errorText("Unable to create spool directory " + directory));
+  }
+  for (int i = 0; i < max_subdirectories && lock_file_ == -1; ++i) {
+    const std::string path = directory + "/" + std::to_string(i);
+    if (mkdir(path.c_str(), 0700) != 0 && errno != EEXIST) {
+      continue;
+    }
+    const int file = open((path + "/lock").c_str(), O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+    if (file == -1) {
+      continue;
+    }
+    if (flock(file, LOCK_EX | LOCK_NB) != 0) {
+      // Another process is using this subdirectory.
+      close(file);
+      continue;
+    }
+    lock_file_ = file;
+    path_ = path;
+  }
+  if (lock_file_ == -1) {
+    throw std::runtime_error("Unable to lock a subdirectory of spool directory " + directory);
+  }
+  recover();
+}
+
+Spool::~Spool() {
+  unmapOldestSegment();
+  closeWriteSegment();
+  close(lock_file_);
+}
+
+std::string Spool::segmentPath(uint64_t sequence) const {
+  // Zero padded, so that the names sort in sequence.
+  char name[32];
+  std::snprintf(name, sizeof(name), "%020llu", static_cast<unsigned long long>(sequence));
+  return path_ + "/" + name + segment_suffix;
+}
+
+void Spool::recover() {
+  DIR *directory = opendir(path_.c_str());
+  if (directory == nullptr) {
+    throw std::runtime_error(errorText("Unable to read spool directory " + path_));
+  }
+  std::vector<Segment> found;
+  const std::size_t suffix_size = sizeof(segment_suffix) - 1;
+  while (const dirent *entry = readdir(directory)) {
+    const std::string name = entry->d_name;
+    if (name.size() <= suffix_size ||
+        name.compare(name.size() - suffix_size, suffix_size, segment_suffix) != 0) {
+      continue;
+    }
+    char *end;
+    const uint64_t sequence = std::strtoull(name.c_str(), &end, 10);
+    struct stat status;
+    if (end != name.c_str() + name.size() - suffix_size ||
+        stat(segmentPath(sequence).c_str(), &status) != 0) {
+      continue;
+    }
+    if (status.st_size == 0) {
+      unlink(segmentPath(sequence).c_str());
+      continue;
+    }
+    found.push_back(Segment{sequence, std::size_t(status.st_size)});
+  }
+  closedir(directory);
+
+  std::sort(found.begin(), found.end(), [](const Segment &left, const Segment &right) {
+    return left.sequence < right.sequence;
+  });
+  for (const Segment &segment : found) {
+    segments_.push_back(segment);
+    total_bytes_ += segment.size;
+    next_sequence_ = segment.sequence + 1;
+  }
+  if (!found.empty()) {
+    logger_->Log(LogLevel::info, "Recovered " + std::to_string(total_bytes_) +
+                                     " bytes of spooled traces from " + path_);
+  }
+}
+
+bool Spool::push(const std::map<std::string, std::string> &headers, const std::string &payload) {
+  const std::string record = encodeRecord(headers, payload);
+  if (record.size() > max_bytes_) {
+    logger_->Log(LogLevel::error, "Unable to spool " + std::to_string(record.size()) +
+                                      " bytes of traces, which exceeds the spool's size limit");
+    return false;
+  }
+
+  std::lock_guard<std::mutex> lock(mutex_);
+  std::size_t deleted = 0;
+  while (!segments_.empty() && total_bytes_ + record.size() > max_bytes_) {
+    deleted += deleteOldestSegment();
+  }
+  if (deleted != 0) {
+    logger_->Log(LogLevel::error, "Spool is full; dropped the oldest " + std::to_string(deleted) +
+                                      " bytes of traces");
+  }
+  if (write_file_ != -1 && segments_.back().size >= segment_size_) {
+    closeWriteSegment();
+  }
+  if (write_file_ == -1 && !openWriteSegment()) {
+    return false;
+  }
+  if (!writeAll(write_file_, record)) {
+    logger_->Log(LogLevel::error, errorText("Unable to spool traces to " + path_));
+    // Part of the record might have been written, so don't append after it.
+    struct stat status;
+    if (fstat(write_file_, &status) == 0) {
+      total_bytes_ += std::size_t(status.st_size) - segments_.back().size;
+      segments_.back().size = std::size_t(status.st_size);
+    }
+    closeWriteSegment();
+    return false;
+  }
+  segments_.back().size += record.size();
+  total_bytes_ += record.size();
+  return true;
+}
+
+bool Spool::front(std::map<std::string, std::string> &headers, std::string &payload,
+                  Position &position) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  while (!segments_.empty()) {
+    if (read_data_ == nullptr) {
+      if (segments_.size() == 1) {
+        // The newest segment is not mapped while it is appended to. Start another.
+        closeWriteSegment();
+        if (segments_.empty()) {
+          break;
+        }
+      }
+      if (!mapOldestSegment()) {
+        deleteOldestSegment();
+        continue;
+      }
+    }
+    const char *const record = read_data_ + read_offset_;
+    if (read_size_ - read_offset_ >= record_header_size) {
+      const std::size_t body_size = readFixed32(record);
+      const char *const body = record + record_header_size;
+      if (body_size != 0 && read_size_ - read_offset_ - record_header_size >= body_size &&
+          checksum(body, body_size) == readFixed32(record + 4)) {
+        if (record[8] != record_pending) {
+          read_offset_ += record_header_size + body_size;
+          continue;
+        }
+        if (decodeBody(body, body_size, headers, payload)) {
+          position.segment = segments_.front().sequence;
+          position.offset = read_offset_;
+          return true;
+        }
+      }
+      logger_->Log(LogLevel::error, "Ignoring the corrupt end of spool segment " +
+                                        segmentPath(segments_.front().sequence));
+    }
+    // Every payload in the oldest segment has been sent.
+    deleteOldestSegment();
+  }
+  return false;
+}
+
+void Spool::pop(const Position &position) {
+  std::lock_guard<std::mutex> lock(mutex_);
+  if (segments_.empty() || read_data_ == nullptr ||
+      segments_.front().sequence != position.segment || read_offset_ != position.offset) {
+    return;
+  }
+  char *const record = read_data_ + read_offset_;
+  record[8] = record_sent;
+  read_offset_ += record_header_size + readFixed32(record);
+  if (read_offset_ >= read_size_) {
+    deleteOldestSegment();
+  }
+}
+
+bool Spool::openWriteSegment() {
+  const uint64_t sequence = next_sequence_++;
+  write_file_ = open(segmentPath(sequence).c_str(),
+                     O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0600);
+  if (write_file_ == -1) {
+    logger_->Log(LogLevel::error, errorText("Unable to create spool segment " +
+                                            segmentPath(sequence)));
+    return false;
+  }
+  segments_.push_back(Segment{sequence, 0});
+  return true;
+}
+
+void Spool::closeWriteSegment() {
+  if (write_file_ == -1) {
+    return;
+  }
+  close(write_file_);
+  write_file_ = -1;
+  if (segments_.back().size == 0) {
+    unlink(segmentPath(segments_.back().sequence).c_str());
+    segments_.pop_back();
+  }
+}
+
+bool Spool::mapOldestSegment() {
+  const std::string path = segmentPath(segments_.front().sequence);
+  const int file = open(path.c_str(), O_RDWR | O_CLOEXEC);
+  if (file == -1) {
+    logger_->Log(LogLevel::error, errorText("Unable to open spool segment " + path));
+    return false;
+  }
+  struct stat status;
+  void *data = MAP_FAILED;
+  if (fstat(file, &status) == 0 && status.st_size > 0) {
+    data = mmap(nullptr, std::size_t(status.st_size), PROT_READ | PROT_WRITE, MAP_SHARED, file, 0);
+    if (data == MAP_FAILED) {
+      logger_->Log(LogLevel::error, errorText("Unable to map spool segment " + path));
+    }
+  }
+  // The mapping remains valid once the file is closed.
+  close(file);
+  if (data == MAP_FAILED) {
+    return false;
+  }
+  read_data_ = static_cast<char *>(data);
+  read_size_ = std::size_t(status.st_size);
+  read_offset_ = 0;
+  return true;
+}
+
+void Spool::unmapOldestSegment() {
+  if (read_data_ != nullptr) {
+    munmap(read_data_, read_size_);
+    read_data_ = nullptr;
+  }
+  read_size_ = 0;
+  read_offset_ = 0;
+}
+
+std::size_t Spool::deleteOldestSegment() {
+  if (segments_.size() == 1) {
+    closeWriteSegment();
+    if (segments_.empty()) {
+      return 0;
+    }
+  }
+  unmapOldestSegment();
+  const Segment oldest = segments_.front();
+  segments_.pop_front();
+  unlink(segmentPath(oldest.sequence).c_str());
+  total_bytes_ -= oldest.size;
+  return oldest.size;
+}
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#else  // _MSC_VER
+
+#include <stdexcept>
+
+namespace datadog {
+namespace opentracing {
+
+Spool::Spool(const std::string &, std::size_t max_bytes, std::shared_ptr<const Logger> logger)
+    : max_bytes_(max_bytes), segment_size_(0), logger_(logger) {
+  throw std::runtime_error("Spooling traces is not supported on Windows");
+}
+
+Spool::~Spool() {}
+
+bool Spool::push(const std::map<std::string, std::string> &, const std::string &) {
+  return false;
+}
+
+bool Spool::front(std::map<std::string, std::string> &, std::string &, Position &) {
+  return false;
+}
+
+void Spool::pop(const Position &) {}
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif  // _MSC_VER
@@ -0,0 +1,111 @@
+#ifndef DD_OPENTRACING_SPOOL_H
+#define DD_OPENTRACING_SPOOL_H
+
+// This component provides a bounded queue on disk of the payloads that
+// `AgentWriter` could not send to the agent, so that they can be sent once the
+// agent is back (e.g. after it restarts during a deploy) instead of being
+// dropped.
+//
+// A spool is a directory of append-only segment files.  Payloads are appended
+// to the newest segment, and read back in order by memory-mapping the oldest
+// segment.  When appending a payload would exceed the spool's size budget,
+// the oldest segments are deleted.  The layout of a segment is described in
+// the cpp file.
+//
+// Each process uses its own numbered subdirectory of the configured
+// directory, which it locks, so that processes that share a configuration
+// (e.g. nginx workers) do not share segments.  A process adopts the payloads
+// left in a subdirectory that is no longer locked by the process that wrote
+// them, so payloads also survive a restart of the application.
+//
+// Not available on Windows, where the constructor throws.
+
+#include <cstdint>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+
+#include "logger.h"
+
+namespace datadog {
+namespace opentracing {
+
+// A thread-safe queue of payloads (and their HTTP headers) stored on disk.
+class Spool {
+ public:
+  // The position of a payload returned by `front`.
+  struct Position {
+    uint64_t segment = 0;
+    std::size_t offset = 0;
+  };
+
+  // Open a spool that uses at most the specified `max_bytes` of disk space
+  // in a subdirectory of the specified `directory`, creating them as
+  // necessary.  Throw a `std::runtime_error` if no subdirectory can be used.
+  Spool(const std::string& directory, std::size_t max_bytes, std::shared_ptr<const Logger> logger);
+  ~Spool();
+
+  Spool(const Spool&) = delete;
+  Spool& operator=(const Spool&) = delete;
+
+  // Append the specified `payload` and its `headers`, deleting the oldest
+  // segments if necessary to stay within budget.  Return false, and log an
+  // error, if the payload could not be written.
+  bool push(const std::map<std::string, std::string>& headers, const std::string& payload);
+  // Load the oldest payload that has not been popped, and its headers, into
+  // the specified `payload` and `headers`, and its position into the
+  // specified `position`.  Return false if there is no such payload.
+  bool front(std::map<std::string, std::string>& headers, std::string& payload,
+             Position& position);
+  // Mark the payload at the specified `position`, as returned by `front`, as
+  // sent, so that it is not returned again (even by a spool opened later on
+  // the same subdirectory).  Do nothing if the payload has been deleted since.
+  void pop(const Position& position);
+
+  // Return the subdirectory that this spool uses.
+  const std::string& path() const { return path_; }
+
+ private:
+  struct Segment {
+    uint64_t sequence;
+    std::size_t size;
+  };
+
+  std::string segmentPath(uint64_t sequence) const;
+  // Add the segments left by a previous process to `segments_`.
+  void recover();
+  // Create a segment to which payloads are appended. Return false on error.
+  bool openWriteSegment();
+  void closeWriteSegment();
+  // Map the oldest segment into memory. Return false on error.
+  bool mapOldestSegment();
+  void unmapOldestSegment();
+  // Delete the oldest segment, and return its size.
+  std::size_t deleteOldestSegment();
+
+  const std::size_t max_bytes_;
+  // Segments are started once the newest one is at least this large.
+  const std::size_t segment_size_;
+  std::shared_ptr<const Logger> logger_;
+  std::string path_;
+  // Holds the lock on `path_`.
+  int lock_file_ = -1;
+
+  std::mutex mutex_;
+  // Oldest first. The newest segment is appended to if `write_file_` is open.
+  std::deque<Segment> segments_;
+  std::size_t total_bytes_ = 0;
+  uint64_t next_sequence_ = 0;
+  int write_file_ = -1;
+  // The oldest segment, when it is mapped, and the offset of its next payload.
+  char* read_data_ = nullptr;
+  std::size_t read_size_ = 0;
+  std::size_t read_offset_ = 0;
+};
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif  // DD_OPENTRACING_SPOOL_H
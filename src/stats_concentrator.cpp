@@ -0,0 +1,188 @@
+#include "stats_concentrator.h"
+
+#include <datadog/version.h>
+
+#include <msgpack.hpp>
+#include <sstream>
+#include <tuple>
+#include <unordered_map>
+
+#include "span.h"
+
+namespace datadog {
+namespace opentracing {
+namespace {
+
+const std::string http_status_code_tag = "http.status_code";
+const std::string datadog_origin_tag = "_dd.origin";
+const std::string synthetics_origin_prefix = "synthetics";
+const std::string measured_metric = "_dd.measured";
+
+// Return the HTTP status code in the specified `span`, or zero if `span` does
+// not have a valid HTTP status code.
+uint32_t httpStatusCode(const SpanData& span) {
+  auto found = span.meta.find(http_status_code_tag);
+  if (found == span.meta.end()) {
+    return 0;
+  }
+  uint32_t result = 0;
+  for (const char ch : found->second) {
+    if (ch < '0' || ch > '9' || result > 99999) {
+      return 0;
+    }
+    result = result * 10 + (ch - '0');
+  }
+  return result;
+}
+
+bool isSynthetics(const SpanData& span) {
+  auto found = span.meta.find(datadog_origin_tag);
+  return found != span.meta.end() &&
+         found->second.compare(0, synthetics_origin_prefix.size(), synthetics_origin_prefix) == 0;
+}
+
+bool isMeasured(const SpanData& span) {
+  auto found = span.metrics.find(measured_metric);
+  return found != span.metrics.end() && found->second == 1;
+}
+
+template <typename Stream>
+void packString(msgpack::packer<Stream>& packer, const std::string& key,
+                const std::string& value) {
+  packer.pack(key);
+  packer.pack(value);
+}
+
+template <typename Stream>
+void packSketch(msgpack::packer<Stream>& packer, const std::string& key, const DDSketch& sketch) {
+  std::string encoded;
+  sketch.encode(encoded);
+  packer.pack(key);
+  packer.pack_bin(static_cast<uint32_t>(encoded.size()));
+  packer.pack_bin_body(encoded.data(), static_cast<uint32_t>(encoded.size()));
+}
+
+}  // namespace
+
+bool StatsConcentrator::Key::operator<(const Key& other) const {
+  return std::tie(service, name, resource, type, http_status_code, synthetics) <
+         std::tie(other.service, other.name, other.resource, other.type, other.http_status_code,
+                  other.synthetics);
+}
+
+StatsConcentrator::StatsConcentrator(TimeProvider clock, std::string hostname,
+                                     std::string environment, std::string version,
+                                     std::chrono::nanoseconds bucket_duration)
+    : clock_(clock),
+      hostname_(std::move(hostname)),
+      environment_(std::move(environment)),
+      version_(std::move(version)),
+      bucket_duration_(bucket_duration.count()) {}
+
+void StatsConcentrator::add(const std::vector<std::unique_ptr<SpanData>>& trace) {
+  std::unordered_map<uint64_t, const SpanData*> spans_by_id;
+  for (const auto& span : trace) {
+    spans_by_id.emplace(span->span_id, span.get());
+  }
+
+  std::lock_guard<std::mutex> lock{mutex_};
+  for (const auto& span : trace) {
+    auto parent = spans_by_id.find(span->parent_id);
+    const bool top_level =
+        parent == spans_by_id.end() || parent->second->service != span->service;
+    if (top_level || isMeasured(*span)) {
+      addSpan(*span, top_level);
+    }
+  }
+}
+
+void StatsConcentrator::addSpan(const SpanData& span, bool top_level) {
+  const int64_t end = span.start + span.duration;
+  const int64_t bucket_start = end - end % bucket_duration_;
+  Group& group = buckets_[bucket_start][Key{span.service, span.name, span.resource, span.type,
+                                            httpStatusCode(span), isSynthetics(span)}];
+  ++group.hits;
+  if (top_level) {
+    ++group.top_level_hits;
+  }
+  const uint64_t duration = span.duration > 0 ? span.duration : 0;
+  group.duration += duration;
+  if (span.error != 0) {
+    ++group.errors;
+    group.error_summary.add(static_cast<double>(duration));
+  } else {
+    group.ok_summary.add(static_cast<double>(duration));
+  }
+}
+
+std::string StatsConcentrator::flush(bool force) {
+  const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          clock_().absolute_time.time_since_epoch())
+                          .count();
+
+  std::map<int64_t, Bucket> completed;
+  uint64_t sequence;
+  {
+    std::lock_guard<std::mutex> lock{mutex_};
+    auto end = force ? buckets_.end() : buckets_.lower_bound(now - bucket_duration_ + 1);
+    if (end == buckets_.begin()) {
+      return "";
+    }
+    completed.insert(std::make_move_iterator(buckets_.begin()), std::make_move_iterator(end));
+    buckets_.erase(buckets_.begin(), end);
+    sequence = ++sequence_;
+  }
+
+  // The field names are those of the "ClientStatsPayload" protobuf message
+  // defined by the Datadog Agent, which also decodes them from msgpack.
+  std::stringstream buffer;
+  msgpack::packer<std::stringstream> packer(buffer);
+  packer.pack_map(7);
+  packString(packer, "Hostname", hostname_);
+  packString(packer, "Env", environment_);
+  packString(packer, "Version", version_);
+  packString(packer, "Lang", "cpp");
+  packString(packer, "TracerVersion", ::datadog::version::tracer_version);
+  packer.pack(std::string("Sequence"));
+  packer.pack(sequence);
+  packer.pack(std::string("Stats"));
+  packer.pack_array(static_cast<uint32_t>(completed.size()));
+  for (const auto& entry : completed) {
+    const Bucket& bucket = entry.second;
+    packer.pack_map(3);
+    packer.pack(std::string("Start"));
+    packer.pack(static_cast<uint64_t>(entry.first));
+    packer.pack(std::string("Duration"));
+    packer.pack(static_cast<uint64_t>(bucket_duration_));
+    packer.pack(std::string("Stats"));
+    packer.pack_array(static_cast<uint32_t>(bucket.size()));
+    for (const auto& item : bucket) {
+      const Key& key = item.first;
+      const Group& group = item.second;
+      packer.pack_map(13);
+      packString(packer, "Service", key.service);
+      packString(packer, "Name", key.name);
+      packString(packer, "Resource", key.resource);
+      packer.pack(std::string("HTTPStatusCode"));
+      packer.pack(key.http_status_code);
+      packString(packer, "Type", key.type);
+      packString(packer, "DBType", "");
+      packer.pack(std::string("Hits"));
+      packer.pack(group.hits);
+      packer.pack(std::string("Errors"));
+      packer.pack(group.errors);
+      packer.pack(std::string("Duration"));
+      packer.pack(group.duration);
+      packSketch(packer, "OkSummary", group.ok_summary);
+      packSketch(packer, "ErrorSummary", group.error_summary);
+      packer.pack(std::string("Synthetics"));
+      packer.pack(key.synthetics);
+      packer.pack(std::string("TopLevelHits"));
+      packer.pack(group.top_level_hits);
+    }
+  }
+  return buffer.str();
+}
+
+}  // namespace opentracing
+}  // namespace datadog
@@ -0,0 +1,99 @@
+#ifndef DD_OPENTRACING_STATS_CONCENTRATOR_H
+#define DD_OPENTRACING_STATS_CONCENTRATOR_H
+
+// This component provides a `StatsConcentrator`, which computes aggregate
+// statistics ("trace metrics") from finished spans on the client side, and
+// encodes them for the Datadog Agent's "/v0.6/stats" endpoint.
+//
+// Spans are grouped by service, operation name, resource, span type, HTTP
+// status code, and whether the trace originated from Synthetics.  Each group
+// counts the spans ("hits"), the erroneous spans, and the top-level spans,
+// sums the spans' durations, and summarizes the durations of erroneous and
+// non-erroneous spans in separate `DDSketch` objects.  The groups are kept in
+// time buckets (ten seconds long by default) according to when the spans
+// finished.
+//
+// Like the Datadog Agent, only "top-level" spans (spans whose parent belongs
+// to a different service or to a different process) and spans explicitly
+// marked as "measured" contribute to statistics.
+//
+// Since statistics are computed from every span before any of them are
+// dropped, traces do not need to be sent to the Agent for their spans to be
+// reflected in trace metrics.
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "clock.h"
+#include "ddsketch.h"
+
+namespace datadog {
+namespace opentracing {
+
+struct SpanData;
+
+class StatsConcentrator {
+ public:
+  // Create a stats concentrator that uses the specified `clock` to determine
+  // which buckets are complete, and that reports statistics for the specified
+  // `hostname`, `environment`, and application `version`, in buckets of the
+  // specified `bucket_duration`.
+  StatsConcentrator(TimeProvider clock, std::string hostname, std::string environment,
+                    std::string version,
+                    std::chrono::nanoseconds bucket_duration = std::chrono::seconds(10));
+
+  // Add statistics for the spans of the specified finished `trace`, which
+  // contains all of the spans of a trace that belong to this process.
+  void add(const std::vector<std::unique_ptr<SpanData>>& trace);
+
+  // Remove the buckets that are complete, or all buckets if the specified
+  // `force` is true, and return their msgpack encoding as a "ClientStatsPayload"
+  // message.  Return an empty string if there are no such buckets.
+  std::string flush(bool force);
+
+ private:
+  struct Key {
+    std::string service;
+    std::string name;
+    std::string resource;
+    std::string type;
+    uint32_t http_status_code;
+    bool synthetics;
+
+    bool operator<(const Key& other) const;
+  };
+
+  struct Group {
+    uint64_t hits = 0;
+    uint64_t errors = 0;
+    uint64_t top_level_hits = 0;
+    // Sum of the durations of the spans, in nanoseconds.
+    uint64_t duration = 0;
+    DDSketch ok_summary;
+    DDSketch error_summary;
+  };
+
+  using Bucket = std::map<Key, Group>;
+
+  void addSpan(const SpanData& span, bool top_level);
+
+  TimeProvider clock_;
+  const std::string hostname_;
+  const std::string environment_;
+  const std::string version_;
+  const int64_t bucket_duration_;
+  std::mutex mutex_;
+  // Buckets are keyed by their start time in nanoseconds since the Unix
+  // epoch.
+  std::map<int64_t, Bucket> buckets_;
+  uint64_t sequence_ = 0;
+};
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif
@@ -17,6 +17,7 @@
 #include <sstream>
 
 #include "bool.h"
+#include "noop_span.h"
 #include "parse_util.h"
 #include "tracer.h"
 
@@ -60,17 +61,6 @@ uint64_t getId() {
   return distribution(TlsRandomNumberGenerator::generator());
 }
 
-namespace {
-
-bool isEnabled() {
-  auto enabled = std::getenv("DD_TRACE_ENABLED");
-  // defaults to true unless env var is set to "false"
-  if (enabled != nullptr && !stob(enabled, true)) {
-    return false;
-  }
-  return true;
-}
-
 std::string reportingHostname(TracerOptions options) {
   // This returns the machine name when the tracer has been configured
   // to report hostnames.
@@ -83,6 +73,17 @@ std::string reportingHostname(TracerOptions options) {
   return "";
 }
 
+namespace {
+
+bool isEnabled() {
+  auto enabled = std::getenv("DD_TRACE_ENABLED");
+  // defaults to true unless env var is set to "false"
+  if (enabled != nullptr && !stob(enabled, true)) {
+    return false;
+  }
+  return true;
+}
+
 double analyticsRate(TracerOptions options) {
   if (options.analytics_rate >= 0.0 && options.analytics_rate <= 1.0) {
     return options.analytics_rate;
@@ -132,6 +133,21 @@ uint64_t traceTagsPropagationMaxLength(const TracerOptions &options, const Logge
   }
 }
 
+// Return whether any of the specified `span_tags`, when set on a trace's local root
+// span, could alter the trace's sampling decision or the service,
+// environment, or operation name on which that decision is based.
+template <typename Tags>
+bool affectsSamplingDecision(const Tags &span_tags) {
+  for (const auto &tag : span_tags) {
+    if (tag.first == ::ot::ext::sampling_priority || tag.first == tags::manual_keep ||
+        tag.first == tags::manual_drop || tag.first == tags::service_name ||
+        tag.first == tags::environment || tag.first == tags::operation_name) {
+      return true;
+    }
+  }
+  return false;
+}
+
 }  // namespace
 
 void Tracer::configureRulesSampler(std::shared_ptr<RulesSampler> sampler) noexcept {
@@ -212,6 +228,14 @@ void Tracer::configureRulesSampler(std::shared_ptr<RulesSampler> sampler) noexce
       return {true, sample_rate};
     });
   }
+
+  // If there is a configured spans-per-second target, then traces unmatched
+  // by any rule are sampled at locally computed rates instead of at the
+  // agent's rates.
+  const double target = opts_.adaptive_sampling_spans_per_second;
+  if (!std::isnan(target)) {
+    sampler->setAdaptiveSampler(std::make_shared<AdaptiveSampler>(get_time_, target));
+  }
 }
 
 Tracer::Tracer(TracerOptions options, std::shared_ptr<SpanBuffer> buffer, TimeProvider get_time,
@@ -224,7 +248,8 @@ Tracer::Tracer(TracerOptions options, std::shared_ptr<SpanBuffer> buffer, TimePr
       legacy_obfuscation_(legacyObfuscationEnabled()) {}
 
 Tracer::Tracer(TracerOptions options, std::shared_ptr<Writer> writer,
-               std::shared_ptr<RulesSampler> trace_sampler, std::shared_ptr<const Logger> logger)
+               std::shared_ptr<RulesSampler> trace_sampler, std::shared_ptr<const Logger> logger,
+               std::shared_ptr<StatsConcentrator> stats)
     : logger_(logger),
       opts_(options),
       get_time_(getRealTime),
@@ -238,7 +263,8 @@ Tracer::Tracer(TracerOptions options, std::shared_ptr<Writer> writer,
   buffer_ = std::make_shared<SpanBuffer>(
       logger_, writer, trace_sampler, span_sampler,
       SpanBufferOptions{isEnabled(), reportingHostname(options), analyticsRate(options),
-                        options.service, traceTagsPropagationMaxLength(options, *logger_)});
+                        options.service, traceTagsPropagationMaxLength(options, *logger_)},
+      stats);
 }
 
 std::unique_ptr<ot::Span> Tracer::StartSpanWithOptions(ot::string_view operation_name,
@@ -247,25 +273,45 @@ std::unique_ptr<ot::Span> Tracer::StartSpanWithOptions(ot::string_view operation
   // Generate a span ID for the new span to use.
   auto span_id = get_id_();
 
-  SpanContext span_context = SpanContext{logger_, span_id, span_id, "", {}};
-  // See the comment in span_context.h on nginx_opentracing_compatibility_hack_.
-  if (operation_name == "dummySpan") {
-    span_context =
-        SpanContext::NginxOpenTracingCompatibilityHackSpanContext(logger_, span_id, span_id, {});
-  }
   auto trace_id = span_id;
   auto parent_id = uint64_t{0};
 
   // Create context from parent context if possible.
+  const SpanContext *parent_context = nullptr;
   for (auto &reference : options.references) {
-    if (auto parent_context = dynamic_cast<const SpanContext *>(reference.second)) {
-      span_context = parent_context->withId(span_id);
+    if (auto context = dynamic_cast<const SpanContext *>(reference.second)) {
+      parent_context = context;
       trace_id = parent_context->traceId();
       parent_id = parent_context->id();
       break;
     }
   }
 
+  // See the comment in span_context.h on nginx_opentracing_compatibility_hack_.
+  SpanContext span_context =
+      parent_context != nullptr
+          ? parent_context->withId(span_id)
+          : operation_name == "dummySpan"
+                ? SpanContext::NginxOpenTracingCompatibilityHackSpanContext(span_id, span_id, {})
+                : SpanContext{span_id, span_id, "", {}};
+
+  // If this span starts a local trace, then maybe the trace can be dropped
+  // already.  Spans of a dropped trace record nothing.
+  if (opts_.early_trace_drop && !opts_.stats_computation_enabled &&
+      span_context.droppedTrace() == nullptr &&
+      (parent_context == nullptr || parent_context->extracted()) &&
+      operation_name != "dummySpan" && !affectsSamplingDecision(opts_.tags) &&
+      !affectsSamplingDecision(options.tags)) {
+    const std::string name = opts_.operation_name_override.empty()
+                                 ? std::string(operation_name)
+                                 : opts_.operation_name_override;
+    span_context.setDroppedTrace(buffer_->dropTraceEarly(opts_.environment, opts_.service, name,
+                                                         trace_id, parent_context));
+  }
+  if (span_context.droppedTrace() != nullptr) {
+    return std::unique_ptr<ot::Span>{new NoopSpan{shared_from_this(), std::move(span_context)}};
+  }
+
   auto span = std::make_unique<Span>(logger_, shared_from_this(), buffer_, get_time_, span_id,
                                      trace_id, parent_id, std::move(span_context), get_time_(),
                                      opts_.service, opts_.type, operation_name, operation_name,
@@ -300,7 +346,8 @@ ot::expected<void> Tracer::Inject(const ot::SpanContext &sc, std::ostream &write
   if (span_context == nullptr) {
     return ot::make_unexpected(ot::invalid_span_context_error);
   }
-  return span_context->serialize(writer, buffer_, opts_.priority_sampling);
+  return span_context->serialize(writer, buffer_, opts_.priority_sampling,
+                                 opts_.binary_stream_propagation);
 }
 
 ot::expected<void> Tracer::Inject(const ot::SpanContext &sc,
@@ -335,7 +382,16 @@ ot::expected<std::unique_ptr<ot::SpanContext>> Tracer::Extract(
   return SpanContext::deserialize(logger_, reader, opts_.extract);
 }
 
-void Tracer::Close() noexcept { buffer_->flush(std::chrono::seconds(5)); }
+void Tracer::Close() noexcept try {
+  const auto deadline =
+      std::chrono::steady_clock::now() + std::chrono::milliseconds(opts_.close_timeout_ms);
+  buffer_->flushAsync(deadline).wait();
+} catch (const std::exception &) {
+}
+
+std::future<bool> Tracer::flushAsync(std::chrono::steady_clock::time_point deadline) {
+  return buffer_->flushAsync(deadline);
+}
 
 const TracerOptions &Tracer::options() const noexcept { return opts_; }
 
@@ -344,5 +400,9 @@ const TracerOptions &getOptions(const ot::Tracer &tracer) {
   return dd_tracer.options();
 }
 
+std::future<bool> flushAsync(ot::Tracer &tracer, std::chrono::steady_clock::time_point deadline) {
+  return static_cast<Tracer &>(tracer).flushAsync(deadline);
+}
+
 }  // namespace opentracing
 }  // namespace datadog
@@ -23,12 +23,17 @@ namespace datadog {
 namespace opentracing {
 
 class SpanBuffer;
+class StatsConcentrator;
 
 // The interface for providing IDs to spans and traces.
 typedef std::function<uint64_t()> IdProvider;
 
 uint64_t getId();
 
+// Return the name of this machine if the specified `options` configure the
+// tracer to report it, or return an empty string otherwise.
+std::string reportingHostname(TracerOptions options);
+
 class Tracer : public ot::Tracer, public std::enable_shared_from_this<Tracer> {
  public:
   // Creates a Tracer by copying the given options and injecting the given dependencies.
@@ -39,9 +44,10 @@ class Tracer : public ot::Tracer, public std::enable_shared_from_this<Tracer> {
   // Creates a Tracer by copying the given options and using the preconfigured writer.
   // The writer is either an AgentWriter that sends trace data directly to the Datadog Agent, or
   // an ExternalWriter that requires an external HTTP client to encode and submit to the Datadog
-  // Agent.
+  // Agent.  If `stats` is not null, then it receives every finished trace.
   Tracer(TracerOptions options, std::shared_ptr<Writer> writer,
-         std::shared_ptr<RulesSampler> sampler, std::shared_ptr<const Logger> logger);
+         std::shared_ptr<RulesSampler> sampler, std::shared_ptr<const Logger> logger,
+         std::shared_ptr<StatsConcentrator> stats = nullptr);
 
   Tracer() = delete;
 
@@ -70,8 +76,12 @@ class Tracer : public ot::Tracer, public std::enable_shared_from_this<Tracer> {
   ot::expected<std::unique_ptr<ot::SpanContext>> Extract(
       const ot::HTTPHeadersReader &reader) const override;
 
+  // Sends the finished traces, blocking for at most `close_timeout_ms` of the options.
   void Close() noexcept override;
 
+  // Starts sending the finished traces without blocking. See `Writer::flushAsync`.
+  std::future<bool> flushAsync(std::chrono::steady_clock::time_point deadline);
+
   const TracerOptions &options() const noexcept;
 
  private:
@@ -62,7 +62,7 @@ ot::expected<TracerOptions> optionsFromConfig(const char *configuration,
       if (!styles || styles.value().size() == 0) {
         error_message =
             "Invalid value for propagation_style_extract, must be a list of at least one element "
-            "with value 'Datadog', or 'B3'";
+            "with value 'Datadog', 'B3', 'B3Single', or 'W3C'";
         return styles.get_unexpected();
       }
       options.extract = styles.value();
@@ -73,7 +73,7 @@ ot::expected<TracerOptions> optionsFromConfig(const char *configuration,
       if (!styles || styles.value().size() == 0) {
         error_message =
             "Invalid value for propagation_style_inject, must be a list of at least one element "
-            "with value 'Datadog', or 'B3'";
+            "with value 'Datadog', 'B3', 'B3Single', or 'W3C'";
         return styles.get_unexpected();
       }
       options.inject = styles.value();
@@ -96,6 +96,64 @@ ot::expected<TracerOptions> optionsFromConfig(const char *configuration,
     if (config.find("span_sampling_rules") != config.end()) {
       options.span_sampling_rules = config.at("span_sampling_rules").dump();
     }
+    if (config.find("adaptive_sampling_spans_per_second") != config.end()) {
+      config.at("adaptive_sampling_spans_per_second")
+          .get_to(options.adaptive_sampling_spans_per_second);
+    }
+    if (config.find("early_trace_drop") != config.end()) {
+      config.at("early_trace_drop").get_to(options.early_trace_drop);
+    }
+    if (config.find("stats_computation_enabled") != config.end()) {
+      config.at("stats_computation_enabled").get_to(options.stats_computation_enabled);
+    }
+    if (config.find("binary_stream_propagation") != config.end()) {
+      config.at("binary_stream_propagation").get_to(options.binary_stream_propagation);
+    }
+    if (config.find("agent_tcp_nodelay") != config.end()) {
+      config.at("agent_tcp_nodelay").get_to(options.agent_tcp_nodelay);
+    }
+    if (config.find("agent_tcp_keepalive_seconds") != config.end()) {
+      config.at("agent_tcp_keepalive_seconds").get_to(options.agent_tcp_keepalive_seconds);
+    }
+    if (config.find("agent_max_concurrent_requests") != config.end()) {
+      config.at("agent_max_concurrent_requests").get_to(options.agent_max_concurrent_requests);
+    }
+    if (config.find("agent_compression_level") != config.end()) {
+      config.at("agent_compression_level").get_to(options.agent_compression_level);
+    }
+    if (config.find("agent_compression_min_bytes") != config.end()) {
+      config.at("agent_compression_min_bytes").get_to(options.agent_compression_min_bytes);
+    }
+    if (config.find("agent_spool_directory") != config.end()) {
+      config.at("agent_spool_directory").get_to(options.agent_spool_directory);
+    }
+    if (config.find("agent_spool_max_megabytes") != config.end()) {
+      config.at("agent_spool_max_megabytes").get_to(options.agent_spool_max_megabytes);
+    }
+    if (config.find("agent_circuit_breaker_failures") != config.end()) {
+      config.at("agent_circuit_breaker_failures").get_to(options.agent_circuit_breaker_failures);
+    }
+    if (config.find("agent_timeout_ms") != config.end()) {
+      config.at("agent_timeout_ms").get_to(options.agent_timeout_ms);
+    }
+    if (config.find("agent_min_timeout_ms") != config.end()) {
+      config.at("agent_min_timeout_ms").get_to(options.agent_min_timeout_ms);
+    }
+    if (config.find("close_timeout_ms") != config.end()) {
+      config.at("close_timeout_ms").get_to(options.close_timeout_ms);
+    }
+    if (config.find("agent_flush_threshold_spans") != config.end()) {
+      config.at("agent_flush_threshold_spans").get_to(options.agent_flush_threshold_spans);
+    }
+    if (config.find("agent_flush_threshold_bytes") != config.end()) {
+      config.at("agent_flush_threshold_bytes").get_to(options.agent_flush_threshold_bytes);
+    }
+    if (config.find("agent_encoder_threads") != config.end()) {
+      config.at("agent_encoder_threads").get_to(options.agent_encoder_threads);
+    }
+    if (config.find("agent_write_batch_size") != config.end()) {
+      config.at("agent_write_batch_size").get_to(options.agent_write_batch_size);
+    }
   } catch (const nlohmann::detail::type_error &) {
     error_message = "configuration has an argument with an incorrect type";
     return ot::make_unexpected(std::make_error_code(std::errc::invalid_argument));
@@ -179,6 +179,10 @@ ot::expected<std::set<PropagationStyle>> asPropagationStyle(
       propagation_styles.insert(PropagationStyle::Datadog);
     } else if (style == "B3") {
       propagation_styles.insert(PropagationStyle::B3);
+    } else if (style == "B3Single") {
+      propagation_styles.insert(PropagationStyle::B3Single);
+    } else if (style == "W3C" || style == "tracecontext") {
+      propagation_styles.insert(PropagationStyle::W3C);
     } else {
       return ot::make_unexpected(std::make_error_code(std::errc::invalid_argument));
     }
@@ -328,6 +332,256 @@ ot::expected<TracerOptions, std::string> applyTracerOptionsFromEnvironment(
     opts.sample_rate = maybe_value.value();
   }
 
+  auto adaptive_sampling = std::getenv("DD_TRACE_ADAPTIVE_SAMPLING_SPANS_PER_SECOND");
+  if (adaptive_sampling != nullptr) {
+    auto maybe_value =
+        parseDouble(adaptive_sampling, 0.0, std::numeric_limits<double>::infinity());
+    if (!maybe_value) {
+      maybe_value.error().insert(0, "while parsing DD_TRACE_ADAPTIVE_SAMPLING_SPANS_PER_SECOND: ");
+      return ot::make_unexpected(std::move(maybe_value.error()));
+    }
+    opts.adaptive_sampling_spans_per_second = maybe_value.value();
+  }
+
+  auto early_trace_drop = std::getenv("DD_TRACE_EARLY_DROP");
+  if (early_trace_drop != nullptr) {
+    auto value = std::string(early_trace_drop);
+    if (value.empty() || isbool(value)) {
+      opts.early_trace_drop = stob(value, false);
+    } else {
+      return ot::make_unexpected("Value for DD_TRACE_EARLY_DROP is invalid"s);
+    }
+  }
+
+  auto stats_computation_enabled = std::getenv("DD_TRACE_STATS_COMPUTATION_ENABLED");
+  if (stats_computation_enabled != nullptr) {
+    auto value = std::string(stats_computation_enabled);
+    if (value.empty() || isbool(value)) {
+      opts.stats_computation_enabled = stob(value, false);
+    } else {
+      return ot::make_unexpected("Value for DD_TRACE_STATS_COMPUTATION_ENABLED is invalid"s);
+    }
+  }
+
+  auto binary_stream_propagation = std::getenv("DD_TRACE_BINARY_STREAM_PROPAGATION");
+  if (binary_stream_propagation != nullptr) {
+    auto value = std::string(binary_stream_propagation);
+    if (value.empty() || isbool(value)) {
+      opts.binary_stream_propagation = stob(value, false);
+    } else {
+      return ot::make_unexpected("Value for DD_TRACE_BINARY_STREAM_PROPAGATION is invalid"s);
+    }
+  }
+
+  auto agent_tcp_nodelay = std::getenv("DD_TRACE_AGENT_TCP_NODELAY");
+  if (agent_tcp_nodelay != nullptr) {
+    auto value = std::string(agent_tcp_nodelay);
+    if (value.empty() || isbool(value)) {
+      opts.agent_tcp_nodelay = stob(value, true);
+    } else {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_TCP_NODELAY is invalid"s);
+    }
+  }
+
+  auto agent_tcp_keepalive = std::getenv("DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS");
+  if (agent_tcp_keepalive != nullptr && std::strlen(agent_tcp_keepalive) > 0) {
+    try {
+      opts.agent_tcp_keepalive_seconds = std::stoi(agent_tcp_keepalive);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS is out of range"s);
+    }
+    if (opts.agent_tcp_keepalive_seconds < 0) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS is invalid"s);
+    }
+  }
+
+  auto agent_max_concurrent_requests = std::getenv("DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS");
+  if (agent_max_concurrent_requests != nullptr &&
+      std::strlen(agent_max_concurrent_requests) > 0) {
+    try {
+      opts.agent_max_concurrent_requests = std::stoi(agent_max_concurrent_requests);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS is out of range"s);
+    }
+    if (opts.agent_max_concurrent_requests < 1) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS is invalid"s);
+    }
+  }
+
+  auto agent_compression_level = std::getenv("DD_TRACE_AGENT_COMPRESSION_LEVEL");
+  if (agent_compression_level != nullptr && std::strlen(agent_compression_level) > 0) {
+    try {
+      opts.agent_compression_level = std::stoi(agent_compression_level);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_LEVEL is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_LEVEL is out of range"s);
+    }
+    if (opts.agent_compression_level < 0 || opts.agent_compression_level > 9) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_LEVEL is out of range"s);
+    }
+  }
+
+  auto agent_compression_min_bytes = std::getenv("DD_TRACE_AGENT_COMPRESSION_MIN_BYTES");
+  if (agent_compression_min_bytes != nullptr && std::strlen(agent_compression_min_bytes) > 0) {
+    try {
+      opts.agent_compression_min_bytes = std::stoi(agent_compression_min_bytes);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_MIN_BYTES is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_COMPRESSION_MIN_BYTES is out of range"s);
+    }
+    if (opts.agent_compression_min_bytes < 0) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_MIN_BYTES is invalid"s);
+    }
+  }
+
+  auto agent_spool_directory = std::getenv("DD_TRACE_AGENT_SPOOL_DIRECTORY");
+  if (agent_spool_directory != nullptr && std::strlen(agent_spool_directory) > 0) {
+    opts.agent_spool_directory = agent_spool_directory;
+  }
+
+  auto agent_spool_max_megabytes = std::getenv("DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES");
+  if (agent_spool_max_megabytes != nullptr && std::strlen(agent_spool_max_megabytes) > 0) {
+    try {
+      opts.agent_spool_max_megabytes = std::stoi(agent_spool_max_megabytes);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES is out of range"s);
+    }
+    if (opts.agent_spool_max_megabytes < 1) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES is invalid"s);
+    }
+  }
+
+  auto agent_circuit_breaker_failures = std::getenv("DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES");
+  if (agent_circuit_breaker_failures != nullptr &&
+      std::strlen(agent_circuit_breaker_failures) > 0) {
+    try {
+      opts.agent_circuit_breaker_failures = std::stoi(agent_circuit_breaker_failures);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES is out of range"s);
+    }
+    if (opts.agent_circuit_breaker_failures < 0) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES is invalid"s);
+    }
+  }
+
+  auto agent_timeout_ms = std::getenv("DD_TRACE_AGENT_TIMEOUT_MS");
+  if (agent_timeout_ms != nullptr && std::strlen(agent_timeout_ms) > 0) {
+    try {
+      opts.agent_timeout_ms = std::stoi(agent_timeout_ms);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_TIMEOUT_MS is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_TIMEOUT_MS is out of range"s);
+    }
+    if (opts.agent_timeout_ms < 1) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_TIMEOUT_MS is invalid"s);
+    }
+  }
+
+  auto agent_min_timeout_ms = std::getenv("DD_TRACE_AGENT_MIN_TIMEOUT_MS");
+  if (agent_min_timeout_ms != nullptr && std::strlen(agent_min_timeout_ms) > 0) {
+    try {
+      opts.agent_min_timeout_ms = std::stoi(agent_min_timeout_ms);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_MIN_TIMEOUT_MS is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_MIN_TIMEOUT_MS is out of range"s);
+    }
+    if (opts.agent_min_timeout_ms < 0) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_MIN_TIMEOUT_MS is invalid"s);
+    }
+  }
+
+  auto close_timeout_ms = std::getenv("DD_TRACE_CLOSE_TIMEOUT_MS");
+  if (close_timeout_ms != nullptr && std::strlen(close_timeout_ms) > 0) {
+    try {
+      opts.close_timeout_ms = std::stoi(close_timeout_ms);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_CLOSE_TIMEOUT_MS is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected("Value for DD_TRACE_CLOSE_TIMEOUT_MS is out of range"s);
+    }
+    if (opts.close_timeout_ms < 0) {
+      return ot::make_unexpected("Value for DD_TRACE_CLOSE_TIMEOUT_MS is invalid"s);
+    }
+  }
+
+  auto flush_threshold_spans = std::getenv("DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS");
+  if (flush_threshold_spans != nullptr && std::strlen(flush_threshold_spans) > 0) {
+    try {
+      opts.agent_flush_threshold_spans = std::stoi(flush_threshold_spans);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS is out of range"s);
+    }
+    if (opts.agent_flush_threshold_spans < 0) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS is invalid"s);
+    }
+  }
+
+  auto flush_threshold_bytes = std::getenv("DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES");
+  if (flush_threshold_bytes != nullptr && std::strlen(flush_threshold_bytes) > 0) {
+    try {
+      opts.agent_flush_threshold_bytes = std::stoi(flush_threshold_bytes);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected(
+          "Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES is out of range"s);
+    }
+    if (opts.agent_flush_threshold_bytes < 0) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES is invalid"s);
+    }
+  }
+
+  auto encoder_threads = std::getenv("DD_TRACE_AGENT_ENCODER_THREADS");
+  if (encoder_threads != nullptr && std::strlen(encoder_threads) > 0) {
+    try {
+      opts.agent_encoder_threads = std::stoi(encoder_threads);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_ENCODER_THREADS is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_ENCODER_THREADS is out of range"s);
+    }
+    if (opts.agent_encoder_threads < 1) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_ENCODER_THREADS is invalid"s);
+    }
+  }
+
+  auto write_batch_size = std::getenv("DD_TRACE_AGENT_WRITE_BATCH_SIZE");
+  if (write_batch_size != nullptr && std::strlen(write_batch_size) > 0) {
+    try {
+      opts.agent_write_batch_size = std::stoi(write_batch_size);
+    } catch (const std::invalid_argument &ia) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_WRITE_BATCH_SIZE is invalid"s);
+    } catch (const std::out_of_range &oor) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_WRITE_BATCH_SIZE is out of range"s);
+    }
+    if (opts.agent_write_batch_size < 1) {
+      return ot::make_unexpected("Value for DD_TRACE_AGENT_WRITE_BATCH_SIZE is invalid"s);
+    }
+  }
+
   applySpanSamplingRulesFromEnvironment(opts);
 
   return opts;
@@ -356,6 +610,9 @@ std::string toJSON(const TracerOptions &options, bool with_timestamp) {
   j["analytics_enabled"] = options.analytics_enabled;
   j["analytics_sample_rate"] = options.analytics_rate;
   j["sampling_rules"] = options.sampling_rules;
+  if (!std::isnan(options.adaptive_sampling_spans_per_second)) {
+    j["adaptive_sampling_spans_per_second"] = options.adaptive_sampling_spans_per_second;
+  }
   if (!options.tags.empty()) {
     j["tags"] = options.tags;
   }
@@ -363,6 +620,60 @@ std::string toJSON(const TracerOptions &options, bool with_timestamp) {
     j["dd_version"] = options.version;
   }
   j["report_hostname"] = options.report_hostname;
+  if (options.early_trace_drop) {
+    j["early_trace_drop"] = options.early_trace_drop;
+  }
+  if (options.stats_computation_enabled) {
+    j["stats_computation_enabled"] = options.stats_computation_enabled;
+  }
+  if (options.binary_stream_propagation) {
+    j["binary_stream_propagation"] = options.binary_stream_propagation;
+  }
+  if (!options.agent_tcp_nodelay) {
+    j["agent_tcp_nodelay"] = options.agent_tcp_nodelay;
+  }
+  if (options.agent_tcp_keepalive_seconds != 0) {
+    j["agent_tcp_keepalive_seconds"] = options.agent_tcp_keepalive_seconds;
+  }
+  if (options.agent_max_concurrent_requests != 1) {
+    j["agent_max_concurrent_requests"] = options.agent_max_concurrent_requests;
+  }
+  if (options.agent_compression_level != 0) {
+    j["agent_compression_level"] = options.agent_compression_level;
+  }
+  if (options.agent_compression_min_bytes != 1024) {
+    j["agent_compression_min_bytes"] = options.agent_compression_min_bytes;
+  }
+  if (!options.agent_spool_directory.empty()) {
+    j["agent_spool_directory"] = options.agent_spool_directory;
+  }
+  if (options.agent_spool_max_megabytes != 100) {
+    j["agent_spool_max_megabytes"] = options.agent_spool_max_megabytes;
+  }
+  if (options.agent_circuit_breaker_failures != 5) {
+    j["agent_circuit_breaker_failures"] = options.agent_circuit_breaker_failures;
+  }
+  if (options.agent_timeout_ms != 2000) {
+    j["agent_timeout_ms"] = options.agent_timeout_ms;
+  }
+  if (options.agent_min_timeout_ms != 0) {
+    j["agent_min_timeout_ms"] = options.agent_min_timeout_ms;
+  }
+  if (options.close_timeout_ms != 5000) {
+    j["close_timeout_ms"] = options.close_timeout_ms;
+  }
+  if (options.agent_flush_threshold_spans != 0) {
+    j["agent_flush_threshold_spans"] = options.agent_flush_threshold_spans;
+  }
+  if (options.agent_flush_threshold_bytes != 1048576) {
+    j["agent_flush_threshold_bytes"] = options.agent_flush_threshold_bytes;
+  }
+  if (options.agent_encoder_threads != 1) {
+    j["agent_encoder_threads"] = options.agent_encoder_threads;
+  }
+  if (options.agent_write_batch_size != 64) {
+    j["agent_write_batch_size"] = options.agent_write_batch_size;
+  }
   if (!options.operation_name_override.empty()) {
     j["operation_name_override"] = options.operation_name_override;
   }
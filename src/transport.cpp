@@ -1,6 +1,7 @@
 #include "transport.h"
 
 #include <cstring>
+#include <iterator>
 #include <stdexcept>
 
 namespace datadog {
@@ -67,34 +68,77 @@ CURLcode CurlHandle::setopt(CURLoption key, size_t value) {
   return curl_easy_setopt(handle_, key, value);
 }
 
-void CurlHandle::setHeaders(std::map<std::string, std::string> headers) {
-  for (auto& header : headers) {
-    headers_[header.first] = header.second;  // Overwrite.
+void CurlHandle::setHeaders(const std::map<std::string, std::string>& headers) {
+  for (const auto& header : headers) {
+    auto result = headers_.insert(header);
+    if (result.second) {
+      header_list_stale_ = true;  // A header was added.
+      continue;
+    }
+    auto& entry = *result.first;
+    if (entry.second == header.second) {
+      continue;
+    }
+    entry.second = header.second;  // Overwrite.
+    if (!header_list_stale_) {
+      // Rewrite the header's line in place. Its buffer is usually large enough already.
+      const auto index = std::distance(headers_.begin(), result.first);
+      std::string& line = header_lines_[index];
+      line.assign(entry.first).append(": ").append(entry.second);
+      header_list_[index].data = &line[0];
+    }
   }
 }
 
+CURLcode CurlHandle::buildHeaderList() {
+  header_lines_.clear();
+  header_list_.clear();
+  for (const auto& pair : headers_) {
+    header_lines_.push_back(pair.first + ": " + pair.second);
+  }
+  header_list_.resize(header_lines_.size());
+  for (std::size_t i = 0; i < header_list_.size(); ++i) {
+    header_list_[i].data = &header_lines_[i][0];
+    header_list_[i].next = i + 1 < header_list_.size() ? &header_list_[i + 1] : nullptr;
+  }
+  curl_slist* list = header_list_.empty() ? nullptr : &header_list_[0];
+  CURLcode rcode = curl_easy_setopt(handle_, CURLOPT_HTTPHEADER, list);
+  if (rcode == CURLE_OK) {
+    header_list_stale_ = false;
+  }
+  return rcode;
+}
+
 CURLcode CurlHandle::perform() {
   // Clear response buffer.
   response_buffer_.clear();
   response_buffer_.str(std::string{});
-  // TODO[willgittoes-dd]: Find a way to not copy these strings each time, without unreasonable
-  // coupling to libcurl internals.
-  struct curl_slist* http_headers = nullptr;
-  for (auto& pair : headers_) {
-    std::string header = pair.first + ": " + pair.second;
-    http_headers = curl_slist_append(http_headers, header.c_str());
+  if (header_list_stale_) {
+    CURLcode rcode = buildHeaderList();
+    if (rcode != CURLE_OK) {
+      std::strncpy(curl_error_buffer_, "Unable to write headers", CURL_ERROR_SIZE - 1);
+      return rcode;
+    }
   }
-  CURLcode rcode = curl_easy_setopt(handle_, CURLOPT_HTTPHEADER, http_headers);
-  if (rcode != CURLE_OK) {
-    std::strncpy(curl_error_buffer_, "Unable to write headers", CURL_ERROR_SIZE - 1);
-    curl_slist_free_all(http_headers);
-    return rcode;
-  }
-  rcode = curl_easy_perform(handle_);
-  curl_slist_free_all(http_headers);
+  CURLcode rcode = curl_easy_perform(handle_);
+  logConnectionReuse();
   return rcode;
 }
 
+void CurlHandle::logConnectionReuse() {
+  ++num_requests_;
+  long new_connections = 0;
+  if (curl_easy_getinfo(handle_, CURLINFO_NUM_CONNECTS, &new_connections) != CURLE_OK ||
+      new_connections <= 0) {
+    return;  // The request reused a connection (or failed before connecting).
+  }
+  num_connections_ += new_connections;
+  std::ostringstream message;
+  message << "Opened a new connection to the Datadog Agent; " << num_connections_
+          << " connections have been opened for " << num_requests_ << " requests";
+  logger_->Trace(message.str());
+}
+
 std::string CurlHandle::getError() { return std::string(curl_error_buffer_); }
 std::string CurlHandle::getResponse() { return response_buffer_.str(); }
 int CurlHandle::getResponseStatus() {
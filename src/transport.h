@@ -6,6 +6,7 @@
 #include <map>
 #include <sstream>
 #include <string>
+#include <vector>
 
 #include "logger.h"
 
@@ -20,7 +21,10 @@ class Handle {
   virtual CURLcode setopt(CURLoption key, const char* value) = 0;
   virtual CURLcode setopt(CURLoption key, long value) = 0;
   virtual CURLcode setopt(CURLoption key, size_t value) = 0;
-  virtual void setHeaders(std::map<std::string, std::string> headers) = 0;
+  // Add the specified `headers` to those sent with each request, replacing
+  // the values of any headers that are already set.  A header whose value is
+  // empty is not sent (as with curl).
+  virtual void setHeaders(const std::map<std::string, std::string>& headers) = 0;
   virtual CURLcode perform() = 0;
   virtual std::string getError() = 0;
   virtual std::string getResponse() = 0;
@@ -39,7 +43,7 @@ class CurlHandle : public Handle {
   CURLcode setopt(CURLoption key, const char* value) override;
   CURLcode setopt(CURLoption key, long value) override;
   CURLcode setopt(CURLoption key, size_t value) override;
-  void setHeaders(std::map<std::string, std::string> headers) override;
+  void setHeaders(const std::map<std::string, std::string>& headers) override;
   CURLcode perform() override;
   std::string getError() override;
   std::string getResponse() override;
@@ -48,14 +52,31 @@ class CurlHandle : public Handle {
  private:
   // For things that need cleaning up if the constructor fails as well as on destruction.
   void tearDownHandle();
+  // Rebuild `header_lines_` and `header_list_` from `headers_`, and pass the list to curl.
+  CURLcode buildHeaderList();
+  // Log, if a new connection was opened for the last request, how many connections have been
+  // opened and how many requests have been made so far.
+  void logConnectionReuse();
 
   CURL* handle_;
   // Not unordered, just so that the headers are always in the same order. Makes testing just a bit
   // easier, and the number of headers is so low that the log(n) insert doesn't matter.
   std::map<std::string, std::string> headers_;
+  // The header list passed to curl, which has a line and a node for each of `headers_`, in the
+  // same order. The nodes are owned here rather than by `curl_slist_append`, so that a request
+  // whose headers differ from the previous request only in their values (e.g. the trace count)
+  // rewrites just those lines, instead of allocating the whole list again. The list is rebuilt
+  // only when a header is added.
+  std::vector<std::string> header_lines_;
+  std::vector<curl_slist> header_list_;
+  bool header_list_stale_ = true;
   char curl_error_buffer_[CURL_ERROR_SIZE];
   std::stringstream response_buffer_;  // So much more humane than a fixed sized buffer.
   std::shared_ptr<const Logger> logger_;
+  // How many requests have been performed, and how many connections curl opened for them. These
+  // are equal if no connection was reused.
+  uint64_t num_requests_ = 0;
+  uint64_t num_connections_ = 0;
 
   // Called with the response from perform().
   friend size_t write_callback(char* ptr, size_t size, size_t nmemb, void* userdata);
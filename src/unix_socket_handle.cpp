@@ -0,0 +1,520 @@
+#include "unix_socket_handle.h"
+
+#ifndef _MSC_VER
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <stdexcept>
+
+#include "parse_util.h"
+
+namespace datadog {
+namespace opentracing {
+namespace {
+
+#ifdef MSG_NOSIGNAL
+// Don't raise SIGPIPE if the agent has closed the connection.
+const int send_flags = MSG_NOSIGNAL;
+#else
+// `SO_NOSIGPIPE` is set on the socket instead.
+const int send_flags = 0;
+#endif
+
+// Limits on what is accepted from the agent, so that a misbehaving peer
+// cannot make the tracer allocate without bound.
+const std::size_t max_line_size = 8 * 1024;
+const std::size_t max_response_size = 16 * 1024 * 1024;
+
+std::string errorText(const std::string &what) { return what + ": " + std::strerror(errno); }
+
+// Return whether the specified `text` is equal to the specified lowercase
+// `lower`, ignoring case.
+bool equalsIgnoreCase(ot::string_view text, ot::string_view lower) {
+  return text.size() == lower.size() &&
+         std::equal(text.begin(), text.end(), lower.begin(), [](char left, char right) {
+           return std::tolower(static_cast<unsigned char>(left)) == right;
+         });
+}
+
+// Wait until the specified `socket` is ready for the specified `events`, or
+// until the specified `deadline`.  Return whether the socket is ready.
+bool waitFor(int socket, short events, std::chrono::steady_clock::time_point deadline) {
+  for (;;) {
+    int timeout = -1;
+    if (deadline != std::chrono::steady_clock::time_point::max()) {
+      const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+          deadline - std::chrono::steady_clock::now());
+      if (remaining.count() <= 0) {
+        return false;
+      }
+      timeout = static_cast<int>(std::min<long long>(remaining.count(), 60 * 1000));
+    }
+    pollfd descriptor{socket, events, 0};
+    const int result = ::poll(&descriptor, 1, timeout);
+    if (result > 0) {
+      return true;
+    }
+    if (result == -1 && errno != EINTR) {
+      return false;
+    }
+  }
+}
+
+}  // namespace
+
+UnixSocketHandle::UnixSocketHandle(std::shared_ptr<const Logger> logger) : logger_(logger) {}
+
+UnixSocketHandle::~UnixSocketHandle() { disconnect(); }
+
+CURLcode UnixSocketHandle::setopt(CURLoption key, const char *value) {
+  switch (key) {
+    case CURLOPT_UNIX_SOCKET_PATH:
+      if (std::strlen(value) >= sizeof(sockaddr_un::sun_path)) {
+        return CURLE_BAD_FUNCTION_ARGUMENT;
+      }
+      if (socket_path_ != value) {
+        disconnect();
+        socket_path_ = value;
+      }
+      return CURLE_OK;
+    case CURLOPT_URL: {
+      // scheme://host[:port][/path]
+      const std::string url{value};
+      const auto scheme_end = url.find("://");
+      if (scheme_end == std::string::npos) {
+        return CURLE_URL_MALFORMAT;
+      }
+      const auto host_begin = scheme_end + 3;
+      const auto path_begin = std::min(url.find('/', host_begin), url.size());
+      const std::string path = path_begin == url.size() ? "/" : url.substr(path_begin);
+      request_line_ = "POST " + path + " HTTP/1.1\r\nHost: " +
+                      url.substr(host_begin, path_begin - host_begin) + "\r\n";
+      return CURLE_OK;
+    }
+    case CURLOPT_POSTFIELDS:
+      body_ = value;
+      return CURLE_OK;
+    default:
+      return CURLE_UNKNOWN_OPTION;
+  }
+}
+
+CURLcode UnixSocketHandle::setopt(CURLoption key, long value) {
+  switch (key) {
+    case CURLOPT_TIMEOUT_MS:
+      timeout_ms_ = value;
+      return CURLE_OK;
+    case CURLOPT_POSTFIELDSIZE:
+      if (value < 0) {
+        return CURLE_BAD_FUNCTION_ARGUMENT;
+      }
+      body_size_ = static_cast<std::size_t>(value);
+      return CURLE_OK;
+    case CURLOPT_TCP_NODELAY:
+    case CURLOPT_TCP_KEEPALIVE:
+    case CURLOPT_TCP_KEEPIDLE:
+    case CURLOPT_TCP_KEEPINTVL:
+      return CURLE_OK;  // Not applicable to unix domain sockets.
+    default:
+      return CURLE_UNKNOWN_OPTION;
+  }
+}
+
+CURLcode UnixSocketHandle::setopt(CURLoption key, size_t value) {
+  if (key != CURLOPT_POSTFIELDSIZE) {
+    return CURLE_UNKNOWN_OPTION;
+  }
+  body_size_ = value;
+  return CURLE_OK;
+}
+
+void UnixSocketHandle::setHeaders(const std::map<std::string, std::string> &headers) {
+  for (const auto &header : headers) {
+    auto &value = headers_[header.first];
+    if (value != header.second) {
+      value = header.second;  // Overwrite.
+      header_lines_stale_ = true;
+    }
+  }
+}
+
+CURLcode UnixSocketHandle::perform() {
+  response_status_ = 0;
+  response_.clear();
+  error_.clear();
+  ++num_requests_;
+  if (socket_path_.empty() || request_line_.empty()) {
+    return fail(CURLE_URL_MALFORMAT, "The agent's socket path and URL must be set");
+  }
+  const Deadline deadline = timeout_ms_ > 0 ? std::chrono::steady_clock::now() +
+                                                  std::chrono::milliseconds(timeout_ms_)
+                                            : Deadline::max();
+  const bool reusing_connection = socket_ != -1;
+  bool closed_by_peer = false;
+  CURLcode rcode = exchange(deadline, closed_by_peer);
+  if (rcode != CURLE_OK && reusing_connection && closed_by_peer) {
+    // The agent closed the idle connection before this request. Nothing was sent, so it is safe
+    // to try again on a new connection.
+    error_.clear();
+    rcode = exchange(deadline, closed_by_peer);
+  }
+  if (rcode != CURLE_OK || close_after_response_) {
+    disconnect();
+  }
+  return rcode;
+}
+
+CURLcode UnixSocketHandle::exchange(Deadline deadline, bool &closed_by_peer) {
+  closed_by_peer = false;
+  if (socket_ == -1) {
+    CURLcode rcode = connect(deadline);
+    if (rcode != CURLE_OK) {
+      return rcode;
+    }
+  }
+  buffer_.clear();
+  buffer_position_ = 0;
+  close_after_response_ = false;
+  CURLcode rcode = sendRequest(deadline, closed_by_peer);
+  if (rcode == CURLE_OK) {
+    rcode = readResponse(deadline, closed_by_peer);
+  }
+  if (rcode != CURLE_OK) {
+    disconnect();
+  }
+  return rcode;
+}
+
+CURLcode UnixSocketHandle::connect(Deadline deadline) {
+  socket_ = ::socket(AF_UNIX, SOCK_STREAM, 0);
+  if (socket_ == -1) {
+    return fail(CURLE_COULDNT_CONNECT, errorText("Unable to create socket"));
+  }
+  if (::fcntl(socket_, F_SETFD, FD_CLOEXEC) == -1 ||
+      ::fcntl(socket_, F_SETFL, ::fcntl(socket_, F_GETFL) | O_NONBLOCK) == -1) {
+    return fail(CURLE_COULDNT_CONNECT, errorText("Unable to configure socket"));
+  }
+#ifdef SO_NOSIGPIPE
+  const int enable = 1;
+  if (::setsockopt(socket_, SOL_SOCKET, SO_NOSIGPIPE, &enable, sizeof(enable)) == -1) {
+    return fail(CURLE_COULDNT_CONNECT, errorText("Unable to configure socket"));
+  }
+#endif
+
+  sockaddr_un address;
+  std::memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  std::memcpy(address.sun_path, socket_path_.c_str(), socket_path_.size() + 1);
+  if (::connect(socket_, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) == -1) {
+    if (errno != EINPROGRESS) {
+      return fail(CURLE_COULDNT_CONNECT, errorText("Unable to connect to " + socket_path_));
+    }
+    // Unlike TCP, a unix domain socket usually connects immediately, but wait if it doesn't.
+    if (!waitFor(socket_, POLLOUT, deadline)) {
+      return fail(CURLE_OPERATION_TIMEDOUT, "Timed out connecting to " + socket_path_);
+    }
+    int error = 0;
+    socklen_t error_size = sizeof(error);
+    if (::getsockopt(socket_, SOL_SOCKET, SO_ERROR, &error, &error_size) == -1 || error != 0) {
+      errno = error;
+      return fail(CURLE_COULDNT_CONNECT, errorText("Unable to connect to " + socket_path_));
+    }
+  }
+
+  ++num_connections_;
+  std::string message = "Opened a new connection to the Datadog Agent at " + socket_path_ + "; " +
+                        std::to_string(num_connections_) + " connections have been opened for " +
+                        std::to_string(num_requests_) + " requests";
+  logger_->Trace(message);
+  return CURLE_OK;
+}
+
+CURLcode UnixSocketHandle::sendRequest(Deadline deadline, bool &closed_by_peer) {
+  if (header_lines_stale_) {
+    header_lines_.clear();
+    for (const auto &header : headers_) {
+      if (!header.second.empty()) {
+        header_lines_.append(header.first).append(": ").append(header.second).append("\r\n");
+      }
+    }
+    header_lines_stale_ = false;
+  }
+  IntegerText digits;
+  const ot::string_view body_size = format_decimal(uint64_t(body_size_), digits);
+  std::string length_line = "Content-Length: ";
+  length_line.append(body_size.data(), body_size.size()).append("\r\n\r\n");
+
+  // The request is sent from its parts, without copying them into one buffer.
+  iovec parts[] = {
+      {const_cast<char *>(request_line_.data()), request_line_.size()},
+      {const_cast<char *>(header_lines_.data()), header_lines_.size()},
+      {const_cast<char *>(length_line.data()), length_line.size()},
+      {const_cast<char *>(body_), body_ == nullptr ? 0 : body_size_},
+  };
+  msghdr message;
+  std::memset(&message, 0, sizeof(message));
+  message.msg_iov = parts;
+  message.msg_iovlen = sizeof(parts) / sizeof(parts[0]);
+
+  std::size_t unsent = 0;
+  for (const auto &part : parts) {
+    unsent += part.iov_len;
+  }
+  const std::size_t request_size = unsent;
+  while (unsent != 0) {
+    const ssize_t sent = ::sendmsg(socket_, &message, send_flags);
+    if (sent == -1) {
+      if (errno == EINTR) {
+        continue;
+      }
+      if (errno == EAGAIN || errno == EWOULDBLOCK) {
+        if (!waitFor(socket_, POLLOUT, deadline)) {
+          return fail(CURLE_OPERATION_TIMEDOUT, "Timed out sending request to the agent");
+        }
+        continue;
+      }
+      closed_by_peer = (errno == EPIPE || errno == ECONNRESET) && unsent == request_size;
+      return fail(CURLE_SEND_ERROR, errorText("Unable to send request to the agent"));
+    }
+    // Skip past what was sent.
+    unsent -= sent;
+    std::size_t skip = sent;
+    while (skip != 0 && skip >= message.msg_iov->iov_len) {
+      skip -= message.msg_iov->iov_len;
+      ++message.msg_iov;
+      --message.msg_iovlen;
+    }
+    if (skip != 0) {
+      message.msg_iov->iov_base = static_cast<char *>(message.msg_iov->iov_base) + skip;
+      message.msg_iov->iov_len -= skip;
+    }
+  }
+  return CURLE_OK;
+}
+
+CURLcode UnixSocketHandle::readResponse(Deadline deadline, bool &closed_by_peer) {
+  std::string line;
+  CURLcode rcode = readLine(deadline, line);
+  if (rcode != CURLE_OK) {
+    closed_by_peer = rcode == CURLE_GOT_NOTHING && buffer_.empty();
+    return rcode;
+  }
+  for (;;) {
+    // HTTP/1.x SSS reason
+    if (line.size() < 12 || line.compare(0, 7, "HTTP/1.") != 0 || line[8] != ' ' ||
+        !std::all_of(line.begin() + 9, line.begin() + 12,
+                     [](char c) { return c >= '0' && c <= '9'; })) {
+      return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response has an invalid status line");
+    }
+    const bool http_1_0 = line[7] == '0';
+    response_status_ = std::stoi(line.substr(9, 3));
+
+    bool chunked = false;
+    bool has_length = false;
+    uint64_t length = 0;
+    close_after_response_ = http_1_0;
+    for (;;) {
+      rcode = readLine(deadline, line);
+      if (rcode != CURLE_OK) {
+        return rcode;
+      }
+      if (line.empty()) {
+        break;
+      }
+      const auto colon = line.find(':');
+      if (colon == std::string::npos) {
+        return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response has an invalid header");
+      }
+      const ot::string_view name{line.data(), colon};
+      const ot::string_view value = trim_ows({line.data() + colon + 1, line.size() - colon - 1});
+      if (equalsIgnoreCase(name, "content-length")) {
+        try {
+          length = parse_uint64(value, 10);
+          has_length = true;
+        } catch (const std::logic_error &) {
+          return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response has an invalid Content-Length");
+        }
+      } else if (equalsIgnoreCase(name, "transfer-encoding")) {
+        chunked = equalsIgnoreCase(value, "chunked");
+      } else if (equalsIgnoreCase(name, "connection")) {
+        close_after_response_ = equalsIgnoreCase(value, "close") ||
+                                (http_1_0 && !equalsIgnoreCase(value, "keep-alive"));
+      }
+    }
+
+    if (response_status_ >= 200) {
+      if (response_status_ == 204 || response_status_ == 304) {
+        return CURLE_OK;
+      }
+      if (chunked) {
+        return readChunkedBody(deadline);
+      }
+      if (has_length) {
+        if (length > max_response_size) {
+          return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response is too large");
+        }
+        return readBody(deadline, std::size_t(length));
+      }
+      return readBodyUntilClosed(deadline);
+    }
+    // That was an informational response. The final response follows.
+    rcode = readLine(deadline, line);
+    if (rcode != CURLE_OK) {
+      return rcode;
+    }
+  }
+}
+
+CURLcode UnixSocketHandle::readBodyUntilClosed(Deadline deadline) {
+  close_after_response_ = true;
+  for (;;) {
+    response_.append(buffer_, buffer_position_, std::string::npos);
+    buffer_position_ = buffer_.size();
+    if (response_.size() > max_response_size) {
+      return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response is too large");
+    }
+    CURLcode rcode = fill(deadline);
+    if (rcode == CURLE_GOT_NOTHING) {
+      error_.clear();
+      return CURLE_OK;
+    }
+    if (rcode != CURLE_OK) {
+      return rcode;
+    }
+  }
+}
+
+CURLcode UnixSocketHandle::fill(Deadline deadline) {
+  if (buffer_position_ != 0) {
+    buffer_.erase(0, buffer_position_);
+    buffer_position_ = 0;
+  }
+  char chunk[16 * 1024];
+  for (;;) {
+    const ssize_t received = ::recv(socket_, chunk, sizeof(chunk), 0);
+    if (received > 0) {
+      buffer_.append(chunk, std::size_t(received));
+      return CURLE_OK;
+    }
+    if (received == 0 || errno == ECONNRESET) {
+      return fail(CURLE_GOT_NOTHING, "The agent closed the connection");
+    }
+    if (errno == EINTR) {
+      continue;
+    }
+    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+      return fail(CURLE_RECV_ERROR, errorText("Unable to receive response from the agent"));
+    }
+    if (!waitFor(socket_, POLLIN, deadline)) {
+      return fail(CURLE_OPERATION_TIMEDOUT, "Timed out waiting for a response from the agent");
+    }
+  }
+}
+
+CURLcode UnixSocketHandle::readLine(Deadline deadline, std::string &line) {
+  for (;;) {
+    const auto end = buffer_.find("\r\n", buffer_position_);
+    if (end != std::string::npos) {
+      line.assign(buffer_, buffer_position_, end - buffer_position_);
+      buffer_position_ = end + 2;
+      return CURLE_OK;
+    }
+    if (buffer_.size() - buffer_position_ > max_line_size) {
+      return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response has a line that is too long");
+    }
+    CURLcode rcode = fill(deadline);
+    if (rcode != CURLE_OK) {
+      return rcode;
+    }
+  }
+}
+
+CURLcode UnixSocketHandle::readBody(Deadline deadline, std::size_t size) {
+  if (size > max_response_size - response_.size()) {
+    return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response is too large");
+  }
+  while (size != 0) {
+    if (buffer_position_ == buffer_.size()) {
+      CURLcode rcode = fill(deadline);
+      if (rcode != CURLE_OK) {
+        return rcode;
+      }
+    }
+    const std::size_t available = std::min(size, buffer_.size() - buffer_position_);
+    response_.append(buffer_, buffer_position_, available);
+    buffer_position_ += available;
+    size -= available;
+  }
+  return CURLE_OK;
+}
+
+CURLcode UnixSocketHandle::readChunkedBody(Deadline deadline) {
+  std::string line;
+  for (;;) {
+    // chunk size [; extensions]
+    CURLcode rcode = readLine(deadline, line);
+    if (rcode != CURLE_OK) {
+      return rcode;
+    }
+    uint64_t size;
+    try {
+      size = parse_uint64({line.data(), std::min(line.find(';'), line.size())}, 16);
+    } catch (const std::logic_error &) {
+      return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response has an invalid chunk size");
+    }
+    if (size == 0) {
+      break;
+    }
+    if (size > max_response_size) {
+      return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response is too large");
+    }
+    rcode = readBody(deadline, std::size_t(size));
+    if (rcode == CURLE_OK) {
+      rcode = readLine(deadline, line);
+    }
+    if (rcode != CURLE_OK) {
+      return rcode;
+    }
+    if (!line.empty()) {
+      return fail(CURLE_WEIRD_SERVER_REPLY, "Agent response has a malformed chunk");
+    }
+  }
+  // Skip the trailer.
+  do {
+    CURLcode rcode = readLine(deadline, line);
+    if (rcode != CURLE_OK) {
+      return rcode;
+    }
+  } while (!line.empty());
+  return CURLE_OK;
+}
+
+CURLcode UnixSocketHandle::fail(CURLcode code, const std::string &message) {
+  error_ = message;
+  return code;
+}
+
+void UnixSocketHandle::disconnect() {
+  if (socket_ != -1) {
+    ::close(socket_);
+    socket_ = -1;
+  }
+}
+
+std::string UnixSocketHandle::getError() { return error_; }
+std::string UnixSocketHandle::getResponse() { return response_; }
+int UnixSocketHandle::getResponseStatus() { return response_status_; }
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif  // _MSC_VER
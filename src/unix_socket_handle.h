@@ -0,0 +1,103 @@
+#ifndef DD_OPENTRACING_UNIX_SOCKET_HANDLE_H
+#define DD_OPENTRACING_UNIX_SOCKET_HANDLE_H
+
+// This component provides a `Handle` that sends HTTP/1.1 requests to the
+// agent over a unix domain socket without going through libcurl.  The agent
+// is a local process, so none of curl's protocol machinery (name resolution,
+// TLS, proxies, redirects) applies, and the request can be written with a
+// single `sendmsg` of its parts.  The connection is kept open between
+// requests.
+//
+// Only the options that `AgentWriter` sets are supported.  Not available on
+// Windows.
+
+#ifndef _MSC_VER
+
+#include <chrono>
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+
+#include "logger.h"
+#include "transport.h"
+
+namespace datadog {
+namespace opentracing {
+
+// A Handle that POSTs to an HTTP server listening on a unix domain socket. Not thread-safe.
+class UnixSocketHandle : public Handle {
+ public:
+  explicit UnixSocketHandle(std::shared_ptr<const Logger> logger);
+  ~UnixSocketHandle() override;
+
+  // Supports `CURLOPT_UNIX_SOCKET_PATH`, `CURLOPT_URL` (of which only the host and the path are
+  // used), `CURLOPT_TIMEOUT_MS`, `CURLOPT_POSTFIELDSIZE` and `CURLOPT_POSTFIELDS` (which, as with
+  // curl, is not copied). The TCP options are accepted and ignored. Other options return
+  // `CURLE_UNKNOWN_OPTION`.
+  CURLcode setopt(CURLoption key, const char* value) override;
+  CURLcode setopt(CURLoption key, long value) override;
+  CURLcode setopt(CURLoption key, size_t value) override;
+  void setHeaders(const std::map<std::string, std::string>& headers) override;
+  CURLcode perform() override;
+  std::string getError() override;
+  std::string getResponse() override;
+  int getResponseStatus() override;
+
+ private:
+  using Deadline = std::chrono::steady_clock::time_point;
+
+  // Send the request and read the response on the current connection, opening one if there is
+  // none. If the request fails because the agent had already closed the connection, then set
+  // `closed_by_peer` to true.
+  CURLcode exchange(Deadline deadline, bool& closed_by_peer);
+  CURLcode connect(Deadline deadline);
+  CURLcode sendRequest(Deadline deadline, bool& closed_by_peer);
+  CURLcode readResponse(Deadline deadline, bool& closed_by_peer);
+  // Append to `buffer_` whatever can be read from the connection before the `deadline`. Return
+  // `CURLE_GOT_NOTHING` if the peer closed the connection.
+  CURLcode fill(Deadline deadline);
+  // Read a line terminated by CRLF, and store it without the terminator in `line`.
+  CURLcode readLine(Deadline deadline, std::string& line);
+  // Read exactly `size` bytes and append them to `response_`.
+  CURLcode readBody(Deadline deadline, std::size_t size);
+  CURLcode readChunkedBody(Deadline deadline);
+  // Read the rest of the response body, which ends when the agent closes the connection.
+  CURLcode readBodyUntilClosed(Deadline deadline);
+  CURLcode fail(CURLcode code, const std::string& message);
+  void disconnect();
+
+  std::shared_ptr<const Logger> logger_;
+  std::string socket_path_;
+  // "POST <path> HTTP/1.1\r\nHost: <host>\r\n", from `CURLOPT_URL`.
+  std::string request_line_;
+  // Not unordered, so that the headers are always sent in the same order.
+  std::map<std::string, std::string> headers_;
+  // The lines of `headers_`, rebuilt only when a header changes.
+  std::string header_lines_;
+  bool header_lines_stale_ = true;
+  long timeout_ms_ = 0;
+  const char* body_ = nullptr;
+  std::size_t body_size_ = 0;
+
+  int socket_ = -1;
+  // Bytes received but not yet consumed.
+  std::string buffer_;
+  std::size_t buffer_position_ = 0;
+  // Whether the server asked for the connection to be closed after the current response.
+  bool close_after_response_ = false;
+
+  int response_status_ = 0;
+  std::string response_;
+  std::string error_;
+  // How many requests have been performed, and how many connections were opened for them.
+  uint64_t num_requests_ = 0;
+  uint64_t num_connections_ = 0;
+};
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif  // _MSC_VER
+
+#endif  // DD_OPENTRACING_UNIX_SOCKET_HANDLE_H
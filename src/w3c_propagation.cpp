@@ -0,0 +1,271 @@
+#include "w3c_propagation.h"
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <stdexcept>
+
+#include "parse_util.h"
+
+namespace datadog {
+namespace opentracing {
+
+// A "traceparent" header value has the following fixed layout, where each
+// field is lowercase hexadecimal:
+//
+//     version "-" trace-id "-" parent-id "-" trace-flags
+//     2 chars     32 chars     16 chars      2 chars
+//
+// Versions later than "00" may append further "-"-prefixed fields, which are
+// ignored.  Version "ff" is invalid, as are all-zero trace and parent IDs.
+//
+// A "tracestate" header value is a comma-separated list of "<key>=<value>"
+// members.  The member whose key is "dd" has a value that is a
+// semicolon-separated list of "<key>:<value>" fields:
+//
+//     s:<sampling priority>
+//     o:<origin>
+//     t.<tag name without "_dd.p.">:<tag value>
+//
+// e.g.
+//
+//     dd=s:2;o:rum;t.dm:-4;t.usr.id:12345
+//
+// Characters that are not allowed in a member are replaced by "_", except
+// that "=" in origins and tag values is replaced by "~".
+//
+// See <https://www.w3.org/TR/trace-context/>.
+
+namespace {
+
+const std::size_t traceparent_size = 55;
+// A "tracestate" member's value can have at most 256 characters.
+const std::size_t max_member_value_size = 256;
+// A "tracestate" header can have at most 32 members, one of which is "dd".
+const int max_other_members = 31;
+const ot::string_view datadog_member_key = "dd";
+const ot::string_view propagated_tag_prefix = "_dd.p.";
+
+bool starts_with(ot::string_view text, ot::string_view prefix) {
+  return text.size() >= prefix.size() &&
+         std::equal(prefix.begin(), prefix.end(), text.begin());
+}
+
+// Return whether every character of the specified `text` is a lowercase
+// hexadecimal digit.
+bool is_lower_hex(ot::string_view text) {
+  return std::all_of(text.begin(), text.end(),
+                     [](char c) { return (c >= '0' && c <= '9') || (c >= 'a' && c <= 'f'); });
+}
+
+// Return the field of the specified `size` at the specified `offset` in the
+// specified `traceparent`.  Throw a `std::invalid_argument` if the field is
+// not lowercase hexadecimal.
+ot::string_view hex_field(ot::string_view traceparent, std::size_t offset, std::size_t size) {
+  const ot::string_view field{traceparent.data() + offset, size};
+  if (!is_lower_hex(field)) {
+    throw std::invalid_argument("traceparent field is not lowercase hexadecimal");
+  }
+  return field;
+}
+
+// Copy the specified `text` into the specified `destination`, and return the
+// end of the copy.
+char* copy(ot::string_view text, char* destination) {
+  return std::copy(text.begin(), text.end(), destination);
+}
+
+// Append to the specified `destination` the specified `text`, with
+// characters not allowed in a "dd" field replaced.  If `is_key` is true, then
+// the text is a field key, which has stricter rules than a field value.
+void append_encoded(std::string& destination, ot::string_view text, bool is_key) {
+  for (const char c : text) {
+    if (c == '=' && !is_key) {
+      destination += '~';
+    } else if (c < ' ' || c > '~' || c == ',' || c == ';' || c == '~' || c == '=' ||
+               (is_key && (c == ' ' || c == ':'))) {
+      destination += '_';
+    } else {
+      destination += c;
+    }
+  }
+}
+
+// Return the specified "dd" field `value` with "~" restored to "=".
+std::string decode_value(ot::string_view value) {
+  std::string result{value};
+  std::replace(result.begin(), result.end(), '~', '=');
+  return result;
+}
+
+// Decode into the specified `state` the fields of the specified "dd" member
+// `value`.
+void parse_datadog_member(TraceState& state, ot::string_view value) {
+  const char* iter = value.begin();
+  const char* const end = value.end();
+  while (iter < end) {
+    const char* const next = std::find(iter, end, ';');
+    const ot::string_view field = range(iter, next);
+    // Advance past the separator, if there is one, but never past `end`.
+    iter = next == end ? end : next + 1;
+
+    const char* const separator = std::find(field.begin(), field.end(), ':');
+    if (separator == field.end()) {
+      continue;
+    }
+    const ot::string_view key = range(field.begin(), separator);
+    const ot::string_view field_value = range(separator + 1, field.end());
+    if (key == "s") {
+      try {
+        state.sampling_priority = asSamplingPriority(parse_int(field_value));
+      } catch (const std::logic_error&) {
+        // An invalid sampling priority is ignored.
+      }
+    } else if (key == "o") {
+      state.origin = decode_value(field_value);
+    } else if (starts_with(key, "t.") && key.size() > 2) {
+      std::string tag_name{propagated_tag_prefix};
+      tag_name.append(key.begin() + 2, key.end());
+      state.trace_tags[tag_name] = decode_value(field_value);
+    }
+  }
+}
+
+}  // namespace
+
+TraceParent parseTraceParent(ot::string_view header_value) {
+  const ot::string_view value = trim_ows(header_value);
+  if (value.size() < traceparent_size || value[2] != '-' || value[35] != '-' ||
+      value[52] != '-' || (value.size() > traceparent_size && value[traceparent_size] != '-')) {
+    throw std::invalid_argument("traceparent does not have the expected layout");
+  }
+
+  const ot::string_view version = hex_field(value, 0, 2);
+  if (version == "ff") {
+    throw std::invalid_argument("traceparent has the invalid version \"ff\"");
+  }
+  if (version == "00" && value.size() != traceparent_size) {
+    throw std::invalid_argument("traceparent of version \"00\" has extra fields");
+  }
+
+  TraceParent result;
+  parse_hex128(hex_field(value, 3, 32), result.trace_id_high, result.trace_id);
+  result.parent_id = parse_uint64(hex_field(value, 36, 16), 16);
+  const uint64_t flags = parse_uint64(hex_field(value, 53, 2), 16);
+  result.sampled = (flags & 1) != 0;
+
+  if (result.trace_id_high == 0 && result.trace_id == 0) {
+    throw std::invalid_argument("traceparent has an all-zero trace ID");
+  }
+  if (result.parent_id == 0) {
+    throw std::invalid_argument("traceparent has an all-zero parent ID");
+  }
+  return result;
+}
+
+ot::string_view formatTraceParent(const TraceParent& trace_parent, TraceParentText& buffer) {
+  IntegerText digits;
+  char* out = copy("00-", buffer.data());
+  out = copy(format_hex128(trace_parent.trace_id_high, trace_parent.trace_id, digits), out);
+  *out++ = '-';
+  // The parent ID is the low 16 of the 32 digits.
+  const ot::string_view parent_id = format_hex128(0, trace_parent.parent_id, digits);
+  out = copy(range(parent_id.begin() + 16, parent_id.end()), out);
+  out = copy(trace_parent.sampled ? "-01" : "-00", out);
+  assert(out == buffer.data() + buffer.size());
+  return ot::string_view{buffer.data(), buffer.size()};
+}
+
+TraceState parseTraceState(ot::string_view header_value) {
+  TraceState state;
+  int other_members = 0;
+  const char* iter = header_value.begin();
+  const char* const end = header_value.end();
+  while (iter < end) {
+    const char* const next = std::find(iter, end, ',');
+    const ot::string_view member = trim_ows(range(iter, next));
+    iter = next == end ? end : next + 1;
+
+    const char* const separator = std::find(member.begin(), member.end(), '=');
+    if (separator == member.end()) {
+      // Empty or malformed member.
+      continue;
+    }
+    const ot::string_view key = range(member.begin(), separator);
+    if (key == datadog_member_key) {
+      parse_datadog_member(state, range(separator + 1, member.end()));
+    } else if (other_members < max_other_members) {
+      if (!state.other_members.empty()) {
+        state.other_members += ',';
+      }
+      state.other_members.append(member.begin(), member.end());
+      ++other_members;
+    }
+  }
+  return state;
+}
+
+std::string formatTraceState(const SamplingPriority* sampling_priority, ot::string_view origin,
+                             ot::string_view serialized_tags, ot::string_view other_members) {
+  std::string result{datadog_member_key};
+  result += '=';
+  const std::size_t value_begin = result.size();
+  const auto separate = [&]() {
+    if (result.size() > value_begin) {
+      result += ';';
+    }
+  };
+
+  if (sampling_priority != nullptr) {
+    IntegerText digits;
+    separate();
+    result += "s:";
+    const ot::string_view priority = format_decimal(static_cast<int>(*sampling_priority), digits);
+    result.append(priority.begin(), priority.end());
+  }
+  if (!origin.empty()) {
+    separate();
+    result += "o:";
+    append_encoded(result, origin, false);
+  }
+
+  // `serialized_tags` is comma-separated "<key>=<value>" pairs.
+  const char* iter = serialized_tags.begin();
+  const char* const end = serialized_tags.end();
+  while (iter < end) {
+    const char* const next = std::find(iter, end, ',');
+    const ot::string_view tag = range(iter, next);
+    iter = next == end ? end : next + 1;
+
+    const char* const separator = std::find(tag.begin(), tag.end(), '=');
+    const ot::string_view key = range(tag.begin(), separator);
+    if (separator == tag.end() || !starts_with(key, propagated_tag_prefix)) {
+      continue;
+    }
+    const std::size_t size_before = result.size();
+    separate();
+    result += "t.";
+    append_encoded(result, range(key.begin() + propagated_tag_prefix.size(), key.end()), true);
+    result += ':';
+    append_encoded(result, range(separator + 1, tag.end()), false);
+    if (result.size() - value_begin > max_member_value_size) {
+      // This tag doesn't fit, but a later one might.
+      result.resize(size_before);
+    }
+  }
+
+  if (result.size() == value_begin) {
+    // There is no Datadog-specific state.
+    result.clear();
+  }
+  if (!other_members.empty()) {
+    if (!result.empty()) {
+      result += ',';
+    }
+    result.append(other_members.begin(), other_members.end());
+  }
+  return result;
+}
+
+}  // namespace opentracing
+}  // namespace datadog
@@ -0,0 +1,78 @@
+#ifndef DD_OPENTRACING_W3C_PROPAGATION_H
+#define DD_OPENTRACING_W3C_PROPAGATION_H
+
+// This component provides serialization and deserialization routines for the
+// [W3C trace context][1] headers, "traceparent" and "tracestate".
+//
+// "traceparent" has a fixed layout, and so is parsed and formatted without
+// allocating memory.  Datadog-specific trace context (the sampling priority,
+// the origin, and the propagated "_dd.p.*" trace tags) travels in the "dd"
+// member of "tracestate".  The format of the "dd" member is described in the
+// cpp file.
+//
+// [1]: https://www.w3.org/TR/trace-context/
+
+#include <opentracing/string_view.h>
+
+#include <array>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+#include "sampling_priority.h"
+
+namespace ot = opentracing;
+
+namespace datadog {
+namespace opentracing {
+
+// `TraceParent` is the trace context encoded in a "traceparent" header.
+struct TraceParent {
+  // The trace ID has 128 bits.  This tracer's trace IDs are the low 64 bits.
+  uint64_t trace_id_high = 0;
+  uint64_t trace_id = 0;
+  uint64_t parent_id = 0;
+  bool sampled = false;
+};
+
+// Return the trace context parsed from the specified "traceparent"
+// `header_value`.  Throw a `std::invalid_argument` if an error occurs.
+TraceParent parseTraceParent(ot::string_view header_value);
+
+// `TraceParentText` is storage for the text produced by `formatTraceParent`.
+using TraceParentText = std::array<char, 55>;
+
+// Return the "traceparent" header value that encodes the specified
+// `trace_parent`.  The text is stored in the specified `buffer`.
+ot::string_view formatTraceParent(const TraceParent &trace_parent, TraceParentText &buffer);
+
+// `TraceState` is the information carried in a "tracestate" header.
+struct TraceState {
+  // The following are decoded from the "dd" member, and are null or empty if
+  // they are absent from it.
+  OptionalSamplingPriority sampling_priority;
+  std::string origin;
+  std::unordered_map<std::string, std::string> trace_tags;
+  // The members of the header other than "dd", which are propagated
+  // unmodified.
+  std::string other_members;
+};
+
+// Return the information parsed from the specified "tracestate"
+// `header_value`.  Malformed members, and malformed parts of the "dd" member,
+// are ignored.
+TraceState parseTraceState(ot::string_view header_value);
+
+// Return a "tracestate" header value whose "dd" member encodes the optionally
+// specified `sampling_priority`, the specified `origin` (if not empty), and
+// the "_dd.p.*" tags among the specified `serialized_tags` (in the
+// "x-datadog-tags" format), followed by the specified `other_members`.  Tags
+// that do not fit within the maximum length of a member are omitted.  Return
+// an empty string if there is nothing to encode.
+std::string formatTraceState(const SamplingPriority *sampling_priority, ot::string_view origin,
+                             ot::string_view serialized_tags, ot::string_view other_members);
+
+}  // namespace opentracing
+}  // namespace datadog
+
+#endif
@@ -1,5 +1,6 @@
 #include "writer.h"
 
+#include <algorithm>
 #include <iostream>
 
 #include "encoder.h"
@@ -11,6 +12,15 @@ namespace opentracing {
 Writer::Writer(std::shared_ptr<RulesSampler> sampler, std::shared_ptr<const Logger> logger)
     : trace_encoder_(std::make_shared<AgentHttpEncoder>(sampler, logger)) {}
 
+std::future<bool> Writer::flushAsync(std::chrono::steady_clock::time_point deadline) {
+  const auto remaining = std::chrono::duration_cast<std::chrono::milliseconds>(
+      deadline - std::chrono::steady_clock::now());
+  flush(std::max(remaining, std::chrono::milliseconds(0)));
+  std::promise<bool> flushed;
+  flushed.set_value(true);
+  return flushed.get_future();
+}
+
 void ExternalWriter::write(TraceData trace) { trace_encoder_->addTrace(std::move(trace)); }
 
 }  // namespace opentracing
@@ -4,6 +4,7 @@
 #include <chrono>
 #include <condition_variable>
 #include <deque>
+#include <future>
 #include <mutex>
 #include <sstream>
 #include <thread>
@@ -32,6 +33,17 @@ class Writer {
   // timeout passes.
   virtual void flush(std::chrono::milliseconds timeout) = 0;
 
+  // Starts sending any buffered Traces to the destination, without blocking. The returned future
+  // becomes true once sending is complete, or false once `deadline` passes first. The default
+  // implementation calls flush() and returns a future that is already true.
+  virtual std::future<bool> flushAsync(std::chrono::steady_clock::time_point deadline);
+
+  // Account for the specified number of `traces` and `spans` that were
+  // dropped by the tracer because they were not sampled, so that the agent
+  // can be told about them.  Dropped spans include those of dropped traces.
+  // The default implementation does nothing.
+  virtual void writeDropped(uint64_t /* traces */, uint64_t /* spans */) {}
+
  protected:
   std::shared_ptr<AgentHttpEncoder> trace_encoder_;
 };
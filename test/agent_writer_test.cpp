@@ -3,8 +3,12 @@
 #include <datadog/version.h>
 
 #include <catch2/catch.hpp>
+#include <cstdlib>
 #include <ctime>
+#include <set>
+#include <thread>
 
+#include "../src/stats_concentrator.h"
 #include "mocks.h"
 using namespace datadog::opentracing;
 
@@ -47,6 +51,7 @@ TEST_CASE("writer") {
           {CURLOPT_URL, "http://localhost:8126/v0.4/traces"}}},
     }));
     test_case.expected_opts[CURLOPT_TIMEOUT_MS] = "2000";
+    test_case.expected_opts[CURLOPT_TCP_NODELAY] = "1";
 
     AgentWriter writer{std::move(handle_ptr),
                        std::chrono::seconds(1),
@@ -61,6 +66,30 @@ TEST_CASE("writer") {
     REQUIRE(handle->options == test_case.expected_opts);
   }
 
+  SECTION("applies connection options") {
+    std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+    MockHandle* handle = handle_ptr.get();
+    AgentConnectionOptions connection_options;
+    connection_options.tcp_nodelay = false;
+    connection_options.tcp_keepalive_seconds = 30;
+    AgentWriter writer{std::move(handle_ptr),
+                       std::chrono::seconds(1),
+                       100,
+                       {},
+                       "hostname",
+                       1234,
+                       "",
+                       std::make_shared<RulesSampler>(),
+                       std::make_shared<MockLogger>(),
+                       nullptr,
+                       connection_options};
+
+    REQUIRE(handle->options[CURLOPT_TCP_NODELAY] == "0");
+    REQUIRE(handle->options[CURLOPT_TCP_KEEPALIVE] == "1");
+    REQUIRE(handle->options[CURLOPT_TCP_KEEPIDLE] == "30");
+    REQUIRE(handle->options[CURLOPT_TCP_KEEPINTVL] == "30");
+  }
+
   SECTION("rejects unsupported url schemes") {
     std::atomic<bool> handle_destructed{false};
     std::unique_ptr<MockHandle> handle_ptr{new MockHandle{&handle_destructed}};
@@ -123,6 +152,7 @@ TEST_CASE("writer") {
     REQUIRE(handle->options == std::unordered_map<CURLoption, std::string, EnumClassHash>{
                                    {CURLOPT_URL, "http://hostname:6319/v0.4/traces"},
                                    {CURLOPT_TIMEOUT_MS, "2000"},
+                                   {CURLOPT_TCP_NODELAY, "1"},
                                    {CURLOPT_POSTFIELDSIZE, "135"}});
     REQUIRE(handle->headers ==
             std::map<std::string, std::string>{
@@ -140,6 +170,19 @@ TEST_CASE("writer") {
     writer.flush(std::chrono::seconds(10));
 
     REQUIRE(sampler->config == "{\"service:nginx,env:\":0.5}");
+
+    // A response that is the same as the last one does not configure the sampler again.
+    sampler->config = "";
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", 2, 1, 0, 69, 420, 0}}));
+    writer.flush(std::chrono::seconds(10));
+    REQUIRE(sampler->config == "");
+
+    handle->response = "{\"rate_by_service\": {\"service:nginx,env:\": 0.25}}";
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", 3, 1, 0, 69, 420, 0}}));
+    writer.flush(std::chrono::seconds(10));
+    REQUIRE(sampler->config == "{\"service:nginx,env:\":0.25}");
   }
 
   SECTION("handle dodgy responses") {
@@ -429,6 +472,74 @@ TEST_CASE("writer") {
   }
 }
 
+TEST_CASE("writer sends client-computed stats") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  auto stats = std::make_shared<StatsConcentrator>(getRealTime, "hostname", "env", "1.0");
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     100,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     stats};
+
+  const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          std::chrono::system_clock::now().time_since_epoch())
+                          .count();
+  auto trace = make_trace(
+      {TestSpanData{"web", "service", "resource", "service.name", 1, 1, 0, now, 420, 0}});
+  stats->add(*trace);
+  writer.write(std::move(trace));
+  writer.writeDropped(2, 5);
+  writer.flush(std::chrono::seconds(10));
+
+  // Flushing the writer sends all of the stats, and then the traces.
+  REQUIRE(handle->requests.size() == 2);
+  REQUIRE(handle->requests[0].first == "http://hostname:6319/v0.6/stats");
+  REQUIRE(!handle->requests[0].second.empty());
+  REQUIRE(handle->requests[1].first == "http://hostname:6319/v0.4/traces");
+  REQUIRE(handle->options[CURLOPT_URL] == "http://hostname:6319/v0.4/traces");
+  REQUIRE(handle->headers["Datadog-Client-Computed-Stats"] == "yes");
+  REQUIRE(handle->headers["Datadog-Client-Dropped-P0-Traces"] == "2");
+  REQUIRE(handle->headers["Datadog-Client-Dropped-P0-Spans"] == "5");
+  REQUIRE(stats->flush(true).empty());
+}
+
+TEST_CASE("writer sends dropped counts when every trace is dropped") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  auto stats = std::make_shared<StatsConcentrator>(getRealTime, "hostname", "env", "1.0");
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     100,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     stats};
+
+  writer.writeDropped(3, 7);
+  writer.flush(std::chrono::seconds(10));
+
+  // A request that contains no traces carries the counts.
+  REQUIRE(handle->requests.size() == 1);
+  REQUIRE(handle->requests[0].first == "http://hostname:6319/v0.4/traces");
+  REQUIRE(handle->requests[0].second == "\x90");
+  REQUIRE(handle->headers["X-Datadog-Trace-Count"] == "0");
+  REQUIRE(handle->headers["Datadog-Client-Dropped-P0-Traces"] == "3");
+  REQUIRE(handle->headers["Datadog-Client-Dropped-P0-Spans"] == "7");
+
+  // Once they are sent, there is nothing left to send.
+  writer.flush(std::chrono::seconds(10));
+  REQUIRE(handle->requests.size() == 1);
+}
+
 TEST_CASE("flush") {
   std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
   MockHandle* handle = handle_ptr.get();
@@ -459,3 +570,557 @@ TEST_CASE("flush") {
     REQUIRE(wait_time < (retry_periods[0] / 2));
   }
 }
+
+TEST_CASE("asynchronous flush") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     100,
+                     {std::chrono::seconds(60)},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>()};
+  writer.write(make_trace(
+      {TestSpanData{"web", "service", "resource", "service.name", 1, 1, 0, 69, 420, 0}}));
+
+  SECTION("becomes true once the traces are sent") {
+    auto flushed = writer.flushAsync(steady_clock::now() + std::chrono::seconds(10));
+    REQUIRE(flushed.wait_for(std::chrono::seconds(10)) == std::future_status::ready);
+    REQUIRE(flushed.get());
+    REQUIRE(handle->getTraces()->size() == 1);
+  }
+
+  SECTION("becomes false once its deadline passes") {
+    // The request fails, and is not retried for a while.
+    handle->perform_result = {CURLE_OPERATION_TIMEDOUT};
+    const auto start = steady_clock::now();
+    auto flushed = writer.flushAsync(start + std::chrono::milliseconds(250));
+    REQUIRE(!flushed.get());
+    const auto waited = steady_clock::now() - start;
+    REQUIRE(waited >= std::chrono::milliseconds(250));
+    REQUIRE(waited < std::chrono::seconds(10));
+  }
+
+  SECTION("limits the timeout of requests to its deadline") {
+    auto flushed = writer.flushAsync(steady_clock::now() + std::chrono::milliseconds(300));
+    REQUIRE(flushed.get());
+    REQUIRE(std::stol(handle->options[CURLOPT_TIMEOUT_MS]) <= 300);
+  }
+
+  SECTION("becomes false when the writer stops") {
+    handle->perform_result = {CURLE_OPERATION_TIMEDOUT};
+    auto flushed = writer.flushAsync(steady_clock::now() + std::chrono::seconds(60));
+    writer.stop();
+    REQUIRE(!flushed.get());
+    REQUIRE(!writer.flushAsync(steady_clock::now() + std::chrono::seconds(60)).get());
+  }
+}
+
+TEST_CASE("writer sends requests concurrently") {
+  SECTION("each handle can have a request in flight") {
+    // `RendezvousHandle::perform` waits until every handle is performing a request.
+    struct Rendezvous {
+      std::mutex mutex;
+      std::condition_variable arrived;
+      int arrivals = 0;
+    };
+    struct RendezvousHandle : public MockHandle {
+      explicit RendezvousHandle(Rendezvous* rendezvous) : rendezvous(rendezvous) {
+        response_status = 200;
+        response = "{\"rate_by_service\": {\"service:,env:\": 1.0}}";
+      }
+      CURLcode perform() override {
+        {
+          std::unique_lock<std::mutex> lock(rendezvous->mutex);
+          ++rendezvous->arrivals;
+          rendezvous->arrived.notify_all();
+          met = rendezvous->arrived.wait_for(lock, std::chrono::seconds(10),
+                                             [&]() { return rendezvous->arrivals >= 2; });
+        }
+        return MockHandle::perform();
+      }
+      Rendezvous* rendezvous;
+      std::atomic<bool> met{false};
+    };
+    Rendezvous rendezvous;
+    std::vector<std::unique_ptr<Handle>> handles;
+    handles.emplace_back(new RendezvousHandle{&rendezvous});
+    handles.emplace_back(new RendezvousHandle{&rendezvous});
+    auto first = static_cast<RendezvousHandle*>(handles[0].get());
+    auto second = static_cast<RendezvousHandle*>(handles[1].get());
+    AgentWriter writer{std::move(handles),
+                       std::chrono::milliseconds(10),
+                       100,
+                       {},
+                       "hostname",
+                       6319,
+                       "",
+                       std::make_shared<RulesSampler>(),
+                       std::make_shared<MockLogger>()};
+
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", 1, 1, 0, 69, 420, 0}}));
+    {
+      // Wait until the first request is in flight before writing the second trace.
+      std::unique_lock<std::mutex> lock(rendezvous.mutex);
+      REQUIRE(rendezvous.arrived.wait_for(lock, std::chrono::seconds(10),
+                                          [&]() { return rendezvous.arrivals >= 1; }));
+    }
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", 2, 1, 0, 69, 420, 0}}));
+    writer.flush(std::chrono::seconds(10));
+
+    REQUIRE(first->met);
+    REQUIRE(second->met);
+    REQUIRE(first->requests.size() == 1);
+    REQUIRE(second->requests.size() == 1);
+  }
+
+  SECTION("a request waiting to be retried does not hold up later requests") {
+    std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+    MockHandle* handle = handle_ptr.get();
+    handle->perform_result = {CURLE_OPERATION_TIMEDOUT, CURLE_OK};
+    AgentWriter writer{std::move(handle_ptr),
+                       std::chrono::seconds(3600),
+                       100,
+                       {std::chrono::seconds(60)},
+                       "hostname",
+                       6319,
+                       "",
+                       std::make_shared<RulesSampler>(),
+                       std::make_shared<MockLogger>()};
+
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", 1, 1, 0, 69, 420, 0}}));
+    // The first request fails, and is not retried for a minute.
+    writer.flush(std::chrono::milliseconds(250));
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", 2, 1, 0, 69, 420, 0}}));
+    writer.flush(std::chrono::milliseconds(250));
+
+    REQUIRE(handle->perform_call_count == 2);
+    auto traces = handle->getTraces();
+    REQUIRE(traces->size() == 1);
+    REQUIRE((*traces)[0][0].trace_id == 2);
+  }
+}
+
+TEST_CASE("writer compresses trace payloads") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  AgentConnectionOptions connection_options;
+  connection_options.compression_level = 6;
+  connection_options.compression_min_bytes = 2048;
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     100,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     nullptr,
+                     connection_options};
+
+  SECTION("large payloads are compressed") {
+    for (uint64_t i = 1; i <= 50; i++) {
+      writer.write(make_trace(
+          {TestSpanData{"web", "service", "resource", "service.name", i, 1, 0, 69, 420, 0}}));
+    }
+    writer.flush(std::chrono::seconds(10));
+    REQUIRE(handle->headers["Content-Encoding"] == "gzip");
+    const std::string payload = handle->options[CURLOPT_POSTFIELDS];
+    REQUIRE(payload.substr(0, 2) == "\x1f\x8b");
+    REQUIRE(payload.size() < 2048);
+
+    SECTION("and small payloads that follow them are not") {
+      writer.write(make_trace(
+          {TestSpanData{"web", "service", "resource", "service.name", 1, 1, 0, 69, 420, 0}}));
+      writer.flush(std::chrono::seconds(10));
+      // An empty header is not sent.
+      REQUIRE(handle->headers["Content-Encoding"] == "");
+      REQUIRE(handle->getTraces()->size() == 1);
+    }
+  }
+
+  SECTION("small payloads are not compressed") {
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", 1, 1, 0, 69, 420, 0}}));
+    writer.flush(std::chrono::seconds(10));
+    REQUIRE(handle->headers["Content-Encoding"] == "");
+    REQUIRE(handle->getTraces()->size() == 1);
+  }
+}
+
+TEST_CASE("writer encodes large batches of traces on several threads") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  AgentConnectionOptions connection_options;
+  connection_options.encoder_threads = 3;
+  connection_options.flush_threshold_bytes = 0;
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     100,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     nullptr,
+                     connection_options};
+  // Enough spans to be split between all of the threads, in traces of different sizes.
+  const uint64_t num_traces = 100;
+  for (uint64_t id = 1; id <= num_traces; id++) {
+    TraceData trace{new std::vector<std::unique_ptr<SpanData>>{}};
+    for (uint64_t span_id = 1; span_id <= id; span_id++) {
+      trace->emplace_back(new TestSpanData{"web", "service", "resource", "service.name", id,
+                                           span_id, 0, 69, 420, 0});
+    }
+    writer.write(std::move(trace));
+  }
+  writer.flush(std::chrono::seconds(10));
+
+  // The ranges are joined into one payload, in order.
+  REQUIRE(handle->getRequests().size() == 1);
+  REQUIRE(handle->headers["X-Datadog-Trace-Count"] == std::to_string(num_traces));
+  auto traces = handle->getTraces();
+  REQUIRE(traces->size() == num_traces);
+  for (uint64_t id = 1; id <= num_traces; id++) {
+    const auto& trace = (*traces)[id - 1];
+    REQUIRE(trace.size() == id);
+    REQUIRE(trace[0].trace_id == id);
+    REQUIRE(trace.back().span_id == id);
+  }
+}
+
+TEST_CASE("writer collects the traces written by each thread") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  AgentConnectionOptions connection_options;
+  connection_options.write_batch_size = 4;
+  std::unique_ptr<AgentWriter> writer{new AgentWriter{std::move(handle_ptr),
+                                                      std::chrono::seconds(3600),
+                                                      100,
+                                                      {},
+                                                      "hostname",
+                                                      6319,
+                                                      "",
+                                                      std::make_shared<RulesSampler>(),
+                                                      std::make_shared<MockLogger>(),
+                                                      nullptr,
+                                                      connection_options}};
+  auto write = [&](uint64_t id) {
+    writer->write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", id, 1, 0, 69, 420, 0}}));
+  };
+  auto trace_ids = [&]() {
+    std::set<uint64_t> ids;
+    auto traces = handle->getTraces();
+    for (const auto& trace : *traces) {
+      ids.insert(trace[0].trace_id);
+    }
+    return ids;
+  };
+  // `other` writes a trace, and then waits to be released before it exits.
+  std::mutex mutex;
+  std::condition_variable changed;
+  bool written = false;
+  bool released = false;
+  auto other = [&]() {
+    write(2);
+    std::unique_lock<std::mutex> lock(mutex);
+    written = true;
+    changed.notify_all();
+    changed.wait(lock, [&]() { return released; });
+  };
+  auto wait_until_written = [&]() {
+    std::unique_lock<std::mutex> lock(mutex);
+    changed.wait(lock, [&]() { return written; });
+  };
+  auto release = [&]() {
+    std::lock_guard<std::mutex> lock(mutex);
+    released = true;
+    changed.notify_all();
+  };
+
+  SECTION("and sends them when flushed") {
+    write(1);
+    std::thread thread(other);
+    wait_until_written();
+    writer->flush(std::chrono::seconds(10));
+    REQUIRE(trace_ids() == std::set<uint64_t>{1, 2});
+    release();
+    thread.join();
+  }
+
+  SECTION("when the thread exits") {
+    release();
+    std::thread thread(other);
+    thread.join();
+    writer->flush(std::chrono::seconds(10));
+    REQUIRE(trace_ids() == std::set<uint64_t>{2});
+  }
+
+  SECTION("and drops them if the writer is destroyed before the thread exits") {
+    std::thread thread(other);
+    wait_until_written();
+    writer.reset();
+    release();
+    thread.join();
+  }
+}
+
+namespace {
+// Wait until the specified `handle` has sent a request, and return the number of traces in it.
+std::size_t waitForRequest(MockHandle* handle, std::chrono::milliseconds timeout) {
+  const auto deadline = steady_clock::now() + timeout;
+  while (handle->getRequests().empty() && steady_clock::now() < deadline) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(5));
+  }
+  return handle->getTraces()->size();
+}
+}  // namespace
+
+TEST_CASE("writer sends traces before the write period passes") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  AgentConnectionOptions connection_options;
+  connection_options.flush_threshold_spans = 3;
+  connection_options.flush_threshold_bytes = 2000;
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     100,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     nullptr,
+                     connection_options};
+  auto write = [&](uint64_t id, std::string service) {
+    writer.write(make_trace(
+        {TestSpanData{"web", service, "resource", "service.name", id, 1, 0, 69, 420, 0}}));
+  };
+
+  SECTION("once there are enough spans") {
+    write(1, "service");
+    write(2, "service");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE(handle->getRequests().empty());
+    write(3, "service");
+    REQUIRE(waitForRequest(handle, std::chrono::seconds(10)) == 3);
+  }
+
+  SECTION("once the traces are large enough") {
+    write(1, "service");
+    std::this_thread::sleep_for(std::chrono::milliseconds(100));
+    REQUIRE(handle->getRequests().empty());
+    write(2, std::string(2000, 's'));
+    REQUIRE(waitForRequest(handle, std::chrono::seconds(10)) == 2);
+  }
+}
+
+TEST_CASE("writer sends traces that threads collect once they reach a flush threshold") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  AgentConnectionOptions connection_options;
+  connection_options.flush_threshold_spans = 100;
+  connection_options.flush_threshold_bytes = 0;
+  connection_options.write_batch_size = 1000;
+  // Dropped counts are only sent along with trace metrics.
+  auto stats = std::make_shared<StatsConcentrator>(getRealTime, "hostname", "env", "1.0");
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     1000,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     stats,
+                     connection_options};
+  // Each thread drops a trace and writes 30, fewer than either threshold, and then waits to be
+  // released before it exits (which would hand its traces to the writer).
+  std::mutex mutex;
+  std::condition_variable condition;
+  bool released = false;
+  std::vector<std::thread> threads;
+  for (uint64_t thread = 0; thread < 4; thread++) {
+    threads.emplace_back([&, thread]() {
+      writer.writeDropped(1, 2);
+      for (uint64_t i = 1; i <= 30; i++) {
+        writer.write(make_trace({TestSpanData{"web", "service", "resource", "service.name",
+                                              thread * 100 + i, 1, 0, 69, 420, 0}}));
+      }
+      std::unique_lock<std::mutex> lock(mutex);
+      condition.wait(lock, [&]() { return released; });
+    });
+  }
+
+  // The traces of every thread count toward the threshold, along with the counts they dropped.
+  const std::size_t sent = waitForRequest(handle, std::chrono::seconds(10));
+  REQUIRE(sent >= 100);
+  REQUIRE(handle->headers["Datadog-Client-Dropped-P0-Traces"] == "4");
+  REQUIRE(handle->headers["Datadog-Client-Dropped-P0-Spans"] == "8");
+  {
+    std::lock_guard<std::mutex> lock(mutex);
+    released = true;
+  }
+  condition.notify_all();
+  for (auto& thread : threads) {
+    thread.join();
+  }
+  // The rest, if any, are sent when the writer is flushed.
+  writer.flush(std::chrono::seconds(10));
+  if (handle->getRequests().size() > 1) {
+    REQUIRE(sent + handle->getTraces()->size() == 120);
+  } else {
+    REQUIRE(sent == 120);
+  }
+}
+
+TEST_CASE("writer wakes up less often while there are no traces") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  AgentConnectionOptions connection_options;
+  connection_options.max_idle_write_period = std::chrono::milliseconds(2000);
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::milliseconds(50),
+                     100,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     nullptr,
+                     connection_options};
+  // By now the worker waits for up to a second between writes, but a trace that is written still
+  // waits for no longer than the write period.
+  std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  const auto start = steady_clock::now();
+  writer.write(make_trace(
+      {TestSpanData{"web", "service", "resource", "service.name", 1, 1, 0, 69, 420, 0}}));
+  REQUIRE(waitForRequest(handle, std::chrono::seconds(10)) == 1);
+  REQUIRE(steady_clock::now() - start < std::chrono::milliseconds(500));
+}
+
+TEST_CASE("writer stops sending requests to an agent that does not respond") {
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  // Three failures, then the agent is back.
+  handle->perform_result = {CURLE_COULDNT_CONNECT, CURLE_COULDNT_CONNECT, CURLE_COULDNT_CONNECT};
+  handle->perform_result.resize(100, CURLE_OK);
+  AgentConnectionOptions connection_options;
+  connection_options.circuit_breaker.failure_threshold = 2;
+  connection_options.circuit_breaker.min_open_period = std::chrono::milliseconds(200);
+  AgentWriter writer{std::move(handle_ptr),
+                     std::chrono::seconds(3600),
+                     100,
+                     {},
+                     "hostname",
+                     6319,
+                     "",
+                     std::make_shared<RulesSampler>(),
+                     std::make_shared<MockLogger>(),
+                     nullptr,
+                     connection_options};
+  auto send = [&](uint64_t id) {
+    writer.write(make_trace(
+        {TestSpanData{"web", "service", "resource", "service.name", id, 1, 0, 69, 420, 0}}));
+    writer.flush(std::chrono::seconds(10));
+  };
+  auto trace_ids = [&]() {
+    std::vector<uint64_t> ids;
+    for (const auto& request : handle->getRequests()) {
+      std::vector<std::vector<TestSpanData>> traces;
+      msgpack::unpack(request.second.data(), request.second.size()).get().convert(traces);
+      // A probe contains no traces.
+      ids.push_back(traces.empty() ? 0 : traces[0][0].trace_id);
+    }
+    return ids;
+  };
+
+  // The second failure opens the breaker, so the third request is not sent.
+  send(1);
+  send(2);
+  send(3);
+  REQUIRE(trace_ids() == std::vector<uint64_t>{1, 2});
+  // Once the breaker has been open for a while, a probe is sent before the next request. It
+  // fails, so the request is not sent.
+  std::this_thread::sleep_for(std::chrono::milliseconds(250));
+  send(4);
+  REQUIRE(trace_ids() == std::vector<uint64_t>{1, 2, 0});
+  REQUIRE(handle->headers["X-Datadog-Trace-Count"] == "0");
+  // The next probe succeeds, and the request is sent after it.
+  std::this_thread::sleep_for(std::chrono::milliseconds(450));
+  send(5);
+  REQUIRE(trace_ids() == std::vector<uint64_t>{1, 2, 0, 0, 5});
+  send(6);
+  REQUIRE(trace_ids() == std::vector<uint64_t>{1, 2, 0, 0, 5, 6});
+}
+
+#ifndef _MSC_VER
+TEST_CASE("writer spools traces that could not be sent") {
+  char directory[] = "/tmp/dd-spool-test-XXXXXX";
+  REQUIRE(mkdtemp(directory) != nullptr);
+  AgentConnectionOptions connection_options;
+  connection_options.spool_directory = directory;
+  connection_options.spool_replay_period = std::chrono::milliseconds(10);
+  connection_options.spool_retry_period = std::chrono::milliseconds(50);
+  auto make_writer = [&](std::unique_ptr<MockHandle> handle) {
+    return std::unique_ptr<AgentWriter>{new AgentWriter{std::move(handle),
+                                                        std::chrono::seconds(3600),
+                                                        100,
+                                                        {},
+                                                        "hostname",
+                                                        6319,
+                                                        "",
+                                                        std::make_shared<RulesSampler>(),
+                                                        std::make_shared<MockLogger>(),
+                                                        nullptr,
+                                                        connection_options}};
+  };
+
+  {
+    // The agent is unavailable, so both payloads are spooled.
+    std::unique_ptr<MockHandle> handle{new MockHandle{}};
+    handle->perform_result = {CURLE_COULDNT_CONNECT};
+    auto writer = make_writer(std::move(handle));
+    for (uint64_t id = 1; id <= 2; id++) {
+      writer->write(make_trace(
+          {TestSpanData{"web", "service", "resource", "service.name", id, 1, 0, 69, 420, 0}}));
+      writer->flush(std::chrono::seconds(10));
+    }
+  }
+
+  // Once the agent is back, a writer using the same directory sends the spooled payloads in
+  // order.
+  std::unique_ptr<MockHandle> handle_ptr{new MockHandle{}};
+  MockHandle* handle = handle_ptr.get();
+  auto writer = make_writer(std::move(handle_ptr));
+  std::vector<uint64_t> trace_ids;
+  for (int i = 0; i < 500 && trace_ids.size() < 2; i++) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+    trace_ids.clear();
+    for (const auto& request : handle->getRequests()) {
+      std::vector<std::vector<TestSpanData>> traces;
+      msgpack::unpack(request.second.data(), request.second.size()).get().convert(traces);
+      trace_ids.push_back(traces[0][0].trace_id);
+    }
+  }
+  REQUIRE(trace_ids == std::vector<uint64_t>{1, 2});
+  // They are not sent again.
+  std::this_thread::sleep_for(std::chrono::milliseconds(100));
+  REQUIRE(handle->getRequests().size() == 2);
+  writer.reset();
+  REQUIRE(std::system((std::string("rm -rf ") + directory).c_str()) == 0);
+}
+#endif
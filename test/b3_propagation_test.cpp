@@ -0,0 +1,58 @@
+// This test covers the B3 single header functions declared in
+// `b3_propagation.h`.
+
+#include "../src/b3_propagation.h"
+
+#include <catch2/catch.hpp>
+#include <stdexcept>
+#include <string>
+
+using namespace datadog::opentracing;
+
+TEST_CASE("b3 single header codec") {
+  SECTION("decodes IDs and the sampling state") {
+    const B3Context result = parseB3("80f198ee56343ba864fe8b2a57d3eff7-e457b5a2e4d86bd1-1");
+    REQUIRE(result.ids_set);
+    REQUIRE(result.trace_id == 0x64fe8b2a57d3eff7ULL);
+    REQUIRE(result.span_id == 0xe457b5a2e4d86bd1ULL);
+    REQUIRE(*result.sampling_priority == SamplingPriority::SamplerKeep);
+  }
+
+  SECTION("decodes optional fields") {
+    B3Context result = parseB3(" 00000000000004d2-000000000000162e ");
+    REQUIRE(result.trace_id == 1234);
+    REQUIRE(result.span_id == 5678);
+    REQUIRE(result.sampling_priority == nullptr);
+
+    result = parseB3("00000000000004d2-000000000000162e-d-05e3ac9a4f6e3b90");
+    REQUIRE(*result.sampling_priority == SamplingPriority::UserKeep);
+  }
+
+  SECTION("decodes a sampling state without IDs") {
+    const B3Context result = parseB3("0");
+    REQUIRE(!result.ids_set);
+    REQUIRE(*result.sampling_priority == SamplingPriority::SamplerDrop);
+  }
+
+  SECTION("encodes IDs and the sampling state") {
+    B3Text buffer;
+    const SamplingPriority user_keep = SamplingPriority::UserKeep;
+    const SamplingPriority user_drop = SamplingPriority::UserDrop;
+    REQUIRE(std::string(formatB3(1234, 5678, &user_keep, buffer)) ==
+            "00000000000004d2-000000000000162e-1");
+    REQUIRE(std::string(formatB3(1234, 5678, &user_drop, buffer)) ==
+            "00000000000004d2-000000000000162e-0");
+    REQUIRE(std::string(formatB3(1234, 5678, nullptr, buffer)) ==
+            "00000000000004d2-000000000000162e");
+  }
+
+  SECTION("rejects invalid headers") {
+    auto header = GENERATE(as<std::string>{}, "", "2", "00000000000004d2",
+                           "4d2-000000000000162e", "00000000000004d2-162e",
+                           "00000000000004d2-000000000000162e-2",
+                           "00000000000004d2-00000000000016xe-1",
+                           "00000000000004d2-000000000000162e-1-05e3ac9a4f6e3b90-1");
+    CAPTURE(header);
+    REQUIRE_THROWS_AS(parseB3(header), std::invalid_argument);
+  }
+}
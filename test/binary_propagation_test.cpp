@@ -0,0 +1,112 @@
+// This test covers the binary span context encoding declared in
+// `binary_propagation.h`.
+
+#include "../src/binary_propagation.h"
+
+#include <catch2/catch.hpp>
+#include <sstream>
+#include <stdexcept>
+#include <string>
+
+using namespace datadog::opentracing;
+
+namespace {
+
+BinaryContext decode(const std::string& encoded) {
+  std::istringstream reader{encoded};
+  return readBinaryContext(reader);
+}
+
+}  // namespace
+
+TEST_CASE("binary span context codec") {
+  SECTION("round trips a context") {
+    const SamplingPriority priority = SamplingPriority::UserDrop;
+    std::string encoded;
+    encodeBinaryContext(encoded, 0xfedcba9876543210ULL, 42, &priority, "rum", "_dd.p.dm=-4",
+                        {{"ayy", "lmao"}, {"hi", "haha"}});
+    REQUIRE(static_cast<unsigned char>(encoded[0]) == binary_context_marker);
+
+    const BinaryContext result = decode(encoded);
+    REQUIRE(result.trace_id == 0xfedcba9876543210ULL);
+    REQUIRE(result.parent_id == 42);
+    REQUIRE(*result.sampling_priority == SamplingPriority::UserDrop);
+    REQUIRE(result.origin == "rum");
+    REQUIRE(result.serialized_tags == "_dd.p.dm=-4");
+    REQUIRE(result.baggage == std::unordered_map<std::string, std::string>{
+                                  {"ayy", "lmao"}, {"hi", "haha"}});
+  }
+
+  SECTION("round trips a minimal context") {
+    std::string encoded;
+    encodeBinaryContext(encoded, 1, 2, nullptr, "", "", {});
+    // marker, version, body size, IDs, flags, and three empty sizes
+    REQUIRE(encoded.size() == 3 + 16 + 1 + 3);
+
+    const BinaryContext result = decode(encoded);
+    REQUIRE(result.trace_id == 1);
+    REQUIRE(result.parent_id == 2);
+    REQUIRE(result.sampling_priority == nullptr);
+    REQUIRE(result.origin.empty());
+    REQUIRE(result.baggage.empty());
+  }
+
+  SECTION("round trips long strings") {
+    const std::string value(1000, 'x');
+    std::string encoded;
+    encodeBinaryContext(encoded, 1, 2, nullptr, value, "", {{"key", value}});
+    const BinaryContext result = decode(encoded);
+    REQUIRE(result.origin == value);
+    REQUIRE(result.baggage.at("key") == value);
+  }
+
+  SECTION("ignores fields appended to the body") {
+    std::string encoded;
+    encodeBinaryContext(encoded, 1, 2, nullptr, "", "", {});
+    // Increase the body size, and append a byte.
+    encoded[2] = static_cast<char>(encoded[2] + 1);
+    encoded += '\x7f';
+    REQUIRE(decode(encoded).parent_id == 2);
+  }
+
+  SECTION("fails on invalid input") {
+    std::string encoded;
+    encodeBinaryContext(encoded, 1, 2, nullptr, "origin", "", {});
+
+    SECTION("truncated") {
+      for (std::size_t size = 0; size < encoded.size(); ++size) {
+        REQUIRE_THROWS_AS(decode(encoded.substr(0, size)), std::invalid_argument);
+      }
+    }
+
+    SECTION("unsupported version") {
+      encoded[1] = '\x02';
+      REQUIRE_THROWS_AS(decode(encoded), std::invalid_argument);
+    }
+
+    SECTION("string longer than the body") {
+      // The origin's size is at offset 20.
+      encoded[20] = '\x7f';
+      REQUIRE_THROWS_AS(decode(encoded), std::invalid_argument);
+    }
+
+    SECTION("body too large") {
+      REQUIRE_THROWS_AS(decode(std::string("\xdd\x01\xff\xff\xff\xff\x0f")),
+                        std::invalid_argument);
+    }
+
+    SECTION("varint too long") {
+      REQUIRE_THROWS_AS(decode(std::string("\xdd\x01") + std::string(10, '\xff') + '\x01'),
+                        std::invalid_argument);
+    }
+
+    SECTION("invalid sampling priority") {
+      const SamplingPriority priority = SamplingPriority::SamplerKeep;
+      encoded.clear();
+      encodeBinaryContext(encoded, 1, 2, &priority, "", "", {});
+      // The sampling priority is at offset 20.
+      encoded[20] = '\x2a';
+      REQUIRE_THROWS_AS(decode(encoded), std::invalid_argument);
+    }
+  }
+}
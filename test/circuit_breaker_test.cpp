@@ -0,0 +1,140 @@
+// This test covers `CircuitBreaker`, declared in `circuit_breaker.h`.
+
+#include "../src/circuit_breaker.h"
+
+#include <catch2/catch.hpp>
+
+#include "mocks.h"
+using namespace datadog::opentracing;
+
+TEST_CASE("circuit breaker") {
+  TimePoint time{std::chrono::system_clock::time_point{}, std::chrono::steady_clock::time_point{}};
+  TimeProvider get_time = [&time]() { return time; };  // Mock clock.
+  using Decision = CircuitBreaker::Decision;
+  CircuitBreakerOptions options;
+  options.failure_threshold = 3;
+  options.min_open_period = std::chrono::milliseconds(1000);
+  options.max_open_period = std::chrono::milliseconds(3000);
+  options.min_timeout = std::chrono::milliseconds(1);
+  options.max_timeout = std::chrono::milliseconds(2000);
+
+  SECTION("opens after consecutive failures") {
+    CircuitBreaker breaker{get_time, options};
+    breaker.recordFailure(Decision::send, false);
+    breaker.recordFailure(Decision::send, false);
+    REQUIRE(breaker.allow() == Decision::send);
+    breaker.recordFailure(Decision::send, false);
+    REQUIRE(breaker.open());
+    REQUIRE(breaker.allow() == Decision::reject);
+  }
+
+  SECTION("a response resets the count of failures") {
+    CircuitBreaker breaker{get_time, options};
+    breaker.recordFailure(Decision::send, false);
+    breaker.recordFailure(Decision::send, false);
+    breaker.recordResponse(Decision::send, std::chrono::milliseconds(1));
+    breaker.recordFailure(Decision::send, false);
+    breaker.recordFailure(Decision::send, false);
+    REQUIRE(!breaker.open());
+    REQUIRE(breaker.allow() == Decision::send);
+  }
+
+  SECTION("never opens if the threshold is zero") {
+    options.failure_threshold = 0;
+    CircuitBreaker breaker{get_time, options};
+    for (int i = 0; i < 100; i++) {
+      breaker.recordFailure(Decision::send, false);
+    }
+    REQUIRE(breaker.allow() == Decision::send);
+  }
+
+  SECTION("probes once the backoff period has passed") {
+    CircuitBreaker breaker{get_time, options};
+    for (int i = 0; i < 3; i++) {
+      breaker.recordFailure(Decision::send, false);
+    }
+    // The period is jittered to between half and all of `min_open_period`.
+    REQUIRE(breaker.probeTime() >= time.relative_time + std::chrono::milliseconds(500));
+    REQUIRE(breaker.probeTime() <= time.relative_time + std::chrono::milliseconds(1000));
+    advanceTime(time, std::chrono::milliseconds(499));
+    REQUIRE(breaker.allow() == Decision::reject);
+    advanceTime(time, std::chrono::milliseconds(501));
+    REQUIRE(breaker.allow() == Decision::probe);
+    // Only one probe at a time.
+    REQUIRE(breaker.allow() == Decision::reject);
+
+    SECTION("and backs off further when the probe fails") {
+      breaker.recordFailure(Decision::probe, false);
+      REQUIRE(breaker.open());
+      REQUIRE(breaker.allow() == Decision::reject);
+      REQUIRE(breaker.probeTime() >= time.relative_time + std::chrono::milliseconds(1000));
+      REQUIRE(breaker.probeTime() <= time.relative_time + std::chrono::milliseconds(2000));
+      advanceTime(time, std::chrono::milliseconds(2000));
+      REQUIRE(breaker.allow() == Decision::probe);
+      breaker.recordFailure(Decision::probe, false);
+      advanceTime(time, std::chrono::milliseconds(3000));
+      REQUIRE(breaker.allow() == Decision::probe);
+      breaker.recordFailure(Decision::probe, false);
+      // The period is capped at `max_open_period`.
+      REQUIRE(breaker.probeTime() <= time.relative_time + std::chrono::milliseconds(3000));
+    }
+
+    SECTION("and closes when the probe gets a response") {
+      breaker.recordResponse(Decision::probe, std::chrono::milliseconds(1));
+      REQUIRE(!breaker.open());
+      REQUIRE(breaker.allow() == Decision::send);
+      REQUIRE(breaker.allow() == Decision::send);
+    }
+  }
+
+  SECTION("jitter shortens a period by up to half") {
+    CircuitBreaker breaker{get_time, options};
+    for (int i = 0; i < 100; i++) {
+      const auto period = breaker.jitter(std::chrono::milliseconds(100));
+      REQUIRE(period >= std::chrono::milliseconds(50));
+      REQUIRE(period <= std::chrono::milliseconds(100));
+    }
+    REQUIRE(breaker.jitter(std::chrono::milliseconds(0)) == std::chrono::milliseconds(0));
+  }
+
+  SECTION("by default, the timeout does not adapt") {
+    CircuitBreaker breaker{get_time, CircuitBreakerOptions{}};
+    for (int i = 0; i < 100; i++) {
+      breaker.recordResponse(Decision::send, std::chrono::milliseconds(10));
+    }
+    REQUIRE(breaker.timeout() == std::chrono::milliseconds(2000));
+  }
+
+  SECTION("the timeout adapts to the latency of responses") {
+    CircuitBreaker breaker{get_time, options};
+    REQUIRE(breaker.timeout() == std::chrono::milliseconds(2000));
+    // The first response sets the latency, and half of it as its deviation.
+    breaker.recordResponse(Decision::send, std::chrono::milliseconds(10));
+    REQUIRE(breaker.timeout() == std::chrono::milliseconds(30));
+    for (int i = 0; i < 100; i++) {
+      breaker.recordResponse(Decision::send, std::chrono::milliseconds(10));
+    }
+    REQUIRE(breaker.timeout() == std::chrono::milliseconds(10));
+
+    SECTION("doubles after each timeout") {
+      breaker.recordFailure(Decision::send, true);
+      REQUIRE(breaker.timeout() == std::chrono::milliseconds(20));
+      breaker.recordFailure(Decision::send, true);
+      REQUIRE(breaker.timeout() == std::chrono::milliseconds(40));
+      // Failures that are not timeouts don't affect it.
+      breaker.recordFailure(Decision::send, false);
+      REQUIRE(breaker.timeout() == std::chrono::milliseconds(40));
+      breaker.recordResponse(Decision::send, std::chrono::milliseconds(10));
+      REQUIRE(breaker.timeout() == std::chrono::milliseconds(10));
+    }
+
+    SECTION("within its bounds") {
+      options.min_timeout = std::chrono::milliseconds(500);
+      CircuitBreaker bounded{get_time, options};
+      bounded.recordResponse(Decision::send, std::chrono::milliseconds(10));
+      REQUIRE(bounded.timeout() == std::chrono::milliseconds(500));
+      bounded.recordResponse(Decision::send, std::chrono::seconds(10));
+      REQUIRE(bounded.timeout() == std::chrono::milliseconds(2000));
+    }
+  }
+}
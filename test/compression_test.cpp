@@ -0,0 +1,70 @@
+// This test covers the compression routines declared in `compression.h`.
+
+#include "../src/compression.h"
+
+#include <zlib.h>
+
+#include <catch2/catch.hpp>
+#include <string>
+
+using namespace datadog::opentracing;
+
+namespace {
+
+// Return the decompression of the specified gzip `compressed` data, or return
+// "<invalid>" if it cannot be decompressed.
+std::string gunzip(const std::string& compressed) {
+  z_stream stream{};
+  REQUIRE(inflateInit2(&stream, 15 + 16) == Z_OK);
+  stream.next_in = reinterpret_cast<Bytef*>(const_cast<char*>(compressed.data()));
+  stream.avail_in = uInt(compressed.size());
+  std::string result;
+  int status = Z_OK;
+  while (status == Z_OK) {
+    char buffer[4096];
+    stream.next_out = reinterpret_cast<Bytef*>(buffer);
+    stream.avail_out = sizeof(buffer);
+    status = inflate(&stream, Z_NO_FLUSH);
+    result.append(buffer, sizeof(buffer) - stream.avail_out);
+  }
+  inflateEnd(&stream);
+  return status == Z_STREAM_END ? result : "<invalid>";
+}
+
+}  // namespace
+
+TEST_CASE("gzip compression") {
+  std::string input;
+  for (int i = 0; i < 1000; ++i) {
+    input += "\x8b\xa4name\xa9http.call\xa7service\xa5nginx\xa8resource\xa4/api";
+    input += std::to_string(i);
+  }
+
+  SECTION("round trips") {
+    const int level = GENERATE(range(min_compression_level, max_compression_level + 1));
+    std::string output;
+    REQUIRE(gzipCompress(input, level, output));
+    REQUIRE(output.substr(0, 2) == "\x1f\x8b");
+    REQUIRE(output.size() < input.size() / 4);
+    REQUIRE(gunzip(output) == input);
+  }
+
+  SECTION("round trips empty input") {
+    std::string output;
+    REQUIRE(gzipCompress("", 6, output));
+    REQUIRE(gunzip(output) == "");
+  }
+
+  SECTION("round trips input containing null characters") {
+    const std::string nulls{"a\0b\0\0c", 6};
+    std::string output;
+    REQUIRE(gzipCompress(nulls, 1, output));
+    REQUIRE(gunzip(output) == nulls);
+  }
+
+  SECTION("rejects invalid levels") {
+    std::string output;
+    REQUIRE(!gzipCompress(input, 0, output));
+    REQUIRE(!gzipCompress(input, 10, output));
+  }
+}
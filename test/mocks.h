@@ -172,6 +172,7 @@ struct MockRulesSampler : public RulesSampler {
 
   SampleResult sample(const std::string& /* environment */, const std::string& /* service */,
                       const std::string& /* name */, uint64_t /* trace_id */) override {
+    ++sample_calls;
     SampleResult result;
     if (sampling_priority != nullptr) {
       result.rule_rate = rule_rate;
@@ -192,6 +193,7 @@ struct MockRulesSampler : public RulesSampler {
   double priority_rate = std::nan("");
   double applied_rate = std::nan("");
   std::string config;
+  int sample_calls = 0;
 };
 
 // A Writer implementation that allows access to the Spans recorded.
@@ -210,7 +212,15 @@ struct MockWriter : public Writer {
 
   void flush(std::chrono::milliseconds /* timeout (unused) */) override{};
 
+  void writeDropped(uint64_t traces, uint64_t spans) override {
+    std::lock_guard<std::mutex> lock_guard{mutex_};
+    dropped_traces += traces;
+    dropped_spans += spans;
+  }
+
   std::vector<std::vector<std::unique_ptr<SpanData>>> traces;
+  uint64_t dropped_traces = 0;
+  uint64_t dropped_spans = 0;
 
  private:
   mutable std::mutex mutex_;
@@ -303,18 +313,25 @@ struct MockHandle : public Handle {
     return rcode;
   }
 
-  void setHeaders(std::map<std::string, std::string> headers_) override {
-    for (auto& header : headers_) {
+  void setHeaders(const std::map<std::string, std::string>& headers_) override {
+    for (const auto& header : headers_) {
       headers[header.first] = header.second;  // Overwrite.
     }
   }
 
   CURLcode perform() override {
     std::unique_lock<std::mutex> lock(mutex);
+    requests.emplace_back(optionValue(CURLOPT_URL), optionValue(CURLOPT_POSTFIELDS));
     perform_called.notify_all();
     return nextPerformResult();
   }
 
+  // Returns a copy of `requests`, which might be appended to concurrently.
+  std::vector<std::pair<std::string, std::string>> getRequests() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return requests;
+  }
+
   // Could be spurious.
   void waitUntilPerformIsCalled() {
     std::unique_lock<std::mutex> lock(mutex);
@@ -354,6 +371,8 @@ struct MockHandle : public Handle {
 
   std::unordered_map<CURLoption, std::string, EnumClassHash> options;
   std::map<std::string, std::string> headers;
+  // The URL and body of each request performed, in order.
+  std::vector<std::pair<std::string, std::string>> requests;
   std::string error = "";
   std::string response = "";
   int response_status = 200;
@@ -365,6 +384,13 @@ struct MockHandle : public Handle {
   int perform_call_count = 0;
 
  private:
+  // Returns the value of the option `key`, or an empty string if it is not
+  // set. Expects mutex to be locked already.
+  std::string optionValue(CURLoption key) const {
+    auto found = options.find(key);
+    return found == options.end() ? "" : found->second;
+  }
+
   // Returns next result code. Expects mutex to be locked already.
   CURLcode nextPerformResult() {
     if (perform_result.size() == 0) {
@@ -0,0 +1,112 @@
+#include "../src/parse_util.h"
+
+#include <catch2/catch.hpp>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+using namespace datadog::opentracing;
+
+TEST_CASE("trim_ows") {
+  REQUIRE(trim_ows("") == "");
+  REQUIRE(trim_ows(" \t ") == "");
+  REQUIRE(trim_ows("\t a b ") == "a b");
+  REQUIRE(trim_ows("a\r\n") == "a\r\n");
+
+  const char text[] = "abc";
+  REQUIRE(range(text, text + 2) == "ab");
+}
+
+TEST_CASE("parse_uint64") {
+  SECTION("parses decimal and hexadecimal integers") {
+    REQUIRE(parse_uint64("0", 10) == 0);
+    REQUIRE(parse_uint64("1234567890", 10) == 1234567890);
+    REQUIRE(parse_uint64("18446744073709551615", 10) == std::numeric_limits<uint64_t>::max());
+    REQUIRE(parse_uint64("1a4", 16) == 0x1a4);
+    REQUIRE(parse_uint64("DEADbeef", 16) == 0xdeadbeef);
+    REQUIRE(parse_uint64("0x1A4", 16) == 0x1a4);
+    REQUIRE(parse_uint64("ffffffffffffffff", 16) == std::numeric_limits<uint64_t>::max());
+  }
+
+  SECTION("tolerates surrounding spaces and tabs") {
+    REQUIRE(parse_uint64("  42", 10) == 42);
+    REQUIRE(parse_uint64("42\t ", 10) == 42);
+    REQUIRE(parse_uint64(" 2a ", 16) == 42);
+  }
+
+  SECTION("fails on invalid text") {
+    auto text = GENERATE(as<std::string>{}, "", "   ", "12a", "1 2", "-1", "+", "0x10",
+                         "42\r\n");
+    REQUIRE_THROWS_AS(parse_uint64(text, 10), std::invalid_argument);
+  }
+
+  SECTION("fails on overflow") {
+    REQUIRE_THROWS_AS(parse_uint64("18446744073709551616", 10), std::out_of_range);
+    REQUIRE_THROWS_AS(parse_uint64("10000000000000000", 16), std::out_of_range);
+  }
+}
+
+TEST_CASE("parse_hex128") {
+  uint64_t high = 1;
+  uint64_t low = 1;
+
+  SECTION("parses up to 32 digits") {
+    parse_hex128("4bf92f3577b34da6a3ce929d0e0e4736", high, low);
+    REQUIRE(high == 0x4bf92f3577b34da6);
+    REQUIRE(low == 0xa3ce929d0e0e4736);
+    parse_hex128("a3ce929d0e0e4736", high, low);
+    REQUIRE(high == 0);
+    REQUIRE(low == 0xa3ce929d0e0e4736);
+    parse_hex128("1ffffffffffffffff", high, low);
+    REQUIRE(high == 1);
+    REQUIRE(low == std::numeric_limits<uint64_t>::max());
+  }
+
+  SECTION("fails on invalid text") {
+    REQUIRE_THROWS_AS(parse_hex128("", high, low), std::invalid_argument);
+    REQUIRE_THROWS_AS(parse_hex128("4bf92f3577b34da6a3ce929d0e0e473g", high, low),
+                      std::invalid_argument);
+    REQUIRE_THROWS_AS(parse_hex128("14bf92f3577b34da6a3ce929d0e0e4736", high, low),
+                      std::out_of_range);
+  }
+}
+
+TEST_CASE("parse_int") {
+  REQUIRE(parse_int("0") == 0);
+  REQUIRE(parse_int(" -1 ") == -1);
+  REQUIRE(parse_int("+2") == 2);
+  REQUIRE(parse_int("2147483647") == std::numeric_limits<int>::max());
+  REQUIRE(parse_int("-2147483648") == std::numeric_limits<int>::min());
+  REQUIRE_THROWS_AS(parse_int("2147483648"), std::out_of_range);
+  REQUIRE_THROWS_AS(parse_int("-"), std::invalid_argument);
+  REQUIRE_THROWS_AS(parse_int("1.0"), std::invalid_argument);
+}
+
+TEST_CASE("integer formatting") {
+  IntegerText buffer;
+
+  SECTION("hexadecimal") {
+    REQUIRE(format_hex(0, buffer) == "0");
+    REQUIRE(format_hex(0x1a4, buffer) == "1a4");
+    REQUIRE(format_hex(std::numeric_limits<uint64_t>::max(), buffer) == "ffffffffffffffff");
+    REQUIRE(format_hex128(0, 0x1a4, buffer) == "000000000000000000000000000001a4");
+    REQUIRE(format_hex128(0x4bf92f3577b34da6, 0xa3ce929d0e0e4736, buffer) ==
+            "4bf92f3577b34da6a3ce929d0e0e4736");
+  }
+
+  SECTION("decimal") {
+    REQUIRE(format_decimal(uint64_t(0), buffer) == "0");
+    REQUIRE(format_decimal(std::numeric_limits<uint64_t>::max(), buffer) ==
+            "18446744073709551615");
+    REQUIRE(format_decimal(-1, buffer) == "-1");
+    REQUIRE(format_decimal(2, buffer) == "2");
+    REQUIRE(format_decimal(std::numeric_limits<int>::min(), buffer) == "-2147483648");
+  }
+
+  SECTION("round trips") {
+    for (uint64_t value : {uint64_t(1), uint64_t(123456789), uint64_t(0x8000000000000000)}) {
+      REQUIRE(parse_uint64(format_hex(value, buffer), 16) == value);
+      REQUIRE(parse_uint64(format_decimal(value, buffer), 10) == value);
+    }
+  }
+}
@@ -6,6 +6,8 @@
 #include <catch2/catch.hpp>
 #include <nlohmann/json.hpp>
 #include <string>
+#include <thread>
+#include <vector>
 
 #include "../src/span.h"
 #include "../src/span_context.h"
@@ -32,12 +34,16 @@ TEST_CASE("SpanContext") {
   buffer->traces().emplace(std::make_pair(
       123, PendingTrace{logger, 123,
                         std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep)}));
-  SpanContext context{logger, 420, 123, "synthetics", {{"ayy", "lmao"}, {"hi", "haha"}}};
+  SpanContext context{420, 123, "synthetics", {{"ayy", "lmao"}, {"hi", "haha"}}};
 
   auto propagation_styles =
       GENERATE(std::set<PropagationStyle>{PropagationStyle::Datadog},
                std::set<PropagationStyle>{PropagationStyle::B3},
-               std::set<PropagationStyle>{PropagationStyle::Datadog, PropagationStyle::B3});
+               std::set<PropagationStyle>{PropagationStyle::Datadog, PropagationStyle::B3},
+               std::set<PropagationStyle>{PropagationStyle::B3Single},
+               std::set<PropagationStyle>{PropagationStyle::W3C},
+               std::set<PropagationStyle>{PropagationStyle::Datadog, PropagationStyle::B3,
+                                          PropagationStyle::B3Single, PropagationStyle::W3C});
   auto priority_sampling = GENERATE(false, true);
 
   SECTION("can be serialized") {
@@ -201,6 +207,60 @@ TEST_CASE("SpanContext") {
   }
 }
 
+TEST_CASE("child contexts share baggage and trace tags") {
+  auto logger = std::make_shared<const MockLogger>();
+  MockTextMapCarrier carrier;
+  carrier.Set("x-datadog-trace-id", "123");
+  carrier.Set("x-datadog-parent-id", "456");
+  carrier.Set("x-datadog-tags", "_dd.p.hello=world");
+  carrier.Set("ot-baggage-ayy", "lmao");
+  auto result = SpanContext::deserialize(logger, carrier, {PropagationStyle::Datadog});
+  REQUIRE(result);
+  auto& parent = dynamic_cast<SpanContext&>(**result);
+
+  SpanContext child = parent.withId(789);
+  // The child refers to the parent's trace tags rather than to a copy.
+  REQUIRE(&child.getExtractedTraceTags() == &parent.getExtractedTraceTags());
+  REQUIRE(getBaggage(&child) == dict{{"ayy", "lmao"}});
+
+  SECTION("until the child's baggage is modified") {
+    child.setBaggageItem("hi", "haha");
+    REQUIRE(getBaggage(&child) == dict{{"ayy", "lmao"}, {"hi", "haha"}});
+    REQUIRE(getBaggage(&parent) == dict{{"ayy", "lmao"}});
+  }
+
+  SECTION("until a sibling's baggage is modified") {
+    SpanContext sibling = parent.withId(790);
+    sibling.setBaggageItem("hi", "haha");
+    REQUIRE(getBaggage(&child) == dict{{"ayy", "lmao"}});
+    REQUIRE(child.baggageItem("hi").empty());
+    REQUIRE(sibling.baggageItem("hi") == "haha");
+  }
+}
+
+TEST_CASE("baggage can be modified while it is read") {
+  SpanContext context{420, 123, "", {}};
+  const int num_threads = 4;
+  const int items_per_thread = 100;
+  std::vector<std::thread> threads;
+  for (int i = 0; i < num_threads; ++i) {
+    threads.emplace_back([&context, i]() {
+      for (int j = 0; j < items_per_thread; ++j) {
+        context.setBaggageItem(std::to_string(i) + "-" + std::to_string(j), "value");
+        // Readers see a consistent snapshot.
+        getBaggage(&context);
+        std::unique_ptr<ot::SpanContext> clone = context.Clone();
+      }
+    });
+  }
+  for (auto& thread : threads) {
+    thread.join();
+  }
+
+  // No item was lost to a concurrent modification.
+  REQUIRE(getBaggage(&context).size() == num_threads * items_per_thread);
+}
+
 TEST_CASE("deserialize fails") {
   auto logger = std::make_shared<const MockLogger>();
   MockTextMapCarrier carrier{};
@@ -208,7 +268,7 @@ TEST_CASE("deserialize fails") {
   buffer->traces().emplace(std::make_pair(
       123, PendingTrace{logger, 123,
                         std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep)}));
-  SpanContext context{logger, 420, 123, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
+  SpanContext context{420, 123, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
 
   struct PropagationStyleTestCase {
     std::set<PropagationStyle> styles;
@@ -284,7 +344,7 @@ TEST_CASE("SamplingPriority values are clamped apropriately for b3") {
   auto buffer = std::make_shared<MockBuffer>();
   buffer->traces().emplace(std::make_pair(
       123, PendingTrace{logger, 123, std::make_unique<SamplingPriority>(priority.first)}));
-  SpanContext context{logger, 420, 123, "", {}};
+  SpanContext context{420, 123, "", {}};
 
   REQUIRE(context.serialize(carrier, buffer, {PropagationStyle::B3}, true));
 
@@ -326,6 +386,238 @@ TEST_CASE("deserialize fails when there are conflicting b3 and datadog headers")
   REQUIRE(err.error() == ot::span_context_corrupted_error);
 }
 
+TEST_CASE("deserialize reads the headers of all styles in one pass") {
+  auto logger = std::make_shared<const MockLogger>();
+  struct CountingCarrier : MockTextMapCarrier {
+    ot::expected<void> ForeachKey(
+        std::function<ot::expected<void>(ot::string_view key, ot::string_view value)> f)
+        const override {
+      ++passes;
+      return MockTextMapCarrier::ForeachKey(f);
+    }
+    mutable int passes = 0;
+  } carrier;
+  carrier.Set("X-Datadog-Trace-Id", "420");
+  carrier.Set("X-DATADOG-PARENT-ID", "421");
+  carrier.Set("x-b3-traceid", "1a4");
+  carrier.Set("x-b3-spanid", "1a5");
+  carrier.Set("x-datadog-origin", "synthetics");
+  carrier.Set("user-agent", "curl/7.68.0");
+  carrier.Set("x-forwarded-for", "10.0.0.1");
+
+  SECTION("with multiple styles") {
+    auto result = SpanContext::deserialize(logger, carrier,
+                                           {PropagationStyle::Datadog, PropagationStyle::B3});
+    REQUIRE(result);
+    REQUIRE(carrier.passes == 1);
+    auto context = dynamic_cast<SpanContext*>(result.value().get());
+    REQUIRE(context->traceId() == 420);
+    REQUIRE(context->id() == 421);
+    REQUIRE(context->origin() == "synthetics");
+  }
+
+  SECTION("ignoring the headers of other styles") {
+    carrier.Set("x-b3-traceid", "not even hex");
+    auto result = SpanContext::deserialize(logger, carrier, {PropagationStyle::Datadog});
+    REQUIRE(result);
+    REQUIRE(carrier.passes == 1);
+    REQUIRE(dynamic_cast<SpanContext*>(result.value().get())->traceId() == 420);
+  }
+}
+
+TEST_CASE("serialize consults the span buffer once for all styles") {
+  auto logger = std::make_shared<const MockLogger>();
+  struct CountingBuffer : MockBuffer {
+    InjectedTraceState prepareInjection(uint64_t trace_id, bool lock_sampling_priority) override {
+      ++calls;
+      return MockBuffer::prepareInjection(trace_id, lock_sampling_priority);
+    }
+    int calls = 0;
+  };
+  auto buffer = std::make_shared<CountingBuffer>();
+  buffer->traces().emplace(std::make_pair(
+      123, PendingTrace{logger, 123,
+                        std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep)}));
+  SpanContext context{420, 123, "", {}};
+  MockTextMapCarrier carrier;
+
+  REQUIRE(context.serialize(carrier, buffer, {PropagationStyle::Datadog, PropagationStyle::B3},
+                            true));
+  REQUIRE(buffer->calls == 1);
+  REQUIRE(carrier.text_map["x-datadog-sampling-priority"] == "1");
+  REQUIRE(carrier.text_map["X-B3-Sampled"] == "1");
+  // The sampling decision was locked as part of the same call.
+  REQUIRE(buffer->traces().at(123).sampling_priority_locked);
+}
+
+TEST_CASE("B3 single header propagation") {
+  auto logger = std::make_shared<const MockLogger>();
+  auto buffer = std::make_shared<MockBuffer>();
+  const std::set<PropagationStyle> b3_single{PropagationStyle::B3Single};
+
+  SECTION("injects the b3 header") {
+    buffer->traces().emplace(std::make_pair(
+        1234, PendingTrace{logger, 1234,
+                           std::make_unique<SamplingPriority>(SamplingPriority::UserKeep)}));
+    SpanContext context{5678, 1234, "synthetics", {}};
+    MockTextMapCarrier carrier;
+    REQUIRE(context.serialize(carrier, buffer, b3_single, true));
+    REQUIRE(carrier.text_map == std::unordered_map<std::string, std::string>{
+                                    {"b3", "00000000000004d2-000000000000162e-1"},
+                                    {"x-datadog-origin", "synthetics"},
+                                    {"x-datadog-tags", ""}});
+  }
+
+  SECTION("extracts a context") {
+    MockTextMapCarrier carrier;
+    carrier.Set("B3", "00000000000004d2-000000000000162e-0");
+    auto result = SpanContext::deserialize(logger, carrier, b3_single);
+    REQUIRE(result);
+    auto extracted = dynamic_cast<SpanContext*>(result->get());
+    REQUIRE(extracted->traceId() == 1234);
+    REQUIRE(extracted->id() == 5678);
+    REQUIRE(*extracted->getPropagatedSamplingPriority() == SamplingPriority::SamplerDrop);
+  }
+
+  SECTION("agrees with the multiple header form") {
+    MockTextMapCarrier carrier;
+    carrier.Set("b3", "00000000000004d2-000000000000162e-1");
+    carrier.Set("X-B3-TraceId", "4d2");
+    carrier.Set("X-B3-SpanId", "162e");
+    carrier.Set("X-B3-Sampled", "1");
+    const std::set<PropagationStyle> both{PropagationStyle::B3, PropagationStyle::B3Single};
+    REQUIRE(SpanContext::deserialize(logger, carrier, both));
+
+    carrier.Set("X-B3-SpanId", "162f");
+    auto result = SpanContext::deserialize(logger, carrier, both);
+    REQUIRE(!result);
+    REQUIRE(result.error() == ot::span_context_corrupted_error);
+  }
+
+  SECTION("fails on an invalid b3 header") {
+    MockTextMapCarrier carrier;
+    carrier.Set("b3", "00000000000004d2");
+    auto result = SpanContext::deserialize(logger, carrier, b3_single);
+    REQUIRE(!result);
+    REQUIRE(result.error() == ot::span_context_corrupted_error);
+  }
+}
+
+TEST_CASE("W3C propagation") {
+  auto logger = std::make_shared<const MockLogger>();
+  auto buffer = std::make_shared<MockBuffer>();
+  const std::set<PropagationStyle> w3c{PropagationStyle::W3C};
+
+  SECTION("injects traceparent and tracestate only") {
+    buffer->traces().emplace(std::make_pair(
+        1234, PendingTrace{logger, 1234,
+                           std::make_unique<SamplingPriority>(SamplingPriority::UserKeep)}));
+    SpanContext context{5678, 1234, "synthetics", {}};
+    MockTextMapCarrier carrier;
+    REQUIRE(context.serialize(carrier, buffer, w3c, true));
+    REQUIRE(carrier.text_map == std::unordered_map<std::string, std::string>{
+                                    {"traceparent",
+                                     "00-000000000000000000000000000004d2-000000000000162e-01"},
+                                    {"tracestate", "dd=s:2;o:synthetics"}});
+  }
+
+  SECTION("extracts, and then injects, a context") {
+    MockTextMapCarrier carrier;
+    carrier.Set("TraceParent", "00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-00");
+    carrier.Set("tracestate", "foo=bar,dd=s:-1;o:rum;t.dm:-4");
+    auto result = SpanContext::deserialize(logger, carrier, w3c);
+    REQUIRE(result);
+    auto extracted = dynamic_cast<SpanContext*>(result->get());
+    REQUIRE(extracted != nullptr);
+    REQUIRE(extracted->traceId() == 0xa3ce929d0e0e4736ULL);
+    REQUIRE(extracted->id() == 0x00f067aa0ba902b7ULL);
+    REQUIRE(*extracted->getPropagatedSamplingPriority() == SamplingPriority::UserDrop);
+    REQUIRE(extracted->origin() == "rum");
+    REQUIRE(extracted->getExtractedTraceTags() ==
+            std::unordered_map<std::string, std::string>{{"_dd.p.dm", "-4"},
+                                                         {"_dd.p.tid", "4bf92f3577b34da6"}});
+
+    // A child context keeps the 128-bit trace ID and the other vendors' state.
+    const SpanContext child = extracted->withId(42);
+    // The child shares the extracted state rather than copying it.
+    REQUIRE(&child.origin() == &extracted->origin());
+    buffer->traces().emplace(std::make_pair(
+        child.traceId(),
+        PendingTrace{logger, child.traceId(),
+                     std::make_unique<SamplingPriority>(SamplingPriority::UserDrop)}));
+    MockTextMapCarrier injected;
+    REQUIRE(child.serialize(injected, buffer, w3c, true));
+    REQUIRE(injected.text_map["traceparent"] ==
+            "00-4bf92f3577b34da6a3ce929d0e0e4736-000000000000002a-00");
+    REQUIRE(injected.text_map["tracestate"] == "dd=s:-1;o:rum,foo=bar");
+  }
+
+  SECTION("takes the sampling decision from traceparent if tracestate disagrees") {
+    MockTextMapCarrier carrier;
+    carrier.Set("traceparent", "00-000000000000000000000000000004d2-000000000000162e-01");
+    carrier.Set("tracestate", "dd=s:-1");
+    auto result = SpanContext::deserialize(logger, carrier, w3c);
+    REQUIRE(result);
+    auto extracted = dynamic_cast<SpanContext*>(result->get());
+    REQUIRE(*extracted->getPropagatedSamplingPriority() == SamplingPriority::SamplerKeep);
+  }
+
+  SECTION("prefers Datadog headers for the origin and trace tags") {
+    MockTextMapCarrier carrier;
+    carrier.Set("traceparent", "00-000000000000000000000000000004d2-000000000000162e-01");
+    carrier.Set("tracestate", "dd=s:1;o:rum;t.dm:-4");
+    carrier.Set("x-datadog-trace-id", "1234");
+    carrier.Set("x-datadog-parent-id", "5678");
+    carrier.Set("x-datadog-sampling-priority", "1");
+    carrier.Set("x-datadog-origin", "synthetics");
+    carrier.Set("x-datadog-tags", "_dd.p.dm=-3");
+    auto result = SpanContext::deserialize(logger, carrier,
+                                           {PropagationStyle::Datadog, PropagationStyle::W3C});
+    REQUIRE(result);
+    auto extracted = dynamic_cast<SpanContext*>(result->get());
+    REQUIRE(extracted->origin() == "synthetics");
+    REQUIRE(extracted->getExtractedTraceTags() ==
+            std::unordered_map<std::string, std::string>{{"_dd.p.dm", "-3"}});
+  }
+
+  SECTION("agrees with Datadog headers on the decision of the sampled flag") {
+    MockTextMapCarrier carrier;
+    carrier.Set("traceparent", "00-000000000000000000000000000004d2-000000000000162e-01");
+    carrier.Set("x-datadog-trace-id", "1234");
+    carrier.Set("x-datadog-parent-id", "5678");
+    const std::set<PropagationStyle> both{PropagationStyle::Datadog, PropagationStyle::W3C};
+    // The sampled flag agrees with an absent priority...
+    REQUIRE(SpanContext::deserialize(logger, carrier, both));
+    // ...and with any priority that keeps the trace.
+    carrier.Set("x-datadog-sampling-priority", "2");
+    REQUIRE(SpanContext::deserialize(logger, carrier, both));
+
+    carrier.Set("x-datadog-sampling-priority", "-1");
+    auto result = SpanContext::deserialize(logger, carrier, both);
+    REQUIRE(!result);
+    REQUIRE(result.error() == ot::span_context_corrupted_error);
+  }
+
+  SECTION("fails on conflicting Datadog headers") {
+    MockTextMapCarrier carrier;
+    carrier.Set("traceparent", "00-000000000000000000000000000004d2-000000000000162e-01");
+    carrier.Set("x-datadog-trace-id", "1234");
+    carrier.Set("x-datadog-parent-id", "1");
+    auto result = SpanContext::deserialize(logger, carrier,
+                                           {PropagationStyle::Datadog, PropagationStyle::W3C});
+    REQUIRE(!result);
+    REQUIRE(result.error() == ot::span_context_corrupted_error);
+  }
+
+  SECTION("fails on an invalid traceparent") {
+    MockTextMapCarrier carrier;
+    carrier.Set("traceparent", "00-000000000000000000000000000004d2-000000000000162e");
+    auto result = SpanContext::deserialize(logger, carrier, w3c);
+    REQUIRE(!result);
+    REQUIRE(result.error() == ot::span_context_corrupted_error);
+  }
+}
+
 TEST_CASE("deserialize returns a null context if both trace ID and parent ID are missing") {
   auto logger = std::make_shared<const MockLogger>();
 
@@ -354,8 +646,11 @@ TEST_CASE("Binary Span Context") {
   auto priority_sampling = GENERATE(false, true);
 
   SECTION("can be serialized") {
-    SpanContext context{logger, 420, 123, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
-    REQUIRE(context.serialize(carrier, buffer, priority_sampling));
+    SpanContext context{420, 123, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
+    // The JSON and the binary encodings are both decoded by `deserialize`.
+    auto binary = GENERATE(false, true);
+    REQUIRE(context.serialize(carrier, buffer, priority_sampling, binary));
+    REQUIRE((carrier.str().front() == '{') == !binary);
 
     SECTION("can be deserialized") {
       auto sc = SpanContext::deserialize(logger, carrier);
@@ -374,7 +669,7 @@ TEST_CASE("Binary Span Context") {
   }
 
   SECTION("serialize fails") {
-    SpanContext context{logger, 420, 123, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
+    SpanContext context{420, 123, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
     SECTION("when the writer is not 'good'") {
       carrier.clear(carrier.badbit);
       auto err = context.serialize(carrier, buffer, priority_sampling);
@@ -412,9 +707,50 @@ TEST_CASE("Binary Span Context") {
       REQUIRE(!err);
       REQUIRE(err.error() == std::make_error_code(std::errc::invalid_argument));
     }
+
+    SECTION("when the binary encoding is truncated") {
+      SpanContext context{420, 123, "", {{"ayy", "lmao"}}};
+      std::stringstream encoded;
+      REQUIRE(context.serialize(encoded, buffer, priority_sampling, true));
+      const std::string text = encoded.str();
+      carrier << text.substr(0, text.size() - 1);
+      auto err = SpanContext::deserialize(logger, carrier);
+      REQUIRE(!err);
+      REQUIRE(err.error() == ot::span_context_corrupted_error);
+    }
   }
 }
 
+TEST_CASE("binary span context carries the whole context") {
+  auto logger = std::make_shared<const MockLogger>();
+  auto buffer = std::make_shared<MockBuffer>(std::make_shared<RulesSampler>(), "service", 512);
+  buffer->traces().emplace(std::make_pair(
+      123, PendingTrace{logger, 123,
+                        std::make_unique<SamplingPriority>(SamplingPriority::UserDrop)}));
+  buffer->traces().at(123).trace_tags = {{"_dd.p.hello", "world"}};
+  SpanContext context{420, 123, "synthetics", {{"ayy", "lmao"}}};
+
+  std::stringstream carrier;
+  REQUIRE(context.serialize(carrier, buffer, true, true));
+  // A message may follow the context in the stream.
+  carrier << "payload";
+
+  auto result = SpanContext::deserialize(logger, carrier);
+  REQUIRE(result);
+  auto& extracted = dynamic_cast<SpanContext&>(**result);
+  REQUIRE(extracted.id() == 420);
+  REQUIRE(extracted.traceId() == 123);
+  REQUIRE(*extracted.getPropagatedSamplingPriority() == SamplingPriority::UserDrop);
+  REQUIRE(extracted.origin() == "synthetics");
+  REQUIRE(extracted.getExtractedTraceTags() == dict{{"_dd.p.hello", "world"}});
+  REQUIRE(getBaggage(&extracted) == dict{{"ayy", "lmao"}});
+
+  // The stream is left at the end of the context.
+  std::string rest;
+  carrier >> rest;
+  REQUIRE(rest == "payload");
+}
+
 TEST_CASE("sampling behaviour") {
   auto logger = std::make_shared<MockLogger>();
   auto sampler = std::make_shared<MockRulesSampler>();
@@ -662,7 +998,7 @@ TEST_CASE("origin header propagation") {
                         std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep)}));
 
   std::shared_ptr<Tracer> tracer{new Tracer{{}, buffer, getRealTime, getId}};
-  SpanContext context{logger, 420, 123, "madeuporigin", {{"ayy", "lmao"}, {"hi", "haha"}}};
+  SpanContext context{420, 123, "madeuporigin", {{"ayy", "lmao"}, {"hi", "haha"}}};
   ot::Tracer::InitGlobal(tracer);
 
   SECTION("the origin header is injected") {
@@ -61,6 +61,15 @@ TEST_CASE("priority sampler unit test") {
       sample_rate = count_sampled / static_cast<double>(total);
       REQUIRE((sample_rate < 0.85 && sample_rate > 0.75));
     }
+
+    SECTION("configuring again replaces the rates, but keeps the default rate if it is missing") {
+      sampler.configure("{ \"service:,env:\": 0.5, \"service:nginx,env:\": 0.3 }"_json);
+      sampler.configure("{ \"service:nginx,env:prod\": 0.2 }"_json);
+      auto result = sampler.sample("", "nginx", 1);
+      REQUIRE(result.priority_rate == 0.5);
+      result = sampler.sample("prod", "nginx", 1);
+      REQUIRE(result.priority_rate == 0.2);
+    }
   }
 }
 
@@ -313,6 +322,101 @@ TEST_CASE("rules sampler") {
   }
 }
 
+TEST_CASE("adaptive sampler") {
+  TimePoint time{std::chrono::system_clock::time_point{}, std::chrono::steady_clock::time_point{}};
+  const TimeProvider get_time = [&time]() { return time; };  // Mock clock.
+  const double target_spans_per_second = 100;
+  AdaptiveSampler sampler{get_time, target_spans_per_second};
+
+  SECTION("keeps everything until a window has been measured") {
+    for (uint64_t trace_id = 0; trace_id < 1000; ++trace_id) {
+      auto result = sampler.sample("service", "operation", trace_id);
+      REQUIRE(result.priority_rate == 1.0);
+      REQUIRE(*result.sampling_priority == SamplingPriority::SamplerKeep);
+      REQUIRE(result.sampling_mechanism.get<SamplingMechanism>() == SamplingMechanism::Adaptive);
+    }
+  }
+
+  SECTION("low-volume keys keep everything, high-volume keys share the rest") {
+    // 1000 traces per second of "busy", and 10 of "quiet".
+    for (uint64_t trace_id = 0; trace_id < 1000; ++trace_id) {
+      sampler.sample("service", "busy", trace_id);
+    }
+    for (uint64_t trace_id = 0; trace_id < 10; ++trace_id) {
+      sampler.sample("service", "quiet", trace_id);
+    }
+    advanceTime(time, std::chrono::seconds(1));
+
+    // "quiet" is within its half of the budget, and so "busy" gets the other
+    // 90 spans per second.
+    REQUIRE(sampler.sample("service", "quiet", 1).priority_rate == 1.0);
+    REQUIRE(sampler.sample("service", "busy", 1).priority_rate == Approx(0.09));
+
+    int kept = 0;
+    const int total = 10000;
+    for (int i = 0; i < total; ++i) {
+      auto result = sampler.sample("service", "busy", getId());
+      kept += *result.sampling_priority == SamplingPriority::SamplerKeep;
+    }
+    const double kept_rate = kept / double(total);
+    REQUIRE((kept_rate > 0.07 && kept_rate < 0.11));
+  }
+
+  SECTION("budget is measured in spans when they are recorded") {
+    // 100 traces per second, each having 10 spans.
+    for (uint64_t trace_id = 0; trace_id < 100; ++trace_id) {
+      sampler.sample("service", "operation", trace_id);
+      sampler.recordSpans("service", "operation", 10);
+    }
+    advanceTime(time, std::chrono::seconds(1));
+
+    REQUIRE(sampler.sample("service", "operation", 1).priority_rate == Approx(0.1));
+  }
+
+  SECTION("spans of unrecorded traces are extrapolated from recorded traces") {
+    // 100 traces per second, only one tenth of which are recorded, each
+    // having 10 spans.
+    for (uint64_t trace_id = 0; trace_id < 100; ++trace_id) {
+      sampler.sample("service", "operation", trace_id);
+      if (trace_id % 10 == 0) {
+        sampler.recordSpans("service", "operation", 10);
+      }
+    }
+    advanceTime(time, std::chrono::seconds(1));
+
+    REQUIRE(sampler.sample("service", "operation", 1).priority_rate == Approx(0.1));
+  }
+
+  SECTION("rates recover when traffic subsides") {
+    for (uint64_t trace_id = 0; trace_id < 1000; ++trace_id) {
+      sampler.sample("service", "operation", trace_id);
+    }
+    advanceTime(time, std::chrono::seconds(1));
+    REQUIRE(sampler.sample("service", "operation", 1).priority_rate == Approx(0.1));
+
+    // Every window is replaced.
+    advanceTime(time, std::chrono::seconds(AdaptiveSampler::num_windows));
+    REQUIRE(sampler.sample("service", "operation", 1).priority_rate == 1.0);
+  }
+
+  SECTION("is consulted by the rules sampler only for unmatched traces") {
+    RulesSampler rules_sampler;
+    rules_sampler.addRule([](const std::string&, const std::string& name) -> RuleResult {
+      if (name == "ruled") {
+        return {true, 1.0};
+      }
+      return {false, std::nan("")};
+    });
+    rules_sampler.setAdaptiveSampler(
+        std::make_shared<AdaptiveSampler>(get_time, target_spans_per_second));
+
+    auto result = rules_sampler.sample("", "service", "ruled", 1);
+    REQUIRE(result.sampling_mechanism.get<SamplingMechanism>() == SamplingMechanism::Rule);
+    result = rules_sampler.sample("", "service", "unruled", 1);
+    REQUIRE(result.sampling_mechanism.get<SamplingMechanism>() == SamplingMechanism::Adaptive);
+  }
+}
+
 TEST_CASE("SpanSampler rule parsing") {
   MockLogger logger;
   const auto dummy_clock = []() { return TimePoint(); };
@@ -3,6 +3,7 @@
 #include <catch2/catch.hpp>
 
 #include "../src/sample.h"
+#include "../src/stats_concentrator.h"
 #include "mocks.h"
 using namespace datadog::opentracing;
 
@@ -15,7 +16,7 @@ TEST_CASE("span buffer") {
 
   auto context_from_span = [](const TestSpanData& span) -> SpanContext {
     auto logger = std::make_shared<const MockLogger>();
-    return SpanContext{logger, span.span_id, span.trace_id, "", {}};
+    return SpanContext{span.span_id, span.trace_id, "", {}};
   };
 
   SECTION("can write a single-span trace") {
@@ -179,3 +180,205 @@ TEST_CASE("span buffer") {
     }
   }
 }
+
+TEST_CASE("span buffer drops unsampled traces when stats are computed") {
+  auto logger = std::make_shared<MockLogger>();
+  auto sampler = std::make_shared<MockRulesSampler>();
+  sampler->sampling_priority = std::make_unique<SamplingPriority>(SamplingPriority::SamplerDrop);
+  auto writer = std::make_shared<MockWriter>(sampler);
+  auto span_sampler = std::make_shared<SpanSampler>();
+  span_sampler->configure(R"([{"name": "keep"}])", *logger, getRealTime);
+  auto stats = std::make_shared<StatsConcentrator>(getRealTime, "", "", "");
+  auto buffer = std::make_shared<SpanBuffer>(logger, writer, sampler, span_sampler,
+                                             SpanBufferOptions{}, stats);
+
+  // Spans named "error" have an error.
+  auto write_trace = [&](std::initializer_list<std::string> names) {
+    for (uint64_t span_id = 1; span_id <= names.size(); ++span_id) {
+      buffer->registerSpan(SpanContext{span_id, 1, "", {}});
+    }
+    uint64_t span_id = 1;
+    for (const auto& name : names) {
+      buffer->finishSpan(std::make_unique<TestSpanData>("type", "service", "resource", name, 1,
+                                                        span_id, span_id - 1, 123, 456,
+                                                        name == "error" ? 1 : 0));
+      ++span_id;
+    }
+  };
+
+  SECTION("unsampled traces are dropped") {
+    write_trace({"root", "child", "child"});
+    REQUIRE(writer->traces.empty());
+    REQUIRE(writer->dropped_traces == 1);
+    REQUIRE(writer->dropped_spans == 3);
+    // Trace metrics include the dropped spans.
+    REQUIRE(!stats->flush(true).empty());
+  }
+
+  SECTION("only spans kept by span sampling are sent") {
+    write_trace({"root", "keep", "child"});
+    REQUIRE(writer->traces.size() == 1);
+    REQUIRE(writer->traces[0].size() == 1);
+    REQUIRE(writer->traces[0][0]->name == "keep");
+    REQUIRE(writer->dropped_traces == 0);
+    REQUIRE(writer->dropped_spans == 2);
+  }
+
+  SECTION("unsampled traces containing an error are sent whole") {
+    write_trace({"root", "error", "keep"});
+    REQUIRE(writer->traces.size() == 1);
+    REQUIRE(writer->traces[0].size() == 3);
+    REQUIRE(writer->dropped_traces == 0);
+    REQUIRE(writer->dropped_spans == 0);
+  }
+
+  SECTION("sampled traces are sent") {
+    sampler->sampling_priority = std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep);
+    write_trace({"root", "child"});
+    REQUIRE(writer->traces.size() == 1);
+    REQUIRE(writer->traces[0].size() == 2);
+    REQUIRE(writer->dropped_traces == 0);
+    REQUIRE(writer->dropped_spans == 0);
+  }
+}
+
+TEST_CASE("span buffer measures adaptive sampling decisions by their key") {
+  TimePoint time{std::chrono::system_clock::time_point{}, std::chrono::steady_clock::time_point{}};
+  const TimeProvider get_time = [&time]() { return time; };  // Mock clock.
+  auto logger = std::make_shared<MockLogger>();
+  auto sampler = std::make_shared<RulesSampler>();
+  sampler->addRule([](const std::string&, const std::string& name) -> RuleResult {
+    if (name == "ruled") {
+      return {true, 1.0};
+    }
+    return {false, std::nan("")};
+  });
+  sampler->setAdaptiveSampler(std::make_shared<AdaptiveSampler>(get_time, 100));
+  auto writer = std::make_shared<MockWriter>(sampler);
+  auto buffer =
+      std::make_shared<SpanBuffer>(logger, writer, sampler, nullptr, SpanBufferOptions{});
+
+  // 50 traces per second of "busy", each having a child span that finishes
+  // last.  The sampling decision is made for the root span, as it would be
+  // when the root span's context is injected.
+  uint64_t trace_id = 1;
+  for (int i = 0; i < 50; ++i, ++trace_id) {
+    auto root = std::make_unique<TestSpanData>("type", "service", "resource", "busy", trace_id,
+                                               1, 0, 123, 456, 0);
+    auto child = std::make_unique<TestSpanData>("type", "service", "resource", "child",
+                                                trace_id, 2, 1, 124, 455, 0);
+    buffer->registerSpan(SpanContext{1, trace_id, "", {}});
+    buffer->registerSpan(SpanContext{2, trace_id, "", {}});
+    buffer->generateSamplingPriority(root.get());
+    buffer->finishSpan(std::move(root));
+    buffer->finishSpan(std::move(child));
+  }
+  // 100 traces per second that match a sampling rule.
+  for (int i = 0; i < 100; ++i, ++trace_id) {
+    buffer->registerSpan(SpanContext{1, trace_id, "", {}});
+    buffer->finishSpan(std::make_unique<TestSpanData>("type", "service", "resource", "ruled",
+                                                      trace_id, 1, 0, 123, 456, 0));
+  }
+  REQUIRE(writer->traces.size() == 150);
+  advanceTime(time, std::chrono::seconds(1));
+
+  // "busy" is the only key measured, and its 100 spans per second are within
+  // the budget.
+  REQUIRE(sampler->sample("", "service", "busy", 1).priority_rate == 1.0);
+}
+
+TEST_CASE("span buffer applies early sampling decisions once") {
+  auto logger = std::make_shared<MockLogger>();
+  auto sampler = std::make_shared<MockRulesSampler>();
+  sampler->sampling_priority = std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep);
+  sampler->sampling_mechanism = SamplingMechanism::AgentRate;
+  auto writer = std::make_shared<MockWriter>(sampler);
+  auto buffer =
+      std::make_shared<SpanBuffer>(logger, writer, sampler, nullptr, SpanBufferOptions{});
+  const uint64_t trace_id = 7;
+
+  auto finish = [&](uint64_t span_id) {
+    buffer->finishSpan(std::make_unique<TestSpanData>("type", "service", "resource", "name",
+                                                      trace_id, span_id, 0, 123, 456, 0));
+  };
+
+  SECTION("two local roots of the same trace") {
+    REQUIRE(buffer->dropTraceEarly("", "service", "name", trace_id, nullptr) == nullptr);
+    REQUIRE(buffer->dropTraceEarly("", "service", "name", trace_id, nullptr) == nullptr);
+    REQUIRE(sampler->sample_calls == 1);
+    buffer->registerSpan(SpanContext{1, trace_id, "", {}});
+    buffer->registerSpan(SpanContext{2, trace_id, "", {}});
+    finish(1);
+    finish(2);
+  }
+
+  SECTION("a root of a trace that is already tracked") {
+    buffer->registerSpan(SpanContext{1, trace_id, "", {}});
+    REQUIRE(buffer->dropTraceEarly("", "service", "name", trace_id, nullptr) == nullptr);
+    REQUIRE(sampler->sample_calls == 0);
+    buffer->registerSpan(SpanContext{2, trace_id, "", {}});
+    finish(1);
+    finish(2);
+    REQUIRE(sampler->sample_calls == 1);
+  }
+
+  REQUIRE(writer->traces.size() == 1);
+  REQUIRE(writer->traces[0].size() == 2);
+
+  // No decision is left over for the trace ID, so the sampler decides anew.
+  const int calls = sampler->sample_calls;
+  sampler->sampling_priority = std::make_unique<SamplingPriority>(SamplingPriority::SamplerDrop);
+  REQUIRE(buffer->dropTraceEarly("", "service", "name", trace_id, nullptr) != nullptr);
+  REQUIRE(sampler->sample_calls == calls + 1);
+}
+
+TEST_CASE("span buffer caches serialized trace tags") {
+  auto logger = std::make_shared<MockLogger>();
+  auto sampler = std::make_shared<MockRulesSampler>();
+  sampler->sampling_priority = std::make_unique<SamplingPriority>(SamplingPriority::SamplerKeep);
+  sampler->sampling_mechanism = SamplingMechanism::AgentRate;
+  auto writer = std::make_shared<MockWriter>(sampler);
+  SpanBufferOptions options;
+  options.service = "service";
+  options.tags_header_size = 512;
+  auto buffer = std::make_shared<SpanBuffer>(logger, writer, sampler, nullptr, options);
+
+  auto span = std::make_unique<TestSpanData>("type", "service", "resource", "name", 1, 1, 0, 123,
+                                             456, 0);
+  buffer->registerSpan(SpanContext{1, 1, "", {}});
+  buffer->generateSamplingPriority(span.get());
+
+  auto first = buffer->serializeTraceTags(1);
+  REQUIRE(first != nullptr);
+  REQUIRE(*first == "_dd.p.dm=-1");
+
+  SECTION("repeated serialization returns the cached tags") {
+    auto second = buffer->serializeTraceTags(1);
+    REQUIRE(second != nullptr);
+    REQUIRE(*second == *first);
+  }
+
+  SECTION("changing the sampling decision invalidates the cache") {
+    buffer->setSamplingPriorityFromUser(
+        1, std::make_unique<UserSamplingPriority>(UserSamplingPriority::UserKeep));
+    auto second = buffer->serializeTraceTags(1);
+    REQUIRE(second != nullptr);
+    REQUIRE(*second == "_dd.p.dm=-4");
+  }
+
+  SECTION("tags too large to propagate are reported once") {
+    SpanBufferOptions small_options = options;
+    small_options.tags_header_size = 4;
+    auto small_buffer =
+        std::make_shared<SpanBuffer>(logger, writer, sampler, nullptr, small_options);
+    small_buffer->registerSpan(SpanContext{2, 2, "", {}});
+    span->trace_id = 2;
+    small_buffer->generateSamplingPriority(span.get());
+    const auto logged_before = logger->records.size();
+    REQUIRE(small_buffer->serializeTraceTags(2) == nullptr);
+    REQUIRE(small_buffer->serializeTraceTags(2) == nullptr);
+    REQUIRE(logger->records.size() == logged_before + 1);
+  }
+
+  buffer->finishSpan(std::move(span));
+}
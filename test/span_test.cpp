@@ -36,7 +36,7 @@ TEST_CASE("span") {
   SECTION("receives id") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
     span.FinishWithOptions(finish_options);
@@ -50,7 +50,7 @@ TEST_CASE("span") {
   SECTION("registers with SpanBuffer") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
     REQUIRE(buffer->traces().size() == 1);
@@ -62,7 +62,7 @@ TEST_CASE("span") {
   SECTION("timed correctly") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
     advanceTime(time, std::chrono::seconds(10));
@@ -89,7 +89,7 @@ TEST_CASE("span") {
     for (auto& test_case : test_cases) {
       auto span_id = get_id();
       Span span{logger,     nullptr, buffer_ptr, get_time,
-                span_id,    span_id, 0,          SpanContext{logger, span_id, span_id, "", {}},
+                span_id,    span_id, 0,          SpanContext{span_id, span_id, "", {}},
                 get_time(), "",      "",         "",
                 "",         ""};
       span.SetTag(ot::ext::http_url, test_case.first);
@@ -131,7 +131,7 @@ TEST_CASE("span") {
     for (auto& test_case : test_cases) {
       auto span_id = get_id();
       Span span{logger,     nullptr, buffer_ptr, get_time,
-                span_id,    span_id, 0,          SpanContext{logger, span_id, span_id, "", {}},
+                span_id,    span_id, 0,          SpanContext{span_id, span_id, "", {}},
                 get_time(), "",      "",         "",
                 "",         "",      true};
       span.SetTag(ot::ext::http_url, test_case.first);
@@ -146,7 +146,7 @@ TEST_CASE("span") {
   SECTION("finishes once") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
     std::vector<std::thread> threads;
@@ -162,7 +162,7 @@ TEST_CASE("span") {
   SECTION("handles tags") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
 
@@ -203,7 +203,7 @@ TEST_CASE("span") {
   SECTION("replaces colons with dots in tag key") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
 
@@ -226,7 +226,7 @@ TEST_CASE("span") {
               span_id,
               span_id,
               0,
-              SpanContext{logger, span_id, span_id, "", {}},
+              SpanContext{span_id, span_id, "", {}},
               get_time(),
               "original service",
               "original type",
@@ -256,7 +256,7 @@ TEST_CASE("span") {
   SECTION("values for analytics_event tag") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
 
@@ -296,7 +296,7 @@ TEST_CASE("span") {
   SECTION("error tag sets error") {
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
 
@@ -345,7 +345,7 @@ TEST_CASE("span") {
 
     auto span_id = get_id();
     Span span{logger,     nullptr, buffer, get_time,
-              span_id,    span_id, 0,      SpanContext{logger, span_id, span_id, "", {}},
+              span_id,    span_id, 0,      SpanContext{span_id, span_id, "", {}},
               get_time(), "",      "",     "",
               "",         ""};
 
@@ -460,7 +460,7 @@ TEST_CASE("span") {
               span_id,
               span_id,
               0,
-              SpanContext{logger, span_id, span_id, "", {}},
+              SpanContext{span_id, span_id, "", {}},
               get_time(),
               "original service",
               "original type",
@@ -488,7 +488,7 @@ TEST_CASE("span") {
               span_id,
               span_id,
               0,
-              SpanContext{logger, span_id, span_id, "", {}},
+              SpanContext{span_id, span_id, "", {}},
               get_time(),
               "original service",
               "original type",
@@ -517,7 +517,7 @@ TEST_CASE("span") {
               span_id,
               span_id,
               0,
-              SpanContext{logger, span_id, span_id, "", {}},
+              SpanContext{span_id, span_id, "", {}},
               get_time(),
               "original service",
               "original type",
@@ -555,7 +555,7 @@ TEST_CASE("span") {
               span_id,
               span_id,
               0,
-              SpanContext{logger, span_id, span_id, "", {}},
+              SpanContext{span_id, span_id, "", {}},
               get_time(),
               "original service",
               "original type",
@@ -575,7 +575,7 @@ TEST_CASE("span") {
   SECTION("priority sampling") {
     SECTION("root spans may be sampled") {
       Span span{logger,     nullptr, buffer, get_time,
-                100,        100,     0,      SpanContext{logger, 100, 100, "", {}},
+                100,        100,     0,      SpanContext{100, 100, "", {}},
                 get_time(), "",      "",     "",
                 "",         ""};
       span.FinishWithOptions(finish_options);
@@ -589,7 +589,7 @@ TEST_CASE("span") {
       Span span{logger,     nullptr,
                 buffer,     get_time,
                 100,        42,
-                42,         SpanContext{logger, 100, 42, "", {}},  // Non-distributed SpanContext
+                42,         SpanContext{100, 42, "", {}},  // Non-distributed SpanContext
                 get_time(), "",
                 "",         "",
                 "",         ""};
@@ -656,7 +656,7 @@ TEST_CASE("span") {
 
     SECTION("spans are tagged with rules sampler rates") {
       Span span{logger,     nullptr, buffer, get_time,
-                100,        100,     0,      SpanContext{logger, 100, 100, "", {}},
+                100,        100,     0,      SpanContext{100, 100, "", {}},
                 get_time(), "",      "",     "",
                 "",         ""};
       span.FinishWithOptions(finish_options);
@@ -0,0 +1,184 @@
+// This test covers `Spool`, declared in `spool.h`.
+
+#include "../src/spool.h"
+
+#include <dirent.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <catch2/catch.hpp>
+#include <string>
+#include <vector>
+
+#include "mocks.h"
+using namespace datadog::opentracing;
+
+namespace {
+
+// `TemporaryDirectory` creates a directory, and deletes it and its contents
+// on destruction.
+class TemporaryDirectory {
+ public:
+  TemporaryDirectory() {
+    char path[] = "/tmp/dd-spool-test-XXXXXX";
+    REQUIRE(mkdtemp(path) != nullptr);
+    path_ = path;
+  }
+  ~TemporaryDirectory() { REQUIRE(std::system(("rm -rf " + path_).c_str()) == 0); }
+
+  const std::string& path() const { return path_; }
+
+ private:
+  std::string path_;
+};
+
+// Return the paths of the segment files in the specified `directory`.
+std::vector<std::string> segments(const std::string& directory) {
+  std::vector<std::string> result;
+  DIR* listing = opendir(directory.c_str());
+  REQUIRE(listing != nullptr);
+  while (const dirent* entry = readdir(listing)) {
+    const std::string name = entry->d_name;
+    if (name.find(".segment") != std::string::npos) {
+      result.push_back(directory + "/" + name);
+    }
+  }
+  closedir(listing);
+  return result;
+}
+
+std::size_t totalSize(const std::vector<std::string>& paths) {
+  std::size_t total = 0;
+  for (const auto& path : paths) {
+    struct stat status;
+    REQUIRE(stat(path.c_str(), &status) == 0);
+    total += std::size_t(status.st_size);
+  }
+  return total;
+}
+
+// Pop every payload in the specified `spool`, and return them.
+std::vector<std::string> drain(Spool& spool) {
+  std::vector<std::string> payloads;
+  std::map<std::string, std::string> headers;
+  std::string payload;
+  Spool::Position position;
+  while (spool.front(headers, payload, position)) {
+    payloads.push_back(payload);
+    spool.pop(position);
+  }
+  return payloads;
+}
+
+}  // namespace
+
+TEST_CASE("spool") {
+  TemporaryDirectory directory;
+  auto logger = std::make_shared<MockLogger>();
+  const std::size_t megabyte = 1024 * 1024;
+
+  SECTION("returns payloads in order") {
+    Spool spool{directory.path(), megabyte, logger};
+    REQUIRE(spool.push({{"X-Datadog-Trace-Count", "1"}, {"Content-Encoding", ""}}, "first"));
+    REQUIRE(spool.push({{"X-Datadog-Trace-Count", "2"}}, std::string("sec\0nd", 6)));
+
+    std::map<std::string, std::string> headers;
+    std::string payload;
+    Spool::Position position;
+    REQUIRE(spool.front(headers, payload, position));
+    REQUIRE(payload == "first");
+    REQUIRE(headers == std::map<std::string, std::string>{{"X-Datadog-Trace-Count", "1"},
+                                                          {"Content-Encoding", ""}});
+    // Until it is popped, the same payload is returned.
+    REQUIRE(spool.front(headers, payload, position));
+    REQUIRE(payload == "first");
+    spool.pop(position);
+    // Payloads can be appended while others are read.
+    REQUIRE(spool.push({}, "third"));
+
+    REQUIRE(spool.front(headers, payload, position));
+    REQUIRE(payload == std::string("sec\0nd", 6));
+    REQUIRE(headers == std::map<std::string, std::string>{{"X-Datadog-Trace-Count", "2"}});
+    spool.pop(position);
+    REQUIRE(drain(spool) == std::vector<std::string>{"third"});
+    // Segments are deleted once they have been sent.
+    REQUIRE(segments(spool.path()).empty());
+  }
+
+  SECTION("payloads that are not popped are recovered by a later spool") {
+    std::string path;
+    {
+      Spool spool{directory.path(), megabyte, logger};
+      path = spool.path();
+      REQUIRE(spool.push({}, "sent"));
+      REQUIRE(spool.push({}, "not sent"));
+      std::map<std::string, std::string> headers;
+      std::string payload;
+      Spool::Position position;
+      REQUIRE(spool.front(headers, payload, position));
+      spool.pop(position);
+      REQUIRE(spool.push({}, "appended"));
+    }
+    Spool spool{directory.path(), megabyte, logger};
+    REQUIRE(spool.path() == path);
+    REQUIRE(drain(spool) == std::vector<std::string>{"not sent", "appended"});
+    // New payloads follow the recovered ones.
+    REQUIRE(spool.push({}, "new"));
+    REQUIRE(drain(spool) == std::vector<std::string>{"new"});
+  }
+
+  SECTION("deletes the oldest payloads to stay within its size limit") {
+    const std::size_t max_bytes = 512 * 1024;
+    Spool spool{directory.path(), max_bytes, logger};
+    for (char c = 'a'; c <= 'z'; ++c) {
+      REQUIRE(spool.push({}, std::string(50 * 1024, c)));
+      REQUIRE(totalSize(segments(spool.path())) <= max_bytes);
+    }
+    const auto payloads = drain(spool);
+    REQUIRE(!payloads.empty());
+    REQUIRE(payloads.size() < 26);
+    REQUIRE(payloads.back() == std::string(50 * 1024, 'z'));
+    for (std::size_t i = 1; i < payloads.size(); ++i) {
+      REQUIRE(payloads[i - 1][0] + 1 == payloads[i][0]);
+    }
+  }
+
+  SECTION("rejects a payload larger than its size limit") {
+    Spool spool{directory.path(), 1024, logger};
+    REQUIRE(!spool.push({}, std::string(2048, 'x')));
+    REQUIRE(drain(spool).empty());
+  }
+
+  SECTION("ignores a payload that was not completely written") {
+    std::string path;
+    {
+      Spool spool{directory.path(), megabyte, logger};
+      path = spool.path();
+      REQUIRE(spool.push({}, "complete"));
+      REQUIRE(spool.push({}, "incomplete"));
+    }
+    const auto files = segments(path);
+    REQUIRE(files.size() == 1);
+    REQUIRE(truncate(files[0].c_str(), totalSize(files) - 1) == 0);
+
+    Spool spool{directory.path(), megabyte, logger};
+    REQUIRE(drain(spool) == std::vector<std::string>{"complete"});
+  }
+
+  SECTION("each spool in a process uses its own subdirectory") {
+    Spool first{directory.path(), megabyte, logger};
+    std::string second_path;
+    {
+      Spool second{directory.path(), megabyte, logger};
+      second_path = second.path();
+      REQUIRE(second_path != first.path());
+      REQUIRE(second.push({}, "left behind"));
+    }
+    REQUIRE(first.push({}, "first"));
+    Spool third{directory.path(), megabyte, logger};
+    REQUIRE(third.path() == second_path);
+    REQUIRE(drain(third) == std::vector<std::string>{"left behind"});
+    REQUIRE(drain(first) == std::vector<std::string>{"first"});
+  }
+}
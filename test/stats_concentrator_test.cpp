@@ -0,0 +1,209 @@
+#include "../src/stats_concentrator.h"
+
+#include <catch2/catch.hpp>
+#include <ctime>
+
+#include "../src/ddsketch.h"
+#include "../src/span.h"
+#include "mocks.h"
+using namespace datadog::opentracing;
+
+namespace {
+
+using Message = std::map<std::string, msgpack::object>;
+
+// Decode the specified msgpack-encoded stats `payload` into the specified
+// `handle`, and return the top-level map.
+Message decode(const std::string& payload, msgpack::object_handle& handle) {
+  handle = msgpack::unpack(payload.data(), payload.size());
+  return handle.get().as<Message>();
+}
+
+}  // namespace
+
+TEST_CASE("ddsketch") {
+  DDSketch sketch;
+
+  SECTION("is empty initially") {
+    REQUIRE(sketch.count() == 0);
+    REQUIRE(sketch.quantile(0.5) == 0);
+  }
+
+  SECTION("quantiles are within the relative accuracy") {
+    for (int i = 1; i <= 1000; ++i) {
+      sketch.add(i);
+    }
+    REQUIRE(sketch.count() == 1000);
+    for (double q : {0.0, 0.25, 0.5, 0.75, 0.99, 1.0}) {
+      const double expected = 1 + q * 999;
+      REQUIRE(sketch.quantile(q) == Approx(expected).epsilon(0.011));
+    }
+  }
+
+  SECTION("values that cannot be indexed count as zero") {
+    sketch.add(0);
+    sketch.add(-5);
+    sketch.add(100);
+    REQUIRE(sketch.count() == 3);
+    REQUIRE(sketch.quantile(0.5) == 0);
+    REQUIRE(sketch.quantile(1) == Approx(100).epsilon(0.01));
+  }
+
+  SECTION("encodes as protobuf") {
+    std::string empty;
+    sketch.encode(empty);
+    // mapping (field 1, 9 bytes: gamma as field 1, fixed64), then an empty
+    // positive value store (field 2).
+    REQUIRE(empty.size() == 13);
+    REQUIRE(empty.substr(0, 3) == std::string("\x0a\x09\x09", 3));
+    REQUIRE(empty.substr(11) == std::string("\x12\x00", 2));
+
+    sketch.add(1);
+    sketch.add(0);
+    std::string encoded;
+    sketch.encode(encoded);
+    // The value 1 has index 0.  The store holds one bin count (field 2, 8
+    // bytes) and the index offset 0 (field 3), and the zero count follows
+    // (field 4, fixed64).
+    REQUIRE(encoded.substr(11, 4) == std::string("\x12\x0c\x12\x08", 4));
+    REQUIRE(encoded.substr(15, 8) == std::string("\0\0\0\0\0\0\xf0\x3f", 8));
+    REQUIRE(encoded.substr(23, 2) == std::string("\x18\x00", 2));
+    REQUIRE(encoded[25] == '\x21');
+    REQUIRE(encoded.size() == 34);
+  }
+}
+
+TEST_CASE("stats concentrator") {
+  // Starting calendar time 2007-03-12 00:00:00
+  std::tm start{};
+  start.tm_mday = 12;
+  start.tm_mon = 2;
+  start.tm_year = 107;
+  TimePoint time{std::chrono::system_clock::from_time_t(timegm(&start)),
+                 std::chrono::steady_clock::time_point{}};
+  TimeProvider get_time = [&time]() { return time; };  // Mock clock.
+  const int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                          time.absolute_time.time_since_epoch())
+                          .count();
+  const int64_t bucket = std::chrono::nanoseconds(std::chrono::seconds(10)).count();
+
+  StatsConcentrator stats{get_time, "hostname", "env", "1.2.3"};
+
+  auto make_trace = [](std::initializer_list<TestSpanData> spans) {
+    std::vector<std::unique_ptr<SpanData>> trace;
+    for (const TestSpanData& span : spans) {
+      trace.emplace_back(new TestSpanData{span});
+    }
+    return trace;
+  };
+
+  SECTION("nothing to flush") { REQUIRE(stats.flush(true).empty()); }
+
+  SECTION("aggregates top-level and measured spans") {
+    TestSpanData root{"web", "service", "GET /", "http.request", 1, 1, 0, now - 1000, 500, 0};
+    root.meta["http.status_code"] = "200";
+    TestSpanData internal{"", "service", "internal", "internal", 1, 2, 1, now - 900, 100, 0};
+    TestSpanData measured{"", "service", "measured", "measured", 1, 3, 1, now - 900, 100, 1};
+    measured.metrics["_dd.measured"] = 1;
+    TestSpanData db{"sql", "db", "SELECT", "db.query", 1, 4, 2, now - 800, 50, 0};
+    stats.add(make_trace({root, internal, measured, db}));
+
+    TestSpanData another{"web", "service", "GET /", "http.request", 2, 5, 0, now - 500, 300, 1};
+    another.meta["http.status_code"] = "200";
+    stats.add(make_trace({another}));
+
+    msgpack::object_handle handle;
+    auto payload = decode(stats.flush(true), handle);
+    REQUIRE(payload["Hostname"].as<std::string>() == "hostname");
+    REQUIRE(payload["Env"].as<std::string>() == "env");
+    REQUIRE(payload["Version"].as<std::string>() == "1.2.3");
+    REQUIRE(payload["Lang"].as<std::string>() == "cpp");
+    REQUIRE(payload["Sequence"].as<uint64_t>() == 1);
+
+    auto buckets = payload["Stats"].as<std::vector<msgpack::object>>();
+    REQUIRE(buckets.size() == 1);
+    auto bucket_message = buckets[0].as<Message>();
+    REQUIRE(bucket_message["Start"].as<int64_t>() == now - bucket);
+    REQUIRE(bucket_message["Duration"].as<int64_t>() == bucket);
+
+    std::map<std::string, Message> groups;
+    for (const auto& group : bucket_message["Stats"].as<std::vector<msgpack::object>>()) {
+      auto message = group.as<Message>();
+      groups[message["Resource"].as<std::string>()] = message;
+    }
+    // The "internal" span is neither top-level nor measured.
+    REQUIRE(groups.size() == 3);
+
+    auto& web = groups["GET /"];
+    REQUIRE(web["Service"].as<std::string>() == "service");
+    REQUIRE(web["Name"].as<std::string>() == "http.request");
+    REQUIRE(web["Type"].as<std::string>() == "web");
+    REQUIRE(web["HTTPStatusCode"].as<uint32_t>() == 200);
+    REQUIRE(web["Hits"].as<uint64_t>() == 2);
+    REQUIRE(web["TopLevelHits"].as<uint64_t>() == 2);
+    REQUIRE(web["Errors"].as<uint64_t>() == 1);
+    REQUIRE(web["Duration"].as<uint64_t>() == 800);
+    REQUIRE(web["Synthetics"].as<bool>() == false);
+    REQUIRE(!web["OkSummary"].as<std::string>().empty());
+    REQUIRE(!web["ErrorSummary"].as<std::string>().empty());
+
+    auto& measured_group = groups["measured"];
+    REQUIRE(measured_group["Hits"].as<uint64_t>() == 1);
+    REQUIRE(measured_group["TopLevelHits"].as<uint64_t>() == 0);
+    REQUIRE(measured_group["Errors"].as<uint64_t>() == 1);
+
+    // A span whose parent has a different service is top-level.
+    auto& db_group = groups["SELECT"];
+    REQUIRE(db_group["Service"].as<std::string>() == "db");
+    REQUIRE(db_group["TopLevelHits"].as<uint64_t>() == 1);
+
+    REQUIRE(stats.flush(true).empty());
+  }
+
+  SECTION("groups by HTTP status code and synthetics origin") {
+    TestSpanData ok{"web", "service", "GET /", "http.request", 1, 1, 0, now - 1000, 500, 0};
+    ok.meta["http.status_code"] = "200";
+    TestSpanData not_found = ok;
+    not_found.meta["http.status_code"] = "404";
+    TestSpanData synthetics = ok;
+    synthetics.meta["_dd.origin"] = "synthetics-browser";
+    TestSpanData invalid = ok;
+    invalid.meta["http.status_code"] = "OK";
+    for (const auto& span : {ok, not_found, synthetics, invalid}) {
+      stats.add(make_trace({span}));
+    }
+
+    msgpack::object_handle handle;
+    auto payload = decode(stats.flush(true), handle);
+    auto buckets = payload["Stats"].as<std::vector<msgpack::object>>();
+    REQUIRE(buckets.size() == 1);
+    auto groups = buckets[0].as<Message>()["Stats"].as<std::vector<msgpack::object>>();
+    std::set<std::pair<uint32_t, bool>> keys;
+    for (const auto& group : groups) {
+      auto message = group.as<Message>();
+      keys.emplace(message["HTTPStatusCode"].as<uint32_t>(), message["Synthetics"].as<bool>());
+    }
+    REQUIRE(keys == std::set<std::pair<uint32_t, bool>>{
+                        {0, false}, {200, false}, {200, true}, {404, false}});
+  }
+
+  SECTION("flushes only completed buckets unless forced") {
+    // Spans are bucketed by the time they finish.
+    stats.add(make_trace({TestSpanData{"", "s", "r", "old", 1, 1, 0, now - bucket - 100, 50, 0}}));
+    stats.add(make_trace({TestSpanData{"", "s", "r", "new", 2, 2, 0, now - 100, 200, 0}}));
+
+    msgpack::object_handle handle;
+    auto payload = decode(stats.flush(false), handle);
+    auto buckets = payload["Stats"].as<std::vector<msgpack::object>>();
+    REQUIRE(buckets.size() == 1);
+    REQUIRE(buckets[0].as<Message>()["Start"].as<int64_t>() == now - 2 * bucket);
+    REQUIRE(stats.flush(false).empty());
+
+    time.absolute_time += std::chrono::seconds(10);
+    payload = decode(stats.flush(false), handle);
+    buckets = payload["Stats"].as<std::vector<msgpack::object>>();
+    REQUIRE(buckets.size() == 1);
+    REQUIRE(buckets[0].as<Message>()["Start"].as<int64_t>() == now);
+    REQUIRE(payload["Sequence"].as<uint64_t>() == 2);
+  }
+}
@@ -89,14 +89,18 @@ TEST_CASE("tracer factory") {
              {"[\"B3\"]", {PropagationStyle::B3}},
              {"[\"Datadog\", \"B3\"]", {PropagationStyle::Datadog, PropagationStyle::B3}},
              {"[\"Datadog\", \"B3\", \"Datadog\", \"B3\"]",
-              {PropagationStyle::Datadog, PropagationStyle::B3}}}));
+              {PropagationStyle::Datadog, PropagationStyle::B3}},
+             {"[\"W3C\", \"tracecontext\"]", {PropagationStyle::W3C}},
+             {"[\"B3Single\"]", {PropagationStyle::B3Single}}}));
     auto propagation_style_extract =
         GENERATE(values<std::pair<std::string, std::set<PropagationStyle>>>(
             {{"[\"Datadog\"]", {PropagationStyle::Datadog}},
              {"[\"B3\"]", {PropagationStyle::B3}},
              {"[\"Datadog\", \"B3\"]", {PropagationStyle::Datadog, PropagationStyle::B3}},
              {"[\"Datadog\", \"B3\", \"Datadog\", \"B3\"]",
-              {PropagationStyle::Datadog, PropagationStyle::B3}}}));
+              {PropagationStyle::Datadog, PropagationStyle::B3}},
+             {"[\"W3C\", \"tracecontext\"]", {PropagationStyle::W3C}},
+             {"[\"B3Single\"]", {PropagationStyle::B3Single}}}));
     auto report_hostname = GENERATE(false, true);
     auto analytics_enabled = GENERATE(false, true);
     auto analytics_rate = GENERATE(0.0, 0.5, 1.0);
@@ -226,10 +230,10 @@ TEST_CASE("tracer factory") {
     std::string incorrect_type = "configuration has an argument with an incorrect type";
     std::string invalid_value_extract =
         "Invalid value for propagation_style_extract, must be a list of at least one element with "
-        "value 'Datadog', or 'B3'";
+        "value 'Datadog', 'B3', 'B3Single', or 'W3C'";
     std::string invalid_value_inject =
         "Invalid value for propagation_style_inject, must be a list of at least one element with "
-        "value 'Datadog', or 'B3'";
+        "value 'Datadog', 'B3', 'B3Single', or 'W3C'";
 
     auto bad_value = GENERATE_COPY(values<BadValueTest>(
         {{"\"i dunno\"", incorrect_type, incorrect_type},
@@ -65,6 +65,29 @@ void requireTracerOptionsResultsMatch(const ot::expected<TracerOptions, std::str
   }
   REQUIRE(lhs->tags == rhs->tags);
   REQUIRE(lhs->sampling_limit_per_second == rhs->sampling_limit_per_second);
+  if (std::isnan(lhs->adaptive_sampling_spans_per_second)) {
+    REQUIRE(std::isnan(rhs->adaptive_sampling_spans_per_second));
+  } else {
+    REQUIRE(lhs->adaptive_sampling_spans_per_second == rhs->adaptive_sampling_spans_per_second);
+  }
+  REQUIRE(lhs->early_trace_drop == rhs->early_trace_drop);
+  REQUIRE(lhs->stats_computation_enabled == rhs->stats_computation_enabled);
+  REQUIRE(lhs->binary_stream_propagation == rhs->binary_stream_propagation);
+  REQUIRE(lhs->agent_tcp_nodelay == rhs->agent_tcp_nodelay);
+  REQUIRE(lhs->agent_tcp_keepalive_seconds == rhs->agent_tcp_keepalive_seconds);
+  REQUIRE(lhs->agent_max_concurrent_requests == rhs->agent_max_concurrent_requests);
+  REQUIRE(lhs->agent_compression_level == rhs->agent_compression_level);
+  REQUIRE(lhs->agent_compression_min_bytes == rhs->agent_compression_min_bytes);
+  REQUIRE(lhs->agent_spool_directory == rhs->agent_spool_directory);
+  REQUIRE(lhs->agent_spool_max_megabytes == rhs->agent_spool_max_megabytes);
+  REQUIRE(lhs->agent_circuit_breaker_failures == rhs->agent_circuit_breaker_failures);
+  REQUIRE(lhs->agent_timeout_ms == rhs->agent_timeout_ms);
+  REQUIRE(lhs->agent_min_timeout_ms == rhs->agent_min_timeout_ms);
+  REQUIRE(lhs->close_timeout_ms == rhs->close_timeout_ms);
+  REQUIRE(lhs->agent_flush_threshold_spans == rhs->agent_flush_threshold_spans);
+  REQUIRE(lhs->agent_flush_threshold_bytes == rhs->agent_flush_threshold_bytes);
+  REQUIRE(lhs->agent_encoder_threads == rhs->agent_encoder_threads);
+  REQUIRE(lhs->agent_write_batch_size == rhs->agent_write_batch_size);
 }
 
 TEST_CASE("tracer options from environment variables") {
@@ -128,6 +151,117 @@ TEST_CASE("tracer options from environment variables") {
        ot::make_unexpected("Value for DD_TRACE_AGENT_PORT is out of range"s)},
       {{{"DD_TRACE_REPORT_HOSTNAME", "yes please"}},
        ot::make_unexpected("Value for DD_TRACE_REPORT_HOSTNAME is invalid"s)},
+      {{{"DD_TRACE_EARLY_DROP", "yes please"}},
+       ot::make_unexpected("Value for DD_TRACE_EARLY_DROP is invalid"s)},
+      {{{"DD_TRACE_STATS_COMPUTATION_ENABLED", "yes please"}},
+       ot::make_unexpected("Value for DD_TRACE_STATS_COMPUTATION_ENABLED is invalid"s)},
+      {{{"DD_TRACE_BINARY_STREAM_PROPAGATION", "yes please"}},
+       ot::make_unexpected("Value for DD_TRACE_BINARY_STREAM_PROPAGATION is invalid"s)},
+      {{{"DD_TRACE_AGENT_TCP_NODELAY", "false"}, {"DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS", "30"}},
+       []() {
+         TracerOptions options;
+         options.agent_tcp_nodelay = false;
+         options.agent_tcp_keepalive_seconds = 30;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_TCP_NODELAY", "yes please"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_TCP_NODELAY is invalid"s)},
+      {{{"DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS", "a minute"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS is invalid"s)},
+      {{{"DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS", "-1"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS is invalid"s)},
+      {{{"DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS", "9223372036854775807"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_TCP_KEEPALIVE_SECONDS is out of range"s)},
+      {{{"DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS", "4"}},
+       []() {
+         TracerOptions options;
+         options.agent_max_concurrent_requests = 4;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS", "0"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS is invalid"s)},
+      {{{"DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS", "many"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_MAX_CONCURRENT_REQUESTS is invalid"s)},
+      {{{"DD_TRACE_AGENT_COMPRESSION_LEVEL", "6"}, {"DD_TRACE_AGENT_COMPRESSION_MIN_BYTES", "0"}},
+       []() {
+         TracerOptions options;
+         options.agent_compression_level = 6;
+         options.agent_compression_min_bytes = 0;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_COMPRESSION_LEVEL", "gzip"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_LEVEL is invalid"s)},
+      {{{"DD_TRACE_AGENT_COMPRESSION_LEVEL", "10"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_LEVEL is out of range"s)},
+      {{{"DD_TRACE_AGENT_COMPRESSION_MIN_BYTES", "-1"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_COMPRESSION_MIN_BYTES is invalid"s)},
+      {{{"DD_TRACE_AGENT_SPOOL_DIRECTORY", "/var/spool/dd-trace"},
+        {"DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES", "20"}},
+       []() {
+         TracerOptions options;
+         options.agent_spool_directory = "/var/spool/dd-trace";
+         options.agent_spool_max_megabytes = 20;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES", "0"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_SPOOL_MAX_MEGABYTES is invalid"s)},
+      {{{"DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES", "0"}, {"DD_TRACE_AGENT_TIMEOUT_MS", "500"}},
+       []() {
+         TracerOptions options;
+         options.agent_circuit_breaker_failures = 0;
+         options.agent_timeout_ms = 500;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES", "-1"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_CIRCUIT_BREAKER_FAILURES is invalid"s)},
+      {{{"DD_TRACE_AGENT_TIMEOUT_MS", "0"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_TIMEOUT_MS is invalid"s)},
+      {{{"DD_TRACE_AGENT_TIMEOUT_MS", "soon"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_TIMEOUT_MS is invalid"s)},
+      {{{"DD_TRACE_AGENT_MIN_TIMEOUT_MS", "500"}},
+       []() {
+         TracerOptions options;
+         options.agent_min_timeout_ms = 500;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_MIN_TIMEOUT_MS", "-1"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_MIN_TIMEOUT_MS is invalid"s)},
+      {{{"DD_TRACE_CLOSE_TIMEOUT_MS", "0"}},
+       []() {
+         TracerOptions options;
+         options.close_timeout_ms = 0;
+         return options;
+       }()},
+      {{{"DD_TRACE_CLOSE_TIMEOUT_MS", "-1"}},
+       ot::make_unexpected("Value for DD_TRACE_CLOSE_TIMEOUT_MS is invalid"s)},
+      {{{"DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS", "1000"},
+        {"DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES", "0"}},
+       []() {
+         TracerOptions options;
+         options.agent_flush_threshold_spans = 1000;
+         options.agent_flush_threshold_bytes = 0;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS", "-1"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_SPANS is invalid"s)},
+      {{{"DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES", "lots"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_FLUSH_THRESHOLD_BYTES is invalid"s)},
+      {{{"DD_TRACE_AGENT_ENCODER_THREADS", "4"}},
+       []() {
+         TracerOptions options;
+         options.agent_encoder_threads = 4;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_ENCODER_THREADS", "0"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_ENCODER_THREADS is invalid"s)},
+      {{{"DD_TRACE_AGENT_WRITE_BATCH_SIZE", "1"}},
+       []() {
+         TracerOptions options;
+         options.agent_write_batch_size = 1;
+         return options;
+       }()},
+      {{{"DD_TRACE_AGENT_WRITE_BATCH_SIZE", "0"}},
+       ot::make_unexpected("Value for DD_TRACE_AGENT_WRITE_BATCH_SIZE is invalid"s)},
       {{{"DD_TRACE_ANALYTICS_ENABLED", "yes please"}},
        ot::make_unexpected("Value for DD_TRACE_ANALYTICS_ENABLED is invalid"s)},
       {{{"DD_TRACE_ANALYTICS_SAMPLE_RATE", "1.1"}},
@@ -169,6 +303,9 @@ TEST_CASE("tracer options from environment variables") {
       {{{"DD_TRACE_RATE_LIMIT", "0.5 BOOM"}},
        ot::make_unexpected(
            "while parsing DD_TRACE_RATE_LIMIT: contains trailing non-floating-point characters: 0.5 BOOM"s)},
+      {{{"DD_TRACE_ADAPTIVE_SAMPLING_SPANS_PER_SECOND", "-1"}},
+       ot::make_unexpected(
+           "while parsing DD_TRACE_ADAPTIVE_SAMPLING_SPANS_PER_SECOND: not within the expected bounds [0, inf]: -1"s)},
   }));
 
   // Setup
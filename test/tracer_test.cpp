@@ -56,7 +56,7 @@ TEST_CASE("tracer") {
 
   SECTION("span context is propagated") {
     MockTextMapCarrier carrier;
-    SpanContext context{logger, 420, 69, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
+    SpanContext context{420, 69, "", {{"ayy", "lmao"}, {"hi", "haha"}}};
     auto success = tracer->Inject(context, carrier);
     REQUIRE(success);
     auto span_context_maybe = tracer->Extract(carrier);
@@ -289,3 +289,109 @@ TEST_CASE("startup log") {
   }
   ::unsetenv(env_var.c_str());
 }
+
+TEST_CASE("early trace drop") {
+  const auto sampler = std::make_shared<RulesSampler>();
+  const auto writer = std::make_shared<MockWriter>(sampler);
+  TracerOptions tracer_options;
+  tracer_options.service = "test.service";
+  tracer_options.early_trace_drop = true;
+  const ot::StartSpanOptions span_options;
+
+  SECTION("spans of a dropped trace are not recorded, but are propagated") {
+    tracer_options.sampling_rules = R"([{"sample_rate": 0.0}])";
+    auto tracer = std::make_shared<Tracer>(tracer_options, writer, sampler,
+                                           std::make_shared<MockLogger>());
+
+    auto root = tracer->StartSpanWithOptions("root", span_options);
+    REQUIRE(dynamic_cast<Span*>(root.get()) == nullptr);
+    auto child = tracer->StartSpan("child", {ot::ChildOf(&root->context())});
+    REQUIRE(dynamic_cast<Span*>(child.get()) == nullptr);
+    child->SetTag("foo", "bar");
+    child->SetBaggageItem("hello", "world");
+
+    MockTextMapCarrier carrier;
+    REQUIRE(tracer->Inject(child->context(), carrier));
+    child->Finish();
+    root->Finish();
+
+    REQUIRE(writer->traces.empty());
+    REQUIRE(carrier.text_map["x-datadog-trace-id"] == root->context().ToTraceID());
+    REQUIRE(carrier.text_map["x-datadog-parent-id"] == child->context().ToSpanID());
+    REQUIRE(carrier.text_map["x-datadog-sampling-priority"] == "-1");
+    REQUIRE(carrier.text_map["x-datadog-tags"] == "_dd.p.dm=-3");
+    REQUIRE(carrier.text_map["ot-baggage-hello"] == "world");
+  }
+
+  SECTION("kept traces are recorded using the decision made at root span start") {
+    tracer_options.sampling_rules = R"([{"sample_rate": 1.0}])";
+    auto tracer = std::make_shared<Tracer>(tracer_options, writer, sampler,
+                                           std::make_shared<MockLogger>());
+
+    auto root = tracer->StartSpanWithOptions("root", span_options);
+    REQUIRE(dynamic_cast<Span*>(root.get()) != nullptr);
+    auto child = tracer->StartSpan("child", {ot::ChildOf(&root->context())});
+    child->Finish();
+    root->Finish();
+
+    REQUIRE(writer->traces.size() == 1);
+    REQUIRE(writer->traces[0].size() == 2);
+    const auto& metrics = writer->traces[0][1]->metrics;
+    REQUIRE(metrics.at("_sampling_priority_v1") ==
+            static_cast<double>(SamplingPriority::UserKeep));
+    REQUIRE(metrics.at("_dd.rule_psr") == 1.0);
+  }
+
+  SECTION("an extracted decision to drop is honored") {
+    tracer_options.sampling_rules = R"([{"sample_rate": 1.0}])";
+    auto tracer = std::make_shared<Tracer>(tracer_options, writer, sampler,
+                                           std::make_shared<MockLogger>());
+
+    MockTextMapCarrier carrier;
+    carrier.text_map["x-datadog-trace-id"] = "123";
+    carrier.text_map["x-datadog-parent-id"] = "456";
+    carrier.text_map["x-datadog-sampling-priority"] = "0";
+    auto context = tracer->Extract(carrier);
+    REQUIRE(context);
+
+    auto span = tracer->StartSpan("span", {ot::ChildOf(context->get())});
+    REQUIRE(dynamic_cast<Span*>(span.get()) == nullptr);
+    MockTextMapCarrier injected;
+    REQUIRE(tracer->Inject(span->context(), injected));
+    span->Finish();
+
+    REQUIRE(writer->traces.empty());
+    REQUIRE(injected.text_map["x-datadog-trace-id"] == "123");
+    REQUIRE(injected.text_map["x-datadog-sampling-priority"] == "0");
+    REQUIRE(injected.text_map["x-datadog-tags"] == "");
+  }
+
+  SECTION("traces are not dropped early when span sampling rules are configured") {
+    tracer_options.sampling_rules = R"([{"sample_rate": 0.0}])";
+    tracer_options.span_sampling_rules = R"([{"service": "other.service"}])";
+    auto tracer = std::make_shared<Tracer>(tracer_options, writer, sampler,
+                                           std::make_shared<MockLogger>());
+
+    auto span = tracer->StartSpanWithOptions("root", span_options);
+    REQUIRE(dynamic_cast<Span*>(span.get()) != nullptr);
+    span->Finish();
+
+    REQUIRE(writer->traces.size() == 1);
+    REQUIRE(writer->traces[0][0]->metrics.at("_sampling_priority_v1") ==
+            static_cast<double>(SamplingPriority::UserDrop));
+  }
+
+  SECTION("traces are not dropped early when the root span has sampling tags") {
+    tracer_options.sampling_rules = R"([{"sample_rate": 0.0}])";
+    auto tracer = std::make_shared<Tracer>(tracer_options, writer, sampler,
+                                           std::make_shared<MockLogger>());
+
+    auto span = tracer->StartSpan("root", {ot::SetTag{datadog::tags::manual_keep, {}}});
+    REQUIRE(dynamic_cast<Span*>(span.get()) != nullptr);
+    span->Finish();
+
+    REQUIRE(writer->traces.size() == 1);
+    REQUIRE(writer->traces[0][0]->metrics.at("_sampling_priority_v1") ==
+            static_cast<double>(SamplingPriority::UserKeep));
+  }
+}
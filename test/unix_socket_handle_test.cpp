@@ -0,0 +1,310 @@
+// This test covers `UnixSocketHandle`, declared in `unix_socket_handle.h`,
+// by sending requests to a stand-in agent listening on a unix domain socket.
+
+#include "../src/unix_socket_handle.h"
+
+#include <poll.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include <atomic>
+#include <catch2/catch.hpp>
+#include <cstring>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+#include "mocks.h"
+using namespace datadog::opentracing;
+
+namespace {
+
+// `StandInAgent` listens on a unix domain socket in a temporary directory.
+// It handles one connection at a time, and answers each request with the
+// response returned by a function of the request.  If that response is empty,
+// or if `close_after_response` is true, then the connection is closed after
+// the response.
+class StandInAgent {
+ public:
+  explicit StandInAgent(std::function<std::string(const std::string&)> respond,
+                        bool close_after_response = false, bool accept = true)
+      : respond_(respond), close_after_response_(close_after_response) {
+    char directory[] = "/tmp/dd-agent-test-XXXXXX";
+    REQUIRE(mkdtemp(directory) != nullptr);
+    directory_ = directory;
+    path_ = directory_ + "/apm.socket";
+
+    listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+    REQUIRE(listener_ != -1);
+    sockaddr_un address;
+    std::memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+    std::strcpy(address.sun_path, path_.c_str());
+    REQUIRE(bind(listener_, reinterpret_cast<sockaddr*>(&address), sizeof(address)) == 0);
+    REQUIRE(listen(listener_, 8) == 0);
+    if (accept) {
+      server_ = std::thread([this]() { serve(); });
+    }
+  }
+
+  ~StandInAgent() {
+    stop_ = true;
+    if (server_.joinable()) {
+      server_.join();
+    }
+    close(listener_);
+    unlink(path_.c_str());
+    rmdir(directory_.c_str());
+  }
+
+  const std::string& path() const { return path_; }
+
+  std::vector<std::string> requests() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return requests_;
+  }
+
+  int connections() {
+    std::lock_guard<std::mutex> lock(mutex_);
+    return connections_;
+  }
+
+ private:
+  // Return whether `socket` became readable before the agent was stopped.
+  bool waitForInput(int socket) {
+    while (!stop_) {
+      pollfd descriptor{socket, POLLIN, 0};
+      if (poll(&descriptor, 1, 10) == 1) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  void serve() {
+    while (waitForInput(listener_)) {
+      const int connection = accept(listener_, nullptr, nullptr);
+      if (connection == -1) {
+        continue;
+      }
+      {
+        std::lock_guard<std::mutex> lock(mutex_);
+        ++connections_;
+      }
+      std::string buffer;
+      std::string request;
+      while (readRequest(connection, buffer, request)) {
+        {
+          std::lock_guard<std::mutex> lock(mutex_);
+          requests_.push_back(request);
+        }
+        const std::string response = respond_(request);
+        if (response.empty() ||
+            send(connection, response.data(), response.size(), 0) != ssize_t(response.size()) ||
+            close_after_response_) {
+          break;
+        }
+      }
+      close(connection);
+    }
+  }
+
+  // Read the next request on `connection` into `request`, using `buffer` to
+  // hold what is read past the request.  Return false if the connection is
+  // closed first.
+  bool readRequest(int connection, std::string& buffer, std::string& request) {
+    std::size_t size = std::string::npos;
+    for (;;) {
+      if (size == std::string::npos) {
+        const auto end = buffer.find("\r\n\r\n");
+        if (end != std::string::npos) {
+          const auto length = buffer.find("Content-Length: ");
+          if (length == std::string::npos) {
+            return false;
+          }
+          size = end + 4 + std::stoul(buffer.substr(length + 16));
+        }
+      }
+      if (size != std::string::npos && buffer.size() >= size) {
+        request = buffer.substr(0, size);
+        buffer.erase(0, size);
+        return true;
+      }
+      char chunk[1024];
+      if (!waitForInput(connection)) {
+        return false;
+      }
+      const ssize_t received = recv(connection, chunk, sizeof(chunk), 0);
+      if (received <= 0) {
+        return false;
+      }
+      buffer.append(chunk, received);
+    }
+  }
+
+  std::function<std::string(const std::string&)> respond_;
+  const bool close_after_response_;
+  std::string directory_;
+  std::string path_;
+  int listener_ = -1;
+  std::atomic<bool> stop_{false};
+  std::thread server_;
+  std::mutex mutex_;
+  std::vector<std::string> requests_;
+  int connections_ = 0;
+};
+
+std::string ok(const std::string&) { return "HTTP/1.1 200 OK\r\nContent-Length: 2\r\n\r\n{}"; }
+
+// Configure the specified `handle` to post the specified `body` to the agent
+// at the specified `path`, as `AgentWriter` does.
+void setUp(UnixSocketHandle& handle, const std::string& path, const std::string& body) {
+  REQUIRE(handle.setopt(CURLOPT_UNIX_SOCKET_PATH, path.c_str()) == CURLE_OK);
+  REQUIRE(handle.setopt(CURLOPT_URL, "http://localhost:8126/v0.4/traces") == CURLE_OK);
+  REQUIRE(handle.setopt(CURLOPT_TIMEOUT_MS, 2000L) == CURLE_OK);
+  REQUIRE(handle.setopt(CURLOPT_POSTFIELDSIZE, body.size()) == CURLE_OK);
+  REQUIRE(handle.setopt(CURLOPT_POSTFIELDS, body.data()) == CURLE_OK);
+}
+
+}  // namespace
+
+TEST_CASE("unix socket handle") {
+  UnixSocketHandle handle{std::make_shared<MockLogger>()};
+  const std::string body{"ab\0cd", 5};
+
+  SECTION("sends a request and reads the response") {
+    StandInAgent agent{[](const std::string&) {
+      return "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\ncontent-length: 13\r\n\r\n"
+             "{\"rate\": 1.0}";
+    }};
+    setUp(handle, agent.path(), body);
+    handle.setHeaders({{"Datadog-Meta-Lang", "cpp"}, {"X-Datadog-Trace-Count", "1"}});
+
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(handle.getResponseStatus() == 200);
+    REQUIRE(handle.getResponse() == "{\"rate\": 1.0}");
+    REQUIRE(agent.requests() == std::vector<std::string>{
+                                    "POST /v0.4/traces HTTP/1.1\r\n"
+                                    "Host: localhost:8126\r\n"
+                                    "Datadog-Meta-Lang: cpp\r\n"
+                                    "X-Datadog-Trace-Count: 1\r\n"
+                                    "Content-Length: 5\r\n"
+                                    "\r\n" +
+                                    body});
+  }
+
+  SECTION("does not send headers whose values are empty") {
+    StandInAgent agent{ok};
+    setUp(handle, agent.path(), body);
+    handle.setHeaders({{"Content-Encoding", "gzip"}, {"Datadog-Meta-Lang", "cpp"}});
+    REQUIRE(handle.perform() == CURLE_OK);
+    handle.setHeaders({{"Content-Encoding", ""}});
+    REQUIRE(handle.perform() == CURLE_OK);
+    const auto requests = agent.requests();
+    REQUIRE(requests.size() == 2);
+    REQUIRE(requests[0].find("Content-Encoding: gzip\r\n") != std::string::npos);
+    REQUIRE(requests[1].find("Content-Encoding") == std::string::npos);
+    REQUIRE(requests[1].find("Datadog-Meta-Lang: cpp\r\n") != std::string::npos);
+  }
+
+  SECTION("reuses the connection") {
+    StandInAgent agent{ok};
+    setUp(handle, agent.path(), body);
+    for (int i = 1; i <= 3; ++i) {
+      handle.setHeaders({{"X-Datadog-Trace-Count", std::to_string(i)}});
+      REQUIRE(handle.perform() == CURLE_OK);
+      REQUIRE(handle.getResponse() == "{}");
+    }
+    const auto requests = agent.requests();
+    REQUIRE(requests.size() == 3);
+    REQUIRE(requests[2].find("X-Datadog-Trace-Count: 3\r\n") != std::string::npos);
+    REQUIRE(agent.connections() == 1);
+  }
+
+  SECTION("reconnects when the agent closes the connection") {
+    StandInAgent agent{ok, true};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.perform() == CURLE_OK);
+    // Give the agent time to close the connection.
+    std::this_thread::sleep_for(std::chrono::milliseconds(50));
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(handle.getResponse() == "{}");
+    REQUIRE(agent.requests().size() == 2);
+    REQUIRE(agent.connections() == 2);
+  }
+
+  SECTION("reconnects when the agent asks to close the connection") {
+    StandInAgent agent{[](const std::string&) {
+      return "HTTP/1.1 200 OK\r\nConnection: close\r\nContent-Length: 2\r\n\r\n{}";
+    }};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(agent.connections() == 2);
+  }
+
+  SECTION("reads a chunked response") {
+    StandInAgent agent{[](const std::string&) {
+      return "HTTP/1.1 200 OK\r\nTransfer-Encoding: chunked\r\n\r\n"
+             "4\r\n{\"ra\r\n9;ext=1\r\nte\": 1.0}\r\n0\r\n\r\n";
+    }};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(handle.getResponse() == "{\"rate\": 1.0}");
+    // The connection is still usable.
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(agent.connections() == 1);
+  }
+
+  SECTION("reads a response that ends when the connection closes") {
+    StandInAgent agent{[](const std::string&) { return "HTTP/1.0 200 OK\r\n\r\n{}"; }, true};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(handle.getResponse() == "{}");
+  }
+
+  SECTION("reports the status of an error response") {
+    StandInAgent agent{[](const std::string&) {
+      return "HTTP/1.1 404 Not Found\r\nContent-Length: 9\r\n\r\nnot found";
+    }};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.perform() == CURLE_OK);
+    REQUIRE(handle.getResponseStatus() == 404);
+    REQUIRE(handle.getResponse() == "not found");
+  }
+
+  SECTION("fails on a malformed response") {
+    StandInAgent agent{[](const std::string&) { return "SMTP ready\r\n\r\n"; }};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.perform() == CURLE_WEIRD_SERVER_REPLY);
+    REQUIRE(!handle.getError().empty());
+  }
+
+  SECTION("fails when the agent closes the connection without responding") {
+    StandInAgent agent{[](const std::string&) { return ""; }};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.perform() == CURLE_GOT_NOTHING);
+  }
+
+  SECTION("fails when there is no agent") {
+    setUp(handle, "/tmp/dd-agent-test-nonexistent.socket", body);
+    REQUIRE(handle.perform() == CURLE_COULDNT_CONNECT);
+    REQUIRE(handle.getError().find("/tmp/dd-agent-test-nonexistent.socket") !=
+            std::string::npos);
+  }
+
+  SECTION("times out when the agent does not respond") {
+    StandInAgent agent{ok, false, false};
+    setUp(handle, agent.path(), body);
+    REQUIRE(handle.setopt(CURLOPT_TIMEOUT_MS, 100L) == CURLE_OK);
+    REQUIRE(handle.perform() == CURLE_OPERATION_TIMEDOUT);
+  }
+
+  SECTION("rejects unsupported options") {
+    REQUIRE(handle.setopt(CURLOPT_PROXY, "http://proxy") == CURLE_UNKNOWN_OPTION);
+    REQUIRE(handle.setopt(CURLOPT_TCP_NODELAY, 1L) == CURLE_OK);
+  }
+}
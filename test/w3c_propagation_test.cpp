@@ -0,0 +1,113 @@
+// This test covers the W3C trace context functions declared in
+// `w3c_propagation.h`.
+
+#include "../src/w3c_propagation.h"
+
+#include <catch2/catch.hpp>
+#include <stdexcept>
+#include <string>
+
+using namespace datadog::opentracing;
+
+TEST_CASE("traceparent codec") {
+  SECTION("decodes a valid header") {
+    const TraceParent result =
+        parseTraceParent(" 00-4bf92f3577b34da6a3ce929d0e0e4736-00f067aa0ba902b7-01 ");
+    REQUIRE(result.trace_id_high == 0x4bf92f3577b34da6ULL);
+    REQUIRE(result.trace_id == 0xa3ce929d0e0e4736ULL);
+    REQUIRE(result.parent_id == 0x00f067aa0ba902b7ULL);
+    REQUIRE(result.sampled);
+  }
+
+  SECTION("reads only the sampled flag") {
+    REQUIRE(!parseTraceParent("00-000000000000000000000000000004d2-000000000000162e-00").sampled);
+    REQUIRE(parseTraceParent("00-000000000000000000000000000004d2-000000000000162e-03").sampled);
+  }
+
+  SECTION("ignores extra fields of later versions") {
+    const TraceParent result =
+        parseTraceParent("01-000000000000000000000000000004d2-000000000000162e-01-what");
+    REQUIRE(result.trace_id == 1234);
+    REQUIRE(result.parent_id == 5678);
+  }
+
+  SECTION("encodes the expected layout") {
+    TraceParent trace_parent;
+    trace_parent.trace_id = 1234;
+    trace_parent.parent_id = 5678;
+    trace_parent.sampled = true;
+    TraceParentText buffer;
+    REQUIRE(std::string(formatTraceParent(trace_parent, buffer)) ==
+            "00-000000000000000000000000000004d2-000000000000162e-01");
+    trace_parent.trace_id_high = 0x4bf92f3577b34da6ULL;
+    trace_parent.sampled = false;
+    REQUIRE(std::string(formatTraceParent(trace_parent, buffer)) ==
+            "00-4bf92f3577b34da600000000000004d2-000000000000162e-00");
+  }
+
+  SECTION("rejects invalid headers") {
+    auto header = GENERATE(as<std::string>{}, "",
+                           "00-000000000000000000000000000004d2-000000000000162e",
+                           "00-000000000000000000000000000004d2-000000000000162e-01-extra",
+                           "ff-000000000000000000000000000004d2-000000000000162e-01",
+                           "00-000000000000000000000000000004D2-000000000000162e-01",
+                           "00-0000000000000000000000000000x4d2-000000000000162e-01",
+                           "00_000000000000000000000000000004d2-000000000000162e-01",
+                           "00-00000000000000000000000000000000-000000000000162e-01",
+                           "00-000000000000000000000000000004d2-0000000000000000-01");
+    CAPTURE(header);
+    REQUIRE_THROWS_AS(parseTraceParent(header), std::invalid_argument);
+  }
+}
+
+TEST_CASE("tracestate codec") {
+  SECTION("decodes the dd member and keeps the others") {
+    const TraceState state =
+        parseTraceState("foo=bar , dd=s:2;o:rum;t.dm:-4;t.usr.id:a~b;x:y,baz=qux,,malformed");
+    REQUIRE(state.sampling_priority != nullptr);
+    REQUIRE(*state.sampling_priority == SamplingPriority::UserKeep);
+    REQUIRE(state.origin == "rum");
+    REQUIRE(state.trace_tags ==
+            std::unordered_map<std::string, std::string>{{"_dd.p.dm", "-4"},
+                                                         {"_dd.p.usr.id", "a=b"}});
+    REQUIRE(state.other_members == "foo=bar,baz=qux");
+  }
+
+  SECTION("ignores an invalid sampling priority") {
+    REQUIRE(parseTraceState("dd=s:x").sampling_priority == nullptr);
+    REQUIRE(parseTraceState("dd=s:9").sampling_priority == nullptr);
+  }
+
+  SECTION("encodes the dd member first") {
+    const SamplingPriority priority = SamplingPriority::SamplerKeep;
+    REQUIRE(formatTraceState(&priority, "synthetics", "_dd.p.dm=-1,other=ignored,_dd.p.a=b=c",
+                             "foo=bar") == "dd=s:1;o:synthetics;t.dm:-1;t.a:b~c,foo=bar");
+  }
+
+  SECTION("replaces characters not allowed in a member") {
+    REQUIRE(formatTraceState(nullptr, "a;b~c,d", "_dd.p.k:e y=v;w", "") ==
+            "dd=o:a_b_c_d;t.k_e_y:v_w");
+  }
+
+  SECTION("omits tags that don't fit") {
+    const std::string long_value(300, 'x');
+    REQUIRE(formatTraceState(nullptr, "", "_dd.p.long=" + long_value + ",_dd.p.dm=-4", "") ==
+            "dd=t.dm:-4");
+  }
+
+  SECTION("is empty if there is nothing to encode") {
+    REQUIRE(formatTraceState(nullptr, "", "", "").empty());
+    REQUIRE(formatTraceState(nullptr, "", "", "foo=bar") == "foo=bar");
+  }
+
+  SECTION("round trips") {
+    const SamplingPriority priority = SamplingPriority::UserDrop;
+    const TraceState state = parseTraceState(
+        formatTraceState(&priority, "o=rigin", "_dd.p.dm=-4,_dd.p.tid=4bf92f3577b34da6", "a=1"));
+    REQUIRE(*state.sampling_priority == priority);
+    REQUIRE(state.origin == "o=rigin");
+    REQUIRE(state.trace_tags == std::unordered_map<std::string, std::string>{
+                                    {"_dd.p.dm", "-4"}, {"_dd.p.tid", "4bf92f3577b34da6"}});
+    REQUIRE(state.other_members == "a=1");
+  }
+}